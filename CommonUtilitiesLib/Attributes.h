@@ -1,22 +1,99 @@
 #pragma once
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <map>
+#include <string>
+#include <type_traits>
 #include <boost/utility/string_view.hpp>
 #include <boost/optional.hpp>
 #include <boost/any.hpp>
+#include "MyAssert.h"
+
+// An attribute known at compile time. Declare each one once, next to the code
+// that owns it, e.g.
+//
+//     constexpr AttributeID<uint64_t> kLastPacketID{ 2 };
+//
+// fSlot picks a slot of Attributes' flat array, and T is checked at compile
+// time wherever the ID is used. Values are small trivially copyable things:
+// integers, bools and pointers.
+template <typename T>
+struct AttributeID
+{
+	static_assert(std::is_trivially_copyable<T>::value && sizeof(T) <= sizeof(uint64_t),
+		"attribute slots only hold small trivially copyable values");
+
+	using value_type = T;
+
+	uint32_t fSlot;
+};
+
 class Attributes {
-	std::map<std::string, boost::any> attributes;
 public:
+	enum { kNumSlots = 8 };
+
+	//
+	// Compile-time IDs: a flat array lookup, no allocation
+	template <typename T>
+	void addAttribute(AttributeID<T> id, typename AttributeID<T>::value_type value) {
+		Slot& theSlot = slot(id);
+		Assert((theSlot.fType == nullptr) || (theSlot.fType == typeTag<T>()));
+		::memcpy(&theSlot.fBits, &value, sizeof(T));
+		theSlot.fType = typeTag<T>();
+	}
+	template <typename T>
+	boost::optional<T> getAttribute(AttributeID<T> id) const {
+		Assert(id.fSlot < kNumSlots);
+		const Slot& theSlot = slots[id.fSlot];
+		if (theSlot.fType == nullptr) return {};
+		// Two IDs sharing a slot with different types is a registration bug
+		Assert(theSlot.fType == typeTag<T>());
+		T value;
+		::memcpy(&value, &theSlot.fBits, sizeof(T));
+		return value;
+	}
+	template <typename T>
+	void removeAttribute(AttributeID<T> id) {
+		slot(id).fType = nullptr;
+	}
+
+	//
+	// Names only known at runtime fall back to a map
 	void addAttribute(boost::string_view key, boost::any value) {
-		attributes[std::string(key)] = value;
+		auto it = attributes.find(key);
+		if (it == end(attributes))
+			attributes.emplace(std::string(key), std::move(value));
+		else
+			it->second = std::move(value);
 	}
 	boost::optional<boost::any> getAttribute(boost::string_view key) {
-		auto it = attributes.find(std::string(key));
+		auto it = attributes.find(key);
 		if (it == end(attributes)) return {};
 		return it->second;
 	}
 	void removeAttribute(boost::string_view key) {
-		auto it = attributes.find(std::string(key));
+		auto it = attributes.find(key);
 		if (it == end(attributes)) return;
 		attributes.erase(it);
 	}
-};
\ No newline at end of file
+private:
+	struct Slot {
+		uint64_t fBits{ 0 };
+		const void* fType{ nullptr };   // nullptr while unset
+	};
+
+	template <typename T>
+	static const void* typeTag() {
+		static const char sTag = 0;
+		return &sTag;
+	}
+	template <typename T>
+	Slot& slot(AttributeID<T> id) {
+		Assert(id.fSlot < kNumSlots);
+		return slots[id.fSlot];
+	}
+
+	Slot slots[kNumSlots];
+	std::map<std::string, boost::any, std::less<>> attributes;
+};
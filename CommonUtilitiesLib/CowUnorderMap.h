@@ -0,0 +1,194 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "SyncUnorderMap.h"
+
+// Same interface as SyncUnorderMap, for maps that are looked up on every
+// packet but only change when a stream is set up or torn down.
+//
+// The table is never modified once it is published: a write copies it, makes
+// its change on the copy and swaps the pointer. Lookups don't lock or retry,
+// they count themselves in one of two reader counters around reading the
+// table, and a write waits for the readers that could still see the old table
+// before freeing it. The counters are spread over a few cache lines, so that
+// the threads looking up don't all bounce the same one. Writes take a mutex
+// and may wait, so they don't belong on the packet path.
+template <typename T>
+class CowUnorderMap
+{
+public:
+
+	CowUnorderMap() = default;
+	~CowUnorderMap() { delete fTable.load(); }
+
+	CowUnorderMap(const CowUnorderMap&) = delete;
+	CowUnorderMap& operator=(const CowUnorderMap&) = delete;
+
+	bool RegisterTask(const indexKey &key, const T& item)
+	{
+		std::lock_guard<std::mutex> locker(fWriteMutex);
+		Table* theTable = fTable.load();
+		if ((theTable != nullptr) && (theTable->Find(key) != nullptr))
+			return false;
+
+		size_t theCount = (theTable == nullptr) ? 0 : theTable->fCount;
+		Table* theNewTable = new Table(theCount + 1);
+		if (theTable != nullptr)
+			theNewTable->CopyFrom(*theTable, nullptr);
+		theNewTable->Insert(key, item);
+		this->Publish(theNewTable);
+		return true;
+	}
+
+	void UnregisterTask(const indexKey &key)
+	{
+		std::lock_guard<std::mutex> locker(fWriteMutex);
+		Table* theTable = fTable.load();
+		if ((theTable == nullptr) || (theTable->Find(key) == nullptr))
+			return;
+
+		Table* theNewTable = nullptr;
+		if (theTable->fCount > 1)
+		{
+			theNewTable = new Table(theTable->fCount - 1);
+			theNewTable->CopyFrom(*theTable, &key);
+		}
+		this->Publish(theNewTable);
+	}
+
+	T GetTask(const indexKey &key)
+	{
+		ReadSection theSection(*this);
+		Table* theTable = fTable.load();
+		if (theTable != nullptr)
+		{
+			const Slot* theSlot = theTable->Find(key);
+			if (theSlot != nullptr)
+				return theSlot->fItem;
+		}
+		return {};
+	}
+
+	bool AddrInMap(const indexKey &key)
+	{
+		ReadSection theSection(*this);
+		Table* theTable = fTable.load();
+		return (theTable != nullptr) && (theTable->Find(key) != nullptr);
+	}
+
+	bool empty() {
+		return fTable.load() == nullptr;
+	}
+
+private:
+
+	struct Slot
+	{
+		indexKey    fKey;
+		T           fItem;
+		bool        fUsed{ false };
+	};
+
+	// Open addressing with linear probing, kept at most half full
+	struct Table
+	{
+		explicit Table(size_t inCount)
+		{
+			while (fMask + 1 < inCount * 2)
+				fMask = (fMask << 1) | 1;
+			fSlots.reset(new Slot[fMask + 1]);
+		}
+
+		const Slot* Find(const indexKey &key) const
+		{
+			for (size_t theIndex = std::hash<indexKey>()(key) & fMask; fSlots[theIndex].fUsed; theIndex = (theIndex + 1) & fMask)
+			{
+				if (fSlots[theIndex].fKey == key)
+					return &fSlots[theIndex];
+			}
+			return nullptr;
+		}
+
+		void Insert(const indexKey &key, const T& item)
+		{
+			size_t theIndex = std::hash<indexKey>()(key) & fMask;
+			while (fSlots[theIndex].fUsed)
+				theIndex = (theIndex + 1) & fMask;
+			fSlots[theIndex].fKey = key;
+			fSlots[theIndex].fItem = item;
+			fSlots[theIndex].fUsed = true;
+			fCount++;
+		}
+
+		void CopyFrom(const Table &inTable, const indexKey *inSkipKey)
+		{
+			for (size_t x = 0; x <= inTable.fMask; x++)
+			{
+				const Slot &theSlot = inTable.fSlots[x];
+				if (theSlot.fUsed && ((inSkipKey == nullptr) || !(theSlot.fKey == *inSkipKey)))
+					this->Insert(theSlot.fKey, theSlot.fItem);
+			}
+		}
+
+		std::unique_ptr<Slot[]> fSlots;
+		size_t                  fMask{ 7 };
+		size_t                  fCount{ 0 };
+	};
+
+	enum
+	{
+		kNumReaderSlots = 8 // power of 2
+	};
+
+	struct alignas(64) ReaderSlot
+	{
+		std::atomic<uint32_t>   fReaders[2]{ {0}, {0} };
+	};
+
+	class ReadSection
+	{
+	public:
+		explicit ReadSection(CowUnorderMap &inMap)
+			: fReaders(inMap.fReaderSlots[GetReaderSlot()].fReaders[inMap.fPhase.load()])
+		{
+			fReaders.fetch_add(1);
+		}
+		~ReadSection() { fReaders.fetch_sub(1); }
+	private:
+		static size_t GetReaderSlot()
+		{
+			static thread_local size_t sSlot = std::hash<std::thread::id>()(std::this_thread::get_id()) & (kNumReaderSlots - 1);
+			return sSlot;
+		}
+
+		std::atomic<uint32_t>&  fReaders;
+	};
+
+	// fWriteMutex must be held
+	void Publish(Table* inNewTable)
+	{
+		std::unique_ptr<Table> theOldTable(fTable.exchange(inNewTable));
+
+		// Flip twice: a reader that read the phase before an earlier write
+		// flipped it may only be counting itself now, under the phase this
+		// write flips away from first. The second flip waits for it.
+		for (int x = 0; x < 2; x++)
+		{
+			uint32_t thePhase = fPhase.load();
+			fPhase.store(thePhase ^ 1);
+			for (const ReaderSlot& theSlot : fReaderSlots)
+			{
+				while (theSlot.fReaders[thePhase].load() != 0)
+					std::this_thread::yield();
+			}
+		}
+	}
+
+	std::atomic<Table*>     fTable{ nullptr };
+	std::atomic<uint32_t>   fPhase{ 0 };
+	ReaderSlot              fReaderSlots[kNumReaderSlots];
+	std::mutex              fWriteMutex;
+};
@@ -90,19 +90,25 @@ void EventContext::Cleanup()
 
 	if (fFileDesc != kInvalidFileDesc)
 	{
+#if defined(__linux__) && !defined(EASY_DEVICE)
+		//the epoll backend hands us back directly, so there is nothing in the
+		//ref table. Take the fd out of epoll and make sure the event thread isn't
+		//still holding on to an event for us before the fd number can be reused.
+		if (fWatchEventCalled)
+		{
+			epollRemoveEvent(fFileDesc);
+			fEventThread->WaitForStaleEvents(this);
+			fWatchEventCalled = false;
+		}
+		err = close(fFileDesc);
+#else
 		//if this object is registered in the table, unregister it now
 		if (fUniqueID > 0)
 		{
 			fEventThread->fRefTable.UnRegister(&fRef);
 
 #if !MACOSXEVENTQUEUE
-			//           select_removeevent(fFileDesc);//The eventqueue / select shim requires this
-
-#if defined(__linux__) && !defined(EASY_DEVICE)
-			deleteEpollEvent(fFileDesc);
-#else
 			select_removeevent(fFileDesc);//The eventqueue / select shim requires this
-#endif           
 #ifdef __Win32__
 			err = ::closesocket(fFileDesc);
 #else
@@ -125,6 +131,7 @@ void EventContext::Cleanup()
 			err = ::closesocket(fFileDesc);
 #else
 			err = close(fFileDesc);
+#endif
 #endif
 	}
 
@@ -149,6 +156,17 @@ void EventContext::SnarfEventContext(EventContext &fromContext)
 	//  way up the chain we need to disable event posting
 	// or copy the posted events afer this op completes
 
+#if defined(__linux__) && !defined(EASY_DEVICE)
+	//point the epoll registration at us, then wait out anything
+	//already harvested for the old context
+	fWatchEventCalled = fromContext.fWatchEventCalled;
+	fEventReq = fromContext.fEventReq;
+	fromContext.fFileDesc = kInvalidFileDesc;
+	fromContext.fWatchEventCalled = false;
+	if (fWatchEventCalled && epollArmEvent(fFileDesc, fEventReq.er_eventbits, this, true) != 0)
+		AssertV(false, OSThread::GetErrno());
+	fEventThread->WaitForStaleEvents(&fromContext);
+#else
 	fromContext.fFileDesc = kInvalidFileDesc;
 
 	fWatchEventCalled = fromContext.fWatchEventCalled;
@@ -160,6 +178,7 @@ void EventContext::SnarfEventContext(EventContext &fromContext)
 	fRef.Set(fUniqueIDStr, this);
 	fEventThread->fRefTable.Swap(&fRef);
 	fEventThread->fRefTable.UnRegister(&fromContext.fRef);
+#endif
 }
 
 void EventContext::RequestEvent(int theMask)
@@ -168,6 +187,16 @@ void EventContext::RequestEvent(int theMask)
 	fModwatched = true;
 #endif
 
+#if defined(__linux__) && !defined(EASY_DEVICE)
+	//
+	// epoll events are one-shot: the first call adds the fd, each
+	// subsequent call re-arms it. The event comes back carrying this.
+	fEventReq.er_handle = fFileDesc;
+	fEventReq.er_eventbits = theMask;
+	if (epollArmEvent(fFileDesc, theMask, this, fWatchEventCalled) != 0)
+		AssertV(false, OSThread::GetErrno());
+	fWatchEventCalled = true;
+#else
 	//
 	// The first time this function gets called, we're supposed to
 	// call watchevent. Each subsequent time, call modwatch. That's
@@ -178,13 +207,9 @@ void EventContext::RequestEvent(int theMask)
 		fEventReq.er_eventbits = theMask;
 #if MACOSXEVENTQUEUE
 		if (modwatch(&fEventReq, theMask) != 0)
-#else
-#if defined(__linux__) && !defined(EASY_DEVICE)
-		if (addEpollEvent(&fEventReq, theMask) != 0)
 #else
 		if (select_modwatch(&fEventReq, theMask) != 0)
 #endif
-#endif  
 			AssertV(false, OSThread::GetErrno());
 	}
 	else
@@ -251,19 +276,80 @@ void EventContext::RequestEvent(int theMask)
 		fWatchEventCalled = true;
 #if MACOSXEVENTQUEUE
 		if (watchevent(&fEventReq, theMask) != 0)
-#else
-#if defined(__linux__) && !defined(EASY_DEVICE)
-		if (addEpollEvent(&fEventReq, theMask) != 0)
 #else
 		if (select_modwatch(&fEventReq, theMask) != 0)
 #endif
-#endif  
 			//this should never fail, but if it does, cleanup.
 			AssertV(false, OSThread::GetErrno());
 
 	}
+#endif
+}
+
+#if defined(__linux__) && !defined(EASY_DEVICE)
+void EventThread::WaitForStaleEvents(EventContext* inContext)
+{
+	if (OSThread::GetCurrent() == this)
+	{
+		//called from a ProcessEvent: just make sure the rest of
+		//this batch doesn't dispatch to inContext
+		for (int x = fCurrentEventIndex + 1; x < fNumCurrentEvents; x++)
+		{
+			if (fCurrentEvents[x].data.ptr == inContext)
+				fCurrentEvents[x].data.ptr = nullptr;
+		}
+		return;
+	}
+
+	if (!fRunning.load(std::memory_order_acquire))
+		return;
+
+	std::unique_lock<std::mutex> locker(fStaleMutex);
+	uint64_t theGeneration = ++fStaleRequests;
+	epollWakeup();
+	fStaleCond.wait(locker, [&] { return fStaleDrained >= theGeneration; });
 }
 
+void EventThread::Entry()
+{
+	fRunning.store(true, std::memory_order_release);
+
+	while (true)
+	{
+		int theNumEvents = epollWaitEvents(fCurrentEvents, kMaxEventsPerWait, kWaitTimeoutInMsec);
+		if (theNumEvents < 0)
+		{
+			int theErrno = OSThread::GetErrno();
+			AssertV(theErrno == EINTR, theErrno);
+			theNumEvents = 0;
+		}
+
+		fNumCurrentEvents = theNumEvents;
+		for (fCurrentEventIndex = 0; fCurrentEventIndex < fNumCurrentEvents; fCurrentEventIndex++)
+		{
+			struct epoll_event& theEvent = fCurrentEvents[fCurrentEventIndex];
+			auto* theContext = (EventContext*)theEvent.data.ptr;
+			if (theContext == nullptr)
+				continue;   // wakeup, or scrubbed by WaitForStaleEvents
+
+#if DEBUG
+			theContext->fModwatched = false;
+#endif
+			theContext->ProcessEvent((theEvent.events & EPOLLOUT) ? EV_WR : EV_RE);
+		}
+		fNumCurrentEvents = 0;
+
+		//anyone who removed an fd before this batch was harvested is safe now
+		{
+			std::lock_guard<std::mutex> locker(fStaleMutex);
+			fStaleDrained = fStaleRequests;
+		}
+		fStaleCond.notify_all();
+
+		this->ThreadYield();
+	}
+}
+#else
 void EventThread::Entry()
 {
 	struct eventreq theCurrentEvent;
@@ -277,13 +363,8 @@ void EventThread::Entry()
 #if MACOSXEVENTQUEUE
 			int theReturnValue = waitevent(&theCurrentEvent, NULL);
 #else
-
-#if defined(__linux__) && !defined(EASY_DEVICE)
-			int theReturnValue = epoll_waitevent(&theCurrentEvent, nullptr);
-#else
 			int theReturnValue = select_waitevent(&theCurrentEvent, NULL);
 #endif
-#endif  
 			//Sort of a hack. In the POSIX version of the server, waitevent can return
 			//an actual POSIX errorcode.
 			if (theReturnValue >= 0)
@@ -317,11 +398,7 @@ void EventThread::Entry()
 		int64_t  yieldStart = OS::Milliseconds();
 #endif
 
-#if 0//defined(__linux__) && !defined(EASY_DEVICE)
-
-#else
 		this->ThreadYield();
-#endif
 
 #if EVENT_CONTEXT_DEBUG
 		int64_t  yieldDur = OS::Milliseconds() - yieldStart;
@@ -337,3 +414,4 @@ void EventThread::Entry()
 #endif
 	}
 }
+#endif
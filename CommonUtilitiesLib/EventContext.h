@@ -42,6 +42,10 @@
 #include "OSRef.h"
 #include "common.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
 #if MACOSXEVENTQUEUE
 #ifdef AVAILABLE_MAC_OS_X_VERSION_10_5_AND_LATER
 #include <sys/ev.h>
@@ -172,6 +176,31 @@ private:
 	void Entry() override;
 	OSRefTable      fRefTable;
 
+#if defined(__linux__) && !defined(EASY_DEVICE)
+	enum
+	{
+		kMaxEventsPerWait = 256,    //int
+		kWaitTimeoutInMsec = 15000  //int
+	};
+
+	//
+	// The epoll backend hands back the EventContext itself (data.ptr), so once a
+	// context has removed its fd it must not go away while an already harvested
+	// batch may still point at it. This blocks until the event thread is done
+	// with the current batch (or, on the event thread, scrubs the rest of it).
+	void            WaitForStaleEvents(EventContext* inContext);
+
+	struct epoll_event  fCurrentEvents[kMaxEventsPerWait];
+	int                 fNumCurrentEvents{ 0 };
+	int                 fCurrentEventIndex{ 0 };
+
+	std::atomic<bool>   fRunning{ false };
+	std::mutex          fStaleMutex;
+	std::condition_variable fStaleCond;
+	uint64_t            fStaleRequests{ 0 };
+	uint64_t            fStaleDrained{ 0 };
+#endif
+
 	friend class EventContext;
 };
 
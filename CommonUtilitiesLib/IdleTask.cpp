@@ -35,6 +35,7 @@
 
  */
 
+#include <algorithm>
 #include "IdleTask.h"
 #include "OS.h"
 
@@ -43,56 +44,55 @@ IdleTaskThread*     IdleTask::sIdleThread = nullptr;
 
 void IdleTaskThread::SetIdleTimer(IdleTask* activeObj, int64_t msec)
 {
-	//note: OSHeap doesn't support a random remove, so this function
-	//won't change the timeout value if there is already one set
-	if (activeObj->fIdleElem.IsMemberOfAnyHeap())
+	//this function won't change the timeout value if there is already one set
+	if (activeObj->fIdleElem.IsMemberOfAnyWheel())
 		return;
 	activeObj->fIdleElem.SetValue(OS::Milliseconds() + msec);
 
 	{
-		OSMutexLocker locker(&fHeapMutex);
-		fIdleHeap.Insert(&activeObj->fIdleElem);
+		OSMutexLocker locker(&fTimerMutex);
+		fIdleTimers.Insert(&activeObj->fIdleElem);
 	}
-	fHeapCond.Signal();
+	fTimerCond.Signal();
 }
 
 void IdleTaskThread::CancelTimeout(IdleTask* idleObj)
 {
 	Assert(idleObj != nullptr);
-	OSMutexLocker locker(&fHeapMutex);
-	fIdleHeap.Remove(&idleObj->fIdleElem);
+	OSMutexLocker locker(&fTimerMutex);
+	fIdleTimers.Remove(&idleObj->fIdleElem);
 }
 
 void
 IdleTaskThread::Entry()
 {
-	OSMutexLocker locker(&fHeapMutex);
+	OSMutexLocker locker(&fTimerMutex);
 
 	while (true)
 	{
 		//if there are no events to process, block.
-		if (fIdleHeap.CurrentHeapSize() == 0)
-			fHeapCond.Wait(&fHeapMutex);
+		if (fIdleTimers.GetSize() == 0)
+			fTimerCond.Wait(&fTimerMutex);
 		int64_t msec = OS::Milliseconds();
 
-		//pop elements out of the heap as long as their timeout time has arrived
-		while ((fIdleHeap.CurrentHeapSize() > 0) && (fIdleHeap.PeekMin()->GetValue() <= msec))
+		//turn the wheel, popping elements as long as their timeout time has arrived
+		for (OSTimerWheelElem* theElem = fIdleTimers.ExtractExpired(msec); theElem != nullptr; theElem = fIdleTimers.ExtractExpired(msec))
 		{
-			auto* elem = (IdleTask*)fIdleHeap.ExtractMin()->GetEnclosingObject();
+			auto* elem = (IdleTask*)theElem->GetEnclosingObject();
 			Assert(elem != nullptr);
 			elem->Signal(Task::kIdleEvent);
 		}
 
-		//we are done sending idle events. If there is a lowest tick count, then
-		//we need to sleep until that time.
-		if (fIdleHeap.CurrentHeapSize() > 0)
+		//we are done sending idle events. If the wheel has another slot coming
+		//up, sleep until exactly that time.
+		int64_t timeoutTime = fIdleTimers.GetNextExpiration();
+		if (timeoutTime >= 0)
 		{
-			int64_t timeoutTime = fIdleHeap.PeekMin()->GetValue();
 			//because sleep takes a 32 bit number
 			timeoutTime -= msec;
 			Assert(timeoutTime > 0);
-			auto smallTime = (uint32_t)timeoutTime;
-			fHeapCond.Wait(&fHeapMutex, smallTime);
+			auto smallTime = (uint32_t)std::max<int64_t>(timeoutTime, 1);
+			fTimerCond.Wait(&fTimerMutex, smallTime);
 		}
 	}
 }
@@ -111,11 +111,11 @@ IdleTask::~IdleTask()
 	//clean up stuff used by idle thread routines
 	Assert(sIdleThread != nullptr);
 
-	OSMutexLocker locker(&sIdleThread->fHeapMutex);
+	OSMutexLocker locker(&sIdleThread->fTimerMutex);
 
 	//Check to see if there is a pending timeout. If so, get this object
-	//out of the heap
-	if (fIdleElem.IsMemberOfAnyHeap())
+	//out of the timer wheel
+	if (fIdleElem.IsMemberOfAnyWheel())
 		sIdleThread->CancelTimeout(this);
 }
 
@@ -42,7 +42,7 @@
 #include "Task.h"
 
 #include "OSThread.h"
-#include "OSHeap.h"
+#include "OSTimerWheel.h"
 #include "OSMutex.h"
 #include "OSCond.h"
 
@@ -53,16 +53,16 @@ class IdleTaskThread : private OSThread
 {
 private:
 
-	IdleTaskThread() : OSThread(), fHeapMutex() {}
-	~IdleTaskThread() override { Assert(fIdleHeap.CurrentHeapSize() == 0); }
+	IdleTaskThread() : OSThread(), fTimerMutex() {}
+	~IdleTaskThread() override { Assert(fIdleTimers.GetSize() == 0); }
 
 	void SetIdleTimer(IdleTask* idleObj, int64_t msec);
 	void CancelTimeout(IdleTask* idleObj);
 
 	void Entry() override;
-	OSHeap  fIdleHeap;
-	OSMutex fHeapMutex;
-	OSCond  fHeapCond;
+	OSTimerWheel    fIdleTimers;
+	OSMutex         fTimerMutex;
+	OSCond          fTimerCond;
 	friend class IdleTask;
 };
 
@@ -93,12 +93,11 @@ public:
 	//CancelTimeout
 	//If there is a pending timeout for this object, this function cancels it.
 	//If there is no pending timeout, this function does nothing.
-	//Currently not supported because OSHeap doesn't support random remove
 	void CancelTimeout() { sIdleThread->CancelTimeout(this); }
 
 private:
 
-	OSHeapElem fIdleElem;
+	OSTimerWheelElem fIdleElem;
 
 	//there is only one idle thread shared by all idle tasks.
 	static IdleTaskThread*  sIdleThread;
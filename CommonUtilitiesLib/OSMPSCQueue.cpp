@@ -0,0 +1,133 @@
+/*
+	File:       OSMPSCQueue.cpp
+
+	Contains:   Implementation of OSMPSCQueue, after Dmitry Vyukov's intrusive
+				MPSC node based queue.
+*/
+
+#include "OSMPSCQueue.h"
+
+#if defined(__linux__)
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static void FutexWait(std::atomic<uint32_t>* inWord, uint32_t inValue, int32_t inTimeoutInMilSecs)
+{
+	struct timespec theTimeout;
+	theTimeout.tv_sec = inTimeoutInMilSecs / 1000;
+	theTimeout.tv_nsec = (inTimeoutInMilSecs % 1000) * 1000000L;
+	(void)::syscall(SYS_futex, reinterpret_cast<uint32_t*>(inWord), FUTEX_WAIT_PRIVATE, inValue, &theTimeout, nullptr, 0);
+}
+
+static void FutexWake(std::atomic<uint32_t>* inWord)
+{
+	(void)::syscall(SYS_futex, reinterpret_cast<uint32_t*>(inWord), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+#else
+#include <chrono>
+#endif
+
+void OSMPSCQueue::Push(OSMPSCQueueElem* inElem)
+{
+	inElem->fNext.store(nullptr, std::memory_order_relaxed);
+	OSMPSCQueueElem* thePrev = fHead.exchange(inElem, std::memory_order_acq_rel);
+	// Until this store, the consumer can't get past thePrev
+	thePrev->fNext.store(inElem, std::memory_order_release);
+}
+
+void OSMPSCQueue::EnQueue(OSMPSCQueueElem* inElem)
+{
+	this->Push(inElem);
+
+	// Pairs with the fence in DeQueueBlocking: either the consumer sees our
+	// element, or we see that it is going to sleep
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (fParked.load(std::memory_order_relaxed) != 0)
+		this->Wake();
+}
+
+OSMPSCQueueElem* OSMPSCQueue::DeQueue()
+{
+	OSMPSCQueueElem* theTail = fTail;
+	OSMPSCQueueElem* theNext = theTail->fNext.load(std::memory_order_acquire);
+
+	if (theTail == &fStub)
+	{
+		if (theNext == nullptr)
+			return nullptr;
+		fTail = theNext;
+		theTail = theNext;
+		theNext = theNext->fNext.load(std::memory_order_acquire);
+	}
+
+	if (theNext != nullptr)
+	{
+		fTail = theNext;
+		return theTail;
+	}
+
+	// theTail is the last element, unless a producer already swapped in a
+	// newer one and hasn't linked it yet
+	if (theTail != fHead.load(std::memory_order_acquire))
+		return nullptr;
+
+	// Put the stub behind theTail, so that taking theTail leaves something
+	this->Push(&fStub);
+	theNext = theTail->fNext.load(std::memory_order_acquire);
+	if (theNext != nullptr)
+	{
+		fTail = theNext;
+		return theTail;
+	}
+
+	return nullptr;
+}
+
+OSMPSCQueueElem* OSMPSCQueue::DeQueueBlocking(int32_t inTimeoutInMilSecs)
+{
+	OSMPSCQueueElem* theElem = this->DeQueue();
+	if (theElem != nullptr)
+		return theElem;
+
+	fParked.store(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	// Anything EnQueued before the producer could have seen the flag
+	theElem = this->DeQueue();
+	if (theElem == nullptr)
+	{
+		this->Park(inTimeoutInMilSecs);
+		theElem = this->DeQueue();
+	}
+
+	fParked.store(0, std::memory_order_relaxed);
+	return theElem;
+}
+
+void OSMPSCQueue::Wake()
+{
+	// Only one of the producers that saw the flag makes the call
+	if (fParked.exchange(0, std::memory_order_acq_rel) == 0)
+		return;
+
+#if defined(__linux__)
+	FutexWake(&fParked);
+#else
+	std::lock_guard<std::mutex> locker(fParkMutex);
+	fParkCond.notify_one();
+#endif
+}
+
+void OSMPSCQueue::Park(int32_t inTimeoutInMilSecs)
+{
+#if defined(__linux__)
+	// Returns right away if a Wake already cleared the flag
+	FutexWait(&fParked, 1, inTimeoutInMilSecs);
+#else
+	std::unique_lock<std::mutex> locker(fParkMutex);
+	fParkCond.wait_for(locker, std::chrono::milliseconds(inTimeoutInMilSecs),
+		[this]() { return fParked.load(std::memory_order_relaxed) == 0; });
+#endif
+}
@@ -0,0 +1,91 @@
+/*
+	File:       OSMPSCQueue.h
+
+	Contains:   Intrusive, lock free multi producer / single consumer queue.
+
+				Any thread may EnQueue; only the thread that owns the queue may
+				DeQueue. An EnQueue is one atomic exchange and one store, with
+				no lock for producers to pile up on.
+
+				The consumer can park in DeQueueBlocking. It says so in a flag
+				before it sleeps, and a producer only makes the wake up call
+				when it sees that flag. The sleep is a futex on Linux, a
+				condition variable elsewhere.
+
+				The links live in the elements. An element may be in one queue
+				at a time, and must stay alive while it is in there.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#if !defined(__linux__)
+#include <condition_variable>
+#include <mutex>
+#endif
+
+class OSMPSCQueue;
+
+class OSMPSCQueueElem
+{
+public:
+	OSMPSCQueueElem(void* enclosingObject = nullptr) : fEnclosingObject(enclosingObject) {}
+	~OSMPSCQueueElem() = default;
+
+	OSMPSCQueueElem(const OSMPSCQueueElem&) = delete;
+	OSMPSCQueueElem& operator=(const OSMPSCQueueElem&) = delete;
+
+	void*   GetEnclosingObject() { return fEnclosingObject; }
+	void    SetEnclosingObject(void* obj) { fEnclosingObject = obj; }
+
+private:
+	std::atomic<OSMPSCQueueElem*>   fNext{ nullptr };
+	void*                           fEnclosingObject;
+
+	friend class OSMPSCQueue;
+};
+
+class OSMPSCQueue
+{
+public:
+	OSMPSCQueue() = default;
+	~OSMPSCQueue() = default;
+
+	OSMPSCQueue(const OSMPSCQueue&) = delete;
+	OSMPSCQueue& operator=(const OSMPSCQueue&) = delete;
+
+	// ANY THREAD. Wakes the consumer if it is parked.
+	void                EnQueue(OSMPSCQueueElem* inElem);
+
+	// CONSUMER ONLY. Elements come out in the order their EnQueue finished
+	// the exchange. Returns nullptr if the queue is empty, and also while
+	// the newest producer is between its two steps; that one wakes the
+	// consumer once it is done, so a DeQueueBlocking can't miss it.
+	OSMPSCQueueElem*    DeQueue();
+
+	// CONSUMER ONLY. Parks for at most inTimeoutInMilSecs if there is nothing
+	// to take. Returns nullptr on timeout or after a Wake.
+	OSMPSCQueueElem*    DeQueueBlocking(int32_t inTimeoutInMilSecs);
+
+	// ANY THREAD. Gets a parked consumer going, to look at its stop request.
+	void                Wake();
+
+private:
+	void                Push(OSMPSCQueueElem* inElem);
+	void                Park(int32_t inTimeoutInMilSecs);
+
+	// Producers swap themselves in at fHead, the consumer takes from fTail.
+	// fStub keeps the list from ever being empty, so neither end is ever
+	// nullptr and producers never touch fTail.
+	OSMPSCQueueElem                 fStub;
+	alignas(64) std::atomic<OSMPSCQueueElem*> fHead{ &fStub };
+	alignas(64) OSMPSCQueueElem*    fTail{ &fStub };
+
+	// 1 while the consumer is parked or about to be. The futex word on Linux.
+	alignas(64) std::atomic<uint32_t> fParked{ 0 };
+#if !defined(__linux__)
+	std::mutex                      fParkMutex;
+	std::condition_variable         fParkCond;
+#endif
+};
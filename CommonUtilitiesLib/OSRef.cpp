@@ -33,6 +33,8 @@
 #include "OSRef.h"
 
 #include <errno.h>
+#include <algorithm>
+#include <thread>
 
 uint32_t  OSRefTableUtils::HashString(StrPtrLen* inString)
 {
@@ -46,12 +48,105 @@ uint32_t  OSRefTableUtils::HashString(StrPtrLen* inString)
 	//data in this string
 	auto* theData = (uint8_t*)inString->Ptr;
 
-	//divide by 4 and take the characters at quarter points in the string,
-	//use those as the basis for the hash value
-	uint32_t quarterLen = inString->Len >> 2;
-	return (inString->Len * (theData[0] + theData[quarterLen] +
-		theData[quarterLen * 2] + theData[quarterLen * 3] +
-		theData[inString->Len - 1]));
+	//FNV-1a over the whole string. Stream names and session IDs often differ
+	//only in a digit or two, which sampling a few characters doesn't see.
+	uint32_t theHash = 2166136261U;
+	for (uint32_t x = 0; x < inString->Len; x++)
+		theHash = (theHash ^ theData[x]) * 16777619U;
+	return theHash;
+}
+
+OSRefTable::OSRefTable(uint32_t tableSize)
+{
+	// An odd bucket count keeps the bucket index from just repeating the
+	// low bits that picked the shard
+	uint32_t theNumBuckets = std::max<uint32_t>(tableSize / kNumShards, 1) | 1;
+	for (Shard& theShard : fShards)
+	{
+		theShard.fBuckets.reset(new std::atomic<OSRef*>[theNumBuckets]);
+		for (uint32_t x = 0; x < theNumBuckets; x++)
+			theShard.fBuckets[x].store(nullptr);
+		theShard.fNumBuckets = theNumBuckets;
+	}
+}
+
+OSRef* OSRefTable::Find(Shard& inShard, const OSRefKey& inKey)
+{
+	OSRef* theRef = inShard.fBuckets[inKey.fHashValue % inShard.fNumBuckets].load();
+	for (; theRef != nullptr; theRef = theRef->fNextHashEntry.load())
+	{
+		if ((theRef->fHashValue == inKey.fHashValue) && theRef->fString.Equal(*inKey.fStringP))
+			break;
+	}
+	return theRef;
+}
+
+void OSRefTable::Add(Shard& inShard, OSRef* inRef)
+{
+	std::atomic<OSRef*>& theHead = inShard.fBuckets[inRef->fHashValue % inShard.fNumBuckets];
+	inRef->fNextHashEntry.store(theHead.load());
+	theHead.store(inRef); // this is what makes it visible to lock free readers
+	inShard.fNumEntries++;
+}
+
+bool OSRefTable::Remove(Shard& inShard, OSRef* inRef)
+{
+	std::atomic<OSRef*>* theLink = &inShard.fBuckets[inRef->fHashValue % inShard.fNumBuckets];
+	for (OSRef* theRef = theLink->load(); theRef != inRef; theRef = theLink->load())
+	{
+		if (theRef == nullptr)
+			return false;
+		theLink = &theRef->fNextHashEntry;
+	}
+
+	// inRef keeps its next pointer, so a reader standing on it still finds
+	// the rest of the chain
+	theLink->store(inRef->fNextHashEntry.load());
+	inShard.fNumEntries--;
+	return true;
+}
+
+uint32_t OSRefTable::EnterRead(Shard& inShard)
+{
+	// If the phase flipped before we were counted, a writer may already have
+	// stopped watching this counter, so count ourselves again in the new one
+	while (true)
+	{
+		uint32_t thePhase = inShard.fPhase.load();
+		inShard.fReaders[thePhase]++;
+		if (inShard.fPhase.load() == thePhase)
+			return thePhase;
+		inShard.fReaders[thePhase]--;
+	}
+}
+
+void OSRefTable::WaitForReaders(Shard& inShard)
+{
+	// Readers that come in after the flip can't see anything unlinked before
+	// it, so only the ones counted in the old phase need to drain
+	std::lock_guard<std::mutex> locker(inShard.fGraceMutex);
+	uint32_t theOldPhase = inShard.fPhase.load();
+	inShard.fPhase.store(theOldPhase ^ 1);
+	while (inShard.fReaders[theOldPhase].load() != 0)
+		std::this_thread::yield();
+}
+
+void OSRefTable::DropRef(Shard& inShard, OSRef* inRef)
+{
+	uint32_t theRefCount = --inRef->fRefCount;
+	// fRefCount is a uint32_t  and QTSS should never run into
+	// a ref greater than 16 * 64K, so this assert just checks to
+	// be sure that we have not decremented the ref less than zero.
+	Assert(theRefCount < 1048576L);
+
+	//make sure to wakeup anyone who may be waiting for this resource to be released.
+	//UnRegister counts itself in fWaiters before it checks fRefCount, so one of
+	//us always sees the other.
+	if (inRef->fWaiters.load() > 0)
+	{
+		OSMutexLocker locker(&inShard.fMutex);
+		inRef->fCond.Signal();
+	}
 }
 
 OS_Error OSRefTable::Register(OSRef* inRef)
@@ -66,24 +161,25 @@ OS_Error OSRefTable::Register(OSRef* inRef)
 	Assert(inRef->fString.Ptr != nullptr);
 	Assert(inRef->fString.Len != 0);
 
-	OSMutexLocker locker(&fMutex);
 	if (inRef->fString.Ptr == nullptr || inRef->fString.Len == 0)
 	{   //printf("OSRefTable::Register inRef is invalid \n");
 		return EPERM;
 	}
 
+	Shard& theShard = this->GetShard(inRef->fHashValue);
+	OSMutexLocker locker(&theShard.fMutex);
+
 	// Check for a duplicate. In this function, if there is a duplicate,
 	// return an error, don't resolve the duplicate
 	OSRefKey key(&inRef->fString);
-	OSRef* duplicateRef = fTable.Map(&key);
-	if (duplicateRef != nullptr)
+	if (Find(theShard, key) != nullptr)
 		return EPERM;
 
 	// There is no duplicate, so add this ref into the table
 #if DEBUG
 	inRef->fInATable = true;
 #endif
-	fTable.Add(inRef);
+	Add(theShard, inRef);
 	return OS_NoErr;
 }
 
@@ -95,63 +191,111 @@ OSRef* OSRefTable::RegisterOrResolve(OSRef* inRef)
 #endif
 	Assert(inRef->fRefCount == 0);
 
-	OSMutexLocker locker(&fMutex);
+	Shard& theShard = this->GetShard(inRef->fHashValue);
+	OSMutexLocker locker(&theShard.fMutex);
 
 	// Check for a duplicate. If there is one, resolve it and return it to the caller
-	OSRef* duplicateRef = this->Resolve(&inRef->fString);
+	OSRefKey key(&inRef->fString);
+	OSRef* duplicateRef = Find(theShard, key);
 	if (duplicateRef != nullptr)
+	{
+		duplicateRef->fRefCount++;
 		return duplicateRef;
+	}
 
 	// There is no duplicate, so add this ref into the table
 #if DEBUG
 	inRef->fInATable = true;
 #endif
-	fTable.Add(inRef);
+	Add(theShard, inRef);
 	return nullptr;
 }
 
-void OSRefTable::UnRegister(OSRef* ref, uint32_t refCount)
+bool OSRefTable::RemoveRef(OSRef* inRef, uint32_t inRefCount, bool inBlock)
 {
-	Assert(ref != nullptr);
-	OSMutexLocker locker(&fMutex);
+	Shard& theShard = this->GetShard(inRef->fHashValue);
+	{
+		OSMutexLocker locker(&theShard.fMutex);
 
-	//make sure that no one else is using the object
-	while (ref->fRefCount > refCount)
-		ref->fCond.Wait(&fMutex);
+		// Until we're done, lock free readers of this shard go through fMutex,
+		// and the ones already in flight give back what they resolved
+		theShard.fRemoveState += (uint64_t(1) << 32) + 1;
 
+		//make sure that no one else is using the object
+		inRef->fWaiters++;
+		while (inBlock && (inRef->fRefCount > inRefCount))
+			inRef->fCond.Wait(&theShard.fMutex);
+		inRef->fWaiters--;
+
+		bool isIdle = (inRef->fRefCount <= inRefCount);
+		if (isIdle)
+		{
 #if DEBUG
-	OSRefKey key(&ref->fString);
-	if (ref->fInATable)
-		Assert(fTable.Map(&key) != NULL);
-	ref->fInATable = false;
+			if (inRef->fInATable)
+				Assert(Find(theShard, OSRefKey(&inRef->fString)) != NULL);
+			inRef->fInATable = false;
 #endif
+			//ok, we now definitely have no one else using this object, so
+			//remove it from the table
+			Remove(theShard, inRef);
+		}
+
+		theShard.fRemoveState--;
+		if (!isIdle)
+			return false;
+	}
 
-	//ok, we now definitely have no one else using this object, so
-	//remove it from the table
-	fTable.Remove(ref);
+	// Readers that found the ref before it was unlinked may still be looking
+	// at it; after this the caller is free to delete it
+	WaitForReaders(theShard);
+	return true;
 }
 
-bool OSRefTable::TryUnRegister(OSRef* ref, uint32_t refCount)
+void OSRefTable::UnRegister(OSRef* ref, uint32_t refCount)
 {
-	OSMutexLocker locker(&fMutex);
-	if (ref->fRefCount > refCount)
-		return false;
-
-	// At this point, this is guarenteed not to block, because
-	// we've already checked that the refCount is low.
-	this->UnRegister(ref, refCount);
-	return true;
+	Assert(ref != nullptr);
+	(void)this->RemoveRef(ref, refCount, true);
 }
 
+bool OSRefTable::TryUnRegister(OSRef* ref, uint32_t refCount)
+{
+	Assert(ref != nullptr);
+	return this->RemoveRef(ref, refCount, false);
+}
 
 OSRef* OSRefTable::Resolve(StrPtrLen* inUniqueID)
 {
 	Assert(inUniqueID != nullptr);
 	OSRefKey key(inUniqueID);
+	Shard& theShard = this->GetShard(key.fHashValue);
+
+	// Fast path: no lock, unless an UnRegister in this shard gets in the way
+	OSRef* ref = nullptr;
+	bool isResolved = false;
+	uint32_t thePhase = EnterRead(theShard);
+	uint64_t theRemoveState = theShard.fRemoveState.load();
+	if ((theRemoveState & UINT32_MAX) == 0)
+	{
+		ref = Find(theShard, key);
+		if (ref != nullptr)
+			ref->fRefCount++;
+		isResolved = true;
+
+		// An UnRegister that started meanwhile may have checked fRefCount
+		// before our increment and be about to remove the ref, so give it back
+		if ((ref != nullptr) && (theShard.fRemoveState.load() != theRemoveState))
+		{
+			DropRef(theShard, ref);
+			ref = nullptr;
+			isResolved = false;
+		}
+	}
+	ExitRead(theShard, thePhase);
+	if (isResolved)
+		return ref;
 
-	//this must be done atomically wrt the table
-	OSMutexLocker locker(&fMutex);
-	OSRef* ref = fTable.Map(&key);
+	OSMutexLocker locker(&theShard.fMutex);
+	ref = Find(theShard, key);
 	if (ref != nullptr)
 	{
 		ref->fRefCount++;
@@ -163,27 +307,28 @@ OSRef* OSRefTable::Resolve(StrPtrLen* inUniqueID)
 void OSRefTable::Release(OSRef* ref)
 {
 	Assert(ref != nullptr);
-	OSMutexLocker locker(&fMutex);
-	ref->fRefCount--;
-	// fRefCount is a uint32_t  and QTSS should never run into
-	// a ref greater than 16 * 64K, so this assert just checks to
-	// be sure that we have not decremented the ref less than zero.
-	Assert(ref->fRefCount < 1048576L);
-	//make sure to wakeup anyone who may be waiting for this resource to be released
-	ref->fCond.Signal();
+	Shard& theShard = this->GetShard(ref->fHashValue);
+	uint32_t thePhase = EnterRead(theShard);
+	DropRef(theShard, ref);
+	ExitRead(theShard, thePhase);
 }
 
 void OSRefTable::Swap(OSRef* newRef)
 {
 	Assert(newRef != nullptr);
-	OSMutexLocker locker(&fMutex);
+	Shard& theShard = this->GetShard(newRef->fHashValue);
+	OSMutexLocker locker(&theShard.fMutex);
 
 	OSRefKey key(&newRef->fString);
-	OSRef* oldRef = fTable.Map(&key);
+	OSRef* oldRef = Find(theShard, key);
 	if (oldRef != nullptr)
 	{
-		fTable.Remove(oldRef);
-		fTable.Add(newRef);
+		// Link newRef in where oldRef was, so a concurrent Resolve finds one or the other
+		std::atomic<OSRef*>* theLink = &theShard.fBuckets[oldRef->fHashValue % theShard.fNumBuckets];
+		while (theLink->load() != oldRef)
+			theLink = &theLink->load()->fNextHashEntry;
+		newRef->fNextHashEntry.store(oldRef->fNextHashEntry.load());
+		theLink->store(newRef);
 #if DEBUG
 		newRef->fInATable = true;
 		oldRef->fInATable = false;
@@ -194,3 +339,11 @@ void OSRefTable::Swap(OSRef* newRef)
 		Assert(0);
 }
 
+uint32_t OSRefTable::GetNumRefsInTable()
+{
+	uint64_t result = 0;
+	for (Shard& theShard : fShards)
+		result += theShard.fNumEntries.load(std::memory_order_relaxed);
+	Assert(result < UINT32_MAX);
+	return (uint32_t)result;
+}
@@ -33,6 +33,10 @@
 				 therefore allowing clients to arbitrate access to objects in a preemptive,
 				 multithreaded environment.
 
+				 The table is split into shards, each with its own lock. Resolve and
+				 Release don't take any lock unless they race with an UnRegister of
+				 a Ref in the same shard.
+
 
 
 
@@ -41,9 +45,11 @@
 #ifndef _OSREF_H_
 #define _OSREF_H_
 
+#include <atomic>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 #include "StrPtrLen.h"
-#include "OSHashTable.h"
 #include "OSCond.h"
 #include "OSHeaders.h"
 
@@ -92,7 +98,7 @@ public:
 #endif
 	void**  GetObjectPtr() { return &fObjectP; }
 	void*   GetObject() { return fObjectP; }
-	uint32_t  GetRefCount() { return fRefCount; }
+	uint32_t  GetRefCount() { return fRefCount.load(); }
 	StrPtrLen *GetString() { return &fString; }
 private:
 
@@ -102,19 +108,18 @@ private:
 	StrPtrLen   fString;
 
 	//refcounting
-	uint32_t  fRefCount{0};
+	std::atomic<uint32_t>  fRefCount{0};
 #if DEBUG
 	bool  fInATable;
 	bool  fSwapCalled;
 #endif
 	OSCond  fCond;//to block threads waiting for this ref.
+	std::atomic<uint32_t>  fWaiters{0};//threads in UnRegister waiting on fCond
 
 	uint32_t              fHashValue{0};
-	OSRef*              fNextHashEntry{nullptr};
+	std::atomic<OSRef*>   fNextHashEntry{nullptr};
 
 	friend class OSRefKey;
-	friend class OSHashTable<OSRef, OSRefKey>;
-	friend class OSHashTableIter<OSRef, OSRefKey>;
 	friend class OSRefTable;
 
 };
@@ -140,51 +145,34 @@ public:
 
 private:
 
-	//PRIVATE ACCESSORS:    
-	int32_t      GetHashKey() { return fHashValue; }
-
-	//these functions are only used by the hash table itself. This constructor
-	//will break the "Set" functions.
-	OSRefKey(OSRef* elem) : fStringP(&elem->fString),
-		fHashValue(elem->fHashValue)
-	{
-	}
-
-	friend int operator ==(const OSRefKey& key1, const OSRefKey& key2)
-	{
-		if (key1.fStringP->Equal(*key2.fStringP))
-			return true;
-		return false;
-	}
-
 	//data:
 	StrPtrLen *fStringP;
 	uint32_t  fHashValue;
 
-	friend class OSHashTable<OSRef, OSRefKey>;
+	friend class OSRefTable;
 };
 
-typedef OSHashTable<OSRef, OSRefKey> OSRefHashTable;
-typedef OSHashTableIter<OSRef, OSRefKey> OSRefHashTableIter;
-
 class OSRefTable
 {
 public:
 
 	enum
 	{
-		kDefaultTableSize = 1193 //uint32_t
+		kDefaultTableSize = 1193, //uint32_t
+		kShardBits = 4,
+		kNumShards = 1 << kShardBits
 	};
 
 	//tableSize doesn't indicate the max number of Refs that can be added
-	//(it's unlimited), but is rather just how big to make the hash table
-	OSRefTable(uint32_t tableSize = kDefaultTableSize) : fTable(tableSize), fMutex() {}
+	//(it's unlimited), but is rather just how big to make the hash table.
+	//The buckets are divided evenly between the shards.
+	OSRefTable(uint32_t tableSize = kDefaultTableSize);
 	~OSRefTable() = default;
 
-	//Allows access to the mutex in case you need to lock the table down
-	//between operations
+	//Allows access to a mutex in case you need to lock several operations
+	//together. The table never takes it itself, so it only keeps out the
+	//threads that take it too.
 	OSMutex*    GetMutex() { return &fMutex; }
-	OSRefHashTable* GetHashTable() { return &fTable; }
 
 	//Registers a Ref in the table. Once the Ref is in, clients may resolve
 	//the ref by using its string ID. You must setup the Ref before passing it
@@ -234,16 +222,70 @@ public:
 	// the new OSRef object.
 	void        Swap(OSRef* newRef);
 
-	uint32_t      GetNumRefsInTable() { uint64_t result = fTable.GetNumEntries(); Assert(result < UINT32_MAX); return (uint32_t)result; }
+	uint32_t      GetNumRefsInTable();
+
+	//Calls inFunc(OSRef*) on every Ref in the table, one shard at a time with
+	//that shard locked. inFunc must not call back into the table.
+	template <typename Func>
+	void        ForEachRef(Func inFunc);
 
 private:
 
+	struct Shard
+	{
+		//Writers take fMutex. Lock free readers announce themselves in
+		//fReaders[fPhase], so a writer that unlinked a Ref can wait for the
+		//ones that might still be looking at it (see WaitForReaders).
+		OSMutex                 fMutex;
+		std::atomic<uint32_t>   fPhase{0};
+		std::atomic<uint32_t>   fReaders[2]{};
+		std::mutex              fGraceMutex;
+
+		//The high half counts the UnRegisters begun on this shard, the low
+		//half the ones still in progress. Resolve uses it to spot a race.
+		std::atomic<uint64_t>   fRemoveState{0};
+
+		std::unique_ptr<std::atomic<OSRef*>[]> fBuckets;
+		uint32_t                fNumBuckets{0};
+		std::atomic<uint32_t>   fNumEntries{0};
+	};
+
+	Shard&      GetShard(uint32_t inHashValue)
+	{ return fShards[(inHashValue * 2654435761U) >> (32 - kShardBits)]; }
+
+	//The shard's bucket walks. Find may run lock free, Add and Remove need fMutex.
+	static OSRef*   Find(Shard& inShard, const OSRefKey& inKey);
+	static void     Add(Shard& inShard, OSRef* inRef);
+	static bool     Remove(Shard& inShard, OSRef* inRef);
+
+	static uint32_t EnterRead(Shard& inShard);
+	static void     ExitRead(Shard& inShard, uint32_t inPhase) { inShard.fReaders[inPhase]--; }
+	static void     WaitForReaders(Shard& inShard);
+
+	//Drops a reference. The caller must be inside a read section, so the Ref
+	//can't be freed under us while we wake up its UnRegister.
+	static void     DropRef(Shard& inShard, OSRef* inRef);
 
-	//all this object needs to do its job is an atomic hashtable
-	OSRefHashTable  fTable;
+	bool        RemoveRef(OSRef* inRef, uint32_t inRefCount, bool inBlock);
+
+	Shard           fShards[kNumShards];
 	OSMutex         fMutex;
 };
 
+template <typename Func>
+void OSRefTable::ForEachRef(Func inFunc)
+{
+	for (Shard& theShard : fShards)
+	{
+		OSMutexLocker locker(&theShard.fMutex);
+		for (uint32_t x = 0; x < theShard.fNumBuckets; x++)
+		{
+			for (OSRef* theRef = theShard.fBuckets[x].load(); theRef != nullptr; theRef = theRef->fNextHashEntry.load())
+				inFunc(theRef);
+		}
+	}
+}
+
 
 class OSRefReleaser
 {
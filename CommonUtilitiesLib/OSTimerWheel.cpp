@@ -0,0 +1,210 @@
+ /*
+	 File:       OSTimerWheel.cpp
+
+	 Contains:   Implements a hierarchical timing wheel
+ */
+
+#include <string.h>
+
+#include "OSTimerWheel.h"
+#include "OS.h"
+#include "MyAssert.h"
+
+static int CountTrailingZeros(uint64_t inBits)
+{
+#if defined(__GNUC__)
+	return __builtin_ctzll(inBits);
+#else
+	int theCount = 0;
+	while ((inBits & 1) == 0)
+	{
+		inBits >>= 1;
+		theCount++;
+	}
+	return theCount;
+#endif
+}
+
+OSTimerWheel::OSTimerWheel()
+{
+	::memset(fSlots, 0, sizeof(fSlots));
+	::memset(fSlotTails, 0, sizeof(fSlotTails));
+	::memset(fOccupied, 0, sizeof(fOccupied));
+}
+
+void OSTimerWheel::Insert(OSTimerWheelElem* inElem)
+{
+	Assert(inElem != nullptr);
+	Assert(inElem->fCurrentWheel == nullptr);
+
+	// An empty wheel may not have been turned in a long time; catch it up
+	// first so the new element doesn't land a long way off in the top level.
+	if (fCount == 0)
+	{
+		int64_t theCurrentTime = OS::Milliseconds();
+		if (theCurrentTime > fCurrentTime)
+			fCurrentTime = theCurrentTime;
+	}
+
+	this->Place(inElem);
+}
+
+OSTimerWheelElem* OSTimerWheel::Remove(OSTimerWheelElem* inElem)
+{
+	Assert(inElem != nullptr);
+	if (inElem->fCurrentWheel != this)
+		return nullptr;
+
+	this->Unlink(inElem);
+	return inElem;
+}
+
+OSTimerWheelElem* OSTimerWheel::ExtractExpired(int64_t inCurrentTime)
+{
+	while ((fSlots[kExpiredLevel][0] == nullptr) && (fCurrentTime < inCurrentTime))
+	{
+		int64_t theNextTime = (fCount == 0) ? -1 : this->GetNextExpiration();
+		if ((theNextTime < 0) || (theNextTime > inCurrentTime))
+		{
+			// Nothing happens between here and inCurrentTime
+			fCurrentTime = inCurrentTime;
+			break;
+		}
+
+		fCurrentTime = theNextTime;
+
+		// Spread out coarser slots whose turn has come, top level first,
+		// then everything in the 1 ms slot for this tick has expired.
+		for (int theLevel = kNumLevels - 1; theLevel > 0; theLevel--)
+		{
+			int theShift = kSlotBits * theLevel;
+			if ((fCurrentTime & ((int64_t(1) << theShift) - 1)) == 0)
+				this->Cascade(theLevel, (int)((fCurrentTime >> theShift) & kSlotMask));
+		}
+		this->Cascade(0, (int)(fCurrentTime & kSlotMask));
+	}
+
+	OSTimerWheelElem* theElem = fSlots[kExpiredLevel][0];
+	if (theElem != nullptr)
+		this->Unlink(theElem);
+	return theElem;
+}
+
+int64_t OSTimerWheel::GetNextExpiration()
+{
+	if (fSlots[kExpiredLevel][0] != nullptr)
+		return fCurrentTime;
+	if (fCount == 0)
+		return -1;
+
+	int64_t theNextTime = -1;
+	for (int theLevel = 0; theLevel < kNumLevels; theLevel++)
+	{
+		int theShift = kSlotBits * theLevel;
+		int64_t theBlock = fCurrentTime >> theShift;
+		int theDistance = this->FindNextOccupied(theLevel, (int)(theBlock & kSlotMask));
+		if (theDistance == 0)
+			continue;
+
+		int64_t theTime = (theBlock + theDistance) << theShift;
+		if ((theNextTime < 0) || (theTime < theNextTime))
+			theNextTime = theTime;
+	}
+
+	return theNextTime;
+}
+
+void OSTimerWheel::Place(OSTimerWheelElem* inElem)
+{
+	int64_t theDelta = inElem->fValue - fCurrentTime;
+	if (theDelta <= 0)
+	{
+		this->Link(inElem, kExpiredLevel, 0);
+		return;
+	}
+
+	int64_t theValue = inElem->fValue;
+	for (int theLevel = 0; theLevel < kNumLevels; theLevel++)
+	{
+		int theShift = kSlotBits * theLevel;
+		if ((theDelta >> (theShift + kSlotBits)) == 0)
+		{
+			this->Link(inElem, theLevel, (int)((theValue >> theShift) & kSlotMask));
+			return;
+		}
+	}
+
+	// Beyond the top level: park it as far out as the wheel reaches. It gets
+	// placed again when that slot comes around.
+	int theShift = kSlotBits * (kNumLevels - 1);
+	theValue = fCurrentTime + (int64_t(1) << (theShift + kSlotBits)) - 1;
+	this->Link(inElem, kNumLevels - 1, (int)((theValue >> theShift) & kSlotMask));
+}
+
+void OSTimerWheel::Link(OSTimerWheelElem* inElem, int inLevel, int inSlot)
+{
+	// Append, so that cascading a slot keeps its elements in the order they came
+	OSTimerWheelElem*& theTail = fSlotTails[inLevel][inSlot];
+	inElem->fPrev = theTail;
+	inElem->fNext = nullptr;
+	if (theTail != nullptr)
+		theTail->fNext = inElem;
+	else
+		fSlots[inLevel][inSlot] = inElem;
+	theTail = inElem;
+
+	inElem->fLevel = (int16_t)inLevel;
+	inElem->fSlot = (int16_t)inSlot;
+	inElem->fCurrentWheel = this;
+	fCount++;
+
+	if (inLevel < kNumLevels)
+		fOccupied[inLevel][inSlot >> 6] |= uint64_t(1) << (inSlot & 63);
+}
+
+void OSTimerWheel::Unlink(OSTimerWheelElem* inElem)
+{
+	OSTimerWheelElem*& theHead = fSlots[inElem->fLevel][inElem->fSlot];
+	if (inElem->fPrev != nullptr)
+		inElem->fPrev->fNext = inElem->fNext;
+	else
+		theHead = inElem->fNext;
+	if (inElem->fNext != nullptr)
+		inElem->fNext->fPrev = inElem->fPrev;
+	else
+		fSlotTails[inElem->fLevel][inElem->fSlot] = inElem->fPrev;
+
+	if ((theHead == nullptr) && (inElem->fLevel < kNumLevels))
+		fOccupied[inElem->fLevel][inElem->fSlot >> 6] &= ~(uint64_t(1) << (inElem->fSlot & 63));
+
+	inElem->fPrev = nullptr;
+	inElem->fNext = nullptr;
+	inElem->fCurrentWheel = nullptr;
+	fCount--;
+}
+
+void OSTimerWheel::Cascade(int inLevel, int inSlot)
+{
+	while (fSlots[inLevel][inSlot] != nullptr)
+	{
+		OSTimerWheelElem* theElem = fSlots[inLevel][inSlot];
+		this->Unlink(theElem);
+		this->Place(theElem);
+	}
+}
+
+int OSTimerWheel::FindNextOccupied(int inLevel, int inSlot)
+{
+	int theDistance = 1;
+	while (theDistance <= kSlotsPerLevel)
+	{
+		int theIndex = (inSlot + theDistance) & kSlotMask;
+		uint64_t theBits = fOccupied[inLevel][theIndex >> 6] >> (theIndex & 63);
+		if (theBits != 0)
+			return theDistance + CountTrailingZeros(theBits);
+
+		theDistance += 64 - (theIndex & 63);
+	}
+
+	return 0;
+}
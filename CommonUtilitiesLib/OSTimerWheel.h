@@ -0,0 +1,102 @@
+ /*
+	 File:       OSTimerWheel.h
+
+	 Contains:   Hierarchical hashed timing wheel with 1 ms resolution.
+
+				 Four levels of 256 slots cover about 49 days; anything further out
+				 parks in the last level and is re-hashed as the wheel turns.
+				 Insert and Remove are O(1). Elements are intrusive, like OSHeapElem:
+				 the value is an absolute expiration time in OS::Milliseconds().
+
+				 Not thread safe; callers provide their own locking.
+ */
+
+#ifndef _OSTIMERWHEEL_H_
+#define _OSTIMERWHEEL_H_
+
+#include "OSHeaders.h"
+
+class OSTimerWheelElem;
+
+class OSTimerWheel
+{
+public:
+
+	enum
+	{
+		kNumLevels = 4,         //int
+		kSlotBits = 8,          //int
+		kSlotsPerLevel = 1 << kSlotBits
+	};
+
+	OSTimerWheel();
+	~OSTimerWheel() = default;
+
+	//ACCESSORS
+	uint32_t    GetSize() { return fCount; }
+
+	// Earliest time the wheel needs to be looked at again: either when the
+	// next timer expires, or when a coarser slot has to be spread out into
+	// finer ones. -1 if the wheel is empty.
+	int64_t     GetNextExpiration();
+
+	//MODIFIERS
+	void                Insert(OSTimerWheelElem* inElem);
+	// Turns the wheel up to inCurrentTime and returns one element whose time
+	// has come, or nullptr if there is none. Elements come out in time order
+	// to the millisecond tick; within a tick, the ones that were in the wheel
+	// longer tend to come first, but that is not guaranteed.
+	OSTimerWheelElem*   ExtractExpired(int64_t inCurrentTime);
+	// Returns inElem if it was in this wheel, nullptr otherwise
+	OSTimerWheelElem*   Remove(OSTimerWheelElem* inElem);
+
+private:
+
+	enum
+	{
+		kSlotMask = kSlotsPerLevel - 1,
+		kExpiredLevel = kNumLevels,
+		kWordsPerLevel = kSlotsPerLevel / 64
+	};
+
+	void        Place(OSTimerWheelElem* inElem);
+	void        Link(OSTimerWheelElem* inElem, int inLevel, int inSlot);
+	void        Unlink(OSTimerWheelElem* inElem);
+	void        Cascade(int inLevel, int inSlot);
+	// Distance (1 to kSlotsPerLevel) from inSlot to the next occupied slot of
+	// inLevel, or 0 if the level is empty
+	int         FindNextOccupied(int inLevel, int inSlot);
+
+	OSTimerWheelElem*   fSlots[kNumLevels + 1][kSlotsPerLevel];   // last row: expired, slot 0 only
+	OSTimerWheelElem*   fSlotTails[kNumLevels + 1][kSlotsPerLevel];   // slots are FIFO
+	uint64_t            fOccupied[kNumLevels][kWordsPerLevel];
+	int64_t             fCurrentTime{ 0 };
+	uint32_t            fCount{ 0 };
+};
+
+class OSTimerWheelElem
+{
+public:
+	OSTimerWheelElem(void* enclosingObject = nullptr)
+		: fEnclosingObject(enclosingObject) {}
+	~OSTimerWheelElem() = default;
+
+	void    SetValue(int64_t newValue) { fValue = newValue; }
+	int64_t GetValue() { return fValue; }
+	void*   GetEnclosingObject() { return fEnclosingObject; }
+	void    SetEnclosingObject(void* obj) { fEnclosingObject = obj; }
+	bool    IsMemberOfAnyWheel() { return fCurrentWheel != nullptr; }
+
+private:
+
+	int64_t             fValue{ 0 };
+	void*               fEnclosingObject;
+	OSTimerWheel*       fCurrentWheel{ nullptr };
+	OSTimerWheelElem*   fPrev{ nullptr };
+	OSTimerWheelElem*   fNext{ nullptr };
+	int16_t             fLevel{ 0 };
+	int16_t             fSlot{ 0 };
+
+	friend class OSTimerWheel;
+};
+#endif //_OSTIMERWHEEL_H_
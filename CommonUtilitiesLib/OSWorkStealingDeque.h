@@ -0,0 +1,106 @@
+/*
+	File:       OSWorkStealingDeque.h
+
+	Contains:   Chase-Lev work-stealing deque of pointers.
+
+				One thread owns the deque and is the only one allowed to Push.
+				Any thread, the owner included, may Steal from the other end;
+				each pushed item is handed out by exactly one Steal.
+
+				The owner takes its own work from the stealing end as well, so
+				items come out in the order they were pushed. The buffer grows
+				on demand. Outgrown buffers are kept until the deque is destroyed
+				because a thief may still be reading from one.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+template <typename T>
+class OSWorkStealingDeque
+{
+public:
+	explicit OSWorkStealingDeque(int64_t inInitialCapacity = 256)
+	{
+		int64_t theCapacity = 1;
+		while (theCapacity < inInitialCapacity)
+			theCapacity <<= 1;
+
+		fBuffers.emplace_back(new Buffer(theCapacity));
+		fBuffer.store(fBuffers.back().get(), std::memory_order_relaxed);
+	}
+
+	OSWorkStealingDeque(const OSWorkStealingDeque&) = delete;
+	OSWorkStealingDeque& operator=(const OSWorkStealingDeque&) = delete;
+
+	// OWNER ONLY
+	void Push(T* inItem)
+	{
+		int64_t theBottom = fBottom.load(std::memory_order_relaxed);
+		int64_t theTop = fTop.load(std::memory_order_acquire);
+		Buffer* theBuffer = fBuffer.load(std::memory_order_relaxed);
+
+		if (theBottom - theTop > theBuffer->fMask)
+			theBuffer = this->Grow(theBuffer, theTop, theBottom);
+
+		theBuffer->Put(theBottom, inItem);
+		std::atomic_thread_fence(std::memory_order_release);
+		fBottom.store(theBottom + 1, std::memory_order_relaxed);
+	}
+
+	// Returns nullptr if the deque is empty, or if another thread won the race
+	// for the oldest item.
+	T* Steal()
+	{
+		int64_t theTop = fTop.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t theBottom = fBottom.load(std::memory_order_acquire);
+		if (theTop >= theBottom)
+			return nullptr;
+
+		Buffer* theBuffer = fBuffer.load(std::memory_order_acquire);
+		T* theItem = theBuffer->Get(theTop);
+		if (!fTop.compare_exchange_strong(theTop, theTop + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return nullptr;
+
+		return theItem;
+	}
+
+	bool IsEmpty() const
+	{
+		return fTop.load(std::memory_order_acquire) >= fBottom.load(std::memory_order_acquire);
+	}
+
+private:
+	struct Buffer
+	{
+		explicit Buffer(int64_t inCapacity)
+			: fMask(inCapacity - 1), fItems(new std::atomic<T*>[inCapacity]) {}
+
+		T*      Get(int64_t inIndex) const { return fItems[inIndex & fMask].load(std::memory_order_relaxed); }
+		void    Put(int64_t inIndex, T* inItem) { fItems[inIndex & fMask].store(inItem, std::memory_order_relaxed); }
+
+		int64_t fMask;
+		std::unique_ptr<std::atomic<T*>[]> fItems;
+	};
+
+	Buffer* Grow(Buffer* inOld, int64_t inTop, int64_t inBottom)
+	{
+		fBuffers.emplace_back(new Buffer((inOld->fMask + 1) * 2));
+		Buffer* theBuffer = fBuffers.back().get();
+		for (int64_t x = inTop; x < inBottom; x++)
+			theBuffer->Put(x, inOld->Get(x));
+
+		fBuffer.store(theBuffer, std::memory_order_release);
+		return theBuffer;
+	}
+
+	std::atomic<int64_t>    fTop{ 0 };
+	std::atomic<int64_t>    fBottom{ 0 };
+	std::atomic<Buffer*>    fBuffer{ nullptr };
+	std::vector<std::unique_ptr<Buffer>> fBuffers;  // owner only
+};
@@ -0,0 +1,247 @@
+#include <mutex>
+#include "ServerMetrics.h"
+
+namespace ServerMetrics {
+
+	namespace {
+
+		enum class Type
+		{
+			Counter,
+			Gauge,
+			Histogram
+		};
+
+		struct Family
+		{
+			std::string                 fName;
+			std::string                 fHelp;
+			Type                        fType;
+			std::unique_ptr<Counter>    fCounter;
+			std::unique_ptr<Gauge>      fGauge;
+			std::unique_ptr<Histogram>  fHistogram;
+			std::vector<std::pair<std::string, std::weak_ptr<Gauge>>> fLabelledGauges;
+		};
+
+		struct Registry
+		{
+			std::mutex                              fMutex;
+			std::vector<std::unique_ptr<Family>>    fFamilies;
+			std::vector<std::function<void()>>      fCollectors;
+		};
+
+		Registry& GetRegistry()
+		{
+			static Registry sRegistry;
+			return sRegistry;
+		}
+
+		// fMutex must be held
+		Family& GetFamily(Registry& inRegistry, const std::string& inName, const std::string& inHelp, Type inType)
+		{
+			for (auto& theFamily : inRegistry.fFamilies)
+			{
+				if (theFamily->fName == inName)
+					return *theFamily;
+			}
+
+			inRegistry.fFamilies.push_back(std::make_unique<Family>());
+			Family& theFamily = *inRegistry.fFamilies.back();
+			theFamily.fName = inName;
+			theFamily.fHelp = inHelp;
+			theFamily.fType = inType;
+			return theFamily;
+		}
+
+		std::string EscapeLabelValue(const std::string& inValue)
+		{
+			std::string theValue;
+			for (char theChar : inValue)
+			{
+				if (theChar == '\\' || theChar == '"')
+					theValue += '\\';
+				if (theChar == '\n')
+					theValue += "\\n";
+				else
+					theValue += theChar;
+			}
+			return theValue;
+		}
+
+		const char* GetTypeName(Type inType)
+		{
+			switch (inType)
+			{
+			case Type::Counter: return "counter";
+			case Type::Gauge: return "gauge";
+			default: return "histogram";
+			}
+		}
+	}
+
+	size_t GetShard()
+	{
+		static std::atomic<size_t> sNextShard{ 0 };
+		static thread_local size_t sShard = sNextShard.fetch_add(1, std::memory_order_relaxed) & (kNumShards - 1);
+		return sShard;
+	}
+
+	uint64_t Counter::GetValue() const
+	{
+		uint64_t theValue = 0;
+		for (const Shard& theShard : fShards)
+			theValue += theShard.fValue.load(std::memory_order_relaxed);
+		return theValue;
+	}
+
+	void Histogram::Observe(uint64_t inValue, uint64_t inCount)
+	{
+		// the bucket is the bit width of inValue - 1
+#if defined(__GNUC__)
+		size_t theBucket = (inValue <= 1) ? 0 : 64 - __builtin_clzll(inValue - 1);
+#else
+		size_t theBucket = 0;
+		for (uint64_t theBound = 1; theBound < inValue; theBound <<= 1)
+			theBucket++;
+#endif
+		if (theBucket > kNumBuckets - 1)
+			theBucket = kNumBuckets - 1;
+
+		Shard& theShard = fShards[GetShard()];
+		theShard.fBuckets[theBucket].fetch_add(inCount, std::memory_order_relaxed);
+		theShard.fSum.fetch_add(inValue * inCount, std::memory_order_relaxed);
+	}
+
+	void Histogram::Snapshot(uint64_t* outBuckets, uint64_t* outSum) const
+	{
+		*outSum = 0;
+		for (size_t x = 0; x < kNumBuckets; x++)
+			outBuckets[x] = 0;
+
+		for (const Shard& theShard : fShards)
+		{
+			for (size_t x = 0; x < kNumBuckets; x++)
+				outBuckets[x] += theShard.fBuckets[x].load(std::memory_order_relaxed);
+			*outSum += theShard.fSum.load(std::memory_order_relaxed);
+		}
+	}
+
+	Counter& GetCounter(const std::string& inName, const std::string& inHelp)
+	{
+		Registry& theRegistry = GetRegistry();
+		std::lock_guard<std::mutex> locker(theRegistry.fMutex);
+		Family& theFamily = GetFamily(theRegistry, inName, inHelp, Type::Counter);
+		if (!theFamily.fCounter)
+			theFamily.fCounter = std::make_unique<Counter>();
+		return *theFamily.fCounter;
+	}
+
+	Gauge& GetGauge(const std::string& inName, const std::string& inHelp)
+	{
+		Registry& theRegistry = GetRegistry();
+		std::lock_guard<std::mutex> locker(theRegistry.fMutex);
+		Family& theFamily = GetFamily(theRegistry, inName, inHelp, Type::Gauge);
+		if (!theFamily.fGauge)
+			theFamily.fGauge = std::make_unique<Gauge>();
+		return *theFamily.fGauge;
+	}
+
+	Histogram& GetHistogram(const std::string& inName, const std::string& inHelp)
+	{
+		Registry& theRegistry = GetRegistry();
+		std::lock_guard<std::mutex> locker(theRegistry.fMutex);
+		Family& theFamily = GetFamily(theRegistry, inName, inHelp, Type::Histogram);
+		if (!theFamily.fHistogram)
+			theFamily.fHistogram = std::make_unique<Histogram>();
+		return *theFamily.fHistogram;
+	}
+
+	std::shared_ptr<Gauge> AddLabelledGauge(const std::string& inName, const std::string& inHelp, const Labels& inLabels)
+	{
+		std::string theLabels;
+		for (const auto& theLabel : inLabels)
+		{
+			theLabels += theLabels.empty() ? "{" : ",";
+			theLabels += theLabel.first + "=\"" + EscapeLabelValue(theLabel.second) + "\"";
+		}
+		if (!theLabels.empty())
+			theLabels += "}";
+
+		auto theGauge = std::make_shared<Gauge>();
+
+		Registry& theRegistry = GetRegistry();
+		std::lock_guard<std::mutex> locker(theRegistry.fMutex);
+		Family& theFamily = GetFamily(theRegistry, inName, inHelp, Type::Gauge);
+		theFamily.fLabelledGauges.emplace_back(std::move(theLabels), theGauge);
+		return theGauge;
+	}
+
+	void AddCollector(std::function<void()> inCollector)
+	{
+		Registry& theRegistry = GetRegistry();
+		std::lock_guard<std::mutex> locker(theRegistry.fMutex);
+		theRegistry.fCollectors.push_back(std::move(inCollector));
+	}
+
+	std::string Render()
+	{
+		Registry& theRegistry = GetRegistry();
+
+		// Collectors get and register metrics of their own, so they run
+		// without the registry locked
+		std::vector<std::function<void()>> theCollectors;
+		{
+			std::lock_guard<std::mutex> locker(theRegistry.fMutex);
+			theCollectors = theRegistry.fCollectors;
+		}
+		for (auto& theCollector : theCollectors)
+			theCollector();
+
+		std::lock_guard<std::mutex> locker(theRegistry.fMutex);
+		std::string theOutput;
+		for (auto& theFamily : theRegistry.fFamilies)
+		{
+			const std::string& theName = theFamily->fName;
+			theOutput += "# HELP " + theName + " " + theFamily->fHelp + "\n";
+			theOutput += "# TYPE " + theName + " " + GetTypeName(theFamily->fType) + "\n";
+
+			if (theFamily->fCounter)
+				theOutput += theName + " " + std::to_string(theFamily->fCounter->GetValue()) + "\n";
+
+			if (theFamily->fGauge)
+				theOutput += theName + " " + std::to_string(theFamily->fGauge->GetValue()) + "\n";
+
+			// drop the gauges whose owner went away
+			auto& theGauges = theFamily->fLabelledGauges;
+			for (auto it = theGauges.begin(); it != theGauges.end();)
+			{
+				if (auto theGauge = it->second.lock())
+				{
+					theOutput += theName + it->first + " " + std::to_string(theGauge->GetValue()) + "\n";
+					++it;
+				}
+				else
+					it = theGauges.erase(it);
+			}
+
+			if (theFamily->fHistogram)
+			{
+				uint64_t theBuckets[Histogram::kNumBuckets];
+				uint64_t theSum = 0;
+				theFamily->fHistogram->Snapshot(theBuckets, &theSum);
+
+				uint64_t theCount = 0;
+				for (size_t x = 0; x < Histogram::kNumBuckets; x++)
+				{
+					theCount += theBuckets[x];
+					std::string theBound = (x < Histogram::kNumBuckets - 1) ? std::to_string((uint64_t)1 << x) : "+Inf";
+					theOutput += theName + "_bucket{le=\"" + theBound + "\"} " + std::to_string(theCount) + "\n";
+				}
+				theOutput += theName + "_sum " + std::to_string(theSum) + "\n";
+				theOutput += theName + "_count " + std::to_string(theCount) + "\n";
+			}
+		}
+
+		return theOutput;
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Counters, gauges and histograms for the server's hot paths, rendered in the
+// Prometheus text format by ServerMetrics::Render.
+//
+// Counters and histograms are sharded: a thread adds to a cache line of its
+// own with a relaxed atomic add, and only a scrape walks the shards to sum
+// them up. Metrics are registered once, typically into a static reference,
+// and live as long as the process. Labelled gauges belong to something with a
+// shorter life, like a stream, and go away with their last reference.
+namespace ServerMetrics {
+
+	enum
+	{
+		kNumShards = 16 // power of 2
+	};
+
+	// The shard of the calling thread
+	size_t GetShard();
+
+	class Counter
+	{
+	public:
+		void        Add(uint64_t inValue = 1) { fShards[GetShard()].fValue.fetch_add(inValue, std::memory_order_relaxed); }
+		uint64_t    GetValue() const;
+
+	private:
+		struct alignas(64) Shard
+		{
+			std::atomic<uint64_t>   fValue{ 0 };
+		};
+		Shard       fShards[kNumShards];
+	};
+
+	class Gauge
+	{
+	public:
+		void        Set(int64_t inValue) { fValue.store(inValue, std::memory_order_relaxed); }
+		void        Add(int64_t inValue) { fValue.fetch_add(inValue, std::memory_order_relaxed); }
+		int64_t     GetValue() const { return fValue.load(std::memory_order_relaxed); }
+
+	private:
+		std::atomic<int64_t>    fValue{ 0 };
+	};
+
+	// Bucket x counts the values up to 2^x, the last one everything above
+	class Histogram
+	{
+	public:
+		enum
+		{
+			kNumBuckets = 24
+		};
+
+		// inCount is how many values this one stands for, when only a
+		// sample of them is observed
+		void        Observe(uint64_t inValue, uint64_t inCount = 1);
+
+		// outBuckets has kNumBuckets entries, not cumulative
+		void        Snapshot(uint64_t* outBuckets, uint64_t* outSum) const;
+
+	private:
+		struct alignas(64) Shard
+		{
+			std::atomic<uint64_t>   fBuckets[kNumBuckets];
+			std::atomic<uint64_t>   fSum{ 0 };
+			Shard() { for (auto& theBucket : fBuckets) theBucket.store(0, std::memory_order_relaxed); }
+		};
+		Shard       fShards[kNumShards];
+	};
+
+	// The same name always gets the same metric
+	Counter&    GetCounter(const std::string& inName, const std::string& inHelp);
+	Gauge&      GetGauge(const std::string& inName, const std::string& inHelp);
+	Histogram&  GetHistogram(const std::string& inName, const std::string& inHelp);
+
+	// One of several gauges under a name, told apart by their labels
+	using Labels = std::vector<std::pair<std::string, std::string>>;
+	std::shared_ptr<Gauge> AddLabelledGauge(const std::string& inName, const std::string& inHelp, const Labels& inLabels);
+
+	// Run on every scrape before rendering, to bring gauges fed from
+	// elsewhere up to date. A collector may get metrics itself.
+	void        AddCollector(std::function<void()> inCollector);
+
+	std::string Render();
+}
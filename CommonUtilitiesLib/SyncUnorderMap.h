@@ -72,6 +72,20 @@ public:
 		return {};
 	}
 
+	// Calls inFunc with the item while still holding the lock, so that an
+	// UnregisterTask for it waits until inFunc is done with it.
+	// Returns false if there is no such key.
+	template <typename Func>
+	bool WithTask(const indexKey &key, Func inFunc)
+	{
+		std::lock_guard<std::mutex> locker(fMutex);
+		auto it = fHashTable.find(key);
+		if (it == end(fHashTable))
+			return false;
+		inFunc(it->second);
+		return true;
+	}
+
 	bool AddrInMap(const indexKey &key)
 	{
 		std::lock_guard<std::mutex> locker(fMutex);
@@ -30,20 +30,21 @@
 
  */
 
+#include <algorithm>
+#include <chrono>
 #include "Task.h"
 #include "OS.h"
 #include "atomic.h"
-#include "OSMutexRW.h"
+#include "ServerMetrics.h"
 
 
 unsigned int Task::sShortTaskThreadPicker = 0;
 unsigned int Task::sBlockingTaskThreadPicker = 0;
 
-OSMutexRW       TaskThreadPool::sMutexRW;
 static char* sTaskStateStr = "live_"; //Alive
 
 Task::Task()
-	: fTimerHeapElem(), fTaskQueueElem(), pickerToUse(&Task::sShortTaskThreadPicker)
+	: fTimerElem(), fTaskQueueElem(), pickerToUse(&Task::sShortTaskThreadPicker)
 {
 #if DEBUG
 	fInRunCount = 0;
@@ -51,7 +52,7 @@ Task::Task()
 	this->SetTaskName("unknown");
 
 	fTaskQueueElem.SetEnclosingObject(this);
-	fTimerHeapElem.SetEnclosingObject(this);
+	fTimerElem.SetEnclosingObject(this);
 
 }
 
@@ -142,9 +143,9 @@ void Task::Signal(EventFlags events)
 
 			if (TASK_DEBUG) if (fTaskName[0] == 0) ::strcpy(fTaskName, " _Corrupt_Task");
 
-			if (TASK_DEBUG) printf("Task::Signal EnQueue B TaskName=%s theThreadIndex=%u thread=%p fTaskQueue.GetLength(%"   _U32BITARG_   ") q_elem=%p enclosing=%p\n", fTaskName, theThreadIndex, (void *)TaskThreadPool::sTaskThreadArray[theThreadIndex], TaskThreadPool::sTaskThreadArray[theThreadIndex]->fTaskQueue.GetQueue()->GetLength(), (void *)&fTaskQueueElem, (void *) this);
+			if (TASK_DEBUG) printf("Task::Signal EnQueue B TaskName=%s theThreadIndex=%u thread=%p q_elem=%p enclosing=%p\n", fTaskName, theThreadIndex, (void *)TaskThreadPool::sTaskThreadArray[theThreadIndex], (void *)&fTaskQueueElem, (void *) this);
 			TaskThreadPool::sTaskThreadArray[theThreadIndex]->fTaskQueue.EnQueue(&fTaskQueueElem);
-			if (TASK_DEBUG) printf("Task::Signal EnQueue A TaskName=%s theThreadIndex=%u thread=%p fTaskQueue.GetLength(%"   _U32BITARG_   ") q_elem=%p enclosing=%p\n", fTaskName, theThreadIndex, (void *)TaskThreadPool::sTaskThreadArray[theThreadIndex], TaskThreadPool::sTaskThreadArray[theThreadIndex]->fTaskQueue.GetQueue()->GetLength(), (void *)&fTaskQueueElem, (void *) this);
+			if (TASK_DEBUG) printf("Task::Signal EnQueue A TaskName=%s theThreadIndex=%u thread=%p q_elem=%p enclosing=%p\n", fTaskName, theThreadIndex, (void *)TaskThreadPool::sTaskThreadArray[theThreadIndex], (void *)&fTaskQueueElem, (void *) this);
 
 		}
 	}
@@ -152,16 +153,6 @@ void Task::Signal(EventFlags events)
 		if (TASK_DEBUG) printf("Task::Signal Sent to dead TaskName=%s  q_elem=%p  enclosing=%p\n", fTaskName, (void *)&fTaskQueueElem, (void *) this);
 }
 
-
-void Task::GlobalUnlock()
-{
-	if (this->fWriteLock)
-	{
-		this->fWriteLock = false;
-		TaskThreadPool::sMutexRW.Unlock();
-	}
-}
-
 void Task::SetThreadPicker(unsigned int* picker)
 {
 	pickerToUse = picker;
@@ -190,6 +181,7 @@ void TaskThread::Entry()
 {
 	Task* theTask = nullptr;
 
+	this->ClaimTaskQueue();
 	while (true)
 	{
 		theTask = this->WaitForTask();
@@ -212,24 +204,26 @@ void TaskThread::Entry()
 #endif
 			theTask->fUseThisThread = nullptr; // Each invocation of Run must independently
 											// request a specific thread.
-			int64_t theTimeout = 0;
-
-			if (theTask->fWriteLock)
+			if (TASK_DEBUG) printf("TaskThread::Entry run TaskName=%s thread=%p task=%p\n", theTask->fTaskName, (void *) this, (void *)theTask);
+
+			//Reading the clock twice around every Run would cost more than a
+			//short Run, so only a sample of them is timed
+			static ServerMetrics::Histogram& sRunTime = ServerMetrics::GetHistogram("easydarwin_task_run_microseconds", "Time a task spends in one Run, sampled");
+			uint32_t theSampleInterval = TaskThreadPool::sRunTimeSampleInterval.load(std::memory_order_relaxed);
+			bool isTimed = (theSampleInterval != 0) && (fRunsUntilTimed-- == 0);
+			std::chrono::steady_clock::time_point theRunStart;
+			if (isTimed)
 			{
-				OSMutexWriteLocker mutexLocker(&TaskThreadPool::sMutexRW);
-				if (TASK_DEBUG) printf("TaskThread::Entry run global locked TaskName=%s thread=%p task=%p\n", theTask->fTaskName, (void *) this, (void *)theTask);
-
-				theTimeout = theTask->Run();
-				theTask->fWriteLock = false;
-			}
-			else
-			{
-				OSMutexReadLocker mutexLocker(&TaskThreadPool::sMutexRW);
-				if (TASK_DEBUG) printf("TaskThread::Entry run TaskName=%s thread=%p task=%p\n", theTask->fTaskName, (void *) this, (void *)theTask);
-
-				theTimeout = theTask->Run();
-
+				fRunsUntilTimed = theSampleInterval - 1;
+				theRunStart = std::chrono::steady_clock::now();
 			}
+			fRunEpoch.fetch_add(1, std::memory_order_acq_rel);
+			fTaskQueueClaim.clear(std::memory_order_release);  // peers may take what gets signalled meanwhile
+			int64_t theTimeout = theTask->Run();
+			this->ClaimTaskQueue();
+			fRunEpoch.fetch_add(1, std::memory_order_release);
+			if (isTimed)
+				sRunTime.Observe(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - theRunStart).count(), theSampleInterval);
 #if DEBUG
 			Assert(this->GetNumLocksHeld() == 0);
 			theTask->fInRunCount--;
@@ -243,13 +237,8 @@ void TaskThread::Entry()
 
 					theTask->fUseThisThread = nullptr;
 
-					if (nullptr != fHeap.Remove(&theTask->fTimerHeapElem))
-						printf("TaskThread::Entry task still in heap before delete\n");
-
-					if (nullptr != theTask->fTaskQueueElem.InQueue())
-						printf("TaskThread::Entry task still in queue before delete\n");
-
-					theTask->fTaskQueueElem.Remove();
+					if (nullptr != fTimers.Remove(&theTask->fTimerElem))
+						printf("TaskThread::Entry task still in timer wheel before delete\n");
 
 					if (theTask->fEvents &~Task::kAlive)
 						printf("TaskThread::Entry flags still set  before delete\n");
@@ -278,9 +267,9 @@ void TaskThread::Entry()
 			{
 				//note that if we get here, we don't reset theTask, so it will get passed into
 				//WaitForTask
-				if (TASK_DEBUG) printf("TaskThread::Entry insert TaskName=%s in timer heap thread=%p elem=%p task=%p timeout=%.2f\n", theTask->fTaskName, (void *) this, (void *)&theTask->fTimerHeapElem, (void *)theTask, (float)theTimeout / (float)1000);
-				theTask->fTimerHeapElem.SetValue(OS::Milliseconds() + theTimeout);
-				fHeap.Insert(&theTask->fTimerHeapElem);
+				if (TASK_DEBUG) printf("TaskThread::Entry insert TaskName=%s in timer wheel thread=%p elem=%p task=%p timeout=%.2f\n", theTask->fTaskName, (void *) this, (void *)&theTask->fTimerElem, (void *)theTask, (float)theTimeout / (float)1000);
+				theTask->fTimerElem.SetValue(OS::Milliseconds() + theTimeout);
+				fTimers.Insert(&theTask->fTimerElem);
 				(void)atomic_or(&theTask->fEvents, Task::kIdleEvent);
 				doneProcessingEvent = true;
 			}
@@ -308,37 +297,198 @@ void TaskThread::Entry()
 	}
 }
 
+void TaskThread::DrainTaskQueue()
+{
+	for (OSMPSCQueueElem* theElem = fTaskQueue.DeQueue(); theElem != nullptr; theElem = fTaskQueue.DeQueue())
+	{
+		if (theElem == &fWakeElem)
+		{
+			fWakeState.store(kBusy, std::memory_order_release);
+			continue;
+		}
+
+		auto* theTask = (Task*)theElem->GetEnclosingObject();
+		if (theTask->fUseThisThread == this)
+			fPinnedQueue.EnQueue(theElem);
+		else
+			fRunQueue.Push(theTask);
+	}
+}
+
+Task* TaskThread::StealTask()
+{
+	uint32_t theFirst = 0;
+	uint32_t theCount = 0;
+	TaskThreadPool::GetPeerThreads(fIndex, &theFirst, &theCount);
+	if (theCount < 2)
+		return nullptr;
+
+	//xorshift, so threads don't all gang up on the same victim
+	fStealSeed ^= fStealSeed << 13;
+	fStealSeed ^= fStealSeed >> 17;
+	fStealSeed ^= fStealSeed << 5;
+
+	uint32_t theStart = fStealSeed % theCount;
+	for (uint32_t x = 0; x < theCount; x++)
+	{
+		TaskThread* theVictim = TaskThreadPool::sTaskThreadArray[theFirst + (theStart + x) % theCount];
+		if (theVictim == this)
+			continue;
+
+		Task* theTask = theVictim->fRunQueue.Steal();
+		if (theTask != nullptr)
+		{
+			if (TASK_DEBUG) printf("TaskThread::StealTask task=%s thread %p stole from thread %p\n", theTask->fTaskName, (void *) this, (void *)theVictim);
+			if (!theVictim->fRunQueue.IsEmpty())
+				this->WakeIdlePeer();
+			return theTask;
+		}
+
+		theTask = this->StealFromTaskQueue(theVictim);
+		if (theTask != nullptr)
+		{
+			if (TASK_DEBUG) printf("TaskThread::StealTask task=%s thread %p stole from the task queue of thread %p\n", theTask->fTaskName, (void *) this, (void *)theVictim);
+			if (!fRunQueue.IsEmpty())
+				this->WakeIdlePeer();
+			return theTask;
+		}
+	}
+
+	return nullptr;
+}
+
+Task* TaskThread::StealFromTaskQueue(TaskThread* inVictim)
+{
+	//Only while the victim is busy in a Run; it takes the claim back after
+	if ((inVictim->fRunEpoch.load(std::memory_order_acquire) & 1) == 0 ||
+		inVictim->fTaskQueueClaim.test_and_set(std::memory_order_acquire))
+		return nullptr;
+
+	Task* theStolen = nullptr;
+	for (OSMPSCQueueElem* theElem = inVictim->fTaskQueue.DeQueue(); theElem != nullptr; theElem = inVictim->fTaskQueue.DeQueue())
+	{
+		if (theElem == &inVictim->fWakeElem)
+		{
+			inVictim->fWakeState.store(kBusy, std::memory_order_release);
+			continue;
+		}
+
+		auto* theTask = (Task*)theElem->GetEnclosingObject();
+		if (theTask->fUseThisThread == inVictim)
+			inVictim->fPinnedQueue.EnQueue(theElem);
+		else if (theStolen == nullptr)
+			theStolen = theTask;
+		else
+			fRunQueue.Push(theTask);
+	}
+
+	inVictim->fTaskQueueClaim.clear(std::memory_order_release);
+	return theStolen;
+}
+
+void TaskThread::WakeIdlePeer()
+{
+	uint32_t theFirst = 0;
+	uint32_t theCount = 0;
+	TaskThreadPool::GetPeerThreads(fIndex, &theFirst, &theCount);
+
+	//Pairs with the fence in WaitForTask: either the peer's last look finds
+	//the work we left, or we see it is idle
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	for (uint32_t x = 1; x < theCount; x++)
+	{
+		TaskThread* thePeer = TaskThreadPool::sTaskThreadArray[theFirst + (fIndex - theFirst + x) % theCount];
+		if (thePeer->fWakeState.load(std::memory_order_relaxed) == kIdle && thePeer->PostWake(true))
+			return;
+	}
+}
+
+bool TaskThread::PostWake(bool inOnlyIfIdle)
+{
+	if (inOnlyIfIdle)
+	{
+		uint32_t theState = kIdle;
+		if (!fWakeState.compare_exchange_strong(theState, kWakePosted, std::memory_order_acq_rel))
+			return false;
+	}
+	else if (fWakeState.exchange(kWakePosted, std::memory_order_acq_rel) == kWakePosted)
+		return false;
+
+	fTaskQueue.EnQueue(&fWakeElem);
+	return true;
+}
+
 Task* TaskThread::WaitForTask()
 {
 	while (true)
 	{
 		int64_t theCurrentTime = OS::Milliseconds();
 
-		if ((fHeap.PeekMin() != nullptr) && (fHeap.PeekMin()->GetValue() <= theCurrentTime))
+		OSTimerWheelElem* theTimerElem = fTimers.ExtractExpired(theCurrentTime);
+		if (theTimerElem != nullptr)
 		{
-			if (TASK_DEBUG) printf("TaskThread::WaitForTask found timer-task=%s thread %p fHeap.CurrentHeapSize(%"   _U32BITARG_   ") taskElem = %p enclose=%p\n", ((Task*)fHeap.PeekMin()->GetEnclosingObject())->fTaskName, (void *) this, fHeap.CurrentHeapSize(), (void *)fHeap.PeekMin(), (void *)fHeap.PeekMin()->GetEnclosingObject());
-			return (Task*)fHeap.ExtractMin()->GetEnclosingObject();
+			if (TASK_DEBUG) printf("TaskThread::WaitForTask found timer-task=%s thread %p fTimers.GetSize(%"   _U32BITARG_   ") taskElem = %p enclose=%p\n", ((Task*)theTimerElem->GetEnclosingObject())->fTaskName, (void *) this, fTimers.GetSize(), (void *)theTimerElem, (void *)theTimerElem->GetEnclosingObject());
+			return (Task*)theTimerElem->GetEnclosingObject();
 		}
 
-		//if there is an element waiting for a timeout, figure out how long we should wait.
-		int64_t theTimeout = 0;
-		if (fHeap.PeekMin() != nullptr)
-			theTimeout = fHeap.PeekMin()->GetValue() - theCurrentTime;
-		Assert(theTimeout >= 0);
+		//Signalled tasks: our own pinned ones first, then our run queue (oldest
+		//first, same end thieves take from), and only then go looking for work
+		this->DrainTaskQueue();
 
-		//
-		// Make sure we can't go to sleep for some ridiculously short
-		// period of time
-		// Do not allow a timeout below 10 ms without first verifying reliable udp 1-2mbit live streams. 
-		// Test with easydarwin.xml pref reliablUDP printfs enabled and look for packet loss and check client for  buffer ahead recovery.
-		if (theTimeout < 10)
-			theTimeout = 10;
+		OSMPSCQueueElem* thePinnedElem = fPinnedQueue.DeQueue();
+		if (thePinnedElem != nullptr)
+			return (Task*)thePinnedElem->GetEnclosingObject();
+
+		Task* theTask = fRunQueue.Steal();
+		if (theTask != nullptr)
+		{
+			//leave the rest to an idle peer rather than let it queue up behind this one
+			if (!fRunQueue.IsEmpty())
+				this->WakeIdlePeer();
+			return theTask;
+		}
+
+		theTask = this->StealTask();
+		if (theTask != nullptr)
+			return theTask;
+
+		//Nothing to do. Say we are idle before one last look at the peers, so
+		//whoever leaves work behind after that look sees it and wakes us.
+		//If a wake up is posted already, it gets us going again anyway.
+		uint32_t theState = kBusy;
+		(void)fWakeState.compare_exchange_strong(theState, kIdle, std::memory_order_acq_rel);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		theTask = this->StealTask();
+		if (theTask != nullptr || OSThread::GetCurrent()->IsStopRequested())
+		{
+			this->LeaveIdle();
+			return theTask;
+		}
+
+		//if there is an element waiting for a timeout, sleep until exactly then.
+		//Otherwise sleep until signalled or woken by a peer; kMaxWaitTimeInMilSecs
+		//is only there as a backstop.
+		int64_t theTimeout = kMaxWaitTimeInMilSecs;
+		int64_t theNextTime = fTimers.GetNextExpiration();
+		if ((theNextTime >= 0) && (theNextTime - theCurrentTime < theTimeout))
+			theTimeout = theNextTime - theCurrentTime;
+
+		//a timeout of 0 would mean wait forever
+		if (theTimeout < 1)
+			theTimeout = 1;
 
 		//wait...
-		OSQueueElem* theElem = fTaskQueue.DeQueueBlocking(this, (int32_t)theTimeout);
+		OSMPSCQueueElem* theElem = fTaskQueue.DeQueueBlocking((int32_t)theTimeout);
+		this->LeaveIdle();
+		if (theElem == &fWakeElem)
+		{
+			fWakeState.store(kBusy, std::memory_order_release);
+			continue;
+		}
 		if (theElem != nullptr)
 		{
-			if (TASK_DEBUG) printf("TaskThread::WaitForTask found signal-task=%s thread %p fTaskQueue.GetLength(%"   _U32BITARG_   ") taskElem = %p enclose=%p\n", ((Task*)theElem->GetEnclosingObject())->fTaskName, (void *) this, fTaskQueue.GetQueue()->GetLength(), (void *)theElem, (void *)theElem->GetEnclosingObject());
+			if (TASK_DEBUG) printf("TaskThread::WaitForTask found signal-task=%s thread %p taskElem = %p enclose=%p\n", ((Task*)theElem->GetEnclosingObject())->fTaskName, (void *) this, (void *)theElem, (void *)theElem->GetEnclosingObject());
 			return (Task*)theElem->GetEnclosingObject();
 		}
 
@@ -353,6 +503,7 @@ TaskThread** TaskThreadPool::sTaskThreadArray = nullptr;
 uint32_t       TaskThreadPool::sNumTaskThreads = 0;
 uint32_t       TaskThreadPool::sNumShortTaskThreads = 0;
 uint32_t       TaskThreadPool::sNumBlockingTaskThreads = 0;
+std::atomic<uint32_t> TaskThreadPool::sRunTimeSampleInterval{ 16 };
 
 bool TaskThreadPool::AddThreads(uint32_t numToAdd)
 {
@@ -362,6 +513,14 @@ bool TaskThreadPool::AddThreads(uint32_t numToAdd)
 	for (uint32_t x = 0; x < numToAdd; x++)
 	{
 		sTaskThreadArray[x] = new TaskThread();
+		sTaskThreadArray[x]->fIndex = x;
+		sTaskThreadArray[x]->fStealSeed = 2463534242U + x * 2654435761U;
+	}
+
+	//only start them once they can all be seen, since each one may go
+	//looking through sTaskThreadArray for work to steal
+	for (uint32_t x = 0; x < numToAdd; x++)
+	{
 		sTaskThreadArray[x]->Start();
 		if (TASK_DEBUG)  printf("TaskThreadPool::AddThreads sTaskThreadArray[%"   _U32BITARG_   "]=%p\n", x, sTaskThreadArray[x]);
 	}
@@ -373,6 +532,23 @@ bool TaskThreadPool::AddThreads(uint32_t numToAdd)
 	return true;
 }
 
+void TaskThreadPool::GetPeerThreads(uint32_t inIndex, uint32_t* outFirst, uint32_t* outCount)
+{
+	uint32_t theNumThreads = sNumTaskThreads;
+	uint32_t theNumShort = std::min(sNumShortTaskThreads, theNumThreads);
+
+	if (inIndex < theNumShort)
+	{
+		*outFirst = 0;
+		*outCount = theNumShort;
+	}
+	else
+	{
+		*outFirst = theNumShort;
+		*outCount = theNumThreads > theNumShort ? theNumThreads - theNumShort : 0;
+	}
+}
+
 TaskThread* TaskThreadPool::GetThread(uint32_t index)
 {
 
@@ -387,6 +563,27 @@ TaskThread* TaskThreadPool::GetThread(uint32_t index)
 
 
 
+void TaskThreadPool::WaitForQuiescentState()
+{
+	OSThread* theCurrentThread = OSThread::GetCurrent();
+
+	for (uint32_t x = 0; x < sNumTaskThreads; x++)
+	{
+		TaskThread* theThread = sTaskThreadArray[x];
+		if (theThread == theCurrentThread)
+			continue;
+
+		//an even epoch means the thread is between tasks. Otherwise wait for
+		//it to move on; whatever it runs next started after we were called.
+		uint64_t theEpoch = theThread->fRunEpoch.load(std::memory_order_acquire);
+		if ((theEpoch & 1) == 0)
+			continue;
+
+		while (theThread->fRunEpoch.load(std::memory_order_acquire) == theEpoch)
+			OSThread::Sleep(1);
+	}
+}
+
 void TaskThreadPool::RemoveThreads()
 {
 	//Tell all the threads to stop
@@ -396,10 +593,16 @@ void TaskThreadPool::RemoveThreads()
 	//Because any (or all) threads may be blocked on the queue, cycle through
 	//all the threads, signalling each one
 	for (uint32_t y = 0; y < sNumTaskThreads; y++)
-		sTaskThreadArray[y]->fTaskQueue.GetCond()->Signal();
+		(void)sTaskThreadArray[y]->PostWake(false);
+
+	//Let whatever is running finish before we start tearing threads down
+	WaitForQuiescentState();
+
+	//Ok, now wait for the selected threads to terminate. Threads still running
+	//may be stealing from the others, so only delete once they have all stopped.
+	for (uint32_t z = 0; z < sNumTaskThreads; z++)
+		sTaskThreadArray[z]->StopAndWaitForThread();
 
-	//Ok, now wait for the selected threads to terminate, deleting them and removing
-	//them from the queue.
 	for (uint32_t z = 0; z < sNumTaskThreads; z++)
 		delete sTaskThreadArray[z];
 
@@ -46,10 +46,12 @@
 #define __TASK_H__
 
 #include <string.h>
+#include <atomic>
+#include "OSMPSCQueue.h"
 #include "OSQueue.h"
-#include "OSHeap.h"
+#include "OSTimerWheel.h"
 #include "OSThread.h"
-#include "OSMutexRW.h"
+#include "OSWorkStealingDeque.h"
 
 #define TASK_DEBUG 0
 
@@ -96,7 +98,6 @@ public:
 
 	//Send an event to this task.
 	void                    Signal(EventFlags eventFlags);
-	void                    GlobalUnlock();
 	bool                  Valid(); // for debugging
 	char            fTaskName[48];
 	void            SetTaskName(char* name);
@@ -137,7 +138,6 @@ private:
 	EventFlags      fEvents{0};
 	TaskThread*     fUseThisThread{nullptr};
 	TaskThread*     fDefaultThread{nullptr};
-	bool          fWriteLock{false};
 
 #if DEBUG
 	//The whole premise of a task is that the Run function cannot be re-entered.
@@ -145,10 +145,8 @@ private:
 	volatile uint32_t fInRunCount;
 #endif
 
-	//This could later be optimized by using a timing wheel instead of a heap,
-	//and that way we wouldn't need both a heap elem and a queue elem here (just queue elem)
-	OSHeapElem      fTimerHeapElem;
-	OSQueueElem     fTaskQueueElem;
+	OSTimerWheelElem fTimerElem;
+	OSMPSCQueueElem fTaskQueueElem;
 
 	unsigned int *pickerToUse;
 	//Variable used for assigning tasks to threads in a round-robin fashion
@@ -164,7 +162,7 @@ public:
 
 	//Implementation detail: all tasks get run on TaskThreads.
 
-	TaskThread() : OSThread(), fTaskThreadPoolElem()
+	TaskThread() : OSThread(), fTaskThreadPoolElem(), fWakeElem(this)
 	{
 		fTaskThreadPoolElem.SetEnclosingObject(this);
 	}
@@ -174,17 +172,73 @@ private:
 
 	enum
 	{
-		kMinWaitTimeInMilSecs = 10  //uint32_t
+		kMaxWaitTimeInMilSecs = 1000  //uint32_t, only a backstop: idle threads get woken
+	};
+
+	// fWakeState
+	enum
+	{
+		kBusy = 0,          // running tasks, or looking for one
+		kIdle = 1,          // found nothing to run or steal, parking
+		kWakePosted = 2     // fWakeElem is in fTaskQueue
 	};
 
 	void    Entry() override;
 	Task*           WaitForTask();
 
+	// Moves everything signalled to this thread out of fTaskQueue: tasks
+	// bound to this thread go to fPinnedQueue, the rest become stealable.
+	void            DrainTaskQueue();
+	// Takes a task from a random peer of the same kind (short / blocking)
+	Task*           StealTask();
+	// Drains fTaskQueue of a victim that is inside a Task::Run, so what got
+	// signalled to it meanwhile doesn't wait for that Run to end. Returns
+	// one task to run and leaves the rest in our fRunQueue, except the ones
+	// bound to the victim, which go to its fPinnedQueue.
+	Task*           StealFromTaskQueue(TaskThread* inVictim);
+	// Only the thread holding the claim may take things out of fTaskQueue.
+	// This thread holds it all the time it is not inside a Task::Run.
+	void            ClaimTaskQueue()
+	{
+		while (fTaskQueueClaim.test_and_set(std::memory_order_acquire)) {}
+	}
+	// Called with tasks left in a run queue: gets one idle peer of the same
+	// kind out of its park so it can come and steal them
+	void            WakeIdlePeer();
+	// Queues fWakeElem, unless it is queued already or inOnlyIfIdle is set
+	// and the thread is not kIdle. Unlike OSMPSCQueue::Wake this can't be
+	// missed by a thread that is just about to park.
+	bool            PostWake(bool inOnlyIfIdle);
+	// kIdle -> kBusy. Leaves a posted wake up alone, DrainTaskQueue clears it.
+	void            LeaveIdle()
+	{
+		uint32_t theState = kIdle;
+		(void)fWakeState.compare_exchange_strong(theState, kBusy, std::memory_order_acq_rel);
+	}
+
 	OSQueueElem     fTaskThreadPoolElem;
 
-	OSHeap              fHeap;
-	OSQueue_Blocking    fTaskQueue;
+	OSTimerWheel        fTimers;
+	OSMPSCQueue         fTaskQueue;     // signalled from anywhere, drained by whoever holds fTaskQueueClaim
+	std::atomic_flag    fTaskQueueClaim = ATOMIC_FLAG_INIT;
+
+	OSMPSCQueue                 fPinnedQueue;   // drained by this thread only
+	OSWorkStealingDeque<Task>   fRunQueue;      // pushed by this thread, taken by anyone
+	uint32_t                    fIndex{ 0 };
+	uint32_t                    fStealSeed{ 0 };
+
+	// Moves kBusy -> kIdle on this thread, kIdle -> kWakePosted on whoever
+	// posts the wake up, and back to kBusy once this thread takes fWakeElem
+	// out of fTaskQueue. So fWakeElem is never queued twice.
+	OSMPSCQueueElem             fWakeElem;
+	std::atomic<uint32_t>       fWakeState{ kBusy };
 
+	// Bumped right before and right after every Task::Run, so it is odd
+	// while this thread is inside a task. Only this thread writes it.
+	std::atomic<uint64_t> fRunEpoch{ 0 };
+
+	// Runs left until the next one that gets timed
+	uint32_t            fRunsUntilTimed{ 0 };
 
 	friend class Task;
 	friend class TaskThreadPool;
@@ -205,14 +259,26 @@ public:
 	static void SetNumShortTaskThreads(uint32_t numToAdd) { sNumShortTaskThreads = numToAdd; }
 	static void SetNumBlockingTaskThreads(uint32_t numToAdd) { sNumBlockingTaskThreads = numToAdd; }
 
+	// Returns once every Task::Run that was in progress when this was called
+	// has returned. Tasks started afterwards are not waited for. Safe to call
+	// from a task thread; the calling thread is skipped.
+	static void     WaitForQuiescentState();
+
+	// Every thread times one Run in inInterval for the run time histogram,
+	// and counts it for all of them. 0 times none.
+	static void     SetRunTimeSampleInterval(uint32_t inInterval) { sRunTimeSampleInterval.store(inInterval, std::memory_order_relaxed); }
+
 private:
 
 	static TaskThread**     sTaskThreadArray;
 	static uint32_t           sNumTaskThreads;
 	static uint32_t           sNumShortTaskThreads;
 	static uint32_t           sNumBlockingTaskThreads;
+	static std::atomic<uint32_t> sRunTimeSampleInterval;
 
-	static OSMutexRW        sMutexRW;// __attribute__((visibility("hidden")));
+	// The threads a task signalled to sTaskThreadArray[inIndex] could also
+	// have been picked from: the short task threads or the blocking ones.
+	static void     GetPeerThreads(uint32_t inIndex, uint32_t* outFirst, uint32_t* outCount);
 
 	friend class Task;
 	friend class TaskThread;
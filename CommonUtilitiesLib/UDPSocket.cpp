@@ -32,6 +32,7 @@
  */
 
 #ifndef __Win32__
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
@@ -48,13 +49,36 @@
 #endif
 #endif
 
+#if defined(__linux__)
+#include <netinet/udp.h>
+#endif
+
 #include <errno.h>
+#include <algorithm>
+#include <atomic>
 #include "UDPSocket.h"
+#include "ServerMetrics.h"
 
 #ifdef USE_NETLOG
 #include <netlog.h>
 #endif
 
+#if defined(__linux__)
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+// Kernel limits for a single UDP_SEGMENT send
+static constexpr size_t kMaxGSOSegments = 64;
+static constexpr size_t kMaxGSOBytes = 65000;
+
+// Cleared the first time the kernel or the NIC turns down a segmented send
+static std::atomic<bool> sGSOSupported{ true };
+#endif
+
 UDPSocket::UDPSocket(Task* inTask, uint32_t inSocketType)
 	: Socket(inTask, inSocketType)
 {
@@ -110,6 +134,259 @@ OS_Error UDPSocket::RecvFrom(uint32_t* outRemoteAddr, uint16_t* outRemotePort,
 	return OS_NoErr;
 }
 
+OS_Error UDPSocket::RecvMany(RecvMsg* ioMsgs, size_t inNumMsgs, size_t* outNumMsgs)
+{
+	Assert(ioMsgs != nullptr);
+	Assert(outNumMsgs != nullptr);
+
+	if (inNumMsgs > kMaxRecvBatch)
+		inNumMsgs = kMaxRecvBatch;
+	*outNumMsgs = 0;
+
+#if defined(__linux__)
+	struct mmsghdr      theHeaders[kMaxRecvBatch];
+	struct iovec        theIOVecs[kMaxRecvBatch];
+	struct sockaddr_in  theAddrs[kMaxRecvBatch];
+
+	::memset(theHeaders, 0, sizeof(struct mmsghdr) * inNumMsgs);
+	for (size_t x = 0; x < inNumMsgs; x++)
+	{
+		theIOVecs[x].iov_base = ioMsgs[x].fBuffer;
+		theIOVecs[x].iov_len = ioMsgs[x].fBufLen;
+		theHeaders[x].msg_hdr.msg_name = &theAddrs[x];
+		theHeaders[x].msg_hdr.msg_namelen = sizeof(theAddrs[x]);
+		theHeaders[x].msg_hdr.msg_iov = &theIOVecs[x];
+		theHeaders[x].msg_hdr.msg_iovlen = 1;
+	}
+
+	int theNumMsgs = ::recvmmsg(fFileDesc, theHeaders, (unsigned int)inNumMsgs, 0, nullptr);
+	if (theNumMsgs == -1)
+		return (OS_Error)OSThread::GetErrno();
+
+	for (int x = 0; x < theNumMsgs; x++)
+	{
+		ioMsgs[x].fRecvLen = theHeaders[x].msg_len;
+		ioMsgs[x].fRemoteAddr = ntohl(theAddrs[x].sin_addr.s_addr);
+		ioMsgs[x].fRemotePort = ntohs(theAddrs[x].sin_port);
+	}
+	*outNumMsgs = (size_t)theNumMsgs;
+	return OS_NoErr;
+#else
+	OS_Error theErr = OS_NoErr;
+	for (; *outNumMsgs < inNumMsgs; (*outNumMsgs)++)
+	{
+		RecvMsg& theMsg = ioMsgs[*outNumMsgs];
+		theErr = this->RecvFrom(&theMsg.fRemoteAddr, &theMsg.fRemotePort, theMsg.fBuffer,
+			theMsg.fBufLen, &theMsg.fRecvLen);
+		if (theErr != OS_NoErr)
+			break;
+	}
+	return (*outNumMsgs > 0) ? OS_NoErr : theErr;
+#endif
+}
+
+OS_Error UDPSocket::SendMany(const SendMsg* inMsgs, size_t inNumMsgs, size_t* outNumSent)
+{
+	Assert(inMsgs != nullptr);
+
+	size_t theNumSent = 0;
+	OS_Error theErr = OS_NoErr;
+
+#if defined(__linux__)
+	struct mmsghdr      theHeaders[kMaxSendBatch];
+	struct iovec        theIOVecs[kMaxSendBatch];
+	struct sockaddr_in  theAddrs[kMaxSendBatch];
+	size_t              theFirstMsg[kMaxSendBatch + 1];
+	union
+	{
+		char            fBuf[CMSG_SPACE(sizeof(uint16_t))];
+		struct cmsghdr  fAlign;
+	} theControl[kMaxSendBatch];
+
+	size_t theMsg = 0;
+	while (theMsg < inNumMsgs)
+	{
+		//
+		// Build at most kMaxSendBatch datagrams worth of headers, folding runs
+		// of same sized datagrams to one destination into a single GSO send.
+		// The kernel allows the last segment of a run to be shorter.
+		size_t theEnd = std::min(inNumMsgs, theMsg + kMaxSendBatch);
+		bool useGSO = sGSOSupported.load(std::memory_order_relaxed);
+		size_t theNumHeaders = 0;
+		::memset(theHeaders, 0, sizeof(theHeaders));
+
+		for (size_t theIndex = theMsg; theIndex < theEnd; theNumHeaders++)
+		{
+			const SendMsg& theFirst = inMsgs[theIndex];
+			size_t theRun = 1;
+			size_t theTotal = theFirst.fLen;
+			while (useGSO && (theIndex + theRun < theEnd) && (theRun < kMaxGSOSegments))
+			{
+				const SendMsg& theNext = inMsgs[theIndex + theRun];
+				if ((theNext.fRemoteAddr != theFirst.fRemoteAddr) || (theNext.fRemotePort != theFirst.fRemotePort) ||
+					(theNext.fLen > theFirst.fLen) || (theTotal + theNext.fLen > kMaxGSOBytes))
+					break;
+
+				theTotal += theNext.fLen;
+				theRun++;
+				if (theNext.fLen < theFirst.fLen)
+					break;
+			}
+
+			for (size_t x = 0; x < theRun; x++)
+			{
+				theIOVecs[theIndex - theMsg + x].iov_base = const_cast<void*>(inMsgs[theIndex + x].fData);
+				theIOVecs[theIndex - theMsg + x].iov_len = inMsgs[theIndex + x].fLen;
+			}
+
+			struct sockaddr_in& theAddr = theAddrs[theNumHeaders];
+			::memset(&theAddr, 0, sizeof(theAddr));
+			theAddr.sin_family = AF_INET;
+			theAddr.sin_port = htons(theFirst.fRemotePort);
+			theAddr.sin_addr.s_addr = htonl(theFirst.fRemoteAddr);
+
+			struct msghdr& theHeader = theHeaders[theNumHeaders].msg_hdr;
+			theHeader.msg_name = &theAddr;
+			theHeader.msg_namelen = sizeof(theAddr);
+			theHeader.msg_iov = &theIOVecs[theIndex - theMsg];
+			theHeader.msg_iovlen = theRun;
+
+			if (theRun > 1)
+			{
+				theHeader.msg_control = theControl[theNumHeaders].fBuf;
+				theHeader.msg_controllen = sizeof(theControl[theNumHeaders].fBuf);
+				struct cmsghdr* theCMsg = CMSG_FIRSTHDR(&theHeader);
+				theCMsg->cmsg_level = SOL_UDP;
+				theCMsg->cmsg_type = UDP_SEGMENT;
+				theCMsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+				uint16_t theSegmentSize = (uint16_t)theFirst.fLen;
+				::memcpy(CMSG_DATA(theCMsg), &theSegmentSize, sizeof(theSegmentSize));
+			}
+
+			theFirstMsg[theNumHeaders] = theIndex;
+			theIndex += theRun;
+		}
+		theFirstMsg[theNumHeaders] = theEnd;
+
+		size_t theHeader = 0;
+		while (theHeader < theNumHeaders)
+		{
+			int theResult = ::sendmmsg(fFileDesc, &theHeaders[theHeader], (unsigned int)(theNumHeaders - theHeader), 0);
+			if (theResult > 0)
+			{
+				theNumSent += theFirstMsg[theHeader + theResult] - theFirstMsg[theHeader];
+				theHeader += theResult;
+				continue;
+			}
+
+			theErr = (OS_Error)OSThread::GetErrno();
+			bool isSegmented = theHeaders[theHeader].msg_hdr.msg_iovlen > 1;
+			if (isSegmented && ((theErr == EIO) || (theErr == EINVAL) || (theErr == ENOPROTOOPT)))
+			{
+				// No GSO here after all. Go back and send the rest one datagram at a time.
+				sGSOSupported.store(false, std::memory_order_relaxed);
+				break;
+			}
+
+			if ((theErr == EAGAIN) || (theErr == EWOULDBLOCK) || (theErr == ENOBUFS))
+			{
+				// The socket buffer is full, so the rest would fail too. It's UDP: drop them.
+				if (outNumSent != nullptr)
+					*outNumSent = theNumSent;
+				return theErr;
+			}
+
+			// Anything else (typically an ICMP error left over from an earlier
+			// send) only concerns this one destination
+			theHeader++;
+		}
+
+		theMsg = theFirstMsg[theHeader];
+	}
+#else
+	for (size_t x = 0; x < inNumMsgs; x++)
+	{
+		struct sockaddr_in  theRemoteAddr;
+		::memset(&theRemoteAddr, 0, sizeof(theRemoteAddr));
+		theRemoteAddr.sin_family = AF_INET;
+		theRemoteAddr.sin_port = htons(inMsgs[x].fRemotePort);
+		theRemoteAddr.sin_addr.s_addr = htonl(inMsgs[x].fRemoteAddr);
+
+		if (::sendto(fFileDesc, (const char*)inMsgs[x].fData, inMsgs[x].fLen, 0,
+			(sockaddr*)&theRemoteAddr, sizeof(theRemoteAddr)) == -1)
+			theErr = (OS_Error)OSThread::GetErrno();
+		else
+			theNumSent++;
+	}
+#endif
+
+	if (outNumSent != nullptr)
+		*outNumSent = theNumSent;
+	return (theNumSent == inNumMsgs) ? OS_NoErr : theErr;
+}
+
+OS_Error UDPSocket::QueueSendTo(uint32_t inRemoteAddr, uint16_t inRemotePort,
+	const char* inData, size_t inLen)
+{
+	Assert(inData != nullptr);
+
+	std::lock_guard<std::mutex> locker(fSendMutex);
+
+	if (fSendQueue == nullptr)
+		fSendQueue.reset(new SendQueue);
+
+	// A blocked socket has to have room again before we pile more on, and
+	// a full queue has to go before there is room in it. A flush always
+	// empties the queue, so a blocked socket has nothing queued.
+	if (fSendQueue->fBlocked)
+	{
+		if (!this->IsWritable())
+			return EAGAIN;
+		fSendQueue->fBlocked = false;
+	}
+
+	if (fSendQueue->fNumMsgs == kMaxSendBatch)
+	{
+		OS_Error theErr = this->FlushSendQueueLocked();
+		if (theErr == EAGAIN)
+			return EAGAIN;
+	}
+
+	fSendQueue->fMsgs[fSendQueue->fNumMsgs++] = { inData, inLen, inRemoteAddr, inRemotePort };
+	return OS_NoErr;
+}
+
+OS_Error UDPSocket::FlushSendQueue()
+{
+	std::lock_guard<std::mutex> locker(fSendMutex);
+	return this->FlushSendQueueLocked();
+}
+
+OS_Error UDPSocket::FlushSendQueueLocked()
+{
+	if ((fSendQueue == nullptr) || (fSendQueue->fNumMsgs == 0))
+		return OS_NoErr;
+
+	static ServerMetrics::Counter& sDropped = ServerMetrics::GetCounter("easydarwin_udp_send_dropped_total", "Queued UDP datagrams the socket did not take");
+
+	// Whatever didn't make it out is dropped, as it would be on the wire.
+	// The queue only points at the data, which isn't ours to hold on to.
+	size_t theNumSent = 0;
+	OS_Error theErr = this->SendMany(fSendQueue->fMsgs, fSendQueue->fNumMsgs, &theNumSent);
+	sDropped.Add(fSendQueue->fNumMsgs - theNumSent);
+	fSendQueue->fNumMsgs = 0;
+	fSendQueue->fBlocked = (theErr == EAGAIN) || (theErr == EWOULDBLOCK) || (theErr == ENOBUFS);
+	if (fSendQueue->fBlocked)
+		return EAGAIN;
+	return theErr;
+}
+
+bool UDPSocket::IsWritable()
+{
+	struct pollfd thePollFD = { fFileDesc, POLLOUT, 0 };
+	return (::poll(&thePollFD, 1, 0) == 1) && (thePollFD.revents & POLLOUT);
+}
+
 OS_Error UDPSocket::JoinMulticast(uint32_t inRemoteAddr)
 {
 	struct ip_mreq  theMulti;
@@ -36,6 +36,8 @@
 #ifndef __UDPSOCKET_H__
 #define __UDPSOCKET_H__
 
+#include <memory>
+#include <mutex>
 #include <vector>
 #include "Socket.h"
 
@@ -61,8 +63,75 @@ public:
 	OS_Error        RecvFrom(uint32_t* outRemoteAddr, uint16_t* outRemotePort,
 		void* ioBuffer, size_t inBufLen, size_t* outRecvLen);
 
+	enum
+	{
+		kMaxRecvBatch = 64,         //uint32_t
+		kMaxSendBatch = 64,         //uint32_t
+		kMaxQueuedPacketSize = 2060 //uint32_t
+	};
+
+	// One datagram slot for RecvMany. The caller supplies fBuffer & fBufLen,
+	// RecvMany fills in the rest.
+	struct RecvMsg
+	{
+		void*     fBuffer;
+		size_t    fBufLen;
+		size_t    fRecvLen;
+		uint32_t  fRemoteAddr;
+		uint16_t  fRemotePort;
+	};
+
+	//Receives up to inNumMsgs (no more than kMaxRecvBatch) datagrams with a single
+	//recvmmsg call where the platform has one, otherwise loops on recvfrom.
+	//returns an ERRNO if nothing could be read
+	OS_Error        RecvMany(RecvMsg* ioMsgs, size_t inNumMsgs, size_t* outNumMsgs);
+
+	// One outgoing datagram for SendMany
+	struct SendMsg
+	{
+		const void* fData;
+		size_t      fLen;
+		uint32_t    fRemoteAddr;
+		uint16_t    fRemotePort;
+	};
+
+	//Sends inNumMsgs datagrams with as few system calls as the platform allows.
+	//On Linux that is sendmmsg, and runs of equal sized datagrams going to the
+	//same destination are handed to the kernel as one UDP_SEGMENT (GSO) send
+	//where it supports that. outNumSent, if given, is how many actually went out.
+	//returns an ERRNO if any datagram couldn't be sent
+	OS_Error        SendMany(const SendMsg* inMsgs, size_t inNumMsgs, size_t* outNumSent = nullptr);
+
+	//Puts the datagram on this socket's send queue. The queue goes out
+	//through SendMany once it is full or when FlushSendQueue is called.
+	//The data is not copied: it has to stay put until the next flush.
+	//Returns EAGAIN, without queueing anything, if the socket buffer is
+	//still too full to take what is queued already.
+	//Thread safe.
+	OS_Error        QueueSendTo(uint32_t inRemoteAddr, uint16_t inRemotePort,
+		const char* inData, size_t inLen);
+	//Sends everything queued. Whatever the socket doesn't take is dropped, as
+	//it would be on the wire, and the error is returned; after an EAGAIN
+	//QueueSendTo keeps returning EAGAIN until the socket is writable again.
+	OS_Error        FlushSendQueue();
+
 private:
+	struct SendQueue
+	{
+		SendMsg     fMsgs[kMaxSendBatch];
+		size_t      fNumMsgs{ 0 };
+		bool        fBlocked{ false };  // the last flush ran into a full socket buffer
+	};
+
+	OS_Error        FlushSendQueueLocked();
+	// Whether the socket buffer has room again, without waiting
+	bool            IsWritable();
+
 	struct sockaddr_in  fMsgAddr;
+
+	// Allocated the first time something is queued; most sockets never are
+	std::mutex                  fSendMutex;
+	std::unique_ptr<SendQueue>  fSendQueue;
 };
 #endif // __UDPSOCKET_H__
 
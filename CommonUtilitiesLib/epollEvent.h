@@ -4,30 +4,31 @@
 	WEChat: EasyDarwin
 	Website: http://www.easydarwin.org
 	Author: Fantasy@EasyDarwin.org
-*/
-
-#ifndef _EPOLLEVENT_H__
-#define _EPOLLEVENT_H__
-#if defined(__linux__)
-#include <stdio.h>
-#include <unistd.h>
-#include <sys/epoll.h>
-#include <stdlib.h>
-#include <string.h>
-#include "common.h"
-
-int epollInit();
-
-int addEpollEvent(struct eventreq *req,int event);//event {EV_RD,EV_RM}
-
-int deleteEpollEvent(int& fd);
-
-int epollwaitevent();
-
-int epoll_waitevent(struct eventreq *req, void* onlyForMOSX);//stay the same with old event
-
-int epollDestory();
-#endif
-
-#endif
-
+*/
+
+#ifndef _EPOLLEVENT_H__
+#define _EPOLLEVENT_H__
+#if defined(__linux__)
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+
+int epollInit();
+
+//arm one EV_RE or EV_WR event on inFd (EPOLLONESHOT). inContext comes back in epoll_event.data.ptr
+int epollArmEvent(int inFd, int inEvent, void* inContext, bool inAlreadyAdded);
+
+int epollRemoveEvent(int inFd);
+
+//harvest up to inMaxEvents events; wakeup events come back with data.ptr == nullptr
+int epollWaitEvents(struct epoll_event* outEvents, int inMaxEvents, int inTimeoutMSec);
+
+void epollWakeup();
+
+int epollDestory();
+#endif
+
+#endif
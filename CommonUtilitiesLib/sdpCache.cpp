@@ -1,10 +1,71 @@
 #include "sdpCache.h"
+#include <atomic>
+#include <mutex>
 #include <unordered_map>
 #include <string>
+#include <boost/functional/hash.hpp>
 
 using namespace std;
 
-static unordered_map<string, string> sdpmap;
+struct SdpPathHash
+{
+	size_t operator()(boost::string_view inPath) const { return boost::hash_range(inPath.begin(), inPath.end()); }
+};
+
+// Keyed by the entry's own fPath, so a lookup needs no string of its own
+using SdpMap = unordered_map<boost::string_view, shared_ptr<const CSdpCache::SdpEntry>, SdpPathHash>;
+
+// Writers copy the map, change the copy and publish it, one at a time. That
+// copies a shared_ptr per announced stream on every ANNOUNCE, which is fine
+// as long as ANNOUNCEs are rare next to DESCRIBEs; a single map is kept for
+// the sake of one consistent snapshot rather than sharding it.
+//
+// std::atomic_load/atomic_store on a shared_ptr are not lock free: libstdc++
+// guards them with a small pool of mutexes picked by the shared_ptr's
+// address, so every reader of sdpmap would go through the same one. Readers
+// only pay for that once per change of the map instead: each thread keeps
+// the snapshot it took last, and takes a new one when sdpGeneration says the
+// map was replaced since.
+static shared_ptr<const SdpMap> sdpmap = make_shared<const SdpMap>();
+static atomic<uint64_t> sdpGeneration{ 1 };
+static mutex sdpmapMutex;
+static uint64_t sdpVersion = 0;
+
+template <typename Func>
+static void UpdateSdpMap(Func inFunc)
+{
+	lock_guard<mutex> lock(sdpmapMutex);
+	auto theNewMap = make_shared<SdpMap>(*atomic_load(&sdpmap));
+	if (inFunc(*theNewMap))
+	{
+		atomic_store(&sdpmap, shared_ptr<const SdpMap>(move(theNewMap)));
+		sdpGeneration.fetch_add(1, memory_order_release);
+	}
+}
+
+// Replaces whatever is at inEntry's path; the key has to go with it, as it
+// points into the entry it was made for
+static void PutSdpEntry(SdpMap &ioMap, shared_ptr<const CSdpCache::SdpEntry> inEntry)
+{
+	ioMap.erase(inEntry->fPath);
+	boost::string_view thePath(inEntry->fPath);
+	ioMap.emplace(thePath, move(inEntry));
+}
+
+static const SdpMap& GetSdpSnapshot()
+{
+	// Keeps the map it saw alive until this thread looks again
+	static thread_local shared_ptr<const SdpMap> sSnapshot;
+	static thread_local uint64_t sSnapshotGeneration = 0;
+
+	uint64_t theGeneration = sdpGeneration.load(memory_order_acquire);
+	if (theGeneration != sSnapshotGeneration)
+	{
+		sSnapshot = atomic_load(&sdpmap);
+		sSnapshotGeneration = theGeneration;
+	}
+	return *sSnapshot;
+}
 
 CSdpCache* CSdpCache::GetInstance()
 {
@@ -17,22 +78,52 @@ void CSdpCache::setSdpMap(boost::string_view path, boost::string_view context)
 	if (path.empty() || context.empty())
 		return;
 
-	sdpmap[string(path)] = string(context);
+	UpdateSdpMap([&](SdpMap &ioMap) {
+		auto theEntry = make_shared<SdpEntry>();
+		theEntry->fPath = string(path);
+		theEntry->fSDP = string(context);
+		theEntry->fVersion = ++sdpVersion;
+		PutSdpEntry(ioMap, move(theEntry));
+		return true;
+	});
 }
 
-boost::string_view CSdpCache::getSdpMap(boost::string_view path)
+string CSdpCache::getSdpMap(boost::string_view path)
 {
-	auto it = sdpmap.find(string(path));
-	if (it == sdpmap.end())
+	auto theEntry = getSdpEntry(path);
+	if (!theEntry)
 		return {};
 
+	return theEntry->fSDP;
+}
+
+shared_ptr<const CSdpCache::SdpEntry> CSdpCache::getSdpEntry(boost::string_view path)
+{
+	const SdpMap& theMap = GetSdpSnapshot();
+	auto it = theMap.find(path);
+	if (it == theMap.end())
+		return nullptr;
+
 	return it->second;
 }
 
+void CSdpCache::setDescribeSdp(boost::string_view path, uint64_t inVersion, shared_ptr<const string> inDescribeSDP)
+{
+	UpdateSdpMap([&](SdpMap &ioMap) {
+		auto it = ioMap.find(path);
+		if ((it == ioMap.end()) || (it->second->fVersion != inVersion))
+			return false;
+
+		auto theEntry = make_shared<SdpEntry>(*it->second);
+		theEntry->fDescribeSDP = move(inDescribeSDP);
+		PutSdpEntry(ioMap, move(theEntry));
+		return true;
+	});
+}
+
 void CSdpCache::eraseSdpMap(boost::string_view path)
 {
-	auto it = sdpmap.find(string(path));
-	if (it == sdpmap.end())
-		return;
-	sdpmap.erase(it);
+	UpdateSdpMap([&](SdpMap &ioMap) {
+		return ioMap.erase(path) != 0;
+	});
 }
\ No newline at end of file
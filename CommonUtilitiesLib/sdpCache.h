@@ -1,6 +1,9 @@
 #ifndef __SDPCACHE_H__
 #define __SDPCACHE_H__
 
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <boost/utility/string_view.hpp>
 
 class CSdpCache
@@ -10,12 +13,33 @@ private:
 public:
 	~CSdpCache() = default;
 
+	// An announced SDP. Entries are never changed once they are in the cache,
+	// a new ANNOUNCE replaces the entry with one of a newer version.
+	struct SdpEntry
+	{
+		std::string                         fPath;
+		std::string                         fSDP;
+		uint64_t                            fVersion{ 0 };
+		// The SDP as DESCRIBE sends it, if someone rendered it already
+		std::shared_ptr<const std::string>  fDescribeSDP;
+	};
+
 	static CSdpCache* GetInstance();
 
 	void setSdpMap(boost::string_view path, boost::string_view context);
 
-	boost::string_view getSdpMap(boost::string_view path);
+	// Returns a copy, as another thread may replace or erase the entry meanwhile
+	std::string getSdpMap(boost::string_view path);
+
+	// Readers work on a snapshot of the cache that writers replace as a whole.
+	// Only the first lookup on a thread after a change takes a lock, and
+	// none allocates. Returns nullptr if nothing was announced at path.
+	std::shared_ptr<const SdpEntry> getSdpEntry(boost::string_view path);
+
+	// Stores what DESCRIBE sends for version inVersion of the SDP at path.
+	// Does nothing if the SDP was announced again since.
+	void setDescribeSdp(boost::string_view path, uint64_t inVersion, std::shared_ptr<const std::string> inDescribeSDP);
 
 	void eraseSdpMap(boost::string_view path);
 };
-#endif
+#endif
\ No newline at end of file
@@ -150,9 +150,11 @@ std::string SDPSourceInfo::GetLocalSDP()
 
                 //now write the 'm' line, but strip off the port information
 				std::string mPrefix, mSuffix;
-				bool r = qi::phrase_parse(sdpLine.cbegin(), sdpLine.cend(),
+				// Not phrase_parse with qi::eoi as the skipper: that matches at the
+				// end of the line without moving and the skip never ends
+				bool r = qi::parse(sdpLine.cbegin(), sdpLine.cend(),
 					+(qi::char_ - qi::digit) >> qi::omit[qi::ushort_] >> +(qi::char_),
-					qi::eoi, mPrefix, mSuffix);
+					mPrefix, mSuffix);
                 localSDP += mPrefix + "0" + mSuffix + "\r\n";
                 trackIndex++;
                 break;
@@ -160,9 +162,9 @@ std::string SDPSourceInfo::GetLocalSDP()
             case 'a':
             {
 				std::string aLineType, rest;
-				bool r = qi::phrase_parse(sdpLine.cbegin(), sdpLine.cend(),
+				bool r = qi::parse(sdpLine.cbegin(), sdpLine.cend(),
 					qi::no_case["a="] >> +(qi::alpha) >> ":" >> +(qi::char_),
-					qi::eoi, aLineType, rest);
+					aLineType, rest);
                 if (aLineType == sControlStr)
                 {
 					uint32_t trackID;
@@ -280,9 +282,9 @@ void SDPSourceInfo::Parse(boost::string_view sdpData)
             case 'a':
             {
 				std::string aLineType, rest;
-				bool r = qi::phrase_parse(sdpLine.cbegin(), sdpLine.cend(),
+				bool r = qi::parse(sdpLine.cbegin(), sdpLine.cend(),
 					qi::no_case["a="] >> +(qi::alpha) >> ":" >> +(qi::char_),
-					qi::eoi, aLineType, rest);
+					aLineType, rest);
 
                 if (aLineType == sBroadcastControlStr)
                 {   
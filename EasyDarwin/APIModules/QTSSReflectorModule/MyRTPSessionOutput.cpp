@@ -0,0 +1,127 @@
+#include <boost/asio/post.hpp>
+#include <boost/asio/write.hpp>
+#include "MyRTPSessionOutput.h"
+#include "ServerMetrics.h"
+
+static ServerMetrics::Counter&    sEgressPackets = ServerMetrics::GetCounter("easydarwin_reflector_egress_packets_total", "Packets written to reflector outputs");
+static ServerMetrics::Counter&    sEgressBytes = ServerMetrics::GetCounter("easydarwin_reflector_egress_bytes_total", "Bytes written to reflector outputs");
+static ServerMetrics::Counter&    sDroppedPackets = ServerMetrics::GetCounter("easydarwin_session_output_dropped_packets_total", "Packets dropped for viewers too far behind");
+static ServerMetrics::Histogram&  sQueueDepth = ServerMetrics::GetHistogram("easydarwin_session_output_queue_packets", "Packets queued for a viewer ahead of a new one");
+
+MyRTPSessionOutput::MyRTPSessionOutput(std::shared_ptr<boost::asio::ip::tcp::socket> inSocket)
+	: fSocket(std::move(inSocket))
+{
+}
+
+bool MyRTPSessionOutput::WritePacket(const std::shared_ptr<MyReflectorPacket>& inPacket, uint8_t inChannel)
+{
+	size_t thePacketLen = inPacket->fPacket.size();
+	if ((thePacketLen == 0) || (thePacketLen > UINT16_MAX))
+		return false;
+
+	std::lock_guard<std::mutex> lock(fMutex);
+	if (fClosed || (fQueue.size() >= kMaxQueuedPackets))
+	{
+		fNumDroppedPackets++;
+		sDroppedPackets.Add();
+		return false;
+	}
+
+	sQueueDepth.Observe(fQueue.size());
+
+	Pending thePending;
+	thePending.fPacket = inPacket;
+	thePending.fHeader = { '$', (char)inChannel, (char)(thePacketLen >> 8), (char)(thePacketLen & 0xFF) };
+	fQueue.push_back(std::move(thePending));
+	this->ScheduleWrite();
+	return true;
+}
+
+void MyRTPSessionOutput::SendResponse(std::string inResponse)
+{
+	std::lock_guard<std::mutex> lock(fMutex);
+	if (fClosed)
+		return;
+
+	Pending thePending;
+	thePending.fResponse = std::move(inResponse);
+	fQueue.push_back(std::move(thePending));
+	this->ScheduleWrite();
+}
+
+void MyRTPSessionOutput::Close()
+{
+	std::lock_guard<std::mutex> lock(fMutex);
+	fClosed = true;
+	fQueue.clear();
+}
+
+void MyRTPSessionOutput::ScheduleWrite()
+{
+	if (fWriting)
+		return; // WriteDone picks up the queue
+
+	fWriting = true;
+	boost::asio::post(fSocket->get_executor(),
+		[self = shared_from_this()]() { self->WriteQueued(); });
+}
+
+void MyRTPSessionOutput::WriteQueued()
+{
+	{
+		std::lock_guard<std::mutex> lock(fMutex);
+		if (fQueue.empty())
+		{
+			fWriting = false;
+			return;
+		}
+		fInFlight.swap(fQueue);
+	}
+
+	// fInFlight doesn't change until the write is done, so the buffers can
+	// point into it
+	fBuffers.clear();
+	for (const Pending& thePending : fInFlight)
+	{
+		if (thePending.fPacket)
+		{
+			fBuffers.push_back(boost::asio::buffer(thePending.fHeader));
+			fBuffers.push_back(boost::asio::buffer(thePending.fPacket->fPacket));
+		}
+		else
+			fBuffers.push_back(boost::asio::buffer(thePending.fResponse));
+	}
+
+	boost::asio::async_write(*fSocket, fBuffers,
+		[self = shared_from_this()](const boost::system::error_code& error, std::size_t) { self->WriteDone(error); });
+}
+
+void MyRTPSessionOutput::WriteDone(const boost::system::error_code& inError)
+{
+	if (!inError)
+	{
+		uint64_t theNumPackets = 0, theNumBytes = 0;
+		for (const Pending& thePending : fInFlight)
+		{
+			if (thePending.fPacket)
+			{
+				theNumPackets++;
+				theNumBytes += thePending.fPacket->fPacket.size();
+			}
+		}
+		sEgressPackets.Add(theNumPackets);
+		sEgressBytes.Add(theNumBytes);
+	}
+
+	fInFlight.clear(); // gives the packets back
+	if (inError)
+	{
+		std::lock_guard<std::mutex> lock(fMutex);
+		fClosed = true;
+		fQueue.clear();
+		fWriting = false;
+		return;
+	}
+
+	this->WriteQueued();
+}
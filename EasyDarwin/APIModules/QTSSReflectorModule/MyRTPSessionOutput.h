@@ -0,0 +1,68 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include "MyReflectorPacket.h"
+#include "MyReflectorSender.h"
+
+// Writes the packets of a PLAY session to its RTSP connection, interleaved.
+// Packets are queued from the broadcaster's thread and written from the thread
+// owning the socket: whatever piled up while a write was in flight goes out in
+// the next async_write as one gather list, each packet as its 4 byte '$' header
+// followed by the shared packet buffer itself, so no viewer copies a packet.
+class MyRTPSessionOutput : public std::enable_shared_from_this<MyRTPSessionOutput>
+{
+public:
+	enum
+	{
+		// A new viewer of a video and an audio stream gets both their GOP
+		// caches at once, and needs room for live packets behind them. A
+		// viewer further behind than this loses packets.
+		kMaxQueuedPackets = 3 * MyReflectorSender::kMaxQueuedPackets
+	};
+
+	explicit MyRTPSessionOutput(std::shared_ptr<boost::asio::ip::tcp::socket> inSocket);
+	~MyRTPSessionOutput() = default;
+
+	// Returns false if the packet was dropped, because the viewer is too far
+	// behind or the output is closed
+	bool WritePacket(const std::shared_ptr<MyReflectorPacket>& inPacket, uint8_t inChannel);
+
+	// Once packets flow, RTSP responses have to be queued behind them, or they
+	// would interleave with a packet write in flight
+	void SendResponse(std::string inResponse);
+
+	// Drops everything queued; what is in flight completes
+	void Close();
+
+	uint64_t GetNumDroppedPackets() const { return fNumDroppedPackets; }
+
+private:
+	struct Pending
+	{
+		std::shared_ptr<MyReflectorPacket>  fPacket;
+		std::array<char, 4>                 fHeader;
+		std::string                         fResponse;  // if there's no packet
+	};
+
+	void ScheduleWrite();   // fMutex must be held
+	void WriteQueued();     // on the socket's thread
+	void WriteDone(const boost::system::error_code& inError);
+
+	std::shared_ptr<boost::asio::ip::tcp::socket>   fSocket;
+
+	std::mutex                  fMutex;
+	std::vector<Pending>        fQueue;
+	bool                        fWriting{ false };
+	bool                        fClosed{ false };
+	uint64_t                    fNumDroppedPackets{ 0 };
+
+	// Only touched by the socket's thread
+	std::vector<Pending>                    fInFlight;
+	std::vector<boost::asio::const_buffer>  fBuffers;
+};
@@ -1,23 +1,39 @@
 #pragma once
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <vector>
 class ReflectorSender;
+class ReflectorPacketRing;
 class ReflectorSocket;
 class RTPSessionOutput;
 
 class MyReflectorPacket
 {
 public:
+	MyReflectorPacket() = default;
 	MyReflectorPacket(const char *data, size_t len) : fPacket(data, data + len) {}
 	~MyReflectorPacket() = default;
 	bool  IsRTCP() { return fIsRTCP; }
+	// Copies the payload in; keeps the buffer's capacity so recycled ring slots don't allocate
+	void  SetPacketData(const char *data, size_t len) { fPacket.assign(data, data + len); }
+	// When the packet came in, and how many bytes its sender took in before it
+	void  SetArrival(std::chrono::high_resolution_clock::time_point inTime, uint64_t inStreamByteOffset)
+	{
+		fTimeArrived = inTime;
+		fStreamByteOffset = inStreamByteOffset;
+	}
 private:
 	std::chrono::high_resolution_clock::time_point fTimeArrived;
 	std::vector<char> fPacket;
 	bool      fIsRTCP{ false };
 	bool      fNeededByOutput{ false }; // is this packet still needed for output?
 	uint64_t  fStreamCountID{ 0 };
+	uint64_t  fStreamByteOffset{ 0 }; // bytes the sender took in before this packet
+
+	// Only used when the packet lives in a ReflectorPacketRing
+	std::atomic<uint32_t> fRefCount{ 0 };
+	std::atomic<uint64_t> fRingSeq{ 0 }; // monotonically increasing index into the ring
 
 	friend bool IsKeyFrameFirstPacket(const MyReflectorPacket &thePacket);
 	friend class ReflectorSender;
@@ -25,9 +41,14 @@ private:
 	friend class ReflectorSocket;
 	friend class RTPSessionOutput;
 	friend class MyReflectorSocket;
+	friend class MyReflectorStream;
+	friend class MyRTPSessionOutput;
+	friend class ReflectorPacketRing;
+	friend class ReflectorGOPCache;
+	friend class ReflectorRetention;
 };
 
-static inline bool IsKeyFrameFirstPacket(const MyReflectorPacket &thePacket)
+inline bool IsKeyFrameFirstPacket(const MyReflectorPacket &thePacket)
 {
 	if (thePacket.fPacket.size() < 20) return false;
 
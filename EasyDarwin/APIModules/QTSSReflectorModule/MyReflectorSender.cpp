@@ -28,18 +28,16 @@ MyReflectorSender::MyReflectorSender(MyReflectorStream* inStream, uint32_t inWri
 {
 }
 
-void MyReflectorSender::appendPacket(std::unique_ptr<MyReflectorPacket> thePacket)
+void MyReflectorSender::appendPacket(std::shared_ptr<MyReflectorPacket> thePacket)
 {
 	if (!thePacket->IsRTCP())
 	{
 		auto type = needToUpdateKeyFrame(fStream, *thePacket);
-		if (needToUpdateKeyFrame(fStream, *thePacket) != KeyFrameType::None)
+		if (type != KeyFrameType::None)
 		{
-			if (fKeyFrameStartPacketElementPointer)
-				fKeyFrameStartPacketElementPointer->fNeededByOutput = false;
-
+			// A new output can start from here, nothing before is needed anymore
+			fPacketQueue.clear();
 			thePacket->fNeededByOutput = true;
-			fKeyFrameStartPacketElementPointer = thePacket.get();
 			if (type == KeyFrameType::Video)
 				fStream->GetMyReflectorSession()->SetHasVideoKeyFrameUpdate(true);
 			else
@@ -55,7 +53,13 @@ void MyReflectorSender::appendPacket(std::unique_ptr<MyReflectorPacket> thePacke
 		// Because this is an RTP packet make sure to atomic add this because
 		// multiple sockets can be adding to this variable simultaneously
 		fStream->fBytesSentInThisInterval += thePacket->fPacket.size();
+
+		// Sender reports are only good for the moment they are sent, so only
+		// RTP packets are kept for the outputs added later
+		fPacketQueue.push_back(thePacket);
+		if (fPacketQueue.size() > kMaxQueuedPackets)
+			fPacketQueue.pop_front();
 	}
 
-	fPacketQueue.push_back(std::move(thePacket));
-}
+	fStream->SendPacketToOutputs(thePacket);
+}
\ No newline at end of file
@@ -7,14 +7,22 @@ class MyReflectorStream;
 class MyReflectorPacket;
 class MyReflectorSender
 {
+public:
+	enum
+	{
+		kMaxQueuedPackets = 4096    // bounds a GOP that never ends
+	};
+
+private:
 	MyReflectorStream*    fStream;
 	uint32_t              fWriteFlag;
-	std::list<std::unique_ptr<MyReflectorPacket>> fPacketQueue;
-	MyReflectorPacket*	fKeyFrameStartPacketElementPointer{ nullptr };
+	// The packets since the last key frame, for the outputs added later
+	std::list<std::shared_ptr<MyReflectorPacket>> fPacketQueue;
 	bool fHasNewPackets{ false };
 	friend class MyReflectorSocket;
+	friend class MyReflectorStream;
 public:
 	MyReflectorSender(MyReflectorStream* inStream, uint32_t inWriteFlag);
 	~MyReflectorSender() = default;
-	void appendPacket(std::unique_ptr<MyReflectorPacket> thePacket);
+	void appendPacket(std::shared_ptr<MyReflectorPacket> thePacket);
 };
\ No newline at end of file
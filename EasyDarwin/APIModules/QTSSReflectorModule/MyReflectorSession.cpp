@@ -17,7 +17,17 @@ void MyReflectorSession::AddBroadcasterClientSession(MyRTPSession* inClientSessi
 	}
 }
 
-QTSS_Error MyReflectorSession::SetupReflectorSession(MyRTSPRequest &inRequest, MyRTPSession &inSession, uint32_t inFlags, bool filterState, uint32_t filterTimeout)
+MyReflectorStream* MyReflectorSession::GetStreamByTrackID(uint32_t inTrackID)
+{
+	for (auto &stream : fStreamArray)
+	{
+		if (stream && (stream->GetStreamInfo()->fTrackID == inTrackID))
+			return stream.get();
+	}
+	return nullptr;
+}
+
+QTSS_Error MyReflectorSession::SetupReflectorSession(MyRTSPRequest &inRequest, uint32_t inFlags, bool filterState, uint32_t filterTimeout)
 {
 	// this must be set to the new SDP.
 	fLocalSDP = fSourceInfo.GetLocalSDP();
@@ -31,7 +41,7 @@ QTSS_Error MyReflectorSession::SetupReflectorSession(MyRTSPRequest &inRequest, M
 		// If that happens, we'll just abort here, which will leave the ReflectorStream
 		// array in an inconsistent state, so we need to make sure in our cleanup
 		// code to check for NULL.
-		QTSS_Error theError = fStreamArray[x]->BindSockets(inRequest, inSession, inFlags, filterState, filterTimeout);
+		QTSS_Error theError = fStreamArray[x]->BindSockets(inRequest, inFlags, filterState, filterTimeout);
 		if (theError != QTSS_NoErr)
 		{
 			fStreamArray[x] = nullptr;
@@ -27,11 +27,14 @@ public:
 		kIsPushSession = 4  // When setting up streams handle port conflicts by allocating.
 	};
 	MyReflectorSession(boost::string_view inSourceID, const SDPSourceInfo &inInfo);
-	QTSS_Error SetupReflectorSession(MyRTSPRequest &inRequest, MyRTPSession &inSession,
+	QTSS_Error SetupReflectorSession(MyRTSPRequest &inRequest,
 		uint32_t inFlags = kMarkSetup, bool filterState = true, uint32_t filterTimeout = 30);
 	void AddBroadcasterClientSession(MyRTPSession* inClientSession);
 	const SDPSourceInfo& GetSourceInfo() const { return fSourceInfo; }
 	MyReflectorStream& GetStreamByIndex(uint32_t inIndex) { return *fStreamArray[inIndex]; }
+	MyReflectorStream* GetStreamByTrackID(uint32_t inTrackID);
+	const std::string& GetLocalSDP() const { return fLocalSDP; }
+	const std::string& GetStreamName() const { return fSessionName; }
 	bool HasVideoKeyFrameUpdate() { return fHasVideoKeyFrameUpdate; }
 	void SetHasVideoKeyFrameUpdate(bool indexUpdate) { fHasVideoKeyFrameUpdate = indexUpdate; }
 };
\ No newline at end of file
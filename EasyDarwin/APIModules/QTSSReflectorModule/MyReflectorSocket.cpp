@@ -9,15 +9,14 @@
 
 void MyReflectorSocket::AddSender(MyReflectorSender* inSender)
 {
-	Assert(true == fDemuxer.RegisterTask(
-	{ inSender->fStream->fStreamInfo.fSrcIPAddr, 0 }, inSender));
+	bool registered = fDemuxer.RegisterTask(
+	{ inSender->fStream->fStreamInfo.fSrcIPAddr, 0 }, inSender);
+	Assert(registered);
 	fSenderQueue.push_back(inSender);
 }
 
 bool MyReflectorSocket::ProcessPacket(time_point now, std::unique_ptr<MyReflectorPacket> thePacket, uint32_t theRemoteAddr, uint16_t theRemotePort)
 {
-	thePacket->fIsRTCP = false;
-
 	static constexpr auto kRefreshBroadcastSessionInterval = std::chrono::milliseconds(10000);
 	if (fBroadcasterClientSession != nullptr) // alway refresh timeout even if we are filtering.
 	{
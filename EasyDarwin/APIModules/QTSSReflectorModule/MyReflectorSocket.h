@@ -4,6 +4,7 @@
 #include <memory>
 #include "MyReflectorPacket.h"
 #include "UDPSocketPool.h"
+#include "CowUnorderMap.h"
 class MyRTPSession;
 class MyReflectorSender;
 class MyReflectorSocket {
@@ -12,7 +13,7 @@ class MyReflectorSocket {
 	uint32_t  fTimeoutSecs{ 30 };
 	MyRTPSession* fBroadcasterClientSession{ nullptr };
 	time_point fLastBroadcasterTimeOutRefresh;
-	SyncUnorderMap<MyReflectorSender*> fDemuxer;
+	CowUnorderMap<MyReflectorSender*> fDemuxer;
 	std::list<MyReflectorSender*> fSenderQueue;
 public:
 	MyReflectorSocket() = default;
@@ -1,8 +1,14 @@
+#include <algorithm>
 #include "MyReflectorStream.h"
 #include "MyRTSPRequest.h"
 #include "MyReflectorSession.h"
 #include "ReflectorStream.h"
 #include "MyReflectorSocket.h"
+#include "MyRTPSessionOutput.h"
+#include "ServerMetrics.h"
+
+static ServerMetrics::Counter&    sIngestPackets = ServerMetrics::GetCounter("easydarwin_reflector_ingest_packets_total", "Packets received by the reflector");
+static ServerMetrics::Counter&    sIngestBytes = ServerMetrics::GetCounter("easydarwin_reflector_ingest_bytes_total", "Bytes received by the reflector");
 
 MyReflectorStream::MyReflectorStream(StreamInfo* inInfo)
 	: fStreamInfo(*inInfo),
@@ -11,7 +17,9 @@ MyReflectorStream::MyReflectorStream(StreamInfo* inInfo)
 {
 }
 
-QTSS_Error MyReflectorStream::BindSockets(MyRTSPRequest &inRequest, MyRTPSession &inSession, uint32_t inReflectorSessionFlags, bool filterState, uint32_t timeout)
+MyReflectorStream::~MyReflectorStream() = default;
+
+QTSS_Error MyReflectorStream::BindSockets(MyRTSPRequest &inRequest, uint32_t inReflectorSessionFlags, bool filterState, uint32_t timeout)
 {
 	// If the incoming data is RTSP interleaved, we don't need to do anything here
 	if (inReflectorSessionFlags & MyReflectorSession::kIsPushSession)
@@ -28,10 +36,12 @@ QTSS_Error MyReflectorStream::BindSockets(MyRTSPRequest &inRequest, MyRTPSession
 
 	if (qtssRTPTransportTypeTCP == fTransportType)
 	{
-		fSockets = new SocketPair<MyReflectorSocket>();
+		fSockets = std::make_unique<SocketPair<MyReflectorSocket>>();
 	}
 	else
 	{
+		// Only interleaved broadcasts so far
+		return QTSS_Unimplemented;
 	}
 
 	//also put this stream onto the socket's queue of streams
@@ -54,7 +64,13 @@ void MyReflectorStream::PushPacket(const char *packet, size_t packetLen, bool is
 {
 	if (packetLen > 0)
 	{
+		sIngestPackets.Add();
+		sIngestBytes.Add(packetLen);
+
 		auto thePacket = std::make_unique<MyReflectorPacket>(packet, packetLen);
+		thePacket->fIsRTCP = isRTCP;
+
+		std::lock_guard<std::mutex> lock(fOutputMutex);
 		if (isRTCP)
 		{
 			//printf("ReflectorStream::PushPacket RTCP packetlen = %"   _U32BITARG_   "\n",packetLen);
@@ -65,4 +81,28 @@ void MyReflectorStream::PushPacket(const char *packet, size_t packetLen, bool is
 			fSockets->GetSocketA()->ProcessPacket(std::chrono::high_resolution_clock::now(), std::move(thePacket), 0, 0);
 		}
 	}
+}
+
+void MyReflectorStream::SendPacketToOutputs(const std::shared_ptr<MyReflectorPacket>& thePacket)
+{
+	for (const auto &theOutput : fOutputs)
+	{
+		uint8_t theChannel = theOutput.fRTPChannel + (thePacket->IsRTCP() ? 1 : 0);
+		theOutput.fOutput->WritePacket(thePacket, theChannel);
+	}
+}
+
+void MyReflectorStream::AddOutput(std::shared_ptr<MyRTPSessionOutput> inOutput, uint8_t inRTPChannel)
+{
+	std::lock_guard<std::mutex> lock(fOutputMutex);
+	for (const auto &thePacket : fRTPSender.fPacketQueue)
+		inOutput->WritePacket(thePacket, inRTPChannel);
+	fOutputs.push_back({ std::move(inOutput), inRTPChannel });
+}
+
+void MyReflectorStream::RemoveOutput(const MyRTPSessionOutput* inOutput)
+{
+	std::lock_guard<std::mutex> lock(fOutputMutex);
+	fOutputs.erase(std::remove_if(fOutputs.begin(), fOutputs.end(),
+		[inOutput](const Output &theOutput) { return theOutput.fOutput.get() == inOutput; }), fOutputs.end());
 }
\ No newline at end of file
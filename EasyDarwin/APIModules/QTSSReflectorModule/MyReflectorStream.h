@@ -1,39 +1,58 @@
 #pragma once
 #include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "SDPSourceInfo.h"
 #include "MyReflectorSender.h"
 #include "UDPSocketPool.h"
 
 class MyRTSPRequest;
-class MyRTPSession;
 class MyReflectorSession;
 class MyReflectorSocket;
+class MyRTPSessionOutput;
 
 class MyReflectorStream {
 	// All the necessary info about this stream
 	StreamInfo  fStreamInfo;
-	MyReflectorSession*	fMyReflectorSession;
+	MyReflectorSession*	fMyReflectorSession{ nullptr };
 	bool fEnableBuffer{ false };
-	SocketPair<MyReflectorSocket>*      fSockets;
+	std::unique_ptr<SocketPair<MyReflectorSocket>> fSockets;
 	QTSS_RTPTransportType fTransportType{ qtssRTPTransportTypeTCP };
 	MyReflectorSender     fRTPSender;
 	MyReflectorSender     fRTCPSender;
 	std::atomic_size_t fBytesSentInThisInterval{ 0 };
-	uint64_t                  fPacketCount;
+	uint64_t                  fPacketCount{ 0 };
+
+	struct Output
+	{
+		std::shared_ptr<MyRTPSessionOutput> fOutput;
+		uint8_t                             fRTPChannel; // RTCP goes on the one after
+	};
+	// Guards the outputs and the packets of the senders, packets are pushed
+	// by the broadcaster's thread, outputs come and go on the viewers' threads
+	std::mutex          fOutputMutex;
+	std::vector<Output> fOutputs;
+
+	void SendPacketToOutputs(const std::shared_ptr<MyReflectorPacket>& thePacket);
 	friend class MyReflectorSender;
 	friend class MyReflectorSocket;
 public:
 	MyReflectorStream(StreamInfo* inInfo);
-	~MyReflectorStream() = default;
-	// Call this to initialize the reflector sockets. Uses the QTSS_RTSPRequestObject
-	// if provided to report any errors that occur 
-	// Passes the QTSS_ClientSessionObject to the socket so the socket can update the session if needed.
-	QTSS_Error BindSockets(MyRTSPRequest &inRequest, MyRTPSession &inSession, uint32_t inReflectorSessionFlags, bool filterState, uint32_t timeout);
+	~MyReflectorStream();
+	// Call this to initialize the reflector sockets. Takes the transport of the
+	// broadcast from the request's SETUP.
+	QTSS_Error BindSockets(MyRTSPRequest &inRequest, uint32_t inReflectorSessionFlags, bool filterState, uint32_t timeout);
 	void SetMyReflectorSession(MyReflectorSession* reflector) { fMyReflectorSession = reflector; }
 	StreamInfo* GetStreamInfo() { return &fStreamInfo; }
 	void SetEnableBuffer(bool enableBuffer) { fEnableBuffer = enableBuffer; }
-	SocketPair<MyReflectorSocket>* GetSocketPair() { return fSockets; }
+	SocketPair<MyReflectorSocket>* GetSocketPair() { return fSockets.get(); }
 	void PushPacket(const char *packet, size_t packetLen, bool isRTCP);
+
+	// The output gets the packets since the last key frame first, then every
+	// packet as it comes in, interleaved on inRTPChannel and the one after
+	void AddOutput(std::shared_ptr<MyRTPSessionOutput> inOutput, uint8_t inRTPChannel);
+	void RemoveOutput(const MyRTPSessionOutput* inOutput);
 	const StreamInfo& GetStreamInfo() const { return fStreamInfo; }
 	MyReflectorSession* GetMyReflectorSession() { return fMyReflectorSession; }
 };
\ No newline at end of file
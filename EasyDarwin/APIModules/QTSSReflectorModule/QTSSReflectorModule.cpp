@@ -33,6 +33,7 @@
 #include "QTSServerInterface.h"
 #include "QTSSReflectorModule.h"
 #include "ReflectorSession.h"
+#include "ReflectorStreamLocks.h"
 #include "OSRef.h"
 #include "OS.h"
 #include "ResizeableStringFormatter.h"
@@ -64,11 +65,8 @@ namespace qi = boost::spirit::qi;
 #define REFLECTOR_MODULE_DEBUGGING 0
 #endif
 
-static boost::string_view       sBroadcasterSessionName = "QTSSReflectorModuleBroadcasterSession";
-static boost::string_view       sStreamCookieName = "QTSSReflectorModuleStreamCookie";
+// The reflector's own attributes are registered in ReflectorAttributes.h
 static boost::string_view       sRTPInfoWaitTime = "QTSSReflectorModuleRTPInfoWaitTime";
-static boost::string_view       sOutputName = "QTSSReflectorModuleOutput";
-static boost::string_view       sKillClientsEnabledName = "QTSSReflectorModuleTearDownClients";
 
 //static boost::string_view       sSessionName = "QTSSReflectorModuleSession";
 
@@ -78,6 +76,13 @@ static boost::string_view       sKillClientsEnabledName = "QTSSReflectorModuleTe
 static OSRefTable*      sSessionMap = nullptr;
 static QTSServerInterface* sServer = nullptr;
 
+// Finding or creating a stream's ReflectorSession, and deciding nobody uses it
+// any more, must not interleave. That is serialized per stream name, so requests
+// for different streams only meet when their names share a stripe; see
+// ReflectorStreamLocks.h for how often that happens.
+static const uint32_t   kNumStreamLocks = 1024;
+static ReflectorStreamLocks sStreamLocks(kNumStreamLocks);
+
 //
 // Prefs
 static bool   sDefaultAllowNonSDPURLs = true;
@@ -143,6 +148,9 @@ static boost::string_view    sTheNowRangeHeader("npt=now-");
 
 // FUNCTION PROTOTYPES
 
+static OSMutex* GetStreamLock(boost::string_view inStreamName);
+static void ReleaseSession(ReflectorSession* inSession);
+
 static QTSS_Error Shutdown();
 static QTSS_Error DoAnnounce(QTSS_StandardRTSP_Params& inParams);
 static QTSS_Error DoDescribe(QTSS_StandardRTSP_Params& inParams);
@@ -184,7 +192,6 @@ namespace ReflectionModule
 
 	QTSS_Error ProcessRTSPRequest(QTSS_StandardRTSP_Params& inParams)
 	{
-		OSMutexLocker locker(sSessionMap->GetMutex());
 		QTSS_RTSPMethod theMethod = inParams.inRTSPRequest->GetMethod();
 
 		if (theMethod == qtssAnnounceMethod)
@@ -194,7 +201,7 @@ namespace ReflectionModule
 		if (theMethod == qtssSetupMethod)
 			return DoSetup(inParams);
 
-		auto opt = inParams.inClientSession->getAttribute(sOutputName);
+		auto opt = inParams.inClientSession->getAttribute(ReflectorAttr::kOutput);
 		if (!opt) // a broadcaster push session
 		{
 			if (theMethod == qtssPlayMethod || theMethod == qtssRecordMethod)
@@ -203,7 +210,7 @@ namespace ReflectionModule
 				return QTSS_RequestFailed;
 		}
 
-		RTPSessionOutput* theOutput = boost::any_cast<RTPSessionOutput*>(opt.value());
+		RTPSessionOutput* theOutput = opt.value();
 		switch (theMethod)
 		{
 		case qtssPlayMethod:
@@ -227,9 +234,9 @@ namespace ReflectionModule
 	{
 		//printf("QTSSReflectorModule:ProcessRTPData inRTSPSession=%"   _U32BITARG_   " inClientSession=%"   _U32BITARG_   "\n",inParams->inRTSPSession, inParams->inClientSession);
 
-		boost::optional<boost::any> attr = inParams->inRTSPSession->getAttribute(sBroadcasterSessionName);
+		boost::optional<ReflectorSession*> attr = inParams->inRTSPSession->getAttribute(ReflectorAttr::kBroadcasterSession);
 		if (!attr) return QTSS_NoErr;
-		ReflectorSession* theSession = boost::any_cast<ReflectorSession *>(attr.value());
+		ReflectorSession* theSession = attr.value();
 		//printf("QTSSReflectorModule.cpp:ProcessRTPData    sClientBroadcastSessionAttr=%"   _U32BITARG_   " theSession=%"   _U32BITARG_   " err=%" _S32BITARG_ " \n",sClientBroadcastSessionAttr, theSession,theErr);
 
 		// it is a broadcaster session
@@ -297,14 +304,13 @@ namespace ReflectionModule
 		ReflectorOutput*    outputPtr = nullptr;
 		ReflectorSession*   theSession = nullptr;
 
-		OSMutexLocker locker(sSessionMap->GetMutex());
-
-		auto opt = inParams->inClientSession->getAttribute(sBroadcasterSessionName);
+		auto opt = inParams->inClientSession->getAttribute(ReflectorAttr::kBroadcasterSession);
 		//printf("QTSSReflectorModule.cpp:DestroySession    sClientBroadcastSessionAttr=%"   _U32BITARG_   " theSession=%"   _U32BITARG_   " err=%" _S32BITARG_ " \n",(uint32_t)sClientBroadcastSessionAttr, (uint32_t)theSession,theErr);
 
 		if (opt)
 		{
-			inParams->inClientSession->removeAttribute(sBroadcasterSessionName);
+			theSession = opt.value();
+			inParams->inClientSession->removeAttribute(ReflectorAttr::kBroadcasterSession);
 
 			SDPSourceInfo& theSoureInfo = theSession->GetSourceInfo();
 
@@ -318,8 +324,8 @@ namespace ReflectionModule
 					theStreamInfo->fSetupToReceive = false;
 			}
 
-			auto opt = inParams->inClientSession->getAttribute(sKillClientsEnabledName);
-			bool killClients = boost::any_cast<bool>(opt.value()); // the pref as the default
+			bool killClients = inParams->inClientSession->getAttribute(ReflectorAttr::kTearDownClients)
+				.value_or(sDefaultTearDownClientsOnDisconnect); // the pref as the default
 																   //printf("QTSSReflectorModule.cpp:DestroySession broadcaster theSession=%"   _U32BITARG_   "\n", (uint32_t) theSession);
 			theSession->RemoveSessionFromOutput();
 
@@ -327,10 +333,10 @@ namespace ReflectionModule
 		}
 		else // ͻ
 		{
-			auto opt = inParams->inClientSession->getAttribute(sOutputName);
+			auto opt = inParams->inClientSession->getAttribute(ReflectorAttr::kOutput);
 			if (!opt)
 				return QTSS_RequestFailed;
-			RTPSessionOutput* theOutput = boost::any_cast<RTPSessionOutput*>(opt.value());
+			RTPSessionOutput* theOutput = opt.value();
 			theSession = theOutput->GetReflectorSession();
 
 			if (theOutput != nullptr)
@@ -339,7 +345,7 @@ namespace ReflectionModule
 			if (outputPtr != nullptr)
 			{
 				RemoveOutput(outputPtr, theSession, false);
-				inParams->inClientSession->removeAttribute(sOutputName);
+				inParams->inClientSession->removeAttribute(ReflectorAttr::kOutput);
 			}
 
 		}
@@ -348,6 +354,19 @@ namespace ReflectionModule
 	}
 }
 
+static OSMutex* GetStreamLock(boost::string_view inStreamName)
+{
+	return sStreamLocks.GetLock(inStreamName);
+}
+
+// RemoveOutput decides whether a session goes away from its ref count with
+// the stream lock held, so every Release has to happen under it too
+static void ReleaseSession(ReflectorSession* inSession)
+{
+	OSMutexLocker locker(GetStreamLock(inSession->GetStreamName()));
+	sSessionMap->Release(inSession->GetRef());
+}
+
 static ReflectorSession* DoSessionSetup(QTSS_StandardRTSP_Params &inParams, bool isPush, bool *foundSessionPtr, std::string* resultFilePath)
 {
 	std::string theFullPath = inParams.inRTSPRequest->GetFileName();
@@ -434,7 +453,10 @@ QTSS_Error DoAnnounce(QTSS_StandardRTSP_Params& inParams)
 	// sortedSDP.GetSessionHeaders()->PrintStrEOL();
 	// sortedSDP.GetMediaHeaders()->PrintStrEOL();
 
-	CSdpCache::GetInstance()->setSdpMap(theStreamName, sortedSDP);
+	{
+		OSMutexLocker locker(GetStreamLock(theStreamName));
+		CSdpCache::GetInstance()->setSdpMap(theStreamName, sortedSDP);
+	}
 
 
 	//printf("QTSSReflectorModule:DoAnnounce SendResponse OK=200\n");
@@ -452,15 +474,15 @@ QTSS_Error DoDescribe(QTSS_StandardRTSP_Params& inParams)
 		return QTSS_RequestFailed;
 
 	uint32_t theLen = 0;
-	auto opt = inParams.inClientSession->getAttribute(sOutputName);
+	auto opt = inParams.inClientSession->getAttribute(ReflectorAttr::kOutput);
 
 	// If there already  was an RTPSessionOutput attached to this Client Session,
 	// destroy it. 
 	if (opt)
 	{
-		RTPSessionOutput* theOutput = boost::any_cast<RTPSessionOutput*>(opt.value());
+		RTPSessionOutput* theOutput = opt.value();
 		RemoveOutput(theOutput, theOutput->GetReflectorSession(), false);
-		inParams.inClientSession->removeAttribute(sOutputName);
+		inParams.inClientSession->removeAttribute(ReflectorAttr::kOutput);
 	}
 	// send the DESCRIBE response
 
@@ -469,43 +491,57 @@ QTSS_Error DoDescribe(QTSS_StandardRTSP_Params& inParams)
 
 	Assert(!theSession->GetLocalSDP().empty());
 
-	boost::string_view theFileData = CSdpCache::GetInstance()->getSdpMap(theFileName);
+	// The SDP is only processed for the first DESCRIBE after an ANNOUNCE,
+	// the cache keeps the result until the next one
+	std::shared_ptr<const CSdpCache::SdpEntry> theEntry = CSdpCache::GetInstance()->getSdpEntry(theFileName);
+	std::shared_ptr<const std::string> theDescribeSDP;
+	if (theEntry)
+		theDescribeSDP = theEntry->fDescribeSDP;
 
-	// -------------- process SDP to remove connection info and add track IDs, port info, and default c= line
+	if (!theDescribeSDP)
+	{
+		// -------------- process SDP to remove connection info and add track IDs, port info, and default c= line
 
-	SDPSourceInfo tempSDPSourceInfo(theFileData); // will make a copy and delete in destructor
-	std::string theSDPData = tempSDPSourceInfo.GetLocalSDP(); // returns a new buffer with processed sdp
+		std::string theSDPData;
+		if (theEntry)
+		{
+			SDPSourceInfo tempSDPSourceInfo(theEntry->fSDP); // will make a copy and delete in destructor
+			theSDPData = tempSDPSourceInfo.GetLocalSDP(); // returns a new buffer with processed sdp
+		}
 
-	if (theSDPData.empty()) // can't find it on disk or it failed to parse just use the one in the session.
-		theSDPData = std::string(theSession->GetLocalSDP());
+		if (theSDPData.empty()) // can't find it on disk or it failed to parse just use the one in the session.
+			theSDPData = std::string(theSession->GetLocalSDP());
 
 
-	// ------------  Clean up missing required SDP lines
+		// ------------  Clean up missing required SDP lines
 
-	std::string editedSDP(theSDPData);
+		std::string editedSDP(theSDPData);
 
-	// ------------ Check the headers
+		// ------------ Check the headers
 
-	SDPContainer checkedSDPContainer(editedSDP);
-	if (!checkedSDPContainer.Parse())
-	{
-		sSessionMap->Release(theSession->GetRef());
+		SDPContainer checkedSDPContainer(editedSDP);
+		if (!checkedSDPContainer.Parse())
+		{
+			ReleaseSession(theSession);
 
-		return inParams.inRTSPRequest->SendErrorResponseWithMessage(qtssUnsupportedMediaType);
-	}
+			return inParams.inRTSPRequest->SendErrorResponseWithMessage(qtssUnsupportedMediaType);
+		}
 
 
-	// ------------ Put SDP header lines in correct order
-	auto sortedSDP = SortSDPLine(checkedSDPContainer);
+		// ------------ Put SDP header lines in correct order
+		theDescribeSDP = std::make_shared<const std::string>(SortSDPLine(checkedSDPContainer));
+		if (theEntry)
+			CSdpCache::GetInstance()->setDescribeSdp(theFileName, theEntry->fVersion, theDescribeSDP);
+	}
 
 	// ------------ Write the SDP 
 
-	theDescribeVec[1].iov_base = const_cast<char *>(sortedSDP.data());
-	theDescribeVec[1].iov_len = sortedSDP.length();
+	theDescribeVec[1].iov_base = const_cast<char *>(theDescribeSDP->data());
+	theDescribeVec[1].iov_len = theDescribeSDP->length();
 
-	inParams.inRTSPRequest->SendDescribeResponse(&theDescribeVec[0], 2, sortedSDP.length());
+	inParams.inRTSPRequest->SendDescribeResponse(&theDescribeVec[0], 2, theDescribeSDP->length());
 
-	sSessionMap->Release(theSession->GetRef());
+	ReleaseSession(theSession);
 
 #ifdef REFLECTORSESSION_DEBUG
 	printf("QTSSReflectorModule.cpp:DoDescribe Session =%p refcount=%"   _U32BITARG_   "\n", theSession->GetRef(), theSession->GetRef()->GetRefCount());
@@ -516,7 +552,7 @@ QTSS_Error DoDescribe(QTSS_StandardRTSP_Params& inParams)
 
 ReflectorSession* FindOrCreateSession(boost::string_view inName, QTSS_StandardRTSP_Params &inParams, bool isPush, bool *foundSessionPtr)
 {
-	OSMutexLocker locker(sSessionMap->GetMutex());
+	OSMutexLocker locker(GetStreamLock(inName));
 
 	std::string theStreamName(inName);
 
@@ -532,7 +568,7 @@ ReflectorSession* FindOrCreateSession(boost::string_view inName, QTSS_StandardRT
 			return nullptr;
 		}
 
-		boost::string_view theFileData = CSdpCache::GetInstance()->getSdpMap(theStreamName);
+		std::string theFileData = CSdpCache::GetInstance()->getSdpMap(theStreamName);
 
 		if (theFileData.empty())
 			return nullptr;
@@ -585,7 +621,7 @@ ReflectorSession* FindOrCreateSession(boost::string_view inName, QTSS_StandardRT
 			if (foundSessionPtr)
 				*foundSessionPtr = true;
 
-			boost::string_view theFileData = CSdpCache::GetInstance()->getSdpMap(theStreamName);
+			std::string theFileData = CSdpCache::GetInstance()->getSdpMap(theStreamName);
 
 			if (theFileData.empty())
 				break;
@@ -615,10 +651,12 @@ ReflectorSession* FindOrCreateSession(boost::string_view inName, QTSS_StandardRT
 // ONLY call when performing a setup.
 void DeleteReflectorPushSession(QTSS_StandardRTSP_Params& inParams, ReflectorSession* theSession, bool foundSession)
 {
-	if(theSession)
-		sSessionMap->Release(theSession->GetRef());
+	Assert(theSession != nullptr);
+	OSMutexLocker locker(GetStreamLock(theSession->GetStreamName()));
 
-	inParams.inClientSession->removeAttribute(sBroadcasterSessionName);
+	sSessionMap->Release(theSession->GetRef());
+
+	inParams.inClientSession->removeAttribute(ReflectorAttr::kBroadcasterSession);
 
 	if (foundSession)
 		return; // we didn't allocate the session so don't delete
@@ -627,7 +665,11 @@ void DeleteReflectorPushSession(QTSS_StandardRTSP_Params& inParams, ReflectorSes
 	if (theSessionRef != nullptr)
 	{
 		theSession->TearDownAllOutputs(); // just to be sure because we are about to delete the session.
-		sSessionMap->UnRegister(theSessionRef);// we had an error while setting up-- don't let anyone get the session
+
+		// Don't wait here for the others to let go: they Release under this
+		// stream lock, and the last of them (in RemoveOutput) retires the session
+		if (!sSessionMap->TryUnRegister(theSessionRef))// we had an error while setting up-- don't let anyone get the session
+			return;
 		//delete theSession;
 		CSdpCache::GetInstance()->eraseSdpMap(theSession->GetStreamName());
 		theSession->StopTimer();
@@ -669,7 +711,7 @@ QTSS_Error DoSetup(QTSS_StandardRTSP_Params &inParams)
 	bool isPush = inParams.inRTSPRequest->IsPushRequest();
 	bool foundSession = false;
 
-	auto opt = inParams.inClientSession->getAttribute(sOutputName);
+	auto opt = inParams.inClientSession->getAttribute(ReflectorAttr::kOutput);
 	if (!opt)
 	{
 		if (!isPush)
@@ -678,13 +720,13 @@ QTSS_Error DoSetup(QTSS_StandardRTSP_Params &inParams)
 			if (theSession == nullptr)
 				return QTSS_RequestFailed;
 
-			auto* theNewOutput = new RTPSessionOutput(inParams.inClientSession, theSession, sStreamCookieName);
+			auto* theNewOutput = new RTPSessionOutput(inParams.inClientSession, theSession, ReflectorAttr::kStreamCookie);
 			theSession->AddOutput(theNewOutput, true);
-			inParams.inClientSession->addAttribute(sOutputName, theNewOutput);
+			inParams.inClientSession->addAttribute(ReflectorAttr::kOutput, theNewOutput);
 		}
 		else
 		{
-			auto opt = inParams.inClientSession->getAttribute(sBroadcasterSessionName);
+			auto opt = inParams.inClientSession->getAttribute(ReflectorAttr::kBroadcasterSession);
 			if (!opt)
 			{
 				theSession = DoSessionSetup(inParams, isPush, &foundSession);
@@ -693,15 +735,15 @@ QTSS_Error DoSetup(QTSS_StandardRTSP_Params &inParams)
 			}
 			else
 			{
-				theSession = boost::any_cast<ReflectorSession*>(opt.value());
+				theSession = opt.value();
 			}
 
-			inParams.inClientSession->addAttribute(sBroadcasterSessionName, theSession);
+			inParams.inClientSession->addAttribute(ReflectorAttr::kBroadcasterSession, theSession);
 		}
 	}
 	else
 	{
-		RTPSessionOutput*  theOutput = boost::any_cast<RTPSessionOutput*>(opt.value());
+		RTPSessionOutput*  theOutput = opt.value();
 		theSession = theOutput->GetReflectorSession();
 		if (theSession == nullptr)
 			return QTSS_RequestFailed;
@@ -754,7 +796,7 @@ QTSS_Error DoSetup(QTSS_StandardRTSP_Params &inParams)
 		SendSetupRTSPResponse(newStream, inParams.inRTSPRequest, 0);
 
 		// This is an incoming data session. Set the Reflector Session in the ClientSession
-		inParams.inClientSession->addAttribute(sBroadcasterSessionName, theSession);
+		inParams.inClientSession->addAttribute(ReflectorAttr::kBroadcasterSession, theSession);
 
 		if (theSession != nullptr)
 			theSession->AddBroadcasterClientSession(inParams.inClientSession);
@@ -797,7 +839,7 @@ QTSS_Error DoSetup(QTSS_StandardRTSP_Params &inParams)
 	// Place the stream cookie in this stream for future reference
 	void* theStreamCookie = theSession->GetStreamCookie(theTrackID);
 	Assert(theStreamCookie != nullptr);
-	newStream->addAttribute(sStreamCookieName, theStreamCookie);
+	newStream->addAttribute(ReflectorAttr::kStreamCookie, theStreamCookie);
 
 	//send the setup response
 	SendSetupRTSPResponse(newStream, inParams.inRTSPRequest, qtssSetupRespDontWriteSSRC);
@@ -816,22 +858,22 @@ QTSS_Error DoPlay(QTSS_StandardRTSP_Params& inParams, ReflectorSession* inSessio
 
 	if (inSession == nullptr)
 	{
-		auto opt = inParams.inClientSession->getAttribute(sBroadcasterSessionName);
+		auto opt = inParams.inClientSession->getAttribute(ReflectorAttr::kBroadcasterSession);
 		if (!opt) return QTSS_RequestFailed;
-		inSession = boost::any_cast<ReflectorSession*>(opt.value());
+		inSession = opt.value();
 
 		Assert(inSession != nullptr);
 
-		inParams.inRTSPSession->addAttribute(sBroadcasterSessionName, inSession);
+		inParams.inRTSPSession->addAttribute(ReflectorAttr::kBroadcasterSession, inSession);
 		//printf("QTSSReflectorModule.cpp:DoPlay (PUSH) inRTSPSession=%"   _U32BITARG_   " inClientSession=%"   _U32BITARG_   "\n",(uint32_t)inParams->inRTSPSession,(uint32_t)inParams->inClientSession);
 	}
 	else
 	{
-		auto opt = inParams.inClientSession->getAttribute(sOutputName);
+		auto opt = inParams.inClientSession->getAttribute(ReflectorAttr::kOutput);
 		if (!opt)
 			return QTSS_RequestFailed;
 
-		RTPSessionOutput*  theOutput = boost::any_cast<RTPSessionOutput*>(opt.value());
+		RTPSessionOutput*  theOutput = opt.value();
 
 		// Tell the session what the bitrate of this reflection is. This is nice for logging,
 		// it also allows the server to scale the TCP buffer size appropriately if we are
@@ -866,6 +908,8 @@ void RemoveOutput(ReflectorOutput* inOutput, ReflectorSession* theSession, bool
 	Assert(theSession);
 	if (theSession != nullptr)
 	{
+		OSMutexLocker locker(GetStreamLock(theSession->GetStreamName()));
+
 		if (inOutput != nullptr)
 		{
 			// ReflectorSessionƳͻ
@@ -30,19 +30,17 @@
 
  */
 
+#include <algorithm>
 #include "RTPSession.h"
 #include "RTPSessionOutput.h"
 #include "ReflectorStream.h"
 
-static boost::string_view        sLastRTPPacketID = "qtssReflectorStreamLastRTPPacketID";
-static boost::string_view        sLastRTCPPacketID = "qtssReflectorStreamLastRTCPPacketID";
-
 RTPSessionOutput::RTPSessionOutput(RTPSession* inClientSession, ReflectorSession* inReflectorSession,
-	boost::string_view inCookieAddrName)
+	AttributeID<void*> inCookieAttr)
 	: ReflectorOutput(inReflectorSession->GetNumStreams()), // create a bookmark for each stream we'll reflect
 	fClientSession(inClientSession),
 	fReflectorSession(inReflectorSession),
-	fCookieAttrName(inCookieAddrName)
+	fCookieAttr(inCookieAttr)
 {
 }
 
@@ -77,8 +75,8 @@ bool  RTPSessionOutput::PacketAlreadySent(RTPStream *theStreamPtr, uint32_t inFl
 
 	if (inFlags & qtssWriteFlagsIsRTP)
 	{
-		boost::optional<boost::any> opt = theStreamPtr->getAttribute(sLastRTPPacketID);
-		if (opt && packetID <= boost::any_cast<uint64_t>(opt.value()))
+		boost::optional<uint64_t> opt = theStreamPtr->getAttribute(ReflectorAttr::kLastRTPPacketID);
+		if (opt && packetID <= opt.value())
 		{
 			//printf("RTPSessionOutput::WritePacket Don't send RTP packet id =%qu\n", *packetIDPtr);
 			packetSent = true;
@@ -87,8 +85,8 @@ bool  RTPSessionOutput::PacketAlreadySent(RTPStream *theStreamPtr, uint32_t inFl
 	}
 	else if (inFlags & qtssWriteFlagsIsRTCP)
 	{
-		boost::optional<boost::any> opt = theStreamPtr->getAttribute(sLastRTCPPacketID);
-		if (opt && packetID <= boost::any_cast<uint64_t>(opt.value()))
+		boost::optional<uint64_t> opt = theStreamPtr->getAttribute(ReflectorAttr::kLastRTCPPacketID);
+		if (opt && packetID <= opt.value())
 		{
 			//printf("RTPSessionOutput::WritePacket Don't send RTP packet id =%qu\n", *packetIDPtr);
 			packetSent = true;
@@ -130,11 +128,11 @@ QTSS_Error  RTPSessionOutput::WritePacket(const std::vector<char> &inPacket, voi
 			{
 				if (inFlags & qtssWriteFlagsIsRTP)
 				{
-					theStreamPtr->addAttribute(sLastRTPPacketID, packetID);
+					theStreamPtr->addAttribute(ReflectorAttr::kLastRTPPacketID, packetID);
 				}
 				else if (inFlags & qtssWriteFlagsIsRTCP)
 				{
-					theStreamPtr->addAttribute(sLastRTCPPacketID, packetID);
+					theStreamPtr->addAttribute(ReflectorAttr::kLastRTCPPacketID, packetID);
 				}
 			}
 		}
@@ -146,6 +144,58 @@ QTSS_Error  RTPSessionOutput::WritePacket(const std::vector<char> &inPacket, voi
 	return writeErr;
 }
 
+QTSS_Error  RTPSessionOutput::WritePackets(MyReflectorPacket* const* inPackets, uint32_t inNumPackets,
+	void* inStreamCookie, uint32_t inFlags, uint32_t* outNumWritten)
+{
+	*outNumWritten = 0;
+	if (fClientSession->GetSessionState() != qtssPlayingState)
+		return QTSS_WouldBlock;
+
+	// a packet is only written once all RTP streams with this ID have it
+	uint32_t theNumWritten = inNumPackets;
+	QTSS_Error writeErr = QTSS_NoErr;
+	for (auto theStreamPtr : fClientSession->GetStreams())
+	{
+		if (!this->PacketMatchesStream(inStreamCookie, theStreamPtr))
+			continue;
+
+		// packet IDs grow along the run, so what the stream already has is a prefix of it
+		uint32_t theFirst = 0;
+		while ((theFirst < inNumPackets) && PacketAlreadySent(theStreamPtr, inFlags, inPackets[theFirst]->fStreamCountID))
+			theFirst++;
+
+		fPacketBuffers.clear();
+		for (uint32_t x = theFirst; x < inNumPackets; x++)
+			fPacketBuffers.push_back(&inPackets[x]->fPacket);
+
+		uint32_t theStreamNumWritten = 0;
+		if (!fPacketBuffers.empty())
+			writeErr = theStreamPtr->WriteV(fPacketBuffers.data(), fPacketBuffers.size(), &theStreamNumWritten, inFlags);
+
+		if (theStreamNumWritten > 0)
+		{
+			uint64_t theLastPacketID = inPackets[theFirst + theStreamNumWritten - 1]->fStreamCountID;
+			if (inFlags & qtssWriteFlagsIsRTP)
+				theStreamPtr->addAttribute(ReflectorAttr::kLastRTPPacketID, theLastPacketID);
+			else if (inFlags & qtssWriteFlagsIsRTCP)
+				theStreamPtr->addAttribute(ReflectorAttr::kLastRTCPPacketID, theLastPacketID);
+		}
+
+		theNumWritten = std::min(theNumWritten, theFirst + theStreamNumWritten);
+		if (writeErr != QTSS_NoErr)
+			break;
+	}
+
+	*outNumWritten = theNumWritten;
+	return writeErr;
+}
+
+void RTPSessionOutput::FlushPackets()
+{
+	for (auto theStreamPtr : fClientSession->GetStreams())
+		theStreamPtr->FlushPackets();
+}
+
 void RTPSessionOutput::TearDown()
 {
 	//fClientSession->SetTeardownReason(qtssCliSesTearDownBroadcastEnded);
@@ -37,6 +37,7 @@
 #define __RTSP_REFLECTOR_OUTPUT_H__
 
 #include "ReflectorOutput.h"
+#include "ReflectorAttributes.h"
 #include "ReflectorSession.h"
 #include "RTPStream.h"
 #include "QTSS.h"
@@ -45,7 +46,7 @@ class RTPSessionOutput : public ReflectorOutput
 {
 public:
 	RTPSessionOutput(RTPSession* inRTPSession, ReflectorSession* inReflectorSession,
-		boost::string_view inCookieAddrName);
+		AttributeID<void*> inCookieAttr);
 	~RTPSessionOutput() override = default;
 
 	ReflectorSession* GetReflectorSession() { return fReflectorSession; }
@@ -56,6 +57,9 @@ public:
 	QTSS_Error  WritePacket(const std::vector<char> &inPacketData, void* inStreamCookie,
 		uint32_t inFlags, 
 		uint64_t packetID) override;
+	QTSS_Error  WritePackets(MyReflectorPacket* const* inPackets, uint32_t inNumPackets,
+		void* inStreamCookie, uint32_t inFlags, uint32_t* outNumWritten) override;
+	void FlushPackets() override;
 	void TearDown() override;
 
 	bool  IsUDP() override;
@@ -65,11 +69,12 @@ private:
 
 	RTPSession*             fClientSession;
 	ReflectorSession*       fReflectorSession;
-	std::string             fCookieAttrName;
+	AttributeID<void*>      fCookieAttr;
 	int64_t                  fBaseArrivalTime{ 0 };
 	bool                  fIsUDP{ false };
 	bool                  fTransportInitialized{ false };
 	bool                  fMustSynch{ true };
+	std::vector<const std::vector<char>*>  fPacketBuffers; // WritePackets scratch, under fMutex
 
 	inline  bool PacketMatchesStream(void* inStreamCookie, RTPStream *theStreamPtr);
 	bool PacketAlreadySent(RTPStream *theStreamPtr, uint32_t inFlags, uint64_t packetID);
@@ -77,15 +82,8 @@ private:
 
 bool RTPSessionOutput::PacketMatchesStream(void* inStreamCookie, RTPStream *theStreamPtr)
 {
-	boost::optional<boost::any> opt = theStreamPtr->getAttribute(fCookieAttrName);
-
-	if (opt && boost::any_cast<void *>(opt.value()) == inStreamCookie)
-		return true;
-
-	return false;
+	boost::optional<void*> opt = theStreamPtr->getAttribute(fCookieAttr);
+	return opt && (opt.value() == inStreamCookie);
 }
 
-class RTPSessionOutput1 {
-
-};
 #endif //__RTSP_REFLECTOR_OUTPUT_H__
@@ -0,0 +1,45 @@
+/*
+	File:       ReflectorAttributes.h
+
+	Contains:   IDs of the attributes the reflector keeps on the server's
+				RTSP sessions, RTP sessions and RTP streams.
+
+				Each ID owns one slot of the object's Attributes. Slots only
+				need to be unique among the IDs set on the same kind of object,
+				but numbering them all in one place keeps that obvious.
+*/
+
+#pragma once
+
+#include "Attributes.h"
+
+class ReflectorSession;
+class RTPSessionOutput;
+
+namespace ReflectorAttr
+{
+	enum : uint32_t
+	{
+		// RTPSession, plus kBroadcasterSession on the RTSPSession
+		kOutputSlot = 0,
+		kBroadcasterSessionSlot = 1,
+		kTearDownClientsSlot = 2,
+
+		// RTPStream
+		kStreamCookieSlot = 3,
+		kLastRTPPacketIDSlot = 4,
+		kLastRTCPPacketIDSlot = 5,
+
+		kNumSlots
+	};
+	// Both are enums of their own, so compare them as plain numbers
+	static_assert(static_cast<size_t>(kNumSlots) <= static_cast<size_t>(Attributes::kNumSlots), "Attributes::kNumSlots is too small for the reflector");
+
+	constexpr AttributeID<RTPSessionOutput*>    kOutput{ kOutputSlot };
+	constexpr AttributeID<ReflectorSession*>    kBroadcasterSession{ kBroadcasterSessionSlot };
+	constexpr AttributeID<bool>                 kTearDownClients{ kTearDownClientsSlot };
+
+	constexpr AttributeID<void*>                kStreamCookie{ kStreamCookieSlot };
+	constexpr AttributeID<uint64_t>             kLastRTPPacketID{ kLastRTPPacketIDSlot };
+	constexpr AttributeID<uint64_t>             kLastRTCPPacketID{ kLastRTCPPacketIDSlot };
+}
@@ -0,0 +1,69 @@
+/*
+	File:       ReflectorBucketSchedule.h
+
+	Contains:   When the buckets of a ReflectorSender's outputs are due a packet.
+
+				Outputs are grouped into buckets of a fixed size, in the order
+				they were added. Bucket n gets a packet n bucket delays after it
+				arrived, so that a packet goes out to a few outputs at a time
+				instead of to all of them in one burst.
+
+				ReflectorSender::ReflectPackets makes one of these per run, with
+				the time it runs at.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+class ReflectorBucketSchedule
+{
+public:
+	using Clock = std::chrono::high_resolution_clock;
+
+	ReflectorBucketSchedule(Clock::time_point inNow, uint32_t inBucketSize, std::chrono::milliseconds inBucketDelay)
+		: fNow(inNow), fBucketSize(inBucketSize), fBucketDelay(inBucketDelay) {}
+
+	uint32_t                    GetBucket(size_t inOutputIndex) const { return (uint32_t)(inOutputIndex / fBucketSize); }
+	std::chrono::milliseconds   GetDelay(uint32_t inBucket) const { return inBucket * fBucketDelay; }
+
+	// A bucket is due the packets that arrived by then
+	Clock::time_point           GetCutoff(uint32_t inBucket) const { return fNow - this->GetDelay(inBucket); }
+
+	// When a packet that arrived at inArrived is due to the bucket
+	Clock::time_point           GetDueTime(Clock::time_point inArrived, uint32_t inBucket) const { return inArrived + this->GetDelay(inBucket); }
+
+	// How far behind its bucket an output is that joined at inJoined and is
+	// at a packet that arrived at inArrived. What was already there when it
+	// joined, the GOP cache burst most of all, only counts from the join on,
+	// or a late joiner would start out behind.
+	std::chrono::milliseconds   GetLag(Clock::time_point inArrived, uint32_t inBucket, Clock::time_point inJoined) const
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(fNow - std::max(this->GetDueTime(inArrived, inBucket), inJoined));
+	}
+
+	// The first packet in [inLow, inHigh) that arrived after inCutoff, given
+	// that arrival times only grow along the sequence. inGetArrival(seq, &time)
+	// returns false for a packet that is gone, which counts as arrived.
+	template <typename GetArrival>
+	static uint64_t FindFirstArrivedAfter(Clock::time_point inCutoff, uint64_t inLow, uint64_t inHigh, GetArrival inGetArrival)
+	{
+		while (inLow < inHigh)
+		{
+			uint64_t theMid = inLow + (inHigh - inLow) / 2;
+			Clock::time_point theArrived;
+			if (!inGetArrival(theMid, &theArrived) || theArrived <= inCutoff)
+				inLow = theMid + 1;
+			else
+				inHigh = theMid;
+		}
+		return inLow;
+	}
+
+private:
+	Clock::time_point           fNow;
+	uint32_t                    fBucketSize;
+	std::chrono::milliseconds   fBucketDelay;
+};
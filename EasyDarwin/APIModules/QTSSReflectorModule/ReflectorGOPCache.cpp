@@ -0,0 +1,88 @@
+/*
+	File:       ReflectorGOPCache.cpp
+
+	Contains:   Implementation of object defined in ReflectorGOPCache.h.
+*/
+
+#include "ReflectorGOPCache.h"
+#include "MyAssert.h"
+
+ReflectorGOPCache::ReflectorGOPCache(ReflectorPacketRing* inRing, size_t inByteBudget)
+	: fRing(inRing),
+	fByteBudget(inByteBudget)
+{
+	fPackets.reserve(inRing->GetCapacity());
+}
+
+void ReflectorGOPCache::ReleaseAll()
+{
+	for (auto thePacket : fPackets)
+		fRing->Release(thePacket);
+
+	// clear() keeps the capacity, so a warm cache doesn't allocate
+	fPackets.clear();
+	fStartSeq = ReflectorPacketRing::kInvalidSeq;
+	fNumBytes = 0;
+}
+
+void ReflectorGOPCache::Clear()
+{
+	std::lock_guard<std::mutex> locker(fMutex);
+	this->ReleaseAll();
+}
+
+void ReflectorGOPCache::Append(MyReflectorPacket* inPacket, uint64_t inSeq, bool inStartsGOP)
+{
+	std::lock_guard<std::mutex> locker(fMutex);
+
+	if (inStartsGOP)
+	{
+		this->ReleaseAll();
+		fStartSeq = inSeq;
+	}
+	else if (fStartSeq == ReflectorPacketRing::kInvalidSeq)
+		return; // waiting for the next key frame
+
+	Assert(inSeq == fStartSeq + fPackets.size());
+
+	size_t thePacketLen = inPacket->fPacket.size();
+	if (fNumBytes + thePacketLen > fByteBudget)
+	{
+		// A partial GOP is no use to anybody
+		this->ReleaseAll();
+		return;
+	}
+
+	fRing->AddRef(inPacket);
+	fPackets.push_back(inPacket);
+	fNumBytes += thePacketLen;
+}
+
+uint64_t ReflectorGOPCache::GetStartSeq()
+{
+	std::lock_guard<std::mutex> locker(fMutex);
+	return fStartSeq;
+}
+
+MyReflectorPacket* ReflectorGOPCache::Acquire(uint64_t inSeq)
+{
+	std::lock_guard<std::mutex> locker(fMutex);
+	if (fStartSeq == ReflectorPacketRing::kInvalidSeq || inSeq < fStartSeq || inSeq - fStartSeq >= fPackets.size())
+		return nullptr;
+
+	MyReflectorPacket* thePacket = fPackets[inSeq - fStartSeq];
+	fRing->AddRef(thePacket);
+	return thePacket;
+}
+
+size_t ReflectorGOPCache::GetNumBytes()
+{
+	std::lock_guard<std::mutex> locker(fMutex);
+	return fNumBytes;
+}
+
+size_t ReflectorGOPCache::GetAllocatedBytes()
+{
+	std::lock_guard<std::mutex> locker(fMutex);
+	return fPackets.capacity() * sizeof(fPackets[0]);
+}
@@ -0,0 +1,63 @@
+/*
+	File:       ReflectorGOPCache.h
+
+	Contains:   Keeps the packets of a stream's latest GOP, from its first key
+				frame packet up to the newest packet, so a viewer that joins late
+				can be sent a decodable picture right away instead of waiting for
+				the next key frame.
+
+				The cache holds references on packets that live in the sender's
+				ReflectorPacketRing, so nothing is copied, and every output shares
+				the same packets. The ring may wrap past the start of a long GOP;
+				the packets stay alive (and addressable by their sequence index)
+				here until the next GOP starts or the byte budget runs out.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "ReflectorPacketRing.h"
+
+class ReflectorGOPCache
+{
+public:
+	ReflectorGOPCache(ReflectorPacketRing* inRing, size_t inByteBudget);
+	~ReflectorGOPCache() { this->Clear(); }
+
+	ReflectorGOPCache(const ReflectorGOPCache&) = delete;
+	ReflectorGOPCache& operator=(const ReflectorGOPCache&) = delete;
+
+	// Called for every packet published to the ring, in sequence order.
+	// inStartsGOP drops the cached GOP and starts a new one with this packet.
+	// A GOP that outgrows the byte budget is dropped until the next one starts.
+	void        Append(MyReflectorPacket* inPacket, uint64_t inSeq, bool inStartsGOP);
+
+	// Sequence index of the first packet of the cached GOP,
+	// or ReflectorPacketRing::kInvalidSeq if nothing is cached.
+	uint64_t    GetStartSeq();
+
+	// Returns the cached packet with this sequence index with a ring reference
+	// held (give it back with ReflectorPacketRing::Release), or nullptr.
+	MyReflectorPacket*  Acquire(uint64_t inSeq);
+
+	// Packet bytes of the cached GOP
+	size_t      GetNumBytes();
+	// What the index of the cached packets takes; the packets themselves live
+	// in the ring's slabs
+	size_t      GetAllocatedBytes();
+
+	void        Clear();
+
+private:
+	void        ReleaseAll();
+
+	ReflectorPacketRing*            fRing;
+	size_t                          fByteBudget;
+
+	std::mutex                      fMutex;
+	std::vector<MyReflectorPacket*> fPackets;   // fPackets[i] has sequence index fStartSeq + i
+	uint64_t                        fStartSeq{ ReflectorPacketRing::kInvalidSeq };
+	size_t                          fNumBytes{ 0 };
+};
@@ -0,0 +1,56 @@
+/*
+	File:       ReflectorMemoryGovernor.cpp
+
+	Contains:   Implementation of object defined in ReflectorMemoryGovernor.h.
+*/
+
+#include <algorithm>
+#include "ReflectorMemoryGovernor.h"
+
+ReflectorMemoryGovernor& ReflectorMemoryGovernor::GetInstance()
+{
+	static ReflectorMemoryGovernor sGovernor;
+	return sGovernor;
+}
+
+ReflectorMemoryGovernor::ReflectorMemoryGovernor()
+	: fRetainedGauge(ServerMetrics::GetGauge("easydarwin_reflector_retained_bytes", "Packet bytes the reflected streams hold on to")),
+	fAllocatedGauge(ServerMetrics::GetGauge("easydarwin_reflector_allocated_bytes", "Bytes the reflected streams allocated to hold their packets")),
+	fBudgetGauge(ServerMetrics::GetGauge("easydarwin_reflector_stream_budget_bytes", "Packet bytes a reflected stream may hold on to now"))
+{
+	ServerMetrics::AddCollector([this]()
+	{
+		fRetainedGauge.Set((int64_t)this->GetRetainedBytes());
+		fAllocatedGauge.Set((int64_t)this->GetAllocatedBytes());
+		fBudgetGauge.Set((int64_t)this->GetStreamBudget());
+	});
+}
+
+void ReflectorMemoryGovernor::SetLimits(uint64_t inStreamBudget, uint64_t inCeiling)
+{
+	fStreamBudget.store(inStreamBudget, std::memory_order_relaxed);
+	fCeiling.store(inCeiling, std::memory_order_relaxed);
+}
+
+bool ReflectorMemoryGovernor::IsUnderPressure() const
+{
+	uint64_t theCeiling = fCeiling.load(std::memory_order_relaxed);
+	return (theCeiling != 0) && (fNumStreams.load(std::memory_order_relaxed) != 0) &&
+		(this->GetAllocatedBytes() > theCeiling / 2);
+}
+
+uint64_t ReflectorMemoryGovernor::GetStreamBudget() const
+{
+	uint64_t theBudget = fStreamBudget.load(std::memory_order_relaxed);
+	if (!this->IsUnderPressure())
+		return theBudget;
+
+	// The share is in allocated bytes, budgets are in retained ones
+	uint64_t theShare = fCeiling.load(std::memory_order_relaxed) / 2 / std::max<uint32_t>(fNumStreams.load(std::memory_order_relaxed), 1);
+	uint64_t theRetained = this->GetRetainedBytes();
+	uint64_t theAllocated = this->GetAllocatedBytes();
+	if (theRetained < theAllocated)
+		theShare = (uint64_t)((double)theShare * theRetained / theAllocated);
+
+	return std::min(theBudget, theShare);
+}
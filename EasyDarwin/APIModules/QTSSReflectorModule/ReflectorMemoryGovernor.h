@@ -0,0 +1,80 @@
+/*
+	File:       ReflectorMemoryGovernor.h
+
+	Contains:   Keeps count of the memory every reflected stream holds on to,
+				and decides how many packet bytes each one may keep.
+
+				Two things are counted: the packet bytes a stream retains, which
+				is what budgets are in, and what its sender allocated to hold
+				them, the ring's slabs and the GOP cache's index. A packet takes
+				a whole slab slot whatever its size, and slabs can't all go back
+				to the heap at once, so the second is the larger one.
+
+				A stream's retention budget comes from the prefs. As long as all
+				streams together allocate less than half the process-wide
+				ceiling, that is all there is to it. Past that, the streams share
+				that half equally: each may retain an equal share of it, scaled
+				down by how much more than that all of them allocate for what
+				they retain. A stream always keeps its current GOP, whatever its
+				budget.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "ServerMetrics.h"
+
+class ReflectorMemoryGovernor
+{
+public:
+	static ReflectorMemoryGovernor& GetInstance();
+
+	ReflectorMemoryGovernor(const ReflectorMemoryGovernor&) = delete;
+	ReflectorMemoryGovernor& operator=(const ReflectorMemoryGovernor&) = delete;
+
+	// The budget a stream gets when there is no pressure, and the ceiling
+	// for all of them together (0 for none)
+	void        SetLimits(uint64_t inStreamBudget, uint64_t inCeiling);
+
+	// Every stream's sender counts itself in while it exists
+	void        AddStream() { fNumStreams.fetch_add(1, std::memory_order_relaxed); }
+	void        RemoveStream() { fNumStreams.fetch_sub(1, std::memory_order_relaxed); }
+
+	// A sender retains inRetainedDelta more packet bytes, and has allocated
+	// inAllocatedDelta more bytes (or fewer, if negative) than it said before
+	void        AddBytes(int64_t inRetainedDelta, int64_t inAllocatedDelta)
+	{
+		fRetainedBytes.fetch_add(inRetainedDelta, std::memory_order_relaxed);
+		fAllocatedBytes.fetch_add(inAllocatedDelta, std::memory_order_relaxed);
+	}
+
+	// Bytes held by all senders together
+	uint64_t    GetRetainedBytes() const { return ToBytes(fRetainedBytes); }
+	uint64_t    GetAllocatedBytes() const { return ToBytes(fAllocatedBytes); }
+
+	// Whether the streams have to share the ceiling
+	bool        IsUnderPressure() const;
+
+	// Packet bytes a stream may retain right now
+	uint64_t    GetStreamBudget() const;
+
+private:
+	ReflectorMemoryGovernor();
+
+	static uint64_t ToBytes(const std::atomic<int64_t>& inBytes)
+	{
+		int64_t theBytes = inBytes.load(std::memory_order_relaxed);
+		return (theBytes > 0) ? (uint64_t)theBytes : 0;
+	}
+
+	std::atomic<int64_t>    fRetainedBytes{ 0 };
+	std::atomic<int64_t>    fAllocatedBytes{ 0 };
+	std::atomic<uint32_t>   fNumStreams{ 0 };
+	std::atomic<uint64_t>   fStreamBudget{ 0 };
+	std::atomic<uint64_t>   fCeiling{ 0 };
+
+	ServerMetrics::Gauge&   fRetainedGauge;
+	ServerMetrics::Gauge&   fAllocatedGauge;
+	ServerMetrics::Gauge&   fBudgetGauge;
+};
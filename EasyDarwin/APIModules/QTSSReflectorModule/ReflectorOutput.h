@@ -37,6 +37,8 @@
 #ifndef __REFLECTOR_OUTPUT_H__
 #define __REFLECTOR_OUTPUT_H__
 
+#include <chrono>
+#include <vector>
 #include "QTSS.h"
 #include "OSHeaders.h"
 #include "MyAssert.h"
@@ -51,13 +53,26 @@ class ReflectorOutput
 		ReflectorOutput(size_t numStreams) : fBookmarkedPacketsElemsArray(numStreams * 2) {};
 		virtual ~ReflectorOutput() = default;
         
-        // an array of packet elements ( from fPacketQueue in ReflectorSender )
-        // possibly one for each ReflectorSender that sends data to this ReflectorOutput        
-        std::vector<MyReflectorPacket*> fBookmarkedPacketsElemsArray;
+        // an array of sequence indexes into the packet ring of each ReflectorSender
+        // that sends data to this ReflectorOutput, keyed by the sender
+        struct BookMark
+        {
+            const void* fSender{ nullptr };
+            uint64_t    fSeq{ 0 };
+            // Fell too far behind and dropped its packets: waiting for the sender's
+            // next key frame at or after fSeq, and gets nothing until then
+            bool        fAwaitingKeyFrame{ false };
+            // When the output started on this sender, and the bytes the sender
+            // had taken in by then. How far behind it is counts from there.
+            std::chrono::high_resolution_clock::time_point fJoinTime;
+            uint64_t    fJoinByteOffset{ 0 };
+        };
+        std::vector<BookMark> fBookmarkedPacketsElemsArray;
 		OSMutex             fMutex;
 	public:
-		inline  MyReflectorPacket*    GetBookMarkedPacket(const std::list<std::unique_ptr<MyReflectorPacket>> &thePacketQueue);
-		inline  void SetBookMarkPacket(MyReflectorPacket* thePacketElemPtr);
+		// Takes out the bookmark inSender left here, if it left one
+		inline  bool GetBookMarkedPacket(const void* inSender, BookMark* outBookMark);
+		inline  void SetBookMarkPacket(const BookMark& inBookMark);
         
         // WritePacket
         //
@@ -69,6 +84,19 @@ class ReflectorOutput
         virtual QTSS_Error  WritePacket(const std::vector<char> &inPacket, void* inStreamCookie,
 			uint32_t inFlags,
 			uint64_t packetID) = 0;
+
+        // WritePackets
+        //
+        // Same as WritePacket for a run of packets of one stream, in ring order,
+        // so that an output can hand them to the network in fewer writes.
+        // *outNumWritten is how many of them were written; unless the error is
+        // QTSS_WouldBlock, the one after those failed and is not worth retrying.
+        virtual QTSS_Error  WritePackets(MyReflectorPacket* const* inPackets, uint32_t inNumPackets,
+			void* inStreamCookie, uint32_t inFlags, uint32_t* outNumWritten) = 0;
+
+        // Outputs that only queue packets in WritePacket send them out here.
+        // Called once a sender is done with a round of writes.
+        virtual void      FlushPackets() {}
     
         virtual void      TearDown() = 0;
         virtual bool      IsUDP() = 0;
@@ -77,39 +105,30 @@ class ReflectorOutput
         enum { kWaitMilliSec = 5, kMaxWaitMilliSec = 1000 };
 };
 
-void  ReflectorOutput::SetBookMarkPacket(MyReflectorPacket* thePacketElemPtr)
+void  ReflectorOutput::SetBookMarkPacket(const BookMark& inBookMark)
 {
 	for (auto &elem : fBookmarkedPacketsElemsArray)
-		if (elem == nullptr) {
-			elem = thePacketElemPtr;
+		if (elem.fSender == nullptr || elem.fSender == inBookMark.fSender) {
+			elem = inBookMark;
 			return;
 		}
 }
 
-MyReflectorPacket*    ReflectorOutput::GetBookMarkedPacket(const std::list<std::unique_ptr<MyReflectorPacket>> &thePacketQueue)
+bool    ReflectorOutput::GetBookMarkedPacket(const void* inSender, BookMark* outBookMark)
 {
-    MyReflectorPacket*        packetElem = nullptr;              
-
     // see if we've bookmarked a held packet for this Sender in this Output
     for (auto &bookmarkedElem : fBookmarkedPacketsElemsArray)
     {         
-		if (!bookmarkedElem) continue;
+		if (bookmarkedElem.fSender != inSender) continue;
 
-		auto it = std::find_if(begin(thePacketQueue), end(thePacketQueue),
-			[bookmarkedElem](const std::unique_ptr<MyReflectorPacket> &pkt) {
-			return pkt.get() == bookmarkedElem;
-		});
-		if (it != end(thePacketQueue))
-		{
-			// this packet was previously bookmarked for this specific queue
-			// remove if from the bookmark list and use it
-			// to jump ahead into the Sender's over all packet queue                        
-			bookmarkedElem = nullptr;
-			packetElem = bookmarkedElem;
-			break;
-		}
+		// this packet was previously bookmarked for this specific sender
+		// remove if from the bookmark list and use it
+		// to jump ahead into the Sender's packet ring
+		*outBookMark = bookmarkedElem;
+		bookmarkedElem.fSender = nullptr;
+		return true;
     }
 
-    return packetElem;
+    return false;
 }
 #endif //__REFLECTOR_OUTPUT_H__
@@ -0,0 +1,277 @@
+/*
+	File:       ReflectorPacketRing.cpp
+
+	Contains:   Implementation of object defined in ReflectorPacketRing.h.
+*/
+
+#include <algorithm>
+#include <functional>
+#include "ReflectorPacketRing.h"
+#include "MyAssert.h"
+
+static size_t RoundUpToPowerOfTwo(size_t inValue)
+{
+	size_t theValue = 1;
+	while (theValue < inValue)
+		theValue <<= 1;
+	return theValue;
+}
+
+ReflectorPacketRing::ReflectorPacketRing(size_t inCapacity)
+	: fSlots(new std::atomic<MyReflectorPacket*>[RoundUpToPowerOfTwo(inCapacity)]),
+	fMask(RoundUpToPowerOfTwo(inCapacity) - 1),
+	fOverflowSlots(new std::atomic<MyReflectorPacket*>[RoundUpToPowerOfTwo(inCapacity)])
+{
+	for (uint64_t x = 0; x <= fMask; x++)
+	{
+		fSlots[x].store(nullptr, std::memory_order_relaxed);
+		fOverflowSlots[x].store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+ReflectorPacketRing::~ReflectorPacketRing()
+{
+	// The packets themselves belong to fSlabs (or fRetiredSlabs), so there is
+	// nothing to hand back
+}
+
+void ReflectorPacketRing::AllocateSlab()
+{
+	std::unique_ptr<MyReflectorPacket[]> theSlab(new MyReflectorPacket[kPacketsPerSlab]);
+	fFreePackets.reserve((fSlabs.size() + 1) * kPacketsPerSlab);
+	for (size_t x = 0; x < kPacketsPerSlab; x++)
+	{
+		theSlab[x].fPacket.reserve(kDefaultPacketCapacity);
+		fFreePackets.push_back(&theSlab[x]);
+	}
+	fSlabs.push_back(std::move(theSlab));
+}
+
+size_t ReflectorPacketRing::GetNumAllocatedPackets()
+{
+	std::lock_guard<std::mutex> locker(fFreeMutex);
+	return fSlabs.size() * kPacketsPerSlab;
+}
+
+size_t ReflectorPacketRing::GetAllocatedBytes()
+{
+	std::lock_guard<std::mutex> locker(fFreeMutex);
+	return fSlabs.size() * kPacketsPerSlab * (sizeof(MyReflectorPacket) + kDefaultPacketCapacity) +
+		2 * (fMask + 1) * sizeof(fSlots[0]);
+}
+
+MyReflectorPacket* ReflectorPacketRing::Reserve()
+{
+	MyReflectorPacket* thePacket = nullptr;
+	{
+		std::lock_guard<std::mutex> locker(fFreeMutex);
+		if (fFreePackets.empty())
+			this->AllocateSlab();
+		thePacket = fFreePackets.back();
+		fFreePackets.pop_back();
+	}
+
+	// A reader holding a stale pointer to this packet may still try to pin it, so
+	// make sure it can never match a sequence index until we publish it again.
+	thePacket->fRingSeq.store(kInvalidSeq, std::memory_order_relaxed);
+	thePacket->fNeededByOutput = false;
+	thePacket->fRefCount.store(1, std::memory_order_release);
+	return thePacket;
+}
+
+uint64_t ReflectorPacketRing::Publish(MyReflectorPacket* inPacket)
+{
+	Assert(inPacket != nullptr);
+
+	uint64_t theSeq = fHead.load(std::memory_order_relaxed);
+	uint64_t theCapacity = fMask + 1;
+	inPacket->fRingSeq.store(theSeq, std::memory_order_relaxed);
+
+	// Only the writer stores to the slots, so this is what the new packet evicts
+	std::atomic<MyReflectorPacket*>& theSlot = fSlots[theSeq & fMask];
+	MyReflectorPacket* theEvicted = theSlot.load(std::memory_order_relaxed);
+	if ((theEvicted != nullptr) && (theSeq - theCapacity >= fLowWaterSeq.load(std::memory_order_acquire)))
+	{
+		// Still bookmarked. It goes aside before it leaves the slot, so that
+		// readers always find it in one place or the other.
+		this->AddToOverflow(theEvicted, theSeq - theCapacity);
+		theEvicted = nullptr;
+	}
+	theSlot.store(inPacket, std::memory_order_release);
+	fHead.store(theSeq + 1, std::memory_order_release);
+
+	if (theEvicted != nullptr)
+	{
+		this->Release(theEvicted);
+		fRecycledSinceSlabCheck++;
+	}
+
+	// Whatever wrapped around has just been dealt with above; now recycle what
+	// readers trimmed. Never trim the packet we just published.
+	if (theSeq + 1 > theCapacity)
+		fFreedSeq = std::max(fFreedSeq, theSeq + 1 - theCapacity);
+
+	uint64_t theTrimSeq = std::min(fTrimSeq.load(std::memory_order_acquire), theSeq);
+	for (; fFreedSeq < theTrimSeq; fFreedSeq++)
+	{
+		MyReflectorPacket* theTrimmed = fSlots[fFreedSeq & fMask].exchange(nullptr, std::memory_order_acq_rel);
+		if (theTrimmed != nullptr)
+		{
+			this->Release(theTrimmed);
+			fRecycledSinceSlabCheck++;
+		}
+	}
+
+	if (fOverflowStartSeq.load(std::memory_order_relaxed) != kInvalidSeq)
+		this->TrimOverflow(std::max(fTrimSeq.load(std::memory_order_acquire), fLowWaterSeq.load(std::memory_order_acquire)));
+
+	if ((++fPublishesSinceSlabCheck >= kPublishesPerSlabCheck) ||
+		((fRecycledSinceSlabCheck >= kPacketsPerSlab) && !fKeepSpareSlabs.load(std::memory_order_relaxed)))
+	{
+		fPublishesSinceSlabCheck = 0;
+		fRecycledSinceSlabCheck = 0;
+		this->ReleaseIdleSlabs();
+	}
+
+	return theSeq;
+}
+
+void ReflectorPacketRing::AddToOverflow(MyReflectorPacket* inPacket, uint64_t inSeq)
+{
+	// The overflow never spans more than the ring: whatever was kept a capacity
+	// before goes. A reader that still wanted it has fallen too far behind.
+	uint64_t theStartSeq = fOverflowStartSeq.load(std::memory_order_relaxed);
+	if ((theStartSeq != kInvalidSeq) && (inSeq - theStartSeq > fMask))
+		this->TrimOverflow(inSeq - fMask);
+
+	Assert(fOverflowSlots[inSeq & fMask].load(std::memory_order_relaxed) == nullptr);
+	fOverflowSlots[inSeq & fMask].store(inPacket, std::memory_order_release);
+	if (fOverflowStartSeq.load(std::memory_order_relaxed) == kInvalidSeq)
+		fOverflowStartSeq.store(inSeq, std::memory_order_release);
+	fOverflowEndSeq = inSeq + 1;
+}
+
+void ReflectorPacketRing::TrimOverflow(uint64_t inSeq)
+{
+	uint64_t theStartSeq = fOverflowStartSeq.load(std::memory_order_relaxed);
+	uint64_t theNewStartSeq = std::min(inSeq, fOverflowEndSeq);
+	if (theNewStartSeq <= theStartSeq)
+		return;
+
+	// Readers stop looking before the packets go
+	fOverflowStartSeq.store((theNewStartSeq == fOverflowEndSeq) ? kInvalidSeq : theNewStartSeq, std::memory_order_release);
+	for (; theStartSeq < theNewStartSeq; theStartSeq++)
+	{
+		MyReflectorPacket* thePacket = fOverflowSlots[theStartSeq & fMask].exchange(nullptr, std::memory_order_acq_rel);
+		if (thePacket != nullptr)
+			this->Release(thePacket);
+	}
+}
+
+void ReflectorPacketRing::ReleaseIdleSlabs()
+{
+	std::lock_guard<std::mutex> locker(fFreeMutex);
+
+	// Keep enough spare packets for the ring to grow back by half without
+	// going to the heap, so a stream that comes and goes doesn't churn slabs
+	size_t theNumInUse = fSlabs.size() * kPacketsPerSlab - fFreePackets.size();
+	size_t theNumSpare = 0;
+	if (fKeepSpareSlabs.load(std::memory_order_relaxed))
+		theNumSpare = std::max<size_t>(2 * kPacketsPerSlab, theNumInUse / 2);
+	if (fFreePackets.size() >= theNumSpare + kPacketsPerSlab)
+	{
+		// A slab is idle when all of its packets are free
+		std::less<MyReflectorPacket*> theLess;
+		std::sort(fFreePackets.begin(), fFreePackets.end(), theLess);
+		for (size_t x = 0; (x < fSlabs.size()) && (fFreePackets.size() >= theNumSpare + kPacketsPerSlab);)
+		{
+			MyReflectorPacket* theFirst = &fSlabs[x][0];
+			auto theBegin = std::lower_bound(fFreePackets.begin(), fFreePackets.end(), theFirst, theLess);
+			auto theEnd = std::lower_bound(theBegin, fFreePackets.end(), theFirst + kPacketsPerSlab, theLess);
+			if (theEnd - theBegin != kPacketsPerSlab)
+			{
+				x++;
+				continue;
+			}
+
+			fFreePackets.erase(theBegin, theEnd);
+			fRetiredSlabs.push_back(std::move(fSlabs[x]));
+			if (x + 1 < fSlabs.size())
+				fSlabs[x] = std::move(fSlabs.back());
+			fSlabs.pop_back();
+		}
+	}
+
+	// A reader may have loaded a pointer to one of these packets before it was
+	// recycled, and be about to look at its refcount. Nobody can once no reader
+	// is in Acquire: the packets are in no slot and on no free list any more.
+	if (!fRetiredSlabs.empty() && (fNumAcquiring.load(std::memory_order_seq_cst) == 0))
+		fRetiredSlabs.clear();
+}
+
+uint64_t ReflectorPacketRing::Tail() const
+{
+	uint64_t theHead = this->Head();
+	uint64_t theCapacity = fMask + 1;
+	uint64_t theTail = theHead > theCapacity ? theHead - theCapacity : 0;
+	theTail = std::min(theTail, fOverflowStartSeq.load(std::memory_order_acquire));
+	return std::max(theTail, fTrimSeq.load(std::memory_order_acquire));
+}
+
+MyReflectorPacket* ReflectorPacketRing::Acquire(uint64_t inSeq)
+{
+	if (inSeq >= this->Head() || inSeq < this->Tail())
+		return nullptr;
+
+	fNumAcquiring.fetch_add(1, std::memory_order_seq_cst);
+	MyReflectorPacket* thePacket = this->TryAcquire(fSlots[inSeq & fMask].load(std::memory_order_acquire), inSeq);
+	if ((thePacket == nullptr) && (inSeq >= fOverflowStartSeq.load(std::memory_order_acquire)))
+		thePacket = this->TryAcquire(fOverflowSlots[inSeq & fMask].load(std::memory_order_acquire), inSeq);
+	fNumAcquiring.fetch_sub(1, std::memory_order_release);
+
+	return thePacket;
+}
+
+MyReflectorPacket* ReflectorPacketRing::TryAcquire(MyReflectorPacket* inPacket, uint64_t inSeq)
+{
+	if (inPacket == nullptr)
+		return nullptr;
+
+	// Only take a reference if someone else still holds one; a count of zero
+	// means the packet is sitting on the free list.
+	uint32_t theCount = inPacket->fRefCount.load(std::memory_order_relaxed);
+	do
+	{
+		if (theCount == 0)
+			return nullptr;
+	} while (!inPacket->fRefCount.compare_exchange_weak(theCount, theCount + 1,
+		std::memory_order_acquire, std::memory_order_relaxed));
+
+	if (inPacket->fRingSeq.load(std::memory_order_acquire) != inSeq)
+	{
+		// The slot was recycled underneath us
+		this->Release(inPacket);
+		return nullptr;
+	}
+
+	return inPacket;
+}
+
+void ReflectorPacketRing::Release(MyReflectorPacket* inPacket)
+{
+	if (inPacket->fRefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		std::lock_guard<std::mutex> locker(fFreeMutex);
+		fFreePackets.push_back(inPacket);
+	}
+}
+
+void ReflectorPacketRing::Trim(uint64_t inSeq)
+{
+	inSeq = std::min(inSeq, this->Head());
+	uint64_t theCurrent = fTrimSeq.load(std::memory_order_relaxed);
+	while (theCurrent < inSeq &&
+		!fTrimSeq.compare_exchange_weak(theCurrent, inSeq, std::memory_order_release, std::memory_order_relaxed))
+	{
+	}
+}
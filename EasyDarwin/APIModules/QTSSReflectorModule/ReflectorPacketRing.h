@@ -0,0 +1,141 @@
+/*
+	File:       ReflectorPacketRing.h
+
+	Contains:   Fixed-capacity ring of refcounted reflector packets.
+
+				Packets are carved out of slabs and recycled through a free list,
+				so once the ring has warmed up, appending a packet doesn't touch
+				the heap. Every packet gets a monotonically increasing sequence
+				index. Outputs bookmark that index instead of a pointer, so seeking
+				to a bookmark is just (index & mask).
+
+				There is a single writer (whoever feeds the ReflectorSender) and any
+				number of readers. A reader must Acquire() a packet before looking at
+				it and Release() it when done; a packet only goes back to the free list
+				once the ring and every reader have let go of it.
+
+				A packet that wraps around while an output still has it (or anything
+				after it) bookmarked is not dropped: the ring keeps it aside, in a
+				second set of slots as many as the ring's, until the outputs move past
+				it or it gets trimmed. So the ring holds at most twice its capacity in
+				packets. An output that falls further behind than that loses what it
+				hasn't sent yet; its bookmark ends up behind Tail(), and it has to
+				start over. Slabs whose packets have all been free for a while go
+				back to the heap.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "MyReflectorPacket.h"
+
+class ReflectorPacketRing
+{
+public:
+	enum : uint64_t { kInvalidSeq = UINT64_MAX };
+
+	// inCapacity is rounded up to a power of two
+	explicit ReflectorPacketRing(size_t inCapacity);
+	~ReflectorPacketRing();
+
+	ReflectorPacketRing(const ReflectorPacketRing&) = delete;
+	ReflectorPacketRing& operator=(const ReflectorPacketRing&) = delete;
+
+	//
+	// WRITER
+
+	// Hands out an unpublished packet owned by the ring. Fill it in, then Publish it.
+	MyReflectorPacket*  Reserve();
+
+	// Makes the packet visible to readers and returns its sequence index. The packet
+	// that used to occupy the slot (seq - capacity) is released, unless it is still
+	// at or past the readers' low water mark: then it is kept aside, and what was
+	// kept aside a capacity before it is released instead. So is anything readers
+	// asked to Trim since the last publish.
+	uint64_t            Publish(MyReflectorPacket* inPacket);
+
+	//
+	// READERS
+
+	// [Tail, Head) is the range of sequence indexes currently in the ring.
+	uint64_t    Head() const { return fHead.load(std::memory_order_acquire); }
+	uint64_t    Tail() const;
+	size_t      GetCapacity() const { return fMask + 1; }
+
+	// Returns the packet with this sequence index with a reference held,
+	// or nullptr if it has already been evicted.
+	MyReflectorPacket*  Acquire(uint64_t inSeq);
+	// Takes another reference on a packet the caller already holds
+	void                AddRef(MyReflectorPacket* inPacket) { inPacket->fRefCount.fetch_add(1, std::memory_order_relaxed); }
+	void                Release(MyReflectorPacket* inPacket);
+
+	// Drops everything older than inSeq. Readers stop seeing those packets
+	// immediately; the writer recycles them on its next Publish.
+	void        Trim(uint64_t inSeq);
+
+	// The oldest sequence index any reader has bookmarked. Packets from there on
+	// survive wrapping around until this moves past them (or they are trimmed).
+	// kInvalidSeq, the default, means nobody has anything bookmarked.
+	void        SetLowWaterSeq(uint64_t inSeq) { fLowWaterSeq.store(inSeq, std::memory_order_release); }
+
+	// Number of packets carved out of the slabs the ring holds; stops growing
+	// once warmed up, and shrinks again once the ring has had idle slabs for a while.
+	size_t      GetNumAllocatedPackets();
+	// What the slabs and the slots take, at the packets' default capacity
+	size_t      GetAllocatedBytes();
+
+	// Gives slabs whose packets are all on the free list back to the heap, as
+	// long as enough free packets are left over. Publish does it now and then.
+	void        ReleaseIdleSlabs();
+
+	// Whether ReleaseIdleSlabs leaves the ring spare packets to grow back into,
+	// which it does by default. Without them, Publish also gives back slabs as
+	// soon as it has recycled a slab's worth of trimmed packets.
+	void        SetKeepSpareSlabs(bool inKeepSpare) { fKeepSpareSlabs.store(inKeepSpare, std::memory_order_relaxed); }
+
+private:
+	enum
+	{
+		kPacketsPerSlab = 64,
+		kDefaultPacketCapacity = 2060,  // matches the largest UDP datagram we accept
+		kPublishesPerSlabCheck = 1024   // how often Publish looks for idle slabs
+	};
+
+	void        AllocateSlab();
+	// Pins inPacket if it still is the packet with this sequence index
+	MyReflectorPacket*  TryAcquire(MyReflectorPacket* inPacket, uint64_t inSeq);
+	// Writer only: keeps a packet that wrapped around, along with its reference,
+	// in place of the one kept a capacity before it
+	void        AddToOverflow(MyReflectorPacket* inPacket, uint64_t inSeq);
+	// Writer only: lets go of kept packets that nobody can want any more
+	void        TrimOverflow(uint64_t inSeq);
+
+	std::unique_ptr<std::atomic<MyReflectorPacket*>[]> fSlots;
+	uint64_t                fMask;
+	std::atomic<uint64_t>   fHead{ 0 };
+	std::atomic<uint64_t>   fTrimSeq{ 0 };
+	uint64_t                fFreedSeq{ 0 };   // writer only: everything below this is out of fSlots
+	std::atomic<uint64_t>   fLowWaterSeq{ kInvalidSeq };
+
+	// Packets that wrapped around while still bookmarked, at (index & mask) like
+	// in fSlots. [fOverflowStartSeq, fOverflowEndSeq) spans at most the capacity.
+	std::unique_ptr<std::atomic<MyReflectorPacket*>[]> fOverflowSlots;
+	std::atomic<uint64_t>   fOverflowStartSeq{ kInvalidSeq };
+	uint64_t                fOverflowEndSeq{ 0 };     // writer only
+
+	// Readers inside Acquire, who may hold a packet pointer they haven't pinned
+	// yet. A retired slab is only deleted once it has seen this at zero.
+	std::atomic<uint32_t>   fNumAcquiring{ 0 };
+	uint32_t                fPublishesSinceSlabCheck{ 0 };    // writer only
+	uint32_t                fRecycledSinceSlabCheck{ 0 };     // writer only
+	std::atomic<bool>       fKeepSpareSlabs{ true };
+
+	std::mutex              fFreeMutex;
+	std::vector<MyReflectorPacket*> fFreePackets;
+	std::vector<std::unique_ptr<MyReflectorPacket[]>> fSlabs;
+	std::vector<std::unique_ptr<MyReflectorPacket[]>> fRetiredSlabs;
+};
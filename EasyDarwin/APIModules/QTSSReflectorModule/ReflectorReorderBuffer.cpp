@@ -0,0 +1,62 @@
+/*
+	File:       ReflectorReorderBuffer.cpp
+
+	Contains:   Implementation of class defined in ReflectorReorderBuffer.h
+*/
+
+#include <algorithm>
+#include "MyAssert.h"
+#include "ReflectorReorderBuffer.h"
+
+ReflectorReorderBuffer::ReflectorReorderBuffer(uint32_t inWindow, std::chrono::milliseconds inMaxHold)
+	: fMaxHold(inMaxHold)
+{
+	uint32_t theNumSlots = 2;
+	while ((theNumSlots < inWindow) && (theNumSlots < kMaxMisorder))
+		theNumSlots <<= 1;
+
+	fSlots.resize(theNumSlots);
+	fSlotMask = (uint16_t)(theNumSlots - 1);
+}
+
+ReflectorReorderBuffer::time_point ReflectorReorderBuffer::GetDeadline() const
+{
+	if (fNumHeld == 0)
+		return time_point::max();
+	return fOldestArrival + fMaxHold;
+}
+
+void ReflectorReorderBuffer::Hold(uint16_t inSeqNumber, const char* inPacket, size_t inPacketLen, time_point inNow)
+{
+	// The slot's buffer stays allocated once it has grown to a packet's size
+	Slot& theSlot = this->GetSlot(inSeqNumber);
+	Assert(!theSlot.fUsed);
+	theSlot.fPacket.assign(inPacket, inPacket + inPacketLen);
+	theSlot.fArrived = inNow;
+	theSlot.fSeqNumber = inSeqNumber;
+	theSlot.fUsed = true;
+
+	if (fNumHeld++ == 0)
+		fOldestArrival = inNow;
+}
+
+void ReflectorReorderBuffer::UpdateOldestArrival()
+{
+	if (fNumHeld == 0)
+		return;
+
+	fOldestArrival = time_point::max();
+	for (const Slot& theSlot : fSlots)
+		if (theSlot.fUsed)
+			fOldestArrival = std::min(fOldestArrival, theSlot.fArrived);
+}
+
+void ReflectorReorderBuffer::SkipGap()
+{
+	Assert(fNumHeld > 0);
+	while (!this->IsHeld(fNextSeqNumber))
+	{
+		fNumLost++;
+		fNextSeqNumber++;
+	}
+}
@@ -0,0 +1,199 @@
+/*
+	File:       ReflectorReorderBuffer.h
+
+	Contains:   An optional ingest stage for a sender's RTP packets, between
+				the socket and the sender's packet ring. Duplicates are
+				dropped, and packets that arrive ahead of a gap are held back
+				for a little while, so the gap can fill and the ring gets them
+				in sequence number order.
+
+				A packet is held until the ones in front of it arrived, until
+				the window is full, or until it was held for the maximum hold
+				time, whichever comes first. Packets arriving in order, which
+				is nearly all of them, are handed on straight away without
+				being copied.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "SequenceNumberMap.h"
+
+class ReflectorReorderBuffer
+{
+public:
+	using time_point = std::chrono::high_resolution_clock::time_point;
+
+	// Holds up to inWindow packets (rounded up to a power of 2)
+	ReflectorReorderBuffer(uint32_t inWindow, std::chrono::milliseconds inMaxHold);
+
+	ReflectorReorderBuffer(const ReflectorReorderBuffer&) = delete;
+	ReflectorReorderBuffer& operator=(const ReflectorReorderBuffer&) = delete;
+
+	// Takes a packet off the wire, and hands whatever is ready now to
+	// inDeliver(const char* inPacket, size_t inPacketLen), in order. The
+	// pointer is only good for the duration of the call.
+	template <typename Deliver>
+	void        Push(const char* inPacket, size_t inPacketLen, time_point inNow, Deliver&& inDeliver);
+
+	// Gives up on the gaps in front of packets held longer than the maximum
+	// hold time, handing those packets on
+	template <typename Deliver>
+	void        Expire(time_point inNow, Deliver&& inDeliver);
+
+	// When Expire next has something to do, or time_point::max()
+	time_point  GetDeadline() const;
+
+	uint64_t    GetNumDuplicates() const { return fNumDuplicates; }
+	uint64_t    GetNumLate() const { return fNumLate; }         // handed on out of order
+	uint64_t    GetNumLost() const { return fNumLost; }         // gaps given up on
+
+private:
+	struct Slot
+	{
+		std::vector<char>   fPacket;
+		time_point          fArrived;
+		uint16_t            fSeqNumber{ 0 };
+		bool                fUsed{ false };
+	};
+
+	enum
+	{
+		kMaxMisorder = 100,     // further back than this, the source restarted
+		kMaxDropout = 3000      // further ahead than this, the source restarted
+	};
+
+	Slot&       GetSlot(uint16_t inSeqNumber) { return fSlots[inSeqNumber & fSlotMask]; }
+	bool        IsHeld(uint16_t inSeqNumber) { Slot& theSlot = this->GetSlot(inSeqNumber); return theSlot.fUsed && (theSlot.fSeqNumber == inSeqNumber); }
+	void        Hold(uint16_t inSeqNumber, const char* inPacket, size_t inPacketLen, time_point inNow);
+	void        UpdateOldestArrival();
+
+	// Hands on the held packets from fNextSeqNumber on, up to the next gap
+	template <typename Deliver>
+	void        DeliverInOrder(Deliver&& inDeliver);
+
+	// Skips the gap at fNextSeqNumber, up to the next held packet
+	void        SkipGap();
+
+	std::vector<Slot>   fSlots;
+	uint16_t            fSlotMask;
+	std::chrono::milliseconds fMaxHold;
+	SequenceNumberMap   fSeqNumberMap;
+
+	bool                fStarted{ false };
+	uint16_t            fNextSeqNumber{ 0 };
+	uint32_t            fNumHeld{ 0 };
+	time_point          fOldestArrival;
+
+	uint64_t            fNumDuplicates{ 0 };
+	uint64_t            fNumLate{ 0 };
+	uint64_t            fNumLost{ 0 };
+};
+
+template <typename Deliver>
+void ReflectorReorderBuffer::Push(const char* inPacket, size_t inPacketLen, time_point inNow, Deliver&& inDeliver)
+{
+	// Without an RTP header there is nothing to order by
+	if ((inPacketLen < 12) || ((inPacket[0] & 0xC0) != 0x80))
+	{
+		inDeliver(inPacket, inPacketLen);
+		return;
+	}
+
+	uint16_t theSeqNumber = (uint16_t)(((uint8_t)inPacket[2] << 8) | (uint8_t)inPacket[3]);
+	if (fSeqNumberMap.AddSequenceNumber(theSeqNumber))
+	{
+		fNumDuplicates++;
+		return;
+	}
+
+	if (!fStarted)
+	{
+		fNextSeqNumber = theSeqNumber;
+		fStarted = true;
+	}
+
+	int16_t theOffset = (int16_t)(theSeqNumber - fNextSeqNumber);
+	if ((theOffset < -kMaxMisorder) || (theOffset > kMaxDropout))
+	{
+		// The source started over: whatever is held won't be completed
+		while (fNumHeld > 0)
+		{
+			this->SkipGap();
+			this->DeliverInOrder(inDeliver);
+		}
+		fNextSeqNumber = theSeqNumber;
+		theOffset = 0;
+	}
+
+	if (theOffset < 0)
+	{
+		// We gave up on this one already, it's still better late than never
+		fNumLate++;
+		inDeliver(inPacket, inPacketLen);
+		return;
+	}
+
+	if (theOffset == 0)
+	{
+		inDeliver(inPacket, inPacketLen);
+		fNextSeqNumber++;
+		this->DeliverInOrder(inDeliver);
+	}
+	else
+	{
+		// Make room: the window ends where this packet is
+		while ((uint32_t)theOffset > fSlotMask)
+		{
+			if (this->IsHeld(fNextSeqNumber))
+				this->DeliverInOrder(inDeliver);
+			else
+			{
+				fNumLost++;
+				fNextSeqNumber++;
+			}
+			theOffset = (int16_t)(theSeqNumber - fNextSeqNumber);
+		}
+
+		if (theOffset == 0)
+		{
+			inDeliver(inPacket, inPacketLen);
+			fNextSeqNumber++;
+			this->DeliverInOrder(inDeliver);
+		}
+		else
+			this->Hold(theSeqNumber, inPacket, inPacketLen, inNow);
+	}
+
+	this->Expire(inNow, inDeliver);
+}
+
+template <typename Deliver>
+void ReflectorReorderBuffer::Expire(time_point inNow, Deliver&& inDeliver)
+{
+	while ((fNumHeld > 0) && (inNow - fOldestArrival >= fMaxHold))
+	{
+		this->SkipGap();
+		this->DeliverInOrder(inDeliver);
+	}
+}
+
+template <typename Deliver>
+void ReflectorReorderBuffer::DeliverInOrder(Deliver&& inDeliver)
+{
+	bool delivered = false;
+	while (this->IsHeld(fNextSeqNumber))
+	{
+		Slot& theSlot = this->GetSlot(fNextSeqNumber);
+		inDeliver(theSlot.fPacket.data(), theSlot.fPacket.size());
+		theSlot.fUsed = false;
+		fNumHeld--;
+		fNextSeqNumber++;
+		delivered = true;
+	}
+
+	if (delivered)
+		this->UpdateOldestArrival();
+}
@@ -0,0 +1,75 @@
+/*
+	File:       ReflectorRetention.cpp
+
+	Contains:   Implementation of object defined in ReflectorRetention.h.
+*/
+
+#include <algorithm>
+#include "ReflectorRetention.h"
+#include "ReflectorMemoryGovernor.h"
+
+ReflectorRetention::ReflectorRetention(ReflectorPacketRing* inRing, ReflectorGOPCache* inGOPCache, bool inIsStream)
+	: fRing(inRing),
+	fGOPCache(inGOPCache),
+	fIsStream(inIsStream)
+{
+	if (fIsStream)
+		ReflectorMemoryGovernor::GetInstance().AddStream();
+}
+
+ReflectorRetention::~ReflectorRetention()
+{
+	ReflectorMemoryGovernor& theGovernor = ReflectorMemoryGovernor::GetInstance();
+	if (fIsStream)
+		theGovernor.RemoveStream();
+	theGovernor.AddBytes(-(int64_t)fRetainedBytes, -(int64_t)fAllocatedBytes);
+}
+
+void ReflectorRetention::Trim(uint64_t inBytesAppended, uint64_t inKeyFrameSeq, uint64_t inOldestBookmark,
+	std::chrono::high_resolution_clock::time_point inNow)
+{
+	static constexpr auto sMaxPacketAge = std::chrono::seconds(20);
+
+	ReflectorMemoryGovernor& theGovernor = ReflectorMemoryGovernor::GetInstance();
+	uint64_t theBudget = theGovernor.GetStreamBudget();
+
+	// Under pressure, what the ring lets go of goes back to the heap
+	fRing->SetKeepSpareSlabs(!theGovernor.IsUnderPressure());
+
+	uint64_t theLimit = fRing->Head();
+	if (inKeyFrameSeq != ReflectorPacketRing::kInvalidSeq)
+		theLimit = std::min(theLimit, inKeyFrameSeq);
+	uint64_t theAgeLimit = std::min(theLimit, inOldestBookmark);
+
+	// Start at the oldest packet and walk forward to the newest packet
+	uint64_t theSeq = fRing->Tail();
+	uint64_t theRetainedBytes = 0;
+	for (; theSeq < fRing->Head(); ++theSeq)
+	{
+		MyReflectorPacket* thePacket = fRing->Acquire(theSeq);
+		if (thePacket == nullptr)
+			continue;
+
+		auto packetDelay = inNow - thePacket->fTimeArrived;
+		theRetainedBytes = inBytesAppended - thePacket->fStreamByteOffset;
+		fRing->Release(thePacket);
+
+		// this packet is going to be kept around as well as the ones that follow.
+		bool isOverBudget = theRetainedBytes > theBudget;
+		bool isTooOld = (theSeq < theAgeLimit) && (packetDelay > sMaxPacketAge);
+		if ((theSeq >= theLimit) || (!isOverBudget && !isTooOld))
+			break;
+		theRetainedBytes = 0;
+	}
+
+	fRing->Trim(theSeq);
+
+	// A long GOP may reach back past what is left in the ring
+	theRetainedBytes = std::max<uint64_t>(theRetainedBytes, fGOPCache->GetNumBytes());
+	uint64_t theAllocatedBytes = fRing->GetAllocatedBytes() + fGOPCache->GetAllocatedBytes();
+
+	theGovernor.AddBytes((int64_t)theRetainedBytes - (int64_t)fRetainedBytes,
+		(int64_t)theAllocatedBytes - (int64_t)fAllocatedBytes);
+	fRetainedBytes = theRetainedBytes;
+	fAllocatedBytes = theAllocatedBytes;
+}
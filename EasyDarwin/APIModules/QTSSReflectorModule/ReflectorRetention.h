@@ -0,0 +1,48 @@
+/*
+	File:       ReflectorRetention.h
+
+	Contains:   Decides which packets a ReflectorSender's ring lets go of, and
+				tells the ReflectorMemoryGovernor what the sender holds.
+
+				Packets go once the stream retains more than its budget after
+				them, or when they are too old and no output has them bookmarked.
+				From the latest key frame onwards everything is kept, and so is
+				what the GOP cache holds.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include "ReflectorGOPCache.h"
+#include "ReflectorPacketRing.h"
+
+class ReflectorRetention
+{
+public:
+	// Only a stream that carries media counts towards the governor's share;
+	// what the others hold counts all the same
+	ReflectorRetention(ReflectorPacketRing* inRing, ReflectorGOPCache* inGOPCache, bool inIsStream);
+	~ReflectorRetention();
+
+	ReflectorRetention(const ReflectorRetention&) = delete;
+	ReflectorRetention& operator=(const ReflectorRetention&) = delete;
+
+	// inBytesAppended is the stream's byte offset after its newest packet,
+	// inKeyFrameSeq where its latest GOP starts (or kInvalidSeq), and
+	// inOldestBookmark the oldest packet an output still has to get
+	void        Trim(uint64_t inBytesAppended, uint64_t inKeyFrameSeq, uint64_t inOldestBookmark,
+		std::chrono::high_resolution_clock::time_point inNow);
+
+	uint64_t    GetRetainedBytes() const { return fRetainedBytes; }
+	uint64_t    GetAllocatedBytes() const { return fAllocatedBytes; }
+
+private:
+	ReflectorPacketRing*    fRing;
+	ReflectorGOPCache*      fGOPCache;
+	bool                    fIsStream;
+
+	// As last told to the ReflectorMemoryGovernor
+	uint64_t                fRetainedBytes{ 0 };
+	uint64_t                fAllocatedBytes{ 0 };
+};
@@ -37,6 +37,9 @@
 #include "SDPSourceInfo.h"
 #include "MyRTSPRequest.h"
 #include "MyReflectorPacket.h"
+#include "ServerPrefs.h"
+#include "ReflectorMemoryGovernor.h"
+#include "ReflectorViewerLag.h"
 
 #if DEBUG
 #define REFLECTOR_STREAM_DEBUGGING 0
@@ -47,11 +50,18 @@
 
 static ReflectorSocketPool  sSocketPool;
 
+// METRICS
+static ServerMetrics::Counter&    sIngestPackets = ServerMetrics::GetCounter("easydarwin_reflector_ingest_packets_total", "Packets received by the reflector");
+static ServerMetrics::Counter&    sIngestBytes = ServerMetrics::GetCounter("easydarwin_reflector_ingest_bytes_total", "Bytes received by the reflector");
+static ServerMetrics::Counter&    sEgressPackets = ServerMetrics::GetCounter("easydarwin_reflector_egress_packets_total", "Packets written to reflector outputs");
+static ServerMetrics::Counter&    sEgressBytes = ServerMetrics::GetCounter("easydarwin_reflector_egress_bytes_total", "Bytes written to reflector outputs");
+static ServerMetrics::Histogram&  sOutputBacklog = ServerMetrics::GetHistogram("easydarwin_reflector_output_backlog_packets", "Packets an output is behind when the reflector gets to it");
+static ServerMetrics::Counter&    sOutputSkips = ServerMetrics::GetCounter("easydarwin_reflector_output_skips_total", "Times a reflector output fell too far behind and skipped to a key frame");
+
 // PREFS
 static uint32_t                   sDefaultOverBufferInSec = 1;
 static uint32_t					sDefaultRTPReflectorThresholdMsec = 2000;
 
-static uint32_t                   sDefaultBucketDelayInMsec = 73;
 static bool						sDefaultUsePacketReceiveTime = false;
 static uint32_t                   sDefaultMaxFuturePacketTimeSec = 60;
 static uint32_t                   sDefaultFirstPacketOffsetMsec = 500;
@@ -147,9 +157,6 @@ ReflectorStream::ReflectorStream(StreamInfo* inInfo)
 		fDestRTCPAddr = fStreamInfo.fDestIPAddr;
 		fDestRTCPPort = fStreamInfo.fPort + 1;
 	}
-
-	pkeyFrameCache = new CKeyFrameCache(MAX_CACHE_SIZE);
-
 }
 
 
@@ -174,19 +181,16 @@ ReflectorStream::~ReflectorStream()
 		if (qtssRTPTransportTypeTCP == fTransportType)
 			sSocketPool.DestructUDPSocketPair(fSockets);
 	}
-
-	// ͷŹؼ֡
-	if (pkeyFrameCache)
-	{
-		delete pkeyFrameCache;
-		pkeyFrameCache = nullptr;
-	}
 }
 
 void ReflectorStream::AddOutput(ReflectorOutput* inOutput)
 {
 	OSMutexLocker locker(&fBucketMutex);
-	fOutputArray.push_back(inOutput);
+	auto it = std::find(begin(fOutputArray), end(fOutputArray), nullptr);
+	if (it != end(fOutputArray))
+		*it = inOutput;
+	else
+		fOutputArray.push_back(inOutput);
 }
 
 void  ReflectorStream::RemoveOutput(ReflectorOutput* inOutput)
@@ -194,7 +198,10 @@ void  ReflectorStream::RemoveOutput(ReflectorOutput* inOutput)
 	OSMutexLocker locker(&fBucketMutex);
 	auto it = std::find(begin(fOutputArray), end(fOutputArray), inOutput);
 	if (it != end(fOutputArray))
-		fOutputArray.erase(it);
+		*it = nullptr;
+
+	while (!fOutputArray.empty() && fOutputArray.back() == nullptr)
+		fOutputArray.pop_back();
 }
 
 void  ReflectorStream::TearDownAllOutputs()
@@ -202,9 +209,10 @@ void  ReflectorStream::TearDownAllOutputs()
 	OSMutexLocker locker(&fBucketMutex);
 
 	//look at all the indexes in the array
-	for (auto &theOutputPtr : fOutputArray)
+	for (size_t x = 0; x < fOutputArray.size(); x++)
 	{
-		theOutputPtr->TearDown();
+		if (fOutputArray[x] != nullptr)
+			fOutputArray[x]->TearDown();
 #if REFLECTOR_STREAM_DEBUGGING  
 		printf("TearDownAllOutputs Removing output from bucket %" _S32BITARG_ ", index %" _S32BITARG_ "\n", x, y);
 #endif
@@ -295,38 +303,76 @@ void ReflectorStream::SendReceiverReport()
 	(void)fSockets->GetSocketB()->SendTo(fDestRTCPAddr, fDestRTCPPort, temp);
 }
 
-void ReflectorStream::PushPacket(char *packet, size_t packetLen, bool isRTCP)
+void ReflectorStream::PushPacket(const char *packet, size_t packetLen, bool isRTCP)
 {
 	if (packetLen > 0)
 	{
-		auto thePacket = std::make_unique<MyReflectorPacket>(packet, packetLen);
 		if (isRTCP)
 		{
 			//printf("ReflectorStream::PushPacket RTCP packetlen = %"   _U32BITARG_   "\n",packetLen);
-			fSockets->GetSocketB()->ProcessPacket(std::chrono::high_resolution_clock::now(), std::move(thePacket), 0, 0);
+			fSockets->GetSocketB()->ProcessPacket(std::chrono::high_resolution_clock::now(), packet, packetLen, 0, 0);
 			fSockets->GetSocketB()->Signal(Task::kIdleEvent);
 		}
 		else
 		{
-			fSockets->GetSocketA()->ProcessPacket(std::chrono::high_resolution_clock::now(), std::move(thePacket), 0, 0);
+			fSockets->GetSocketA()->ProcessPacket(std::chrono::high_resolution_clock::now(), packet, packetLen, 0, 0);
 			fSockets->GetSocketA()->Signal(Task::kIdleEvent);
 		}
 	}
 }
 
+void    ReflectorStream::UpdateBitRate(time_point currentTime)
+{
+	static constexpr auto kBitRateAvgInterval = std::chrono::milliseconds(30000); // time between bitrate averages
+	if (std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - fLastBitRateSample) > kBitRateAvgInterval)
+	{
+		uint64_t intervalBytes = fBytesSentInThisInterval;
+		fBytesSentInThisInterval -= intervalBytes;
+
+		// Multiply by 1000 to convert from milliseconds to seconds, and by 8 to convert from bytes to bits.
+		// In 64 bits, a 32 bit product overflows past about 143 Kbit/s
+		uint64_t bps = (intervalBytes * 8 * 1000) / std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - fLastBitRateSample).count();
+		fCurrentBitRate = (uint32_t)std::min<uint64_t>(bps, UINT32_MAX);
+
+		if (fBitRateGauge == nullptr && fMyReflectorSession != nullptr)
+			fBitRateGauge = ServerMetrics::AddLabelledGauge("easydarwin_reflector_stream_bitrate_bits",
+				"Average incoming bit rate of a reflected stream",
+				{ { "stream", fMyReflectorSession->GetStreamName().to_string() }, { "track", std::to_string(fStreamInfo.fTrackID) } });
+		if (fBitRateGauge != nullptr)
+			fBitRateGauge->Set((int64_t)bps);
+
+		// Don't check again for awhile!
+		fLastBitRateSample = currentTime;
+	}
+}
+
 ReflectorSender::ReflectorSender(ReflectorStream* inStream, uint32_t inWriteFlag)
 	: fStream(inStream),
 	fWriteFlag(inWriteFlag),
-	fKeyFrameStartPacketElementPointer(nullptr)
+	fPacketRing(kPacketRingCapacity),
+	fGOPCache(&fPacketRing, ServerPrefs::GetReflectorGOPCacheSizeInK() * 1024),
+	fRetention(&fPacketRing, &fGOPCache, inWriteFlag == qtssWriteFlagsIsRTP)
+{
+	if ((fWriteFlag == qtssWriteFlagsIsRTP) && (ServerPrefs::GetReflectorReorderWindow() > 0))
+		fReorderBuffer = std::make_unique<ReflectorReorderBuffer>(ServerPrefs::GetReflectorReorderWindow(),
+			std::chrono::milliseconds(ServerPrefs::GetReflectorReorderMaxHoldMsec()));
+
+	ReflectorMemoryGovernor::GetInstance().SetLimits((uint64_t)ServerPrefs::GetReflectorStreamRetentionInK() * 1024,
+		(uint64_t)ServerPrefs::GetReflectorMaxRetentionInMB() * 1024 * 1024);
+}
+
+ReflectorSender::~ReflectorSender()
 {
 }
 
 bool ReflectorSender::ShouldReflectNow()
 {
 	//check to make sure there actually is work to do for this stream.
-	if (!fHasNewPackets)
-		return false;
-	return true;
+	if (fHasNewPackets)
+		return true;
+
+	//or that a bucket is due packets it was held back from
+	return std::chrono::high_resolution_clock::now() >= fNextBucketTime;
 }
 
 #if REFLECTOR_STREAM_DEBUGGING
@@ -359,7 +405,9 @@ static uint16_t DGetPacketSeqNumber(StrPtrLen* inPacket)
 /   groups the ReflectorOutput's into buckets.  The input streams are reflected to
 /   each bucket progressively later in time.  So rather than send a single packet
 /   to say 1000 clients all at once, we send it to just the first 16, then then next 16
-/   100 ms later and so on.
+/   73 ms later and so on (see ServerPrefs::GetReflectorBucketOffsetDelayMsec).
+/   fNextBucketTime tells the socket when to run us again for a bucket that
+/   is still owed packets.
 /
 /
 /   intputs     ioWakeupTime - relative time to call us again in MSec
@@ -389,59 +437,155 @@ void ReflectorSender::ReflectPackets()
 	// Check to see if we should update the session's bitrate average
 	fStream->UpdateBitRate(currentTime);
 
-	MyReflectorPacket *fFirstPacketInQueueForNewOutput = 
-		fKeyFrameStartPacketElementPointer ? fKeyFrameStartPacketElementPointer : 
+	uint64_t theHead = fPacketRing.Head();
+	uint64_t theTail = fPacketRing.Tail();
+	uint64_t theKeyFrameSeq = fKeyFrameStartSeq.load(std::memory_order_acquire);
+	uint64_t theFirstSeqForNewOutput =
+		(theKeyFrameSeq != ReflectorPacketRing::kInvalidSeq && theKeyFrameSeq >= theTail) ? theKeyFrameSeq :
 		GetClientBufferStartPacketOffset(std::chrono::seconds(0));
 
-	for (auto &theOutput : fStream->fOutputArray)
+	// New outputs get the cached GOP burst at them first, so they can start
+	// decoding straight away. It also stays reachable after the ring wraps.
+	uint64_t theGOPStartSeq = fGOPCache.GetStartSeq();
+	if (theGOPStartSeq != ReflectorPacketRing::kInvalidSeq)
+	{
+		theFirstSeqForNewOutput = theGOPStartSeq;
+		theTail = std::min(theTail, theGOPStartSeq);
+	}
+	uint64_t theOldestBookmark = theHead;
+
+	ReflectorBucketSchedule theSchedule(currentTime, ReflectorStream::sBucketSize,
+		std::chrono::milliseconds(ServerPrefs::GetReflectorBucketOffsetDelayMsec()));
+	uint32_t theBucket = 0;
+	uint64_t theBucketHead = theHead;
+	fNextBucketTime = std::chrono::high_resolution_clock::time_point::max();
+
+	for (size_t theIndex = 0; theIndex < fStream->fOutputArray.size(); theIndex++)
 	{
-		if (false == theOutput->IsPlaying()) continue;
+		ReflectorOutput* theOutput = fStream->fOutputArray[theIndex];
+		if (theOutput == nullptr || false == theOutput->IsPlaying()) continue;
+
+		// Buckets get the packets that arrived at least their delay ago
+		if (theSchedule.GetBucket(theIndex) != theBucket)
+		{
+			theBucket = theSchedule.GetBucket(theIndex);
+			theBucketHead = GetBucketHead(theSchedule.GetCutoff(theBucket), theTail, theBucketHead);
+			if (MyReflectorPacket* thePacket = (theBucketHead < theHead) ? this->AcquirePacket(theBucketHead) : nullptr)
+			{
+				fNextBucketTime = std::min(fNextBucketTime, theSchedule.GetDueTime(thePacket->fTimeArrived, theBucket));
+				fPacketRing.Release(thePacket);
+			}
+		}
+
 		OSMutexLocker locker(&theOutput->fMutex);
-		MyReflectorPacket* packetElem = theOutput->GetBookMarkedPacket(fPacketQueue);
-		if (packetElem == nullptr) // should only be a new output
-			packetElem = fFirstPacketInQueueForNewOutput; // everybody starts at the oldest packet in the buffer delay or uses a bookmark
+		ReflectorOutput::BookMark theBookMark;
+		if (!theOutput->GetBookMarkedPacket(this, &theBookMark))
+		{
+			theBookMark.fSender = this;
+			theBookMark.fSeq = theFirstSeqForNewOutput; // everybody starts at the oldest packet in the buffer delay or uses a bookmark
+			theBookMark.fAwaitingKeyFrame = false;
+			theBookMark.fJoinTime = currentTime;
+			theBookMark.fJoinByteOffset = fBytesAppended.load(std::memory_order_relaxed);
+		}
+		else if (theBookMark.fSeq < theTail)
+		{
+			// So far behind that even the ring's overflow let go of its packets
+			sOutputSkips.Add();
+			theBookMark.fSeq = theFirstSeqForNewOutput;
+			theBookMark.fAwaitingKeyFrame = false;
+		}
+		uint64_t& theSeq = theBookMark.fSeq;
+		bool& isAwaitingKeyFrame = theBookMark.fAwaitingKeyFrame;
+
+		if (isAwaitingKeyFrame)
+			isAwaitingKeyFrame = this->AwaitKeyFrame(&theSeq);
 
-		packetElem = SendPacketsToOutput(theOutput, packetElem);
-		if (packetElem)
+		if (!isAwaitingKeyFrame)
 		{
-			MyReflectorPacket* thePacket = NeedRelocateBookMark(packetElem);
+			sOutputBacklog.Observe((theBucketHead > theSeq) ? theBucketHead - theSeq : 0);
+			theSeq = SendPacketsToOutput(theOutput, theSeq, theBucketHead);
 
-			thePacket->fNeededByOutput = true; 				// flag to prevent removal in RemoveOldPackets
-			theOutput->SetBookMarkPacket(thePacket); 	// store a reference to the packet
+			// A viewer that can't keep up would hold on to the packets it didn't
+			// take, and fall further behind live with every one
+			if (this->IsOutputCongested(theBookMark, theBucketHead, theSchedule, theBucket))
+			{
+				sOutputSkips.Add();
+				isAwaitingKeyFrame = this->SkipToKeyFrame(&theSeq, theHead);
+			}
 		}
+
+		theOutput->SetBookMarkPacket(theBookMark); 	// store where to pick up next time
+		theOldestBookmark = std::min(theOldestBookmark, theSeq); // prevent removal in RemoveOldPackets
 	}
 
-	RemoveOldPackets();
+	// UDP outputs only queued what they were given. Outputs sharing a socket
+	// pool pair all go out together here, in as few sends as possible.
+	for (auto &theOutput : fStream->fOutputArray)
+		if (theOutput != nullptr)
+			theOutput->FlushPackets();
+
+	for (auto thePacket : fWrittenPackets)
+		fPacketRing.Release(thePacket);
+	fWrittenPackets.clear();
+
+	// Packets the outputs have yet to get must survive the ring wrapping around
+	fPacketRing.SetLowWaterSeq(theOldestBookmark);
+	RemoveOldPackets(theOldestBookmark);
 }
 
-MyReflectorPacket*    ReflectorSender::SendPacketsToOutput(ReflectorOutput* theOutput, MyReflectorPacket* currentPacket)
+uint64_t    ReflectorSender::SendPacketsToOutput(ReflectorOutput* theOutput, uint64_t inSeq, uint64_t inHead)
 {
-	auto it = std::find_if(begin(fPacketQueue), end(fPacketQueue),
-		[currentPacket](const std::unique_ptr<MyReflectorPacket> &pkt) {
-		return pkt.get() == currentPacket;
-	});
+	// The output gets the packets in batches, so that an interleaved one can
+	// write a batch in a single writev instead of a write per packet
+	MyReflectorPacket* thePackets[kMaxPacketsPerWrite];
+	uint64_t theSeqs[kMaxPacketsPerWrite];
 
-	QTSS_Error err = QTSS_NoErr;
-	for (; it != fPacketQueue.end(); ++it)
+	while (inSeq < inHead)
 	{
-		const auto &thePacket = *it;
-
-		//printf("packetLateness %qd, seq# %li\n", packetLateness, (int32_t) DGetPacketSeqNumber( &thePacket->fPacketPtr ) );          
+		uint32_t theNumPackets = 0;
+		for (; (inSeq < inHead) && (theNumPackets < kMaxPacketsPerWrite); ++inSeq)
+		{
+			MyReflectorPacket* thePacket = this->AcquirePacket(inSeq);
+			if (thePacket == nullptr)
+				continue; // recycled while we were working our way up to it
 
-		err = theOutput->WritePacket(thePacket->fPacket, fStream, fWriteFlag, 
-			thePacket->fStreamCountID);
+			thePackets[theNumPackets] = thePacket;
+			theSeqs[theNumPackets++] = inSeq;
+		}
 
-		if (err == QTSS_WouldBlock)
-		{ 
+		if (theNumPackets == 0)
 			break;
+
+		uint32_t theNumWritten = 0;
+		QTSS_Error err = theOutput->WritePackets(thePackets, theNumPackets, fStream, fWriteFlag, &theNumWritten);
+		uint64_t theNumBytes = 0;
+		for (uint32_t x = 0; x < theNumPackets; x++)
+		{
+			if (x < theNumWritten)
+			{
+				theNumBytes += thePackets[x]->fPacket.size();
+				fWrittenPackets.push_back(thePackets[x]); // released after FlushPackets
+			}
+			else
+				fPacketRing.Release(thePackets[x]);
+		}
+		sEgressPackets.Add(theNumWritten);
+		sEgressBytes.Add(theNumBytes);
+
+		if (theNumWritten < theNumPackets)
+		{
+			if (err == QTSS_WouldBlock)
+				return theSeqs[theNumWritten];
+
+			inSeq = theSeqs[theNumWritten] + 1; // skip the packet that failed
 		}
 	}
 
-	return fPacketQueue.back().get();
+	return inSeq;
 }
 
 
-MyReflectorPacket* ReflectorSender::GetClientBufferStartPacketOffset(std::chrono::seconds offset)
+uint64_t ReflectorSender::GetClientBufferStartPacketOffset(std::chrono::seconds offset)
 {
 	auto theCurrentTime = std::chrono::high_resolution_clock::now();
 
@@ -451,105 +595,165 @@ MyReflectorPacket* ReflectorSender::GetClientBufferStartPacketOffset(std::chrono
 	if (offset > sOverBufferInSec)
 		offset = sOverBufferInSec;
 
-	for (const auto &thePacket : fPacketQueue)
+	// Arrival times only grow along the ring, so binary search for the
+	// oldest packet that is still inside the client buffer window.
+	uint64_t theLow = fPacketRing.Tail();
+	uint64_t theHigh = fPacketRing.Head();
+	while (theLow < theHigh)
 	{
-		auto packetDelay = theCurrentTime - thePacket->fTimeArrived;
-		if (packetDelay <= sOverBufferInSec - offset)
-			return thePacket.get();
+		uint64_t theMid = theLow + (theHigh - theLow) / 2;
+		bool tooOld = true;
+		if (MyReflectorPacket* thePacket = fPacketRing.Acquire(theMid))
+		{
+			tooOld = theCurrentTime - thePacket->fTimeArrived > sOverBufferInSec - offset;
+			fPacketRing.Release(thePacket);
+		}
+
+		if (tooOld)
+			theLow = theMid + 1;
+		else
+			theHigh = theMid;
 	}
 
-	return nullptr;
+	return theLow;
 }
 
-void    ReflectorSender::RemoveOldPackets()
+void    ReflectorSender::RemoveOldPackets(uint64_t inOldestBookmark)
 {
-	// Iterate through the senders queue to clear out packets
-	// Start at the oldest packet and walk forward to the newest packet
-	// 
-	auto theCurrentTime = std::chrono::high_resolution_clock::now();
-	static constexpr auto sMaxPacketAge = std::chrono::seconds(20);
-
-	for (auto it = fPacketQueue.begin(); it != fPacketQueue.end(); )
-	{
-		const auto &thePacket = *it;
+	fRetention.Trim(fBytesAppended.load(std::memory_order_relaxed), fKeyFrameStartSeq.load(std::memory_order_acquire),
+		inOldestBookmark, std::chrono::high_resolution_clock::now());
+}
 
-		auto packetDelay = std::chrono::duration_cast<std::chrono::milliseconds>(theCurrentTime - thePacket->fTimeArrived);
+uint64_t ReflectorSender::GetBucketHead(std::chrono::high_resolution_clock::time_point inCutoff, uint64_t inLow, uint64_t inHigh)
+{
+	return ReflectorBucketSchedule::FindFirstArrivedAfter(inCutoff, inLow, inHigh,
+		[this](uint64_t inSeq, std::chrono::high_resolution_clock::time_point* outArrived) {
+		MyReflectorPacket* thePacket = this->AcquirePacket(inSeq);
+		if (thePacket == nullptr)
+			return false;
+		*outArrived = thePacket->fTimeArrived;
+		fPacketRing.Release(thePacket);
+		return true;
+	});
+}
 
-		// walk q and remove packets that are too old
-		if (!thePacket->fNeededByOutput && packetDelay > sMaxPacketAge) // delete based on late tolerance and whether a client is blocked on the packet
-		{
-			printf("erase packet\n");
-			// not needed and older than our required buffer
-			it = fPacketQueue.erase(it);
-		}
-		else
-		{
-			// we want to keep all of these but we should reset the es that should be aged out unless marked
-			// as need the next time through reflect packets.
-			++it;
+bool ReflectorSender::IsOutputCongested(const ReflectorOutput::BookMark& inBookMark, uint64_t inBucketHead,
+	const ReflectorBucketSchedule& inSchedule, uint32_t inBucket)
+{
+	if (inBookMark.fSeq >= inBucketHead)
+		return false; // caught up
 
-			if (fKeyFrameStartPacketElementPointer == thePacket.get())
-					break;
+	MyReflectorPacket* thePacket = this->AcquirePacket(inBookMark.fSeq);
+	if (thePacket == nullptr)
+		return false;
 
-			thePacket->fNeededByOutput = false; //mark not needed.. will be set next time through reflect packets
-			if (packetDelay <= sMaxPacketAge)  // this packet is going to be kept around as well as the ones that follow.
-				break;
-		}
+	auto theLag = inSchedule.GetLag(thePacket->fTimeArrived, inBucket, inBookMark.fJoinTime);
+	uint64_t theHeadByteOffset = fBytesAppended.load(std::memory_order_relaxed);
+	if (MyReflectorPacket* theHeadPacket = this->AcquirePacket(inBucketHead))
+	{
+		theHeadByteOffset = theHeadPacket->fStreamByteOffset;
+		fPacketRing.Release(theHeadPacket);
 	}
+	uint64_t theByteOffset = std::max(thePacket->fStreamByteOffset, inBookMark.fJoinByteOffset);
+	uint64_t theBytesBehind = (theHeadByteOffset > theByteOffset) ? theHeadByteOffset - theByteOffset : 0;
+	fPacketRing.Release(thePacket);
+
+	ReflectorViewerLag theLimits(std::chrono::milliseconds(ServerPrefs::GetReflectorMaxViewerLagMsec()),
+		(uint64_t)ServerPrefs::GetReflectorMaxViewerLagInK() * 1024);
+	return theLimits.IsCongested(theLag, theBytesBehind);
 }
 
-// if current packet over max packetAgeTime, we need relocate the BookMark to
-// the new fKeyFrameStartPacketElementPointer
-MyReflectorPacket* ReflectorSender::NeedRelocateBookMark(MyReflectorPacket* thePacket)
+bool ReflectorSender::SkipToKeyFrame(uint64_t* ioSeq, uint64_t inHead)
 {
-	Assert(thePacket);
+	uint64_t theKeyFrameSeq = fKeyFrameStartSeq.load(std::memory_order_acquire);
+	if (theKeyFrameSeq != ReflectorPacketRing::kInvalidSeq && theKeyFrameSeq > *ioSeq)
+		fStream->GetMyReflectorSession()->SetHasVideoKeyFrameUpdate(true);
 
-	auto packetDelay = 
-		std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - thePacket->fTimeArrived);
+	return ReflectorViewerLag::SkipToKeyFrame(theKeyFrameSeq, ioSeq, inHead);
+}
 
-	static constexpr auto sRelocatePacketAge = std::chrono::seconds(1);
-	if (packetDelay > sRelocatePacketAge)
+bool ReflectorSender::AwaitKeyFrame(uint64_t* ioSeq)
+{
+	return ReflectorViewerLag::AwaitKeyFrame(fKeyFrameStartSeq.load(std::memory_order_acquire), ioSeq);
+}
+
+MyReflectorPacket* ReflectorSender::AcquirePacket(uint64_t inSeq)
+{
+	MyReflectorPacket* thePacket = fPacketRing.Acquire(inSeq);
+	if (thePacket == nullptr)
+		thePacket = fGOPCache.Acquire(inSeq);
+	return thePacket;
+}
+
+void ReflectorSender::receivePacket(const char* inPacket, size_t inPacketLen, bool isRTCP)
+{
+	if (isRTCP || (fReorderBuffer == nullptr))
 	{
-		if (fKeyFrameStartPacketElementPointer && fKeyFrameStartPacketElementPointer->fTimeArrived > thePacket->fTimeArrived)
-		{
-			fStream->GetMyReflectorSession()->SetHasVideoKeyFrameUpdate(true);
-			return fKeyFrameStartPacketElementPointer;
-		}
+		this->appendPacket(inPacket, inPacketLen, isRTCP);
+		return;
 	}
 
-	return thePacket;
+	std::lock_guard<std::mutex> locker(fReorderMutex);
+	fReorderBuffer->Push(inPacket, inPacketLen, std::chrono::high_resolution_clock::now(),
+		[this](const char* inData, size_t inDataLen) { this->appendPacket(inData, inDataLen, false); });
+}
+
+void ReflectorSender::expireHeldPackets(std::chrono::high_resolution_clock::time_point inNow)
+{
+	if (fReorderBuffer == nullptr)
+		return;
+
+	std::lock_guard<std::mutex> locker(fReorderMutex);
+	fReorderBuffer->Expire(inNow,
+		[this](const char* inData, size_t inDataLen) { this->appendPacket(inData, inDataLen, false); });
+}
+
+std::chrono::high_resolution_clock::time_point ReflectorSender::GetWakeupTime()
+{
+	if (fReorderBuffer == nullptr)
+		return fNextBucketTime;
+
+	std::lock_guard<std::mutex> locker(fReorderMutex);
+	return std::min(fNextBucketTime, fReorderBuffer->GetDeadline());
 }
 
-void ReflectorSender::appendPacket(std::unique_ptr<MyReflectorPacket> thePacket)
+void ReflectorSender::appendPacket(const char* inPacket, size_t inPacketLen, bool isRTCP)
 {
-	if (!thePacket->IsRTCP())
+	// Copy straight into a recycled ring slot; nothing is allocated once the ring is warm
+	MyReflectorPacket* thePacket = fPacketRing.Reserve();
+	thePacket->SetPacketData(inPacket, inPacketLen);
+	thePacket->fIsRTCP = isRTCP;
+	thePacket->fStreamCountID = ++(fStream->fPacketCount);
+	thePacket->SetArrival(std::chrono::high_resolution_clock::now(), fBytesAppended.load(std::memory_order_relaxed));
+	fBytesAppended.store(thePacket->fStreamByteOffset + inPacketLen, std::memory_order_relaxed);
+
+	auto type = isRTCP ? KeyFrameType::None : needToUpdateKeyFrame(fStream, *thePacket);
+	bool startsGOP = type != KeyFrameType::None && !fLastPacketWasKeyFrame;
+	fLastPacketWasKeyFrame = type != KeyFrameType::None;
+
+	uint64_t theSeq = fPacketRing.Publish(thePacket);
+	fGOPCache.Append(thePacket, theSeq, startsGOP);
+
+	if (startsGOP)
 	{
-		auto type = needToUpdateKeyFrame(fStream, *thePacket);
-		if (needToUpdateKeyFrame(fStream, *thePacket) != KeyFrameType::None)
-		{
-			if (fKeyFrameStartPacketElementPointer)
-				fKeyFrameStartPacketElementPointer->fNeededByOutput = false;
-
-			thePacket->fNeededByOutput = true;
-			fKeyFrameStartPacketElementPointer = thePacket.get();
-			if (type == KeyFrameType::Video) 
-				fStream->GetMyReflectorSession()->SetHasVideoKeyFrameUpdate(true);
-			else 
-				fStream->GetMyReflectorSession()->SetHasVideoKeyFrameUpdate(false);
-		}
+		fKeyFrameStartSeq.store(theSeq, std::memory_order_release);
+		if (type == KeyFrameType::Video) 
+			fStream->GetMyReflectorSession()->SetHasVideoKeyFrameUpdate(true);
+		else 
+			fStream->GetMyReflectorSession()->SetHasVideoKeyFrameUpdate(false);
 	}
 
 	fHasNewPackets = true;
+	sIngestPackets.Add();
+	sIngestBytes.Add(inPacketLen);
 
-	if (!(thePacket->IsRTCP()))
+	if (!isRTCP)
 	{
 		// don't check for duplicate packets, they may be needed to keep in sync.
 		// Because this is an RTP packet make sure to atomic add this because
 		// multiple sockets can be adding to this variable simultaneously
-		fStream->fBytesSentInThisInterval += thePacket->fPacket.size();
+		fStream->fBytesSentInThisInterval += inPacketLen;
 	}
-
-	fPacketQueue.push_back(std::move(thePacket));
 }
 
 void ReflectorSocketPool::SetUDPSocketOptions(SocketPair<ReflectorSocket>* inPair)
@@ -704,8 +908,9 @@ ReflectorSocket::ReflectorSocket()
 
 void    ReflectorSocket::AddSender(ReflectorSender* inSender)
 {
-	Assert(true == fDemuxer.RegisterTask(
-	{ inSender->fStream->fStreamInfo.fSrcIPAddr, 0 }, inSender));
+	bool registered = fDemuxer.RegisterTask(
+	{ inSender->fStream->fStreamInfo.fSrcIPAddr, 0 }, inSender);
+	Assert(registered);
 	fSenderQueue.push_back(inSender);
 }
 
@@ -733,107 +938,151 @@ int64_t ReflectorSocket::Run()
 	if (theEvents & Task::kReadEvent)
 		this->GetIncomingData(std::chrono::high_resolution_clock::now());
 
+	//Packets held back for reordering don't wait for a missing one forever
+	auto theCurrentTime = std::chrono::high_resolution_clock::now();
+	for (const auto &theSender2 : fSenderQueue)
+		if (theSender2 != nullptr)
+			theSender2->expireHeldPackets(theCurrentTime);
+
 	//Now that we've gotten all available packets, have the streams reflect
 	for (const auto &theSender2 : fSenderQueue)
 		if (theSender2 != nullptr && theSender2->ShouldReflectNow())
 			theSender2->ReflectPackets();
 
 	//For smoothing purposes, the streams can mark when they want to wakeup.
-	this->SetIdleTimer(1000);
+	auto theWakeupTime = std::chrono::high_resolution_clock::time_point::max();
+	for (const auto &theSender2 : fSenderQueue)
+		if (theSender2 != nullptr)
+			theWakeupTime = std::min(theWakeupTime, theSender2->GetWakeupTime());
+
+	int64_t theIdleTime = 1000;
+	if (theWakeupTime != std::chrono::high_resolution_clock::time_point::max())
+	{
+		auto theWait = std::chrono::duration_cast<std::chrono::milliseconds>(theWakeupTime - std::chrono::high_resolution_clock::now());
+		theIdleTime = std::max<int64_t>(1, std::min<int64_t>(theIdleTime, theWait.count() + 1));
+	}
+	this->SetIdleTimer(theIdleTime);
 
 	return 0;
 }
 
-bool ReflectorSocket::ProcessPacket(time_point now, std::unique_ptr<MyReflectorPacket> thePacket, uint32_t theRemoteAddr, uint16_t theRemotePort)
+// Find the appropriate ReflectorSender for packets coming from this address.
+ReflectorSender* ReflectorSocket::FindSender(uint32_t theRemoteAddr)
 {
-	bool done = false; // stop when result is true
-	if (thePacket != nullptr) do
-	{
-		if (GetLocalPort() & 1)
-			thePacket->fIsRTCP = true;
-		else
-			thePacket->fIsRTCP = false;
+	ReflectorSender* theSender = fDemuxer.GetTask({ theRemoteAddr, 0 });
+	// If there is a generic sender for this socket, use it.
+	if (theSender == nullptr)
+		theSender = fDemuxer.GetTask({ 0, 0 });
+	return theSender;
+}
 
-		static constexpr auto kRefreshBroadcastSessionInterval = std::chrono::milliseconds(10000);
-		if (fBroadcasterClientSession != nullptr) // alway refresh timeout even if we are filtering.
+void ReflectorSocket::RefreshBroadcasterSession(time_point now)
+{
+	static constexpr auto kRefreshBroadcastSessionInterval = std::chrono::milliseconds(10000);
+	if (fBroadcasterClientSession != nullptr) // alway refresh timeout even if we are filtering.
+	{
+		if (std::chrono::duration_cast<std::chrono::milliseconds>(now - fLastBroadcasterTimeOutRefresh) > kRefreshBroadcastSessionInterval)
 		{
-			if (std::chrono::duration_cast<std::chrono::milliseconds>(now - fLastBroadcasterTimeOutRefresh) > kRefreshBroadcastSessionInterval)
-			{
-				fBroadcasterClientSession->RefreshTimeouts();
-				fLastBroadcasterTimeOutRefresh = now;
-			}
+			fBroadcasterClientSession->RefreshTimeouts();
+			fLastBroadcasterTimeOutRefresh = now;
 		}
+	}
+}
 
-		if (thePacket->fPacket.empty())
-		{
-			//put the packet back on the free queue, because we didn't actually
-			//get any data here.
-			this->RequestEvent(EV_RE);
-			done = true;
-			//printf("ReflectorSocket::ProcessPacket no more packets on this socket!\n");
-			break;//no more packets on this socket!
-		}
+bool ReflectorSocket::ProcessPacket(time_point now, const char* inPacket, size_t inPacketLen, uint32_t theRemoteAddr, uint16_t theRemotePort)
+{
+	this->RefreshBroadcasterSession(now);
 
-		if (thePacket->IsRTCP())
-		{
-			//if this is a new RTCP packet, check to see if it is a sender report.
-			//We should only reflect sender reports. Because RTCP packets can't have both
-			//an SR & an RR, and because the SR & the RR must be the first packet in a
-			//compound RTCP packet, all we have to do to determine this is look at the
-			//packet type of the first packet in the compound packet.
-			RTCPPacket theRTCPPacket;
-			if ((!theRTCPPacket.ParsePacket((uint8_t*)&thePacket->fPacket[0], thePacket->fPacket.size())) ||
-				(theRTCPPacket.GetPacketType() != RTCPSRPacket::kSRPacketType))
-			{
-				//pretend as if we never got this packet
-				done = true;
-				break;
-			}
-		}
+	if (inPacketLen == 0)
+	{
+		//we didn't actually get any data here.
+		this->RequestEvent(EV_RE);
+		//printf("ReflectorSocket::ProcessPacket no more packets on this socket!\n");
+		return true;//no more packets on this socket!
+	}
 
-		// Find the appropriate ReflectorSender for this packet.
-		ReflectorSender* theSender = fDemuxer.GetTask({ theRemoteAddr, 0 });
-		// If there is a generic sender for this socket, use it.
-		if (theSender == nullptr)
-			theSender = fDemuxer.GetTask({ 0, 0 });
+	return !this->EnqueuePacket(this->FindSender(theRemoteAddr), inPacket, inPacketLen);
+}
 
-		if (theSender == nullptr)
+bool ReflectorSocket::EnqueuePacket(ReflectorSender* inSender, const char* inPacket, size_t inPacketLen)
+{
+	bool isRTCP = (GetLocalPort() & 1) != 0;
+	if (isRTCP)
+	{
+		//if this is a new RTCP packet, check to see if it is a sender report.
+		//We should only reflect sender reports. Because RTCP packets can't have both
+		//an SR & an RR, and because the SR & the RR must be the first packet in a
+		//compound RTCP packet, all we have to do to determine this is look at the
+		//packet type of the first packet in the compound packet.
+		RTCPPacket theRTCPPacket;
+		if ((!theRTCPPacket.ParsePacket((uint8_t*)inPacket, inPacketLen)) ||
+			(theRTCPPacket.GetPacketType() != RTCPSRPacket::kSRPacketType))
 		{
-			//uint16_t* theSeqNumberP = (uint16_t*)thePacket->fPacketPtr.Ptr;
-			//printf("ReflectorSocket::ProcessPacket no sender found for packet! sequence number=%d\n",ntohs(theSeqNumberP[1]));
-			done = true;
-			break;
+			//pretend as if we never got this packet
+			return false;
 		}
+	}
 
-		Assert(theSender != nullptr); // at this point we have a sender
-
-		thePacket->fStreamCountID = ++(theSender->fStream->fPacketCount);
-		thePacket->fTimeArrived = std::chrono::high_resolution_clock::now();
-		theSender->appendPacket(std::move(thePacket));
-	} while (false);
+	if (inSender == nullptr)
+	{
+		//uint16_t* theSeqNumberP = (uint16_t*)inPacket;
+		//printf("ReflectorSocket::ProcessPacket no sender found for packet! sequence number=%d\n",ntohs(theSeqNumberP[1]));
+		return false;
+	}
 
-	return done;
+	inSender->receivePacket(inPacket, inPacketLen, isRTCP);
+	return true;
 }
 
 
 void ReflectorSocket::GetIncomingData(time_point now)
 {
-	uint32_t theRemoteAddr = 0;
-	uint16_t theRemotePort = 0;
-	//get all the outstanding packets for this socket
+	// Receive buffers only live for the duration of this call (appendPacket copies
+	// into the sender's ring), so one set per task thread is enough.
+	static thread_local char sRecvBuffers[UDPSocket::kMaxRecvBatch][kMaxReflectorPacketSize];
+	static thread_local UDPSocket::RecvMsg sRecvMsgs[UDPSocket::kMaxRecvBatch];
+
+	size_t theBatchSize = std::min<size_t>(ServerPrefs::GetReflectorRecvBatchSize(), UDPSocket::kMaxRecvBatch);
+	if (theBatchSize == 0)
+		theBatchSize = 1;
+	for (size_t x = 0; x < theBatchSize; x++)
+	{
+		sRecvMsgs[x].fBuffer = sRecvBuffers[x];
+		sRecvMsgs[x].fBufLen = kMaxReflectorPacketSize;
+	}
+
+	this->RefreshBroadcasterSession(now);
+
+	//get all the outstanding packets for this socket, a batch at a time
 	while (true)
 	{
-		//get a packet off the free queue.
-		
-		static const size_t kMaxReflectorPacketSize = 2060;
-		static char fPacketPtr[kMaxReflectorPacketSize];
-		size_t fPacketLen;
-		(void)this->RecvFrom(&theRemoteAddr, &theRemotePort, fPacketPtr,
-			kMaxReflectorPacketSize, &fPacketLen);
-
-		auto thePacket = std::make_unique<MyReflectorPacket>(fPacketPtr, fPacketLen);
-		if (this->ProcessPacket(now, std::move(thePacket), theRemoteAddr, theRemotePort))
+		size_t theNumMsgs = 0;
+		(void)this->RecvMany(sRecvMsgs, theBatchSize, &theNumMsgs);
+
+		// Datagrams in a batch nearly always come from the same source, so
+		// only go to the demuxer when the source address changes.
+		ReflectorSender* theSender = nullptr;
+		uint32_t theSenderAddr = 0;
+		for (size_t x = 0; x < theNumMsgs; x++)
+		{
+			const UDPSocket::RecvMsg& theMsg = sRecvMsgs[x];
+			if (theMsg.fRecvLen == 0)
+				continue;
+
+			if (theSender == nullptr || theMsg.fRemoteAddr != theSenderAddr)
+			{
+				theSender = this->FindSender(theMsg.fRemoteAddr);
+				theSenderAddr = theMsg.fRemoteAddr;
+			}
+			(void)this->EnqueuePacket(theSender, (const char*)theMsg.fBuffer, theMsg.fRecvLen);
+		}
+
+		// A short batch means the socket has been drained
+		if (theNumMsgs < theBatchSize)
+		{
+			this->RequestEvent(EV_RE);
 			break;
+		}
 
 		//printf("ReflectorSocket::GetIncomingData \n");
 	}
@@ -36,6 +36,8 @@
 
 #include <atomic>
 #include <chrono>
+#include <memory>
+#include <mutex>
 #include "QTSS.h"
 
 #include "IdleTask.h"
@@ -43,7 +45,9 @@
 
 #include "UDPSocket.h"
 #include "UDPSocketPool.h"
-#include "SequenceNumberMap.h"
+#include "CowUnorderMap.h"
+#include "ReflectorReorderBuffer.h"
+#include "ServerMetrics.h"
 
 #include "OSMutex.h"
 #include "OSQueue.h"
@@ -51,13 +55,15 @@
 
 #include "RTCPSRPacket.h"
 #include "ReflectorOutput.h"
+#include "ReflectorPacketRing.h"
+#include "ReflectorGOPCache.h"
+#include "ReflectorRetention.h"
+#include "ReflectorBucketSchedule.h"
 
  /*fantasy add this*/
-#include "keyframecache.h"
 
 //This will add some printfs that are useful for checking the thinning
 #define REFLECTOR_THINNING_DEBUGGING 0 
-#define MAX_CACHE_SIZE  1024*1024*2
 
 class ReflectorStream;
 class ReflectorSession;
@@ -76,17 +82,23 @@ public:
 	void    AddSender(ReflectorSender* inSender);
 	void    RemoveSender(ReflectorSender* inStreamElem);
 	bool  HasSender() { return !fDemuxer.empty(); }
-	bool  ProcessPacket(time_point now, std::unique_ptr<MyReflectorPacket> thePacket, uint32_t theRemoteAddr, uint16_t theRemotePort);
+	bool  ProcessPacket(time_point now, const char* inPacket, size_t inPacketLen, uint32_t theRemoteAddr, uint16_t theRemotePort);
 	int64_t      Run() override;
 private:
 
 	//virtual int64_t        Run();
 	void    GetIncomingData(time_point now);
 
+	ReflectorSender*    FindSender(uint32_t theRemoteAddr);
+	void    RefreshBroadcasterSession(time_point now);
+	// Hands one packet to its sender. Returns false if the packet was dropped
+	bool    EnqueuePacket(ReflectorSender* inSender, const char* inPacket, size_t inPacketLen);
+
 	//Number of packets to allocate when the socket is first created
 	enum
 	{
-		kSSRCTimeOut = 30000 // milliseconds before clearing the SSRC if no new ssrcs have come in
+		kSSRCTimeOut = 30000, // milliseconds before clearing the SSRC if no new ssrcs have come in
+		kMaxReflectorPacketSize = 2060
 	};
 	RTPSession*                  fBroadcasterClientSession{nullptr};
 	time_point                   fLastBroadcasterTimeOutRefresh;
@@ -100,7 +112,7 @@ private:
 	uint64_t  fFirstReceiveTime{0};
 	int64_t  fFirstArrivalTime{0};
 	uint32_t  fCurrentSSRC{0};
-	SyncUnorderMap<ReflectorSender*> fDemuxer;
+	CowUnorderMap<ReflectorSender*> fDemuxer;
 };
 
 
@@ -146,9 +158,7 @@ class ReflectorSender
 {
 public:
 	ReflectorSender(ReflectorStream* inStream, uint32_t inWriteFlag);
-	~ReflectorSender() = default;
-
-	int64_t  fSleepTime;
+	~ReflectorSender();
 
 	//We want to make sure that ReflectPackets only gets invoked when there
 	//is actually work to do, because it is an expensive function
@@ -158,26 +168,76 @@ public:
 	//Returns the time at which it next needs to be invoked
 	void        ReflectPackets();
 
-	MyReflectorPacket*    SendPacketsToOutput(ReflectorOutput* theOutput, MyReflectorPacket* currentPacket);
+	// Sends everything from inSeq up to inHead, returns the sequence index to resume from
+	uint64_t    SendPacketsToOutput(ReflectorOutput* theOutput, uint64_t inSeq, uint64_t inHead);
+
+	// Trims the ring down to the stream's byte budget, and drops what is too old
+	// for any output to still want. The current GOP always stays.
+	void        RemoveOldPackets(uint64_t inOldestBookmark);
+	uint64_t    GetClientBufferStartPacketOffset(std::chrono::seconds offset);
+
+	// Whether the output is further behind its bucket than the prefs allow.
+	// Neither the bucket's own delay nor what was there when it joined count.
+	bool        IsOutputCongested(const ReflectorOutput::BookMark& inBookMark, uint64_t inBucketHead,
+		const ReflectorBucketSchedule& inSchedule, uint32_t inBucket);
+
+	// Drops what a congested output has left to send: it resumes at the latest
+	// key frame if that is ahead of it, else waits at the head for the next one.
+	// Returns whether it waits.
+	bool        SkipToKeyFrame(uint64_t* ioSeq, uint64_t inHead);
+
+	// Moves a waiting output on to the key frame it waits for, if that came in.
+	// Returns whether it still waits.
+	bool        AwaitKeyFrame(uint64_t* ioSeq);
 
-	void        RemoveOldPackets();
-	MyReflectorPacket* GetClientBufferStartPacketOffset(std::chrono::seconds offset);
+	// The first packet in [inLow, inHigh) that arrived after inCutoff
+	uint64_t    GetBucketHead(std::chrono::high_resolution_clock::time_point inCutoff, uint64_t inLow, uint64_t inHigh);
 
-	MyReflectorPacket* NeedRelocateBookMark(MyReflectorPacket* thePacket);
+	// Looks in the ring first, then in the GOP cache for packets the ring has already recycled
+	MyReflectorPacket*  AcquirePacket(uint64_t inSeq);
 
 	ReflectorStream*    fStream;
 	uint32_t              fWriteFlag;
 
-	std::list<std::unique_ptr<MyReflectorPacket>> fPacketQueue;
-	MyReflectorPacket*	fKeyFrameStartPacketElementPointer{ nullptr };//最新关键帧指针
+	enum
+	{
+		kPacketRingCapacity = 8192,
+		kMaxPacketsPerWrite = 64    // handed to an output in one WritePackets
+	};
+	ReflectorPacketRing fPacketRing;
+	ReflectorGOPCache   fGOPCache;  // must come after fPacketRing
+	std::atomic<uint64_t> fKeyFrameStartSeq{ ReflectorPacketRing::kInvalidSeq };//最新关键帧
+	bool      fLastPacketWasKeyFrame{ false }; // SPS, PPS and IDR packets in a row start a single GOP
+	std::atomic<uint64_t> fBytesAppended{ 0 }; // only the writer adds to it
+	ReflectorRetention  fRetention; // must come after fGOPCache
+
+	// Packets written this round. UDP outputs only queue a pointer to them,
+	// so they are held until the outputs have flushed.
+	std::vector<MyReflectorPacket*> fWrittenPackets;
 
 	//these serve as an optimization, keeping track of when this
 	//sender needs to run so it doesn't run unnecessarily
 
 	bool      fHasNewPackets{ false };
 
+	// when the next bucket of outputs is due packets it was held back from
+	std::chrono::high_resolution_clock::time_point fNextBucketTime{ std::chrono::high_resolution_clock::time_point::max() };
+
 	std::chrono::high_resolution_clock::time_point fLastRRTime;
-	void appendPacket(std::unique_ptr<MyReflectorPacket> thePacket);
+
+	// Packets off the wire go through the reorder buffer, if there is one,
+	// on their way to appendPacket
+	void receivePacket(const char* inPacket, size_t inPacketLen, bool isRTCP);
+	void expireHeldPackets(std::chrono::high_resolution_clock::time_point inNow);
+	void appendPacket(const char* inPacket, size_t inPacketLen, bool isRTCP);
+
+	// when ReflectorSocket::Run next has to run for this sender, at the latest
+	std::chrono::high_resolution_clock::time_point GetWakeupTime();
+
+	// RTP senders only, see ServerPrefs::GetReflectorReorderWindow
+	std::unique_ptr<ReflectorReorderBuffer> fReorderBuffer;
+	std::mutex          fReorderMutex;  // packets pushed over RTSP come from the session's thread
+
 	friend class ReflectorSocket;
 	friend class ReflectorStream;
 };
@@ -211,10 +271,9 @@ public:
 	QTSS_Error BindSockets(RTSPRequest *inRequest, RTPSession* inSession, uint32_t inReflectorSessionFlags, bool filterState, uint32_t timeout);
 
 	// This stream reflects packets from the broadcast to specific ReflectorOutputs.
-	// You attach outputs to ReflectorStreams this way. You can force the ReflectorStream
-	// to put this output into a certain bucket by passing in a certain bucket index.
-	// Pass in -1 if you don't care. AddOutput returns the bucket index this output was
-	// placed into, or -1 on an error.
+	// You attach outputs to ReflectorStreams this way. Outputs fill the buckets
+	// sBucketSize at a time, in the order they are added; the place of a removed
+	// output goes to the next one added.
 
 	void  AddOutput(ReflectorOutput* inOutput);
 
@@ -227,7 +286,7 @@ public:
 	// by channel numbers
 	void	SetRTPChannelNum(int16_t inChannel) { fRTPChannel = inChannel; }
 	void	SetRTCPChannelNum(int16_t inChannel) { fRTCPChannel = inChannel; }
-	void	PushPacket(char *packet, size_t packetLen, bool isRTCP);
+	void	PushPacket(const char *packet, size_t packetLen, bool isRTCP);
 
 	//
 	// ACCESSORS
@@ -243,7 +302,7 @@ public:
 
 	uint64_t                  fPacketCount{ 0 };
 
-	inline  void                    UpdateBitRate(time_point currentTime);
+	void                    UpdateBitRate(time_point currentTime);
 
 	void                    IncEyeCount() { OSMutexLocker locker(&fBucketMutex); fEyeCount++; }
 	void                    DecEyeCount() { OSMutexLocker locker(&fBucketMutex); fEyeCount--; }
@@ -264,7 +323,6 @@ private:
 
 	ReflectorSender     fRTPSender;
 	ReflectorSender     fRTCPSender;
-	SequenceNumberMap   fSequenceNumberMap; //for removing duplicate packets
 
 	// All the necessary info about this stream
 	StreamInfo  fStreamInfo;
@@ -277,7 +335,9 @@ private:
 	};
 
 	// BUCKET ARRAY
-	//ReflectorOutputs are kept in a 1-dimensional array
+	//ReflectorOutputs are kept in a 1-dimensional array, output x being in
+	//bucket x / sBucketSize. Removed outputs leave a nullptr behind, so
+	//that the others stay in their bucket.
 	std::vector<ReflectorOutput*>     fOutputArray;
 
 	//Bucket array can't be modified while we are sending packets.
@@ -300,6 +360,7 @@ private:
 	time_point            fLastBitRateSample;
 	
 	std::atomic_size_t   fBytesSentInThisInterval;// unsigned int because we need to atomic_add 
+	std::shared_ptr<ServerMetrics::Gauge> fBitRateGauge; // created with the first average
 
 	// If incoming data is RTSP interleaved
 	int16_t              fRTPChannel; //These will be -1 if not set to anything
@@ -318,28 +379,7 @@ private:
 
 	friend class ReflectorSocket;
 	friend class ReflectorSender;
-
-public:
-	CKeyFrameCache*		pkeyFrameCache;
 };
 
-
-void    ReflectorStream::UpdateBitRate(time_point currentTime)
-{
-	static constexpr auto kBitRateAvgInterval = std::chrono::milliseconds(30000); // time between bitrate averages
-	if (std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - fLastBitRateSample) > kBitRateAvgInterval)
-	{
-		unsigned int intervalBytes = fBytesSentInThisInterval;
-		fBytesSentInThisInterval -= intervalBytes;
-
-		// Multiply by 1000 to convert from milliseconds to seconds, and by 8 to convert from bytes to bits
-		float bps = (float)(intervalBytes * 8 * 1000) / std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - fLastBitRateSample).count();
-		fCurrentBitRate = (uint32_t)bps;
-
-		// Don't check again for awhile!
-		fLastBitRateSample = currentTime;
-	}
-}
-
 #endif //_REFLECTOR_SESSION_H_
 
@@ -0,0 +1,45 @@
+/*
+	File:       ReflectorStreamLocks.h
+
+	Contains:   The locks QTSSReflectorModule serializes a stream's session
+				lifecycle with: finding or creating its ReflectorSession, and
+				deciding nobody uses it any more.
+
+				A stream name picks one of a fixed number of stripes by its hash,
+				so streams whose names land on the same stripe share a lock and
+				wait for each other. Creating a session holds it while the SDP
+				is parsed and the sockets are bound, and everyone else on that
+				stripe waits that long too. Of N live streams over S stripes, a
+				given one shares its stripe with at least one other with
+				probability 1 - (1 - 1/S)^(N-1): about 62% for 1000 streams over
+				1024 stripes, 10% for 100 of them.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <boost/functional/hash.hpp>
+#include <boost/utility/string_view.hpp>
+#include "OSMutex.h"
+
+class ReflectorStreamLocks
+{
+public:
+	explicit ReflectorStreamLocks(uint32_t inNumStripes)
+		: fLocks(new OSMutex[inNumStripes]), fNumStripes(inNumStripes) {}
+
+	ReflectorStreamLocks(const ReflectorStreamLocks&) = delete;
+	ReflectorStreamLocks& operator=(const ReflectorStreamLocks&) = delete;
+
+	uint32_t    GetStripe(boost::string_view inStreamName) const
+	{
+		return (uint32_t)(boost::hash_range(inStreamName.begin(), inStreamName.end()) % fNumStripes);
+	}
+
+	OSMutex*    GetLock(boost::string_view inStreamName) { return &fLocks[this->GetStripe(inStreamName)]; }
+
+private:
+	std::unique_ptr<OSMutex[]>  fLocks;
+	uint32_t                    fNumStripes;
+};
@@ -0,0 +1,68 @@
+/*
+	File:       ReflectorViewerLag.h
+
+	Contains:   When a ReflectorSender gives up on an output that can't keep up
+				with its bucket, and where the output picks up again.
+
+				An output is congested once it is further behind than either
+				limit, in time or in bytes. It then drops what it has left: it
+				resumes at the latest key frame if that is ahead of it, or else
+				waits at the head, pinning nothing, until the next key frame
+				comes in. Streams without key frames, and RTCP, jump to live.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include "ReflectorPacketRing.h"
+
+class ReflectorViewerLag
+{
+public:
+	// A limit of 0 is no limit
+	ReflectorViewerLag(std::chrono::milliseconds inMaxLag, uint64_t inMaxBytesBehind)
+		: fMaxLag(inMaxLag), fMaxBytesBehind(inMaxBytesBehind) {}
+
+	bool        IsCongested(std::chrono::milliseconds inLag, uint64_t inBytesBehind) const
+	{
+		return ((fMaxLag.count() > 0) && (inLag > fMaxLag)) ||
+			((fMaxBytesBehind > 0) && (inBytesBehind > fMaxBytesBehind));
+	}
+
+	// Moves a congested output at *ioSeq on, given the latest key frame at
+	// inKeyFrameSeq (or kInvalidSeq) and the head at inHead. Returns whether
+	// it waits for the next key frame now.
+	static bool SkipToKeyFrame(uint64_t inKeyFrameSeq, uint64_t* ioSeq, uint64_t inHead)
+	{
+		if (inKeyFrameSeq == ReflectorPacketRing::kInvalidSeq)
+		{
+			*ioSeq = inHead;
+			return false;
+		}
+
+		if (inKeyFrameSeq > *ioSeq)
+		{
+			*ioSeq = inKeyFrameSeq;
+			return false;
+		}
+
+		*ioSeq = inHead;
+		return true;
+	}
+
+	// Moves a waiting output on to the key frame it waits for, if that came
+	// in. Returns whether it still waits.
+	static bool AwaitKeyFrame(uint64_t inKeyFrameSeq, uint64_t* ioSeq)
+	{
+		if (inKeyFrameSeq == ReflectorPacketRing::kInvalidSeq || inKeyFrameSeq < *ioSeq)
+			return true;
+
+		*ioSeq = inKeyFrameSeq;
+		return false;
+	}
+
+private:
+	std::chrono::milliseconds   fMaxLag;
+	uint64_t                    fMaxBytesBehind;
+};
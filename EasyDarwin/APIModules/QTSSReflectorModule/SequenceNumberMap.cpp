@@ -28,15 +28,23 @@
 	 Contains:   Implements object defined in SequenceNumberMap.h.
  */
 
-#include <string.h>
+#include <algorithm>
 #include "MyAssert.h"
 
 #include "SequenceNumberMap.h"
 
+static int32_t RoundUpWindowSize(uint32_t inSlidingWindowSize)
+{
+	int32_t theWindowSize = 64;
+	while ((uint32_t)theWindowSize < inSlidingWindowSize)
+		theWindowSize <<= 1;
+	return theWindowSize;
+}
+
 SequenceNumberMap::SequenceNumberMap(uint32_t inSlidingWindowSize)
 	: 
-	fWindowSize((int32_t)inSlidingWindowSize),
-	fNegativeWindowSize((int32_t)inSlidingWindowSize - (int32_t)(2 * inSlidingWindowSize))
+	fWindowSize(RoundUpWindowSize(inSlidingWindowSize)),
+	fNegativeWindowSize(-fWindowSize)
 {
 	Assert(fNegativeWindowSize < 0);
 	Assert(fWindowSize < 32768);//AddSequenceNumber makes this assumption
@@ -48,11 +56,9 @@ bool SequenceNumberMap::AddSequenceNumber(uint16_t inSeqNumber)
 	// Returns whether sequence number has already been added.
 
 	//Check to see if object has been initialized
-	if (fSlidingWindow == nullptr)
+	if (fSlidingWindow.empty())
 	{
-		fSlidingWindow = new bool[fWindowSize + 1];
-		::memset(fSlidingWindow, 0, fWindowSize * sizeof(bool));
-		fHighestSeqIndex = 0;
+		fSlidingWindow.assign(fWindowSize / 64, 0);
 		fHighestSeqNumber = inSeqNumber;
 	}
 
@@ -61,37 +67,25 @@ bool SequenceNumberMap::AddSequenceNumber(uint16_t inSeqNumber)
 
 	int16_t theWindowOffset = inSeqNumber - fHighestSeqNumber;
 
-	if (theWindowOffset < fNegativeWindowSize)
+	if (theWindowOffset <= fNegativeWindowSize)
 		return false;//We don't know, but for safety, assume we haven't seen it.
 
 	// If this seq # is higher thn the highest previous, set the highest to be this
 	// new sequence number, and zero out our sliding window as we go.
 
-	while (theWindowOffset > 0)
+	if (theWindowOffset > 0)
 	{
-		fHighestSeqNumber++;
-
-		fHighestSeqIndex++;
-		if (fHighestSeqIndex == fWindowSize)
-			fHighestSeqIndex = 0;
-		fSlidingWindow[fHighestSeqIndex] = false;
-
-		theWindowOffset--;
+		this->ClearSequenceNumbers(fHighestSeqNumber + 1, theWindowOffset);
+		fHighestSeqNumber = inSeqNumber;
 	}
 
-	// Find the right entry in the sliding window for this sequence number, taking
-	// into account that we may need to wrap.
-
-	int32_t theWindowIndex = fHighestSeqIndex + theWindowOffset;
-	if (theWindowIndex < 0)
-		theWindowIndex += fWindowSize;
+	// Turn this bit on, return whether it was already turned on.
+	uint32_t theBit = inSeqNumber & (fWindowSize - 1);
+	uint64_t theMask = (uint64_t)1 << (theBit & 63);
+	uint64_t& theWord = fSlidingWindow[theBit >> 6];
 
-	Assert(theWindowIndex >= 0);
-	Assert(theWindowIndex < fWindowSize);
-
-	// Turn this index on, return whether it was already turned on.
-	bool alreadyAdded = fSlidingWindow[theWindowIndex];
-	fSlidingWindow[theWindowIndex] = true;
+	bool alreadyAdded = (theWord & theMask) != 0;
+	theWord |= theMask;
 #if SEQUENCENUMBERMAPTESTING
 	//if (alreadyAdded)
 	//  printf("Found a duplicate seq num. Num = %d\n", inSeqNumber);
@@ -99,6 +93,28 @@ bool SequenceNumberMap::AddSequenceNumber(uint16_t inSeqNumber)
 	return alreadyAdded;
 }
 
+void SequenceNumberMap::ClearSequenceNumbers(uint16_t inFirstSeqNumber, uint32_t inCount)
+{
+	if (inCount >= (uint32_t)fWindowSize)
+	{
+		std::fill(fSlidingWindow.begin(), fSlidingWindow.end(), 0);
+		return;
+	}
+
+	// a word at a time, the window size being a multiple of 64
+	uint32_t theBit = inFirstSeqNumber & (fWindowSize - 1);
+	while (inCount > 0)
+	{
+		uint32_t theShift = theBit & 63;
+		uint32_t theNumBits = std::min<uint32_t>(inCount, 64 - theShift);
+		uint64_t theMask = (theNumBits == 64) ? ~(uint64_t)0 : (((uint64_t)1 << theNumBits) - 1) << theShift;
+		fSlidingWindow[theBit >> 6] &= ~theMask;
+
+		theBit = (theBit + theNumBits) & (fWindowSize - 1);
+		inCount -= theNumBits;
+	}
+}
+
 #if SEQUENCENUMBERMAPTESTING
 void SequenceNumberMap::Test()
 {
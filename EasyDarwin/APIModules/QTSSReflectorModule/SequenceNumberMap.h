@@ -38,6 +38,7 @@
 
 #include "OSHeaders.h"
 #include <stdint.h>
+#include <vector>
 
 #define SEQUENCENUMBERMAPTESTING 1
 
@@ -50,8 +51,9 @@ public:
 		kDefaultSlidingWindowSize = 256
 	};
 
+	// The window is rounded up to a power of 2, of at least 64
 	SequenceNumberMap(uint32_t inSlidingWindowSize = kDefaultSlidingWindowSize);
-	~SequenceNumberMap() { delete[] fSlidingWindow; }
+	~SequenceNumberMap() = default;
 
 	// Returns whether this sequence number was already added or not.
 	bool  AddSequenceNumber(uint16_t inSeqNumber);
@@ -62,12 +64,16 @@ public:
 
 private:
 
-	bool*         fSlidingWindow{nullptr};
+	// Forgets the inCount sequence numbers from inFirstSeqNumber on
+	void  ClearSequenceNumbers(uint16_t inFirstSeqNumber, uint32_t inCount);
+
+	// One bit per sequence number, sequence number n being bit n % fWindowSize.
+	// As the window size divides 65536, that holds across wrap arounds too.
+	std::vector<uint64_t>   fSlidingWindow;
 
 	const int32_t    fWindowSize;
 	const int32_t    fNegativeWindowSize;
 
-	uint16_t          fHighestSeqIndex{0};
 	uint16_t          fHighestSeqNumber{0};
 };
 
@@ -0,0 +1,72 @@
+/*
+	File:       IoServicePool.cpp
+
+	Contains:   Implementation of class defined in IoServicePool.h
+*/
+
+#include <algorithm>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#include "IoServicePool.h"
+
+// The cores we may run on, which under taskset or a container's cpuset is
+// fewer than the machine has
+static size_t GetNumUsableCores()
+{
+#ifdef __linux__
+	cpu_set_t theSet;
+	CPU_ZERO(&theSet);
+	if (::sched_getaffinity(0, sizeof(theSet), &theSet) == 0 && CPU_COUNT(&theSet) > 0)
+		return (size_t)CPU_COUNT(&theSet);
+#endif
+	return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+IoServicePool::IoServicePool(size_t inNumIoServices)
+{
+	if (inNumIoServices == 0)
+		inNumIoServices = GetNumUsableCores();
+
+	for (size_t x = 0; x < inNumIoServices; x++)
+	{
+		// Each io_service is only ever run by one thread, which lets asio
+		// skip its own locking
+		fIoServices.push_back(std::make_unique<boost::asio::io_service>(1));
+		fWork.push_back(std::make_unique<boost::asio::io_service::work>(*fIoServices.back()));
+	}
+}
+
+IoServicePool::~IoServicePool()
+{
+	this->Stop();
+}
+
+void IoServicePool::Start()
+{
+	if (!fThreads.empty())
+		return;
+
+	for (auto& theIoService : fIoServices)
+	{
+		boost::asio::io_service* theService = theIoService.get();
+		fThreads.emplace_back([theService] { theService->run(); });
+	}
+}
+
+void IoServicePool::Stop()
+{
+	fWork.clear();
+	for (auto& theIoService : fIoServices)
+		theIoService->stop();
+
+	for (auto& theThread : fThreads)
+		theThread.join();
+	fThreads.clear();
+}
+
+boost::asio::io_service& IoServicePool::GetNextIoService()
+{
+	size_t theIndex = fNextIoService.fetch_add(1, std::memory_order_relaxed);
+	return *fIoServices[theIndex % fIoServices.size()];
+}
@@ -0,0 +1,47 @@
+/*
+	File:       IoServicePool.h
+
+	Contains:   A fixed set of io_services, each run by a thread of its own.
+
+				Whatever is bound to one of them (a socket, a timer, the
+				coroutine waiting on them) only ever runs on that thread, so it
+				needs no locking against itself. Only state shared between
+				io_services does.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <boost/asio/io_service.hpp>
+
+class IoServicePool
+{
+public:
+	// 0 makes one io_service per core the process may run on
+	explicit IoServicePool(size_t inNumIoServices = 0);
+	~IoServicePool();
+
+	IoServicePool(const IoServicePool&) = delete;
+	IoServicePool& operator=(const IoServicePool&) = delete;
+
+	// Starts the threads. Work can be queued on the io_services before this.
+	void                        Start();
+
+	// Stops every io_service and joins the threads
+	void                        Stop();
+
+	size_t                      GetNumIoServices() const { return fIoServices.size(); }
+	boost::asio::io_service&    GetIoService(size_t inIndex) { return *fIoServices[inIndex]; }
+
+	// Round robin over the pool
+	boost::asio::io_service&    GetNextIoService();
+
+private:
+	std::vector<std::unique_ptr<boost::asio::io_service>>        fIoServices;
+	std::vector<std::unique_ptr<boost::asio::io_service::work>>  fWork;
+	std::vector<std::thread>    fThreads;
+	std::atomic<size_t>         fNextIoService{ 0 };
+};
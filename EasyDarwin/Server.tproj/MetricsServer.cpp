@@ -0,0 +1,75 @@
+/*
+	File:       MetricsServer.cpp
+
+	Contains:   Implementation of class defined in MetricsServer.h
+*/
+
+#include <iostream>
+#include <boost/asio/streambuf.hpp>
+#include <fmt/format.h>
+#include "MetricsServer.h"
+#include "ServerMetrics.h"
+
+static constexpr size_t kMaxRequestSize = 8192; // a scrape is a single GET
+
+static CoTask RunMetricsSession(std::shared_ptr<boost::asio::ip::tcp::socket> socket)
+{
+	boost::asio::streambuf buffer(kMaxRequestSize);
+	auto result = co_await AsyncReadUntil(*socket, buffer);
+	if (!result)
+		co_return;
+
+	std::string requestLine{ boost::asio::buffer_cast<const char*>(buffer.data()), result.Get() };
+	requestLine.erase(std::min(requestLine.find("\r\n"), requestLine.size()));
+
+	std::string output;
+	if (requestLine.compare(0, 13, "GET /metrics ") == 0) {
+		std::string body = ServerMetrics::Render();
+		output = fmt::format("HTTP/1.0 200 OK\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n"
+			"Content-Length: {}\r\n"
+			"Connection: close\r\n\r\n{}", body.size(), body);
+	}
+	else {
+		output = "HTTP/1.0 404 Not Found\r\n"
+			"Content-Length: 0\r\n"
+			"Connection: close\r\n\r\n";
+	}
+
+	result = co_await AsyncWrite(*socket, boost::asio::buffer(output));
+	if (!result)
+		std::cerr << "Error when writing metrics: " << result.Error().message() << "\n";
+
+	boost::system::error_code ec;
+	socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+}
+
+MetricsServer::MetricsServer(IoServicePool& inPool, uint16_t inPort) : fPool(inPool)
+{
+	if (inPort == 0)
+		return;
+
+	boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::tcp::v4(), inPort);
+	fAcceptor = std::make_unique<boost::asio::ip::tcp::acceptor>(fPool.GetIoService(0));
+	fAcceptor->open(endpoint.protocol());
+	fAcceptor->set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+	fAcceptor->bind(endpoint);
+	fAcceptor->listen();
+
+	AcceptConnections();
+}
+
+CoTask MetricsServer::AcceptConnections()
+{
+	while (true) {
+		Result<boost::asio::ip::tcp::socket> result = co_await AsyncAccept(*fAcceptor, fPool.GetIoService(0));
+		if (result) {
+			RunMetricsSession(std::make_shared<boost::asio::ip::tcp::socket>(std::move(result.Get())));
+		}
+		else {
+			std::cerr << "Error accepting metrics connection: " << result.Error().message()
+				<< "\n";
+			break;
+		}
+	}
+}
@@ -0,0 +1,29 @@
+/*
+	File:       MetricsServer.h
+
+	Contains:   Serves the server metrics over HTTP, in the Prometheus text
+				format, at GET /metrics. A scrape runs on the first io_service
+				of the pool, one request per connection.
+*/
+
+#pragma once
+
+#include <boost/asio/ip/tcp.hpp>
+#include "IoServicePool.h"
+#include "coroutine_wrappers.h"
+
+class MetricsServer
+{
+public:
+	// Listens on inPort, unless it is 0
+	MetricsServer(IoServicePool& inPool, uint16_t inPort);
+
+	MetricsServer(const MetricsServer&) = delete;
+	MetricsServer& operator=(const MetricsServer&) = delete;
+
+private:
+	CoTask AcceptConnections();
+
+	IoServicePool&  fPool;
+	std::unique_ptr<boost::asio::ip::tcp::acceptor> fAcceptor;
+};
@@ -7,7 +7,7 @@ MyRTPSession::MyRTPSession()
 
 }
 void MyRTPSession::AddStream(MyRTSPRequest& request,
-	QTSS_AddStreamFlags inFlags)
+	QTSS_AddStreamFlags inFlags, uint8_t inRTPChannel)
 {
 	// Create a new SSRC for this stream. This should just be a random number unique
 	// to all the streams in the session
@@ -23,5 +23,5 @@ void MyRTPSession::AddStream(MyRTSPRequest& request,
 		}
 	}
 
-	fStreamBuffer.emplace_back(request, theSSRC, *this, inFlags);
+	fStreamBuffer.emplace_back(request, theSSRC, *this, inFlags, inRTPChannel);
 }
\ No newline at end of file
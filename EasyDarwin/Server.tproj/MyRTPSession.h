@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <boost/utility/string_view.hpp>
@@ -18,7 +19,8 @@ public:
 	//This call can only be made during an RTSP Setup request, and the
 	//RTSPRequestInterface must be provided.
 	//You may also opt to attach a codec name and type to this stream.
-	void AddStream(MyRTSPRequest& request, QTSS_AddStreamFlags inFlags);
+	//Interleaved streams go over inRTPChannel and the channel after it.
+	void AddStream(MyRTSPRequest& request, QTSS_AddStreamFlags inFlags, uint8_t inRTPChannel = 0);
 
 	std::vector<MyRTPStream>& GetStreams() { return fStreamBuffer; }
 	void RefreshTimeouts() { }
@@ -63,7 +63,7 @@ std::ostream& operator << (std::ostream& stream, const MyRTPStream& RTPStream)
 	return stream;
 }
 
-MyRTPStream::MyRTPStream(MyRTSPRequest& request, uint32_t inSSRC, MyRTPSession& inSession, QTSS_AddStreamFlags inFlags)
+MyRTPStream::MyRTPStream(MyRTSPRequest& request, uint32_t inSSRC, MyRTPSession& inSession, QTSS_AddStreamFlags inFlags, uint8_t inRTPChannel)
 	: fStreamURL(request.GetFileName()),
 	fTransportType(request.GetTransportType()),
 	fNetworkMode(request.GetNetworkMode()),
@@ -79,8 +79,8 @@ MyRTPStream::MyRTPStream(MyRTSPRequest& request, uint32_t inSSRC, MyRTPSession&
 	{
 		fIsTCP = true;
 
-		// If it is, get 2 channel numbers from the RTSP session.
-		fRTPChannel = 0;// request.GetSession().GetTwoChannelNumbers(fSession.fRTSPSessionID);
+		// If it is, the 2 channel numbers come from the RTSP session.
+		fRTPChannel = inRTPChannel;
 		fRTCPChannel = fRTPChannel + 1;
 	}
 }
@@ -21,7 +21,7 @@ class MyRTPStream {
 	void SetOverBufferState(MyRTSPRequest& request);
 	friend std::ostream& operator << (std::ostream& stream, const MyRTPStream& RTPStream);
 public:
-	MyRTPStream(MyRTSPRequest& request, uint32_t inSSRC, MyRTPSession& inSession, QTSS_AddStreamFlags inFlags);
+	MyRTPStream(MyRTSPRequest& request, uint32_t inSSRC, MyRTPSession& inSession, QTSS_AddStreamFlags inFlags, uint8_t inRTPChannel);
 	~MyRTPStream() = default;
 	uint32_t GetSSRC() const { return fSsrc; }
 
@@ -99,6 +99,11 @@ public:
 	static bool parse(std::string &string, MyRTSPRequest& req) noexcept {
 		std::istringstream stream(string);
 		req.header.clear();
+		// The request object is reused for every request of a connection
+		req.fNetworkMode = qtssRTPNetworkModeDefault;
+		req.fTransportType = qtssRTPTransportTypeUDP;
+		req.fTransportMode = qtssRTPTransportModePlay;
+		req.fEnableDynamicRateState = -1;
 		std::string line;
 		getline(stream, line);
 		size_t method_end;
@@ -7,6 +7,8 @@
 #include "MyRTPSession.h"
 #include "MyRTPStream.h"
 #include "MyReflectorSession.h"
+#include "MyReflectorStream.h"
+#include "MyRTPSessionOutput.h"
 #include "MyAssert.h"
 
 static std::string GenerateNewSessionID()
@@ -28,7 +30,7 @@ std::shared_ptr<MyReflectorSession> MyRTSPSession::CreateSession(MyRTSPRequest &
 	std::lock_guard<std::mutex> lock(mServer.session_mutex);
 	auto it = mServer.sessionMap.find(std::string(sessionName));
 	if (it == mServer.sessionMap.end()) {
-		boost::string_view theFileData = CSdpCache::GetInstance()->getSdpMap(sessionName);
+		std::string theFileData = CSdpCache::GetInstance()->getSdpMap(sessionName);
 
 		if (theFileData.empty())
 			return nullptr;
@@ -48,7 +50,7 @@ std::shared_ptr<MyReflectorSession> MyRTSPSession::CreateSession(MyRTSPRequest &
 
 		auto theSession = std::make_shared<MyReflectorSession>(sessionName, theInfo);
 
-		QTSS_Error theErr = theSession->SetupReflectorSession(request, *fRTPSession, theSetupFlag);
+		QTSS_Error theErr = theSession->SetupReflectorSession(request, theSetupFlag);
 		if (theErr != QTSS_NoErr)
 		{
 			//delete theSession;
@@ -65,43 +67,32 @@ std::shared_ptr<MyReflectorSession> MyRTSPSession::CreateSession(MyRTSPRequest &
 std::error_code MyRTSPSession::do_setup(MyRTSPRequest &request)
 {
 	bool isPush = request.IsPushRequest();
-	if (!rtp_OutputSession)
+	if (!isPush)
 	{
-		if (!isPush)
-		{
-#if 0
-			theSession = DoSessionSetup(inParams, isPush);
-			if (theSession == nullptr)
-				return QTSS_RequestFailed;
-			auto* theNewOutput = new RTPSessionOutput(inParams->inClientSession, theSession, sStreamCookieName);
-			theSession->AddOutput(theNewOutput, true);
-			inParams->inClientSession->addAttribute(sOutputName, theNewOutput);
-#endif
-		}
-		else
+		if (!playSession)
 		{
-			if (!broadcastSession)
-			{
-				broadcastSession = CreateSession(request, request.GetFileName());
-				//if (theSession == nullptr)
-				//					return QTSS_RequestFailed;
-			}
+			std::lock_guard<std::mutex> lock(mServer.session_mutex);
+			auto it = mServer.sessionMap.find(request.GetFileName());
+			if (it == mServer.sessionMap.end())
+				return std::make_error_code(std::errc::no_such_file_or_directory);
+			playSession = it->second;
 		}
 	}
 	else
 	{
-		//auto theSession = outputSession.value().GetReflectorSession();
+		if (!broadcastSession)
+		{
+			broadcastSession = CreateSession(request, request.GetFileName());
+			if (!broadcastSession)
+				return std::make_error_code(std::errc::no_such_file_or_directory);
+		}
 	}
 
 	//unless there is a digit at the end of this path (representing trackID), don't
 	//even bother with the request
 	std::string theDigitStr = request.GetFileDigit();
-	if (theDigitStr.empty())
-	{
-		//if (isPush)
-			//DeleteReflectorPushSession(inParams, theSession, foundSession);
-		//return inParams.inRTSPRequest->SendErrorResponse(qtssClientBadRequest);
-	}
+	if (theDigitStr.empty() || (theDigitStr.size() > 9))
+		return std::make_error_code(std::errc::invalid_argument);
 
 	uint32_t theTrackID = std::stoi(theDigitStr);
 
@@ -112,10 +103,7 @@ std::error_code MyRTSPSession::do_setup(MyRTSPRequest &request)
 		const StreamInfo* theStreamInfo = broadcastSession->GetSourceInfo().GetStreamInfoByTrackID(theTrackID);
 		// If theStreamInfo is NULL, we don't have a legit track, so return an error
 		if (theStreamInfo == nullptr)
-		{
-			//DeleteReflectorPushSession(inParams, theSession, foundSession);
-			//return inParams.inRTSPRequest->SendErrorResponse(qtssClientBadRequest);
-		}
+			return std::make_error_code(std::errc::invalid_argument);
 
 		if (theStreamInfo->fSetupToReceive)
 		{
@@ -125,7 +113,7 @@ std::error_code MyRTSPSession::do_setup(MyRTSPRequest &request)
 
 		request.SetUpServerPort(theStreamInfo->fPort);
 
-		fRTPSession->AddStream(request, qtssASFlagsForceUDPTransport);
+		fRTPSession->AddStream(request, qtssASFlagsForceUDPTransport, GetTwoChannelNumbers(fSessionID));
 
 		auto &newStream = fRTPSession->GetStreams().back();
 		//send the setup response
@@ -139,6 +127,33 @@ std::error_code MyRTSPSession::do_setup(MyRTSPRequest &request)
 #endif
 		return {};
 	}
+
+	MyReflectorStream* theStream = playSession->GetStreamByTrackID(theTrackID);
+	if (theStream == nullptr)
+		return std::make_error_code(std::errc::invalid_argument);
+
+	// The packets are only reflected interleaved so far
+	if (request.GetTransportType() != qtssRTPTransportTypeTCP)
+		return std::make_error_code(std::errc::not_supported);
+
+	uint8_t theRTPChannel = GetTwoChannelNumbers(fSessionID);
+	fRTPSession->AddStream(request, qtssASFlagsNoFlags, theRTPChannel);
+	fPlayStreams.emplace_back(theStream, theRTPChannel);
+	return {};
+}
+
+std::error_code MyRTSPSession::do_describe(MyRTSPRequest &request, std::string &outSDP)
+{
+	std::shared_ptr<MyReflectorSession> theSession;
+	{
+		std::lock_guard<std::mutex> lock(mServer.session_mutex);
+		auto it = mServer.sessionMap.find(request.GetFileName());
+		if (it == mServer.sessionMap.end())
+			return std::make_error_code(std::errc::no_such_file_or_directory);
+		theSession = it->second;
+	}
+
+	outSDP = theSession->GetLocalSDP();
 	return {};
 }
 
@@ -156,6 +171,9 @@ std::error_code MyRTSPSession::do_play(MyReflectorSession *session)
 
 std::error_code MyRTSPSession::process_rtppacket(const char *packetData, size_t length)
 {
+	if (length < 4)
+		return std::make_error_code(std::errc::invalid_argument);
+
 	const SDPSourceInfo& theSoureInfo = broadcastSession->GetSourceInfo();
 	uint32_t  numStreams = theSoureInfo.GetNumStreams();
 	//printf("QTSSReflectorModule.cpp:ProcessRTPData numStreams=%"   _U32BITARG_   "\n",numStreams);
@@ -174,6 +192,8 @@ std::error_code MyRTSPSession::process_rtppacket(const char *packetData, size_t
 	uint16_t  packetDataLen;
 	memcpy(&packetDataLen, &packetData[2], 2);
 	packetDataLen = ntohs(packetDataLen);
+	if (length < 4 + (size_t)packetDataLen)
+		return std::make_error_code(std::errc::invalid_argument);
 
 	char*   rtpPacket = (char *)&packetData[4];
 
@@ -198,6 +218,53 @@ std::error_code MyRTSPSession::process_rtppacket(const char *packetData, size_t
 	return {};
 }
 
+void MyRTSPSession::AddPlayOutput(std::shared_ptr<boost::asio::ip::tcp::socket> inSocket)
+{
+	if (!rtp_OutputSession)
+		rtp_OutputSession = std::make_shared<MyRTPSessionOutput>(std::move(inSocket));
+}
+
+void MyRTSPSession::StartPlaying()
+{
+	// The output may only see the packets after the response to PLAY
+	for (const auto &thePlayStream : fPlayStreams)
+		thePlayStream.first->AddOutput(rtp_OutputSession, thePlayStream.second);
+}
+
+void MyRTSPSession::StopPlaying()
+{
+	if (!rtp_OutputSession)
+		return;
+
+	for (const auto &thePlayStream : fPlayStreams)
+		thePlayStream.first->RemoveOutput(rtp_OutputSession.get());
+}
+
+void MyRTSPSession::TearDown()
+{
+	StopPlaying();
+	if (rtp_OutputSession)
+		rtp_OutputSession->Close();
+
+	if (broadcastSession)
+	{
+		broadcastSession->AddBroadcasterClientSession(nullptr);
+
+		// The viewers still holding on to the session keep it alive, they
+		// just don't get any more packets
+		std::lock_guard<std::mutex> lock(mServer.session_mutex);
+		auto it = mServer.sessionMap.find(broadcastSession->GetStreamName());
+		if ((it != mServer.sessionMap.end()) && (it->second == broadcastSession))
+			mServer.sessionMap.erase(it);
+	}
+
+	if (!fSessionID.empty())
+	{
+		std::lock_guard<std::mutex> lock(mServer.rtp_mutex);
+		mServer.rtpMap.erase(fSessionID);
+	}
+}
+
 void MyRTSPSession::FindOrCreateRTPSession(MyRTSPRequest &request)
 {
 	// This function attempts to locate the appropriate RTP session for this RTSP
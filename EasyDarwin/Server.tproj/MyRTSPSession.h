@@ -2,12 +2,16 @@
 #include <memory>
 #include <string>
 #include <system_error>
+#include <utility>
+#include <vector>
+#include <boost/asio/ip/tcp.hpp>
 #include <boost/utility/string_view.hpp>
 class RTSPServer;
 class MyReflectorSession;
 class RTPSession;
 class MyRTPSession;
-class RTPSessionOutput1;
+class MyReflectorStream;
+class MyRTPSessionOutput;
 class Connection;
 class MyRTSPRequest;
 class MyRTSPSession {
@@ -16,7 +20,11 @@ class MyRTSPSession {
 public:
 	std::shared_ptr<MyRTPSession>     fRTPSession;
 	std::shared_ptr<MyReflectorSession> broadcastSession;
-	std::shared_ptr<RTPSessionOutput1> rtp_OutputSession;
+	// What this connection plays, and the streams it has set up with their
+	// interleaved RTP channel
+	std::shared_ptr<MyReflectorSession> playSession;
+	std::vector<std::pair<MyReflectorStream*, uint8_t>> fPlayStreams;
+	std::shared_ptr<MyRTPSessionOutput> rtp_OutputSession;
 	std::string fSessionID;
 	std::vector<std::string> fChNumToSessIDMap;
 	friend class Response;
@@ -28,10 +36,20 @@ public:
 		int a = 1;
 	}
 	std::error_code do_setup(MyRTSPRequest &request);
+	std::error_code do_describe(MyRTSPRequest &request, std::string &outSDP);
 	std::error_code do_play(MyReflectorSession *session);
 	std::error_code process_rtppacket(const char *packetData, size_t length);
 	void FindOrCreateRTPSession(MyRTSPRequest &request);
 
+	// From PLAY on, everything written to the connection goes through the
+	// output: AddPlayOutput creates it, StartPlaying hooks it up to the streams
+	void AddPlayOutput(std::shared_ptr<boost::asio::ip::tcp::socket> inSocket);
+	void StartPlaying();
+	void StopPlaying();
+
+	// The connection is gone
+	void TearDown();
+
 	// If RTP data is interleaved into the RTSP connection, we need to associate
 	// 2 unique channel numbers with each RTP stream, one for RTP and one for RTCP.
 	// This function allocates 2 channel numbers, returns the lower one. The other one
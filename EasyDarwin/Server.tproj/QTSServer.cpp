@@ -111,6 +111,31 @@ public:
 	void            SetUDPSocketOptions(UDPSocketPair* inPair) override;
 };
 
+class RTCPSocket : public Task, public UDPSocket
+{
+public:
+
+	// Socket B of an RTPSocketPool pair. Reads the RTCP the UDP clients send
+	// back and hands it to their RTPStreams, which keeps their sessions alive.
+
+	RTCPSocket();
+	~RTCPSocket() override = default;
+
+	// The pair goes away with this socket, once a kKillEvent gets here
+	void            SetSocketPair(UDPSocketPair* inPair) { fPair = inPair; }
+
+	int64_t         Run() override;
+
+private:
+
+	enum
+	{
+		kMaxRTCPPacketSize = 2048   //uint32_t
+	};
+
+	UDPSocketPair*  fPair{ nullptr };
+};
+
 
 
 char*           QTSServer::sPortPrefString = "rtsp_port";
@@ -383,18 +408,20 @@ UDPSocketPair*  RTPSocketPool::ConstructUDPSocketPair()
 {
 	//construct a pair of UDP sockets, the lower one for RTP data (outgoing only, no demuxer
 	//necessary), and one for RTCP data (incoming, so definitely need a demuxer).
-	//These are nonblocking sockets that DON'T receive events (we are going to poll for data)
-	// They do receive events - we don't poll from them anymore
-	return new
-		UDPSocketPair(new UDPSocket(nullptr, Socket::kNonBlockingSocketType),
-			new UDPSocket(nullptr, Socket::kNonBlockingSocketType));
+	//The RTCP one gets read events and reads for itself.
+	auto* theRTCPSocket = new RTCPSocket();
+	auto* thePair = new UDPSocketPair(new UDPSocket(nullptr, Socket::kNonBlockingSocketType), theRTCPSocket);
+	theRTCPSocket->SetSocketPair(thePair);
+	return thePair;
 }
 
 void RTPSocketPool::DestructUDPSocketPair(UDPSocketPair* inPair)
 {
 	delete inPair->GetSocketA();
-	delete inPair->GetSocketB();
-	delete inPair;
+
+	//the RTCP socket may be in the middle of a read, so it deletes itself,
+	//and the pair with it, on its own task thread
+	static_cast<RTCPSocket*>(inPair->GetSocketB())->Signal(Task::kKillEvent);
 }
 
 void RTPSocketPool::SetUDPSocketOptions(UDPSocketPair* inPair)
@@ -419,4 +446,47 @@ void RTPSocketPool::SetUDPSocketOptions(UDPSocketPair* inPair)
 		if (theErr != OS_NoErr)
 			theRcvBufSize >>= 1;
 	}
+
+	//
+	// And start listening for RTCP
+	inPair->GetSocketB()->RequestEvent(EV_RE);
+}
+
+RTCPSocket::RTCPSocket()
+	: Task(),
+	UDPSocket(nullptr, Socket::kNonBlockingSocketType)
+{
+	this->SetTaskName("RTCPSocket");
+	this->SetTask(this);
+}
+
+int64_t RTCPSocket::Run()
+{
+	Task::EventFlags theEvents = this->GetEvents();
+	if (theEvents & Task::kKillEvent)
+	{
+		delete fPair;
+		return -1;
+	}
+
+	if (theEvents & Task::kReadEvent)
+	{
+		char thePacket[kMaxRTCPPacketSize];
+		while (true)
+		{
+			uint32_t theRemoteAddr = 0;
+			uint16_t theRemotePort = 0;
+			size_t theLen = 0;
+			if (this->RecvFrom(&theRemoteAddr, &theRemotePort, thePacket, sizeof(thePacket), &theLen) != OS_NoErr)
+				break;
+
+			//the stream can't go away while the demuxer has it
+			StrPtrLen theRTCP(thePacket, theLen);
+			(void)fPair->GetSocketBDemux().WithTask({ theRemoteAddr, theRemotePort },
+				[&theRTCP](RTPStream* inStream) { inStream->ProcessIncomingRTCPPacket(&theRTCP); });
+		}
+		this->RequestEvent(EV_RE);
+	}
+
+	return 0;
 }
\ No newline at end of file
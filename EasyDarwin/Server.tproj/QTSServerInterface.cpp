@@ -29,6 +29,9 @@
 
  //INCLUDES:
 
+#ifndef __Win32__
+#include <sys/resource.h>
+#endif
 #include <boost/asio/io_service.hpp>
 
 #include "QTSServerInterface.h"
@@ -38,6 +41,7 @@
 #include "UDPSocketPool.h"
 #include "RTSPProtocol.h"
 #include "ServerPrefs.h"
+#include "ServerMetrics.h"
 
 // STATIC DATA
 
@@ -50,6 +54,57 @@ std::string             QTSServerInterface::sPublicHeaderStr;
 QTSServerInterface::QTSServerInterface()
 {
 	sServer = this;
+	ServerMetrics::AddCollector([this]() { this->UpdateStatistics(); });
+}
+
+// CPU time used by the whole process
+static float GetCPUTimeUsedInSec()
+{
+#ifdef __Win32__
+	FILETIME theCreation, theExit, theKernel, theUser;
+	if (!::GetProcessTimes(::GetCurrentProcess(), &theCreation, &theExit, &theKernel, &theUser))
+		return 0;
+	uint64_t theTime = ((uint64_t)theKernel.dwHighDateTime << 32 | theKernel.dwLowDateTime) +
+		((uint64_t)theUser.dwHighDateTime << 32 | theUser.dwLowDateTime);
+	return theTime / 10000000.0f; // in 100ns
+#else
+	struct rusage theUsage;
+	if (::getrusage(RUSAGE_SELF, &theUsage) != 0)
+		return 0;
+	return theUsage.ru_utime.tv_sec + theUsage.ru_stime.tv_sec +
+		(theUsage.ru_utime.tv_usec + theUsage.ru_stime.tv_usec) / 1000000.0f;
+#endif
+}
+
+void QTSServerInterface::UpdateStatistics()
+{
+	static ServerMetrics::Counter& sRTPPackets = ServerMetrics::GetCounter("easydarwin_reflector_egress_packets_total", "Packets written to reflector outputs");
+	static ServerMetrics::Counter& sRTPBytes = ServerMetrics::GetCounter("easydarwin_reflector_egress_bytes_total", "Bytes written to reflector outputs");
+	static ServerMetrics::Gauge& sBandwidth = ServerMetrics::GetGauge("easydarwin_rtp_bandwidth_bits", "Bits per second served since the previous scrape");
+	static ServerMetrics::Gauge& sPacketRate = ServerMetrics::GetGauge("easydarwin_rtp_packets_per_second", "Packets per second served since the previous scrape");
+	static ServerMetrics::Gauge& sCPUPercent = ServerMetrics::GetGauge("easydarwin_cpu_percent", "CPU used by the server since the previous scrape, 100 per busy core");
+
+	auto theNow = std::chrono::steady_clock::now();
+	float theInterval = std::chrono::duration<float>(theNow - fLastStatisticsTime).count();
+	if (theInterval <= 0)
+		return;
+
+	uint64_t theTotalPackets = sRTPPackets.GetValue();
+	uint64_t theTotalBytes = sRTPBytes.GetValue();
+	float theCPUTime = ::GetCPUTimeUsedInSec();
+
+	fRTPPacketsPerSecond = (uint32_t)((theTotalPackets - fTotalRTPPackets) / theInterval);
+	fAvgRTPBandwidthInBits = (uint32_t)((theTotalBytes - fTotalRTPBytes) * 8 / theInterval);
+	fCPUPercent = (theCPUTime - fCPUTimeUsedInSec) * 100 / theInterval;
+
+	fTotalRTPPackets = theTotalPackets;
+	fTotalRTPBytes = theTotalBytes;
+	fCPUTimeUsedInSec = theCPUTime;
+	fLastStatisticsTime = theNow;
+
+	sBandwidth.Set(fAvgRTPBandwidthInBits);
+	sPacketRate.Set(fRTPPacketsPerSecond);
+	sCPUPercent.Set((int64_t)fCPUPercent);
 }
 
 QTSServerInterface* getSingleton()
@@ -59,11 +114,9 @@ QTSServerInterface* getSingleton()
 
 void QTSServerInterface::KillAllRTPSessions()
 {
-	OSMutexLocker locker(fRTPMap->GetMutex());
-	for (OSRefHashTableIter theIter(fRTPMap->GetHashTable()); !theIter.IsDone(); theIter.Next())
+	fRTPMap->ForEachRef([](OSRef* theRef)
 	{
-		OSRef* theRef = theIter.GetCurrent();
 		auto* theSession = (RTPSessionInterface*)theRef->GetObject();
 		theSession->Signal(Task::kKillEvent);
-	}
+	});
 }
\ No newline at end of file
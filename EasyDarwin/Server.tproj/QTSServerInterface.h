@@ -40,6 +40,7 @@
 
 #include <array>
 #include <atomic>
+#include <chrono>
 #include <list>
 #include <vector>
 #include <boost/utility/string_view.hpp>
@@ -173,6 +174,10 @@ private:
 
 	OSMutex             fMutex;
 
+	// Brings the statistics below up to date from the server metrics, on every scrape
+	void                UpdateStatistics();
+	std::chrono::steady_clock::time_point fLastStatisticsTime{ std::chrono::steady_clock::now() };
+
 	//stores the total number of bytes served since startup
 	uint64_t              fTotalRTPBytes{0};
 	//total number of rtp packets sent since startup
@@ -100,6 +100,18 @@ public:
 	inline void removeAttribute(boost::string_view key) {
 		attr.removeAttribute(key);
 	}
+	template <typename T>
+	inline void addAttribute(AttributeID<T> id, typename AttributeID<T>::value_type value) {
+		attr.addAttribute(id, value);
+	}
+	template <typename T>
+	inline boost::optional<T> getAttribute(AttributeID<T> id) {
+		return attr.getAttribute(id);
+	}
+	template <typename T>
+	inline void removeAttribute(AttributeID<T> id) {
+		attr.removeAttribute(id);
+	}
 private:
 	Attributes attr;
 	//where timeouts, deletion conditions get processed
@@ -66,6 +66,7 @@ RTPStream::~RTPStream()
 {
 	if (fSockets != nullptr)
 	{
+		fSockets->GetSocketBDemux().UnregisterTask({ fRemoteAddr, fRemoteRTCPPort });
 		getSingleton()->GetSocketPool()->ReleaseUDPSocketPair(fSockets);
 	}
 }
@@ -93,6 +94,29 @@ QTSS_Error RTPStream::Setup(RTSPRequest* request, QTSS_AddStreamFlags inFlags)
 		return QTSS_NoErr;
 	}
 
+	// Pushed data comes in on the reflector's own sockets
+	if (request->IsPushRequest())
+		return QTSS_NoErr;
+
+	//
+	// Send to wherever the RTSP connection comes from, at the ports the
+	// client asked for in its transport header.
+	TCPSocket* theRTSPSocket = request->GetSession()->GetSocket();
+	fRemoteAddr = theRTSPSocket->GetRemoteAddr();
+	fRemoteRTPPort = request->GetClientPortA();
+	fRemoteRTCPPort = request->GetClientPortB();
+	if (fRemoteRTPPort == 0)
+		return request->SendErrorResponse(qtssClientBadRequest);
+
+	// Bind to the address the client reached us on, so the RTP comes back from
+	// where it expects. The pool hands out a pair that isn't already talking to
+	// this client's RTCP port, so many clients can share one pair.
+	fSockets = getSingleton()->GetSocketPool()->GetUDPSocketPair(theRTSPSocket->GetLocalAddr(), 0,
+		fRemoteAddr, fRemoteRTCPPort);
+	if (fSockets == nullptr)
+		return request->SendErrorResponse(qtssServerUnavailable);
+
+	fSockets->GetSocketBDemux().RegisterTask({ fRemoteAddr, fRemoteRTCPPort }, this);
 	return QTSS_NoErr;
 }
 
@@ -125,9 +149,14 @@ void RTPStream::AppendTransport(RTSPRequestInterface* request)
 		// to do this is to put the src address in the transport. So now we do that always.
 		//
 		boost::string_view theSrcIPAddress = ServerPrefs::GetTransportSrcAddr();
-		if (theSrcIPAddress.empty()) {
-			//StrPtrLen *p = fSockets->GetSocketA()->GetLocalAddrStr();
-			theSrcIPAddress = std::string("127.0.0.1");
+		std::string theLocalAddress;
+		if (theSrcIPAddress.empty() && (fSockets != nullptr)) {
+			StrPtrLen *p = fSockets->GetSocketA()->GetLocalAddrStr();
+			theLocalAddress = std::string(p->Ptr, p->Len);
+			theSrcIPAddress = theLocalAddress;
+		}
+		else if (theSrcIPAddress.empty()) {
+			theSrcIPAddress = "127.0.0.1";
 		}
 
 
@@ -183,7 +212,7 @@ QTSS_Error  RTPStream::InterleavedWrite(const std::vector<char> &inBuffer, uint3
 
 	if (fSession->GetRTSPSession() == nullptr) // RTSPSession required for interleaved write
 	{
-		return EAGAIN;
+		return QTSS_WouldBlock;
 	}
 
 	OSMutexLocker   locker(fSession->GetRTSPSessionMutex());
@@ -199,14 +228,75 @@ QTSS_Error  RTPStream::InterleavedWrite(const std::vector<char> &inBuffer, uint3
 	if (err == QTSS_NoErr)
 		fSession->RefreshTimeout(); // RTSP session gets refreshed internally in WriteV
 
+	// A busy or full connection is for the caller to come back to
+	if (err == EAGAIN)
+		return QTSS_WouldBlock;
+	return err;
+}
+
+QTSS_Error  RTPStream::InterleavedWriteV(const std::vector<char>* const* inPackets, uint32_t inNumPackets, uint32_t* outNumWritten, unsigned char channel)
+{
+	if (fSession->GetRTSPSession() == nullptr) // RTSPSession required for interleaved write
+	{
+		return QTSS_WouldBlock;
+	}
+
+	OSMutexLocker   locker(fSession->GetRTSPSessionMutex());
+
+	QTSS_Error err = fSession->GetRTSPSession()->InterleavedWriteV(inPackets, inNumPackets, outNumWritten, channel);
+
+	// as in InterleavedWrite, refresh the session if anything got through
+	if (*outNumWritten > 0)
+		fSession->RefreshTimeout();
+
+	if (err == EAGAIN)
+		return QTSS_WouldBlock;
 	return err;
 }
 
+/*********************************
+/
+/   UDPWrite
+/
+/   Queue the given RTP or RTCP packet on this stream's UDP socket. It goes out
+/   with the next FlushPackets, or sooner if the socket's queue fills up. The
+/   packet isn't copied, so the caller keeps it until then.
+/
+*/
+
+QTSS_Error  RTPStream::UDPWrite(const std::vector<char> &inBuffer, bool isRTCP)
+{
+	if (fSockets == nullptr)
+		return QTSS_WouldBlock;
+
+	// Unlike the interleaved case, sending doesn't refresh the session timeout:
+	// the client's RTCP, read by the pool's RTCP socket, does that.
+	OS_Error theErr = OS_NoErr;
+	if (isRTCP)
+		theErr = fSockets->GetSocketB()->QueueSendTo(fRemoteAddr, fRemoteRTCPPort, &inBuffer[0], inBuffer.size());
+	else
+		theErr = fSockets->GetSocketA()->QueueSendTo(fRemoteAddr, fRemoteRTPPort, &inBuffer[0], inBuffer.size());
+
+	// A full socket buffer is for the reflector to come back to later
+	if (theErr == EAGAIN)
+		return QTSS_WouldBlock;
+	return theErr;
+}
+
+void RTPStream::FlushPackets()
+{
+	if (fSockets == nullptr)
+		return;
+
+	(void)fSockets->GetSocketA()->FlushSendQueue();
+	(void)fSockets->GetSocketB()->FlushSendQueue();
+}
+
 QTSS_Error  RTPStream::Write(const std::vector<char> &thePacket, uint32_t* outLenWritten, uint32_t inFlags)
 {
 	Assert(fSession != nullptr);
 	if (!fSession->GetSessionMutex()->TryLock())
-		return EAGAIN;
+		return QTSS_WouldBlock;
 
 
 	QTSS_Error err = QTSS_NoErr;
@@ -218,6 +308,10 @@ QTSS_Error  RTPStream::Write(const std::vector<char> &thePacket, uint32_t* outLe
 		{
 			err = this->InterleavedWrite(thePacket, outLenWritten, fRTCPChannel);
 		}
+		else if (!thePacket.empty())
+		{
+			err = this->UDPWrite(thePacket, kIsRTCPPacket);
+		}
 	}
 	else if (inFlags & qtssWriteFlagsIsRTP)
 	{
@@ -226,6 +320,8 @@ QTSS_Error  RTPStream::Write(const std::vector<char> &thePacket, uint32_t* outLe
 		// also tells us whether this packet is just too old to send
 		if (fTransportType == qtssRTPTransportTypeTCP)    // write out in interleave format on the RTSP TCP channel.
 			err = this->InterleavedWrite(thePacket, outLenWritten, fRTPChannel);
+		else if (!thePacket.empty())
+			err = this->UDPWrite(thePacket, kIsRTPPacket);
 
 		//if (err != QTSS_NoErr)
 		//  printf("flow controlled\n");
@@ -246,6 +342,40 @@ QTSS_Error  RTPStream::Write(const std::vector<char> &thePacket, uint32_t* outLe
 	return err;
 }
 
+QTSS_Error  RTPStream::WriteV(const std::vector<char>* const* inPackets, uint32_t inNumPackets, uint32_t* outNumWritten, uint32_t inFlags)
+{
+	Assert(fSession != nullptr);
+	*outNumWritten = 0;
+
+	unsigned char theChannel = 0;
+	if (inFlags & qtssWriteFlagsIsRTCP)
+		theChannel = fRTCPChannel;
+	else if (inFlags & qtssWriteFlagsIsRTP)
+		theChannel = fRTPChannel;
+	else
+		return QTSS_BadArgument;//qtssWriteFlagsIsRTCP or qtssWriteFlagsIsRTP wasn't specified
+
+	if (fTransportType != qtssRTPTransportTypeTCP)
+	{
+		// UDP writes only queue the packet, there's nothing to gain from a batch
+		for (; *outNumWritten < inNumPackets; (*outNumWritten)++)
+		{
+			QTSS_Error err = this->Write(*inPackets[*outNumWritten], nullptr, inFlags);
+			if (err != QTSS_NoErr)
+				return err;
+		}
+		return QTSS_NoErr;
+	}
+
+	if (!fSession->GetSessionMutex()->TryLock())
+		return QTSS_WouldBlock;
+
+	QTSS_Error err = this->InterleavedWriteV(inPackets, inNumPackets, outNumWritten, theChannel);
+
+	fSession->GetSessionMutex()->Unlock();// Make sure to unlock the mutex
+	return err;
+}
+
 void RTPStream::ProcessIncomingInterleavedData(uint8_t inChannelNum, RTSPSessionInterface* inRTSPSession, StrPtrLen* inPacket)
 {
 	if (inChannelNum == fRTPChannel)
@@ -77,9 +77,20 @@ class RTPStream
         QTSS_Error Setup(RTSPRequest* request, QTSS_AddStreamFlags inFlags);
         
         // Write sends RTP data to the client. Caller must specify
-        // either qtssWriteFlagsIsRTP or qtssWriteFlagsIsRTCP
+        // either qtssWriteFlagsIsRTP or qtssWriteFlagsIsRTCP. Returns
+        // QTSS_WouldBlock if the session or its connection is busy.
         QTSS_Error  Write(const std::vector<char> &thePacket,
                                         uint32_t* outLenWritten, QTSS_WriteFlags inFlags);
+
+        // Same for several packets, which over TCP go out in as few writes as
+        // the connection allows. If this returns an error, the first
+        // *outNumWritten packets were still written.
+        QTSS_Error  WriteV(const std::vector<char>* const* inPackets, uint32_t inNumPackets,
+                                        uint32_t* outNumWritten, QTSS_WriteFlags inFlags);
+
+        // UDP writes are only queued on the stream's sockets. This pushes
+        // out whatever is queued; call it once done with a batch of writes.
+        void        FlushPackets();
         
         
         //UTILITY uint8_t_t:
@@ -119,6 +130,18 @@ class RTPStream
 		inline void removeAttribute(boost::string_view key) {
 			attr.removeAttribute(key);
 		}
+		template <typename T>
+		inline void addAttribute(AttributeID<T> id, typename AttributeID<T>::value_type value) {
+			attr.addAttribute(id, value);
+		}
+		template <typename T>
+		inline boost::optional<T> getAttribute(AttributeID<T> id) {
+			return attr.getAttribute(id);
+		}
+		template <typename T>
+		inline void removeAttribute(AttributeID<T> id) {
+			attr.removeAttribute(id);
+		}
     private:
         
         enum
@@ -153,9 +176,16 @@ class RTPStream
         
 		QTSS_RTPNetworkMode     fNetworkMode{ qtssRTPNetworkModeDefault };
 
+        // If we are sending over UDP, this is where the client wants it
+		uint32_t  fRemoteAddr{ 0 };
+		uint16_t  fRemoteRTPPort{ 0 };
+		uint16_t  fRemoteRTCPPort{ 0 };
+
         //-----------------------------------------------------------
         // acutally write the data out that way
         QTSS_Error  InterleavedWrite(const std::vector<char> &inBuffer, uint32_t* outLenWritten, unsigned char channel );
+        QTSS_Error  InterleavedWriteV(const std::vector<char>* const* inPackets, uint32_t inNumPackets, uint32_t* outNumWritten, unsigned char channel);
+        QTSS_Error  UDPWrite(const std::vector<char> &inBuffer, bool isRTCP);
 
         enum { rtp = 0, rtcpSR = 1, rtcpRR = 2, rtcpACK = 3, rtcpAPP = 4 };
 };
@@ -28,11 +28,9 @@
 	 Contains:   Implementation of RTSPRequest class.
  */
 
-#include <map>
 #include <boost/utility/string_view.hpp>
 #include <boost/spirit/include/qi.hpp>
 #include <boost/algorithm/string/predicate.hpp>
-#include <boost/fusion/include/std_pair.hpp>
 
 #include "RTSPRequest.h"
 #include "RTSPProtocol.h"
@@ -102,77 +100,56 @@ static float processNPT(boost::string_view nptStr)
 		return (valArray[0] * 3600) + (valArray[1] * 60) + valArray[2] + (valArray[3] / divArray[3]);
 }
 
-typedef std::map<std::string, std::string> header_fields_t;
-
-struct RTSPRequestHeader
-{
-	std::string method;
-	std::string uri;
-	std::string rtsp_version;
-
-	header_fields_t header_fields;
-};
-
 namespace qi = boost::spirit::qi;
 
-BOOST_FUSION_ADAPT_STRUCT(RTSPRequestHeader, method, uri, rtsp_version, header_fields)
-
-template <typename Iterator, typename Skipper = qi::ascii::blank_type>
-struct RTSPHeaderGrammar : qi::grammar <Iterator, RTSPRequestHeader(), Skipper> {
-	RTSPHeaderGrammar() : RTSPHeaderGrammar::base_type(rtsp_header, "RTSPHeaderGrammar Grammar") {
-		method = +qi::alpha;
-		uri = +qi::graph;
-		rtsp_ver = "RTSP/" >> +qi::char_("0-9.");
-
-		field_key = +qi::char_("0-9a-zA-Z-");
-		field_value = +~qi::char_("\r\n");
+static void TrimBlanks(boost::string_view& ioStr)
+{
+	while (!ioStr.empty() && (ioStr.front() == ' ' || ioStr.front() == '\t'))
+		ioStr.remove_prefix(1);
+	while (!ioStr.empty() && (ioStr.back() == ' ' || ioStr.back() == '\t'))
+		ioStr.remove_suffix(1);
+}
 
-		fields = *(field_key >> ':' >> field_value >> qi::lexeme["\r\n"]);
+// Splits off everything up to the next inDelimiter (or the end), trimmed
+static boost::string_view NextToken(boost::string_view& ioStr, char inDelimiter)
+{
+	size_t thePos = ioStr.find(inDelimiter);
+	boost::string_view theToken = ioStr.substr(0, thePos);
+	ioStr.remove_prefix((thePos == boost::string_view::npos) ? ioStr.size() : thePos + 1);
+	TrimBlanks(theToken);
+	return theToken;
+}
 
-		rtsp_header = method >> uri >> rtsp_ver >> qi::lexeme["\r\n"] >> fields >> qi::lexeme["\r\n"];
-		BOOST_SPIRIT_DEBUG_NODES((method)(uri)(rtsp_ver)(fields)(rtsp_header))
-	}
-private:
-	qi::rule<Iterator, std::map<std::string, std::string>(), Skipper> fields;
-	qi::rule<Iterator, RTSPRequestHeader(), Skipper> rtsp_header;
-	// lexemes
-	qi::rule<Iterator, std::string()> method, uri, rtsp_ver;
-	qi::rule<Iterator, std::string()> field_key, field_value;
-};
+static uint32_t ParseUInt(boost::string_view inStr, bool* outOK = nullptr)
+{
+	uint32_t theValue = 0;
+	size_t theLen = 0;
+	for (; theLen < inStr.size() && inStr[theLen] >= '0' && inStr[theLen] <= '9'; theLen++)
+		theValue = (theValue * 10) + (inStr[theLen] - '0');
+
+	if (outOK != nullptr)
+		*outOK = (theLen > 0);
+	return theValue;
+}
 
 //Parses the request
 QTSS_Error RTSPRequest::Parse()
 {
 	fHeaderDict.clear();
-	boost::string_view requestHeader = GetFullRequest();
-	typedef boost::string_view::const_iterator It;
-	RTSPHeaderGrammar<It> rtspGrammar;
-	It iter = requestHeader.begin(), end = requestHeader.end();
-	RTSPRequestHeader rtspHeader;
-	bool r = phrase_parse(iter, end, rtspGrammar, qi::ascii::blank, rtspHeader);
-
-	if (r && iter == end) {
-		std::cout << "Full Request:\n" << std::string(requestHeader) << "\b\n";
-		std::cout << "Parsing succeeded\n";
-		//check the version
-		//fVersion = RTSPProtocol::GetVersion(rtspHeader.rtsp_version);
-		//if (fVersion != RTSPProtocol::RTSPVersion::k10Version)
-			//return QTSSModuleUtils::SendErrorResponse(this, qtssClientBadRequest, qtssMsgBadRTSPRequest, nullptr);
-	}
-	else {
-		std::cout << "Parsing failed\n";
-		std::cout << "stopped at: \"" << std::string(iter, end) << "\"\n";
-		//return QTSSModuleUtils::SendErrorResponse(this, qtssClientBadRequest, qtssMsgBadRTSPRequest, nullptr);
-	}
+
+	// Everything the parser hands back points into the full request
+	RTSPRequestParser theParser;
+	if (!theParser.Parse(GetFullRequest()))
+		return SendErrorResponse(qtssClientBadRequest);
 
 	//parse status line.
-	QTSS_Error error = ParseFirstLine(rtspHeader.method, rtspHeader.uri, rtspHeader.rtsp_version);
+	QTSS_Error error = ParseFirstLine(theParser.GetMethod(), theParser.GetURI(), theParser.GetVersion());
 
 	//handle any errors that come up    
 	if (error != QTSS_NoErr)
 		return error;
 
-	error = this->ParseHeaders(rtspHeader.header_fields);
+	error = this->ParseHeaders(theParser);
 	if (error != QTSS_NoErr)
 		return error;
 
@@ -210,30 +187,44 @@ QTSS_Error RTSPRequest::ParseURI(boost::string_view fulluri)
 	//qtssRTSPReqAbsoluteURL = rtsp://www.easydarwin.org:554/live.sdp?channel=1&token=888888
 	SetAbsoluteURL(fulluri);
 	//theAbsURL = rtsp://www.easydarwin.org:554/live.sdp
-	std::string theAbsURL;
-	bool r = qi::phrase_parse(fulluri.cbegin(), fulluri.cend(),
-		+(qi::char_ - "?") >> -("?" >> +(qi::char_)), qi::ascii::blank, theAbsURL, queryString);
+	size_t theQueryPos = fulluri.find('?');
+	boost::string_view theAbsURL = fulluri.substr(0, theQueryPos);
+	if (theQueryPos != boost::string_view::npos)
+		queryString.assign(fulluri.data() + theQueryPos + 1, fulluri.size() - theQueryPos - 1);
+	else
+		queryString.clear();
+
+	if (theAbsURL.empty())
+		return SendErrorResponse(qtssClientBadRequest);
+
 	//we always should have a slash before the uri.
 	//If not, that indicates this is a full URI. Also, this could be a '*' OPTIONS request
 	if (theAbsURL[0] != '/' && theAbsURL[0] != '*')
 	{
-		std::string theHost;
-		bool r = qi::phrase_parse(theAbsURL.cbegin(), theAbsURL.cend(),
-			qi::no_case["RTSP://"] >> *(qi::char_ - "/") >> (qi::eoi | *(qi::char_)),  
-			qi::ascii::blank, theHost, uriPath);
+		static boost::string_view sRTSPScheme("rtsp://");
+		boost::string_view theHost, thePath;
+		if (boost::istarts_with(theAbsURL, sRTSPScheme))
+		{
+			boost::string_view theRest = theAbsURL.substr(sRTSPScheme.size());
+			size_t theSlashPos = theRest.find('/');
+			theHost = theRest.substr(0, theSlashPos);
+			if (theSlashPos != boost::string_view::npos)
+				thePath = theRest.substr(theSlashPos);
+		}
 
 		fHeaderDict.Set(qtssHostHeader, theHost);
-		if (uriPath.empty()) {
-			static char* sSlashURI = "/";
-			uriPath = sSlashURI;
-		}
+		if (thePath.empty())
+			thePath = "/";
+		uriPath.assign(thePath.data(), thePath.size());
 	}
+	else
+		uriPath.assign(theAbsURL.data(), theAbsURL.size());
 
 	// don't allow non-aggregate operations indicated by a url/media track=id
 	// might need this for rate adapt   if (qtssSetupMethod != fMethod && qtssOptionsMethod != fMethod && qtssSetParameterMethod != fMethod) // any method not a setup, options, or setparameter is not allowed to have a "/trackID=" in the url.
 	if (qtssSetupMethod != fMethod) // any method not a setup is not allowed to have a "/trackID=" in the url.
 	{
-		if (theAbsURL.find("/trackID=") != std::string::npos) // check for non-aggregate method and return error
+		if (theAbsURL.find("/trackID=") != boost::string_view::npos) // check for non-aggregate method and return error
 			return SendErrorResponse(qtssClientAggregateOptionAllowed);
 	}
 
@@ -252,29 +243,29 @@ QTSS_Error RTSPRequest::ParseURI(boost::string_view fulluri)
 }
 
 
-//throws eHTTPNoMoreData and eHTTPOutOfBuffer
-QTSS_Error RTSPRequest::ParseHeaders(const std::map<std::string, std::string>& headers)
+QTSS_Error RTSPRequest::ParseHeaders(const RTSPRequestParser& inParser)
 {
-	for (const auto pairs : headers)
+	for (size_t x = 0; x < inParser.GetNumHeaders(); x++)
 	{
-		//Look up the proper header enumeration based on the header string.
-		//Use the enumeration to look up the dictionary ID of this header,
-		//and set that dictionary attribute to be whatever is in the body of the header
-		boost::string_view theKeyWord = pairs.first;
-		uint32_t theHeader = RTSPProtocol::GetRequestHeader(theKeyWord);
-		boost::string_view theHeaderVal = pairs.second;
-
-		// If this is an unknown header, ignore it. Otherwise, set the proper
-		// dictionary attribute
-		if (theHeader != qtssIllegalHeader)
-		{
-			Assert(theHeader < qtssNumHeaders);
-			fHeaderDict.Set(theHeader, std::string(theHeaderVal));
-		}
+		//The parser already looked up the proper header enumeration based on the
+		//header string. Use it to set that dictionary attribute to be whatever
+		//is in the body of the header
+		const RTSPRequestParser::Header& theHeader = inParser.GetHeader(x);
+		boost::string_view theHeaderVal = theHeader.fValue;
+
+		// If this is an unknown header, ignore it. If it was repeated, only
+		// the first one counts.
+		if (theHeader.fID == qtssIllegalHeader)
+			continue;
+		if (inParser.GetHeaderValue(theHeader.fID).data() != theHeaderVal.data())
+			continue;
+
+		Assert(theHeader.fID < qtssNumHeaders);
+		fHeaderDict.Set(theHeader.fID, theHeaderVal);
 
 		//some headers require some special processing. If this code begins
 		//to get out of control, we made need to come up with a function pointer table
-		switch (theHeader)
+		switch (theHeader.fID)
 		{
 		case qtssSessionHeader:             ParseSessionHeader(theHeaderVal); break;
 		case qtssTransportHeader:           ParseTransportHeader(theHeaderVal); break;
@@ -289,10 +280,9 @@ QTSS_Error RTSPRequest::ParseHeaders(const std::map<std::string, std::string>& h
 
 	// Tell the session what the request body length is for this request
 	// so that it can prevent people from reading past the end of the request.
-	std::string theContentLengthBody(fHeaderDict.Get(qtssContentLengthHeader));
-	if (!theContentLengthBody.empty())
+	if (!fHeaderDict.Get(qtssContentLengthHeader).empty())
 	{
-		this->GetSession()->SetRequestBodyLength(std::stoi(theContentLengthBody));
+		this->GetSession()->SetRequestBodyLength(fContentLength);
 	}
 
 	return QTSS_NoErr;
@@ -300,12 +290,10 @@ QTSS_Error RTSPRequest::ParseHeaders(const std::map<std::string, std::string>& h
 
 void RTSPRequest::ParseSessionHeader(boost::string_view header)
 {
-	std::string theSessionID;
-	auto iter = header.cbegin(), end = header.cend();
-	bool r = qi::phrase_parse(iter, end, *(qi::digit), qi::lit(";") | qi::ascii::blank, theSessionID);
-	if (r && iter == end) {
+	//Session: 12345678;timeout=60
+	boost::string_view theSessionID = NextToken(header, ';');
+	if (!theSessionID.empty())
 		fHeaderDict.Set(qtssSessionHeader, theSessionID);
-	}
 }
 
 bool RTSPRequest::ParseNetworkModeSubHeader(boost::string_view inSubHeader)
@@ -349,16 +337,24 @@ void RTSPRequest::ParseTransportHeader(boost::string_view header)
 	//
 	// A client may send multiple transports to the server, comma separated.
 	// In this case, the server should just pick one and use that. 
-	std::vector<std::string> transports = spirit_direct(header, ",");
-	for (const auto &transport : transports)
-		if (boost::istarts_with(transport, sRTPAVPTransportStr)) {
-			fFirstTransport = transport;
+	boost::string_view theTransport;
+	while (!header.empty())
+	{
+		boost::string_view theCandidate = NextToken(header, ',');
+		if (boost::istarts_with(theCandidate, sRTPAVPTransportStr)) {
+			theTransport = theCandidate;
 			break;
 		}
+	}
+	fFirstTransport.assign(theTransport.begin(), theTransport.end());
 
-	std::vector<std::string> SubHeaders = spirit_direct(fFirstTransport, ";");
-	for (const auto &subHeader : SubHeaders)
+	bool isUDP = false;
+	while (!theTransport.empty())
 	{
+		boost::string_view subHeader = NextToken(theTransport, ';');
+		if (subHeader.empty())
+			continue;
+
 		// Extract the relevent information from the relevent subheader.
 		// So far we care about 3 sub-headers
 
@@ -371,6 +367,14 @@ void RTSPRequest::ParseTransportHeader(boost::string_view header)
 				{
 					if (boost::iequals(subHeader, "RTP/AVP/TCP"))
 						fTransportType = qtssRTPTransportTypeTCP;
+					else if (boost::iequals(subHeader, "RTP/AVP") || boost::iequals(subHeader, "RTP/AVP/UDP"))
+						isUDP = true;
+					break;
+				}
+			case 'c':   //client_port sub-header
+			case 'C':   //client_port sub-header
+				{
+					ParseClientPortSubHeader(subHeader);
 					break;
 				}
 			case 'm':   //mode sub-header
@@ -382,19 +386,29 @@ void RTSPRequest::ParseTransportHeader(boost::string_view header)
 			}
 		}
 	}
+
+	// Players that gave us somewhere to send to get plain UDP. Everything
+	// else, including UDP pushes, stays interleaved on the RTSP connection.
+	if (isUDP && (fClientPortA != 0) && !IsPushRequest())
+		fTransportType = qtssRTPTransportTypeUDP;
 }
 
 void  RTSPRequest::ParseRangeHeader(boost::string_view header)
 {
-	std::string startStr, endStr;
-	bool r = qi::phrase_parse(header.begin(), header.end(), 
-		qi::omit[+(qi::char_ - "=")] >> "=" >> +(qi::char_ - "-") >> -("-" >> +qi::char_)
-		, qi::ascii::blank, startStr, endStr);
-
+	//Range: npt=0.000-
+	//       npt=00:01:00-00:02:30.5
+	size_t theEqualsPos = header.find('=');
+	boost::string_view theRange;
+	if (theEqualsPos != boost::string_view::npos)
+		theRange = header.substr(theEqualsPos + 1);
+
+	boost::string_view startStr = NextToken(theRange, '-');
 	fStartTime = (double)processNPT(startStr);
+
 	//see if there is a stop time as well.
-	if (!endStr.empty())
-		fStopTime = (double)processNPT(endStr);
+	TrimBlanks(theRange);
+	if (!theRange.empty())
+		fStopTime = (double)processNPT(theRange);
 }
 
 void  RTSPRequest::ParseRetransmitHeader(boost::string_view header)
@@ -423,8 +437,11 @@ void  RTSPRequest::ParseRetransmitHeader(boost::string_view header)
 
 void  RTSPRequest::ParseContentLengthHeader(boost::string_view header)
 {
-	auto iter = header.cbegin(), end = header.cend();
-	bool r = qi::phrase_parse(iter, end, qi::uint_, qi::ascii::blank, fContentLength);
+	TrimBlanks(header);
+	bool isValid = false;
+	uint32_t theLength = ParseUInt(header, &isValid);
+	if (isValid)
+		fContentLength = theLength;
 }
 
 void  RTSPRequest::ParsePrebufferHeader(boost::string_view header)
@@ -452,15 +469,40 @@ void RTSPRequest::ParseModeSubHeader(boost::string_view inModeSubHeader)
 	static boost::string_view sReceiveMode("receive");
 	static boost::string_view sRecordMode("record");
 
-	std::string name, mode;
-	bool r = qi::phrase_parse(inModeSubHeader.cbegin(), inModeSubHeader.cend(),
-		*(qi::alpha - "=") >> "=" >> *(qi::char_), qi::ascii::blank,
-		name, mode);
-	if (r && boost::iequals(name, sModeSubHeader)) {
+	boost::string_view name = NextToken(inModeSubHeader, '=');
+	boost::string_view mode = inModeSubHeader;
+	TrimBlanks(mode);
+	if (mode.size() >= 2 && mode.front() == '"' && mode.back() == '"')
+		mode = mode.substr(1, mode.size() - 2);
+
+	if (boost::iequals(name, sModeSubHeader)) {
 		if (boost::iequals(mode, sReceiveMode) || boost::iequals(mode, sRecordMode))
 			fTransportMode = qtssRTPTransportModeRecord;
 	}
 }
+
+void RTSPRequest::ParseClientPortSubHeader(boost::string_view inClientPortSubHeader)
+{
+	static boost::string_view sClientPortSubHeader("client_port");
+
+	boost::string_view name = NextToken(inClientPortSubHeader, '=');
+	if (!boost::iequals(name, sClientPortSubHeader))
+		return;
+
+	bool isValid = false;
+	boost::string_view portAStr = NextToken(inClientPortSubHeader, '-');
+	uint32_t portA = ParseUInt(portAStr, &isValid);
+	if (!isValid || (portA == 0) || (portA > 65535))
+		return;
+
+	uint32_t portB = ParseUInt(inClientPortSubHeader, &isValid);
+	if (!isValid || (portB == 0) || (portB > 65535))
+		portB = portA + 1; // A lone port means RTCP goes to the next one up
+
+	fClientPortA = (uint16_t)portA;
+	fClientPortB = (uint16_t)portB;
+}
+
 // DJM PROTOTYPE
 
 QTSS_Error RTSPRequest::SendErrorResponseWithMessage(QTSS_RTSPStatusCode inStatusCode)
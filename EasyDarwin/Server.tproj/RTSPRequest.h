@@ -55,6 +55,7 @@
 #include "RTSPRequestInterface.h"
 #include "RTSPSessionInterface.h"
 #include "StringParser.h"
+#include "RTSPRequestParser.h"
 
  //HTTPRequest class definition
 class RTSPRequest : public RTSPRequestInterface
@@ -102,7 +103,7 @@ private:
 	//the headers, fill out the data & HTTPParameters object.
 	//
 	//Returns:      A handler object signifying that a fatal syntax error has occurred
-	QTSS_Error ParseHeaders(const std::map<std::string, std::string> &headers);
+	QTSS_Error ParseHeaders(const RTSPRequestParser &inParser);
 
 
 	//Functions to parse the contents of particuarly complicated headers (as a convienence
@@ -115,6 +116,7 @@ private:
 	void    ParsePrebufferHeader(boost::string_view header);
 	void    ParseSessionHeader(boost::string_view header);
 	void    ParseModeSubHeader(boost::string_view inModeSubHeader);
+	void    ParseClientPortSubHeader(boost::string_view inClientPortSubHeader);
 	bool    ParseNetworkModeSubHeader(boost::string_view inSubHeader);
 };
 
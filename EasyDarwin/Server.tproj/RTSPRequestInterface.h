@@ -48,17 +48,22 @@
 #include "RTSPProtocol.h"
 
 class HeaderDict {
-	std::map<int, std::string> infos;
+	// Indexed by QTSS_RTSPHeader. clear() keeps the buffers, so a request
+	// object that gets reused stops allocating for the headers it sees.
+	std::string infos[qtssNumHeaders];
 public:
-	void Set(int type, const std::string &session) {
-		infos[type] = session;
+	void Set(int type, boost::string_view value) {
+		if (type < 0 || type >= qtssNumHeaders) return;
+		infos[type].assign(value.data(), value.size());
 	}
 	boost::string_view Get(int type) const { 
-		auto it = infos.find(type);
-		if (it == end(infos)) return {};
-		return it->second;
+		if (type < 0 || type >= qtssNumHeaders) return {};
+		return infos[type];
+	}
+	void clear() {
+		for (auto &info : infos)
+			info.clear();
 	}
-	void clear() { infos.clear(); }
 };
 
 class RTSPRequestInterface
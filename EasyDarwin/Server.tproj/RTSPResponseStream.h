@@ -85,6 +85,9 @@ public:
 	QTSS_Error Flush();
 
 	uint32_t    GetBytesWritten() { return formater.GetBytesWritten(); }
+
+	// Data a partial write left behind, that the next write sends first
+	uint32_t    GetBytesBuffered() { return formater.GetCurrentOffset() - fBytesSentInBuffer; }
 	void        Reset(uint32_t inNumBytesToLeave = 0) { formater.Reset(inNumBytesToLeave);  }
 	void        PutEOL() { formater.PutEOL(); }
 	void        Put(const boost::string_view str) { formater.Put(str); }
@@ -10,21 +10,8 @@
 #include "MyRTSPRequest.h"
 #include "MyRTPSession.h"
 #include "MyRTPStream.h"
+#include "MyRTPSessionOutput.h"
 #include <fmt/format.h>
-#include "Uri.h"
-
-static std::string getStreamIdFromUri(std::string_view uri, size_t removeDepthFromEnd = 0)
-{
-	std::string pathname = Uri::Parse(std::string(uri)).Path.substr(1);
-	if (pathname.back() == '/') pathname.pop_back();
-	for (size_t count = 0; count < removeDepthFromEnd; count++)
-	{
-		size_t pos = pathname.find_last_of('/');
-		if (pos == std::string::npos) break;
-		pathname = pathname.substr(0, pos);
-	}
-	return pathname;
-}
 
 template <typename S>
 static std::vector<std::string> spirit_direct(const S& input, char const* delimiter)
@@ -37,164 +24,244 @@ static std::vector<std::string> spirit_direct(const S& input, char const* delimi
 	return result;
 }
 
-CoTask RunRTSPSession(RTSPServer &server, boost::asio::ip::tcp::socket socket, MyRTSPSession *session) {
+static std::string MakeErrorResponse(const std::error_code &ec, const std::string &cseq)
+{
+	const char *theStatus = "400 Bad Request";
+	if (ec == std::errc::no_such_file_or_directory)
+		theStatus = "404 Not Found";
+	else if (ec == std::errc::not_supported)
+		theStatus = "461 Unsupported Transport";
+	return fmt::format("RTSP/1.0 {}\r\n"
+		"Cseq: {}\r\n\r\n", theStatus, cseq);
+}
+
+CoTask RunRTSPSession(RTSPServer &server, std::shared_ptr<boost::asio::ip::tcp::socket> socket, MyRTSPSession *session) {
 	boost::asio::streambuf buffer;
 	MyRTSPRequest request;
 	while (true) {
-		auto result = co_await AsyncRead(socket, buffer.prepare(4));
-		if (!result) {
-			std::cerr << "Error when reading: " << result.Error().message() << "\n";
-			break;
-		}
-		const char *firstChar = boost::asio::buffer_cast<const char*>(buffer.data());
-		buffer.commit(result.Get());
-		if (*firstChar == '$') {
-			uint8_t packetChannel = (uint8_t)firstChar[1];
-			uint16_t packetDataLen = *(uint16_t *)(firstChar + 2);
-			packetDataLen = ntohs(packetDataLen);
-			result = co_await AsyncRead(socket, buffer.prepare(packetDataLen));
+		// Whatever comes next, its first 4 bytes tell an interleaved packet
+		// from a request. The buffer may hold them already.
+		if (buffer.size() < 4) {
+			auto result = co_await AsyncRead(*socket, buffer.prepare(4 - buffer.size()));
 			if (!result) {
 				std::cerr << "Error when reading: " << result.Error().message() << "\n";
 				break;
 			}
-			else {
-				int a = 1;
+			buffer.commit(result.Get());
+		}
+		const char *firstChar = boost::asio::buffer_cast<const char*>(buffer.data());
+		if (*firstChar == '$') {
+			uint16_t packetDataLen;
+			memcpy(&packetDataLen, firstChar + 2, 2);
+			size_t packetLen = 4 + ntohs(packetDataLen);
+			if (buffer.size() < packetLen) {
+				auto result = co_await AsyncRead(*socket, buffer.prepare(packetLen - buffer.size()));
+				if (!result) {
+					std::cerr << "Error when reading: " << result.Error().message() << "\n";
+					break;
+				}
+				buffer.commit(result.Get());
 			}
+			// The viewers' RTCP receiver reports are dropped here
+			if (session->broadcastSession)
+				session->process_rtppacket(boost::asio::buffer_cast<const char*>(buffer.data()), packetLen);
+			buffer.consume(packetLen);
+			continue;
 		}
-		else {
-			result = co_await AsyncReadUntil(socket, buffer);
-			if (!result) {
-				std::cerr << "Error when reading: " << result.Error().message() << "\n";
-				break;
+
+		auto result = co_await AsyncReadUntil(*socket, buffer);
+		if (!result) {
+			std::cerr << "Error when reading: " << result.Error().message() << "\n";
+			break;
+		}
+		std::string text{ boost::asio::buffer_cast<const char*>(buffer.data()), result.Get() };
+		std::string content;
+		buffer.consume(result.Get());
+		if (!RequestMessage::parse(text, request))
+			break;
+
+		auto it = request.header.find("Content-Length");
+		if (it != request.header.end()) {
+			unsigned long long content_length = 0;
+			try {
+				content_length = std::stoull(it->second);
 			}
-			std::string text{ boost::asio::buffer_cast<const char*>(buffer.data()), result.Get() };
-			std::string content;
-			buffer.consume(result.Get());
-			if (!RequestMessage::parse(text, request)) {
-				return;
+			catch (const std::exception &e) {
+				break;
 			}
-			auto it = request.header.find("Content-Length");
-			if (it != request.header.end()) {
-				unsigned long long content_length = 0;
-				try {
-					content_length = std::stoull(it->second);
-				}
-				catch (const std::exception &e) {
-					return;
-				}
+			// Some of the body may have come in with the headers
+			size_t buffered = std::min<size_t>(buffer.size(), content_length);
+			content.assign(boost::asio::buffer_cast<const char*>(buffer.data()), buffered);
+			buffer.consume(buffered);
+			if (buffered < content_length) {
 				content.resize(content_length);
 				result = co_await AsyncRead(
-					socket, boost::asio::buffer(&content[0], content.length()));
+					*socket, boost::asio::buffer(&content[buffered], content.length() - buffered));
 				if (!result) {
 					std::cerr << "Error when reading: " << result.Error().message() << "\n";
 					break;
-				} 
-				else 
-				{
-					buffer.consume(content_length);
-					if (request.method == "ANNOUNCE") {
-						std::string streamID = getStreamIdFromUri(request.path);
-						AVStream *stream = nullptr;
-						if (stream != nullptr) {
-							stream->reset();
-							//this.rtpParser.clearUnorderedPacketBuffer(stream.id);
-						}
-						else {
-							stream = new AVStream(streamID);
-							stream->type = StreamType::LIVE;
-						}
-						SDPContainer checkedSDPContainer(content);
-						if (!checkedSDPContainer.Parse())
-						{
-							//return inParams->inRTSPRequest->SendErrorResponseWithMessage(qtssUnsupportedMediaType);
-						}
-						CSdpCache::GetInstance()->setSdpMap("live.sdp", content);
-						std::string output = fmt::format("RTSP/1.0 200 OK\r\n"
-							"Cseq: {} \r\n\r\n", request.header["CSeq"]);
-						result = co_await AsyncWrite(
-							socket, boost::asio::buffer(output.data(), output.length()));
-						if (!result) {
-							std::cerr << "Error when writing: " << result.Error().message() << "\n";
-							break;
-						}
-					}
 				}
-				
 			}
-			if (request.method == "OPTIONS") {
-				std::string output = 
-					fmt::format("RTSP/1.0 200 OK\r\n"
-						        "Cseq: {} \r\n"
-            					"Public: DESCRIBE, SETUP, TEARDOWN, PLAY, PAUSE, OPTIONS, ANNOUNCE, RECORD\r\n\r\n", request.header["CSeq"]);
-				result = co_await AsyncWrite(
-					socket, boost::asio::buffer(output));
-				if (!result) {
-					std::cerr << "Error when writing: " << result.Error().message() << "\n";
-					break;
-				}
+		}
+
+		std::string output;
+		bool startPlaying = false;
+		if (request.method == "ANNOUNCE") {
+			SDPContainer checkedSDPContainer(content);
+			if (!checkedSDPContainer.Parse())
+			{
+				output = fmt::format("RTSP/1.0 415 Unsupported Media Type\r\n"
+					"Cseq: {}\r\n\r\n", request.header["CSeq"]);
 			}
-			else if (request.method == "SETUP") {
-				session->FindOrCreateRTPSession(request);
-				std::error_code ec = session->do_setup(request);
-				if (!ec) {
-					std::string modifyTransport = [session, &request]() {
-						auto &stream = session->fRTPSession->GetStreams().back();
-						std::string transportStr = request.header["Transport"];
-						std::vector<std::string> headers = spirit_direct(transportStr, ";");
-						std::string output;
-						for (const auto & header : headers) {
-							if (header.empty()) continue;
-							if (boost::istarts_with(header, "interleaved")) continue;
-							output += header + ";";
-						}
-						output += "interleaved=" + std::to_string(stream.GetRTPChannelNum()) + "-" +
-							std::to_string(stream.GetRTCPChannelNum());
-						return std::move(output);
-					}();
-					std::string output = fmt::format("RTSP/1.0 200 OK\r\n"
-							"Cseq: {}\r\n"
-							"Session: {}\r\n"
-							"Transport: {}\r\n\r\n", request.header["CSeq"], session->fSessionID, modifyTransport);
-					result = co_await AsyncWrite(
-						socket, boost::asio::buffer(output));
-					if (!result) {
-						std::cerr << "Error when writing: " << result.Error().message() << "\n";
-						break;
-					}
-				}
+			else
+			{
+				CSdpCache::GetInstance()->setSdpMap(request.GetFileName(), content);
+				output = fmt::format("RTSP/1.0 200 OK\r\n"
+					"Cseq: {} \r\n\r\n", request.header["CSeq"]);
 			}
-			if (request.method == "RECORD") {
-				session->FindOrCreateRTPSession(request);
-				if (!session->rtp_OutputSession) {
-					std::error_code ec = session->do_play(nullptr);
-					std::string streamsStr = [session, &request]() {
-						auto &streams = session->fRTPSession->GetStreams();
-						std::string output;
-						for (auto &stream : streams)
-							output += "url=" + request.path + "/" + stream.GetStreamURL() + ",";
-						return std::move(output);
-					}();
-					auto output = fmt::format("RTSP/1.0 200 OK\r\n"
-							"Cseq: {}\r\n"
-							"Session: {}\r\n"
-							"RTP-Info: {}\r\n\r\n", request.header["CSeq"], session->fSessionID, streamsStr);
-					result = co_await AsyncWrite(
-						socket, boost::asio::buffer(output.data(), output.length()));
-					if (!result) {
-						std::cerr << "Error when writing: " << result.Error().message() << "\n";
-						break;
+		}
+		else if (request.method == "OPTIONS") {
+			output =
+				fmt::format("RTSP/1.0 200 OK\r\n"
+					        "Cseq: {} \r\n"
+        					"Public: DESCRIBE, SETUP, TEARDOWN, PLAY, PAUSE, OPTIONS, ANNOUNCE, RECORD\r\n\r\n", request.header["CSeq"]);
+		}
+		else if (request.method == "DESCRIBE") {
+			std::string sdp;
+			std::error_code ec = session->do_describe(request, sdp);
+			if (ec)
+				output = MakeErrorResponse(ec, request.header["CSeq"]);
+			else
+				output = fmt::format("RTSP/1.0 200 OK\r\n"
+					"Cseq: {}\r\n"
+					"Content-Base: {}/\r\n"
+					"Content-Type: application/sdp\r\n"
+					"Content-Length: {}\r\n\r\n{}", request.header["CSeq"], request.path, sdp.size(), sdp);
+		}
+		else if (request.method == "SETUP") {
+			session->FindOrCreateRTPSession(request);
+			std::error_code ec = session->do_setup(request);
+			if (ec)
+				output = MakeErrorResponse(ec, request.header["CSeq"]);
+			else {
+				std::string modifyTransport = [session, &request]() {
+					auto &stream = session->fRTPSession->GetStreams().back();
+					std::string transportStr = request.header["Transport"];
+					std::vector<std::string> headers = spirit_direct(transportStr, ";");
+					std::string output;
+					for (const auto & header : headers) {
+						if (header.empty()) continue;
+						if (boost::istarts_with(header, "interleaved")) continue;
+						output += header + ";";
 					}
-				}
+					output += "interleaved=" + std::to_string(stream.GetRTPChannelNum()) + "-" +
+						std::to_string(stream.GetRTCPChannelNum());
+					return std::move(output);
+				}();
+				output = fmt::format("RTSP/1.0 200 OK\r\n"
+						"Cseq: {}\r\n"
+						"Session: {}\r\n"
+						"Transport: {}\r\n\r\n", request.header["CSeq"], session->fSessionID, modifyTransport);
+			}
+		}
+		else if (request.method == "PLAY") {
+			if (session->fPlayStreams.empty())
+				output = fmt::format("RTSP/1.0 455 Method Not Valid in This State\r\n"
+					"Cseq: {}\r\n\r\n", request.header["CSeq"]);
+			else {
+				// From here on the output owns the writes to the connection,
+				// so that the response can't land inside a packet
+				session->AddPlayOutput(socket);
+				startPlaying = true;
+				output = fmt::format("RTSP/1.0 200 OK\r\n"
+					"Cseq: {}\r\n"
+					"Session: {}\r\n"
+					"Range: npt=0.000-\r\n\r\n", request.header["CSeq"], session->fSessionID);
 			}
 		}
+		else if (request.method == "TEARDOWN") {
+			session->StopPlaying();
+			output = fmt::format("RTSP/1.0 200 OK\r\n"
+				"Cseq: {}\r\n"
+				"Session: {}\r\n\r\n", request.header["CSeq"], session->fSessionID);
+		}
+		else if (request.method == "RECORD") {
+			session->FindOrCreateRTPSession(request);
+			std::error_code ec = session->do_play(nullptr);
+			std::string streamsStr = [session, &request]() {
+				auto &streams = session->fRTPSession->GetStreams();
+				std::string output;
+				for (auto &stream : streams)
+					output += "url=" + request.path + "/" + stream.GetStreamURL() + ",";
+				return std::move(output);
+			}();
+			output = fmt::format("RTSP/1.0 200 OK\r\n"
+					"Cseq: {}\r\n"
+					"Session: {}\r\n"
+					"RTP-Info: {}\r\n\r\n", request.header["CSeq"], session->fSessionID, streamsStr);
+		}
+		else {
+			output = fmt::format("RTSP/1.0 501 Not Implemented\r\n"
+				"Cseq: {}\r\n\r\n", request.header["CSeq"]);
+		}
+
+		if (session->rtp_OutputSession)
+			session->rtp_OutputSession->SendResponse(std::move(output));
+		else {
+			result = co_await AsyncWrite(*socket, boost::asio::buffer(output));
+			if (!result) {
+				std::cerr << "Error when writing: " << result.Error().message() << "\n";
+				break;
+			}
+		}
+		if (startPlaying)
+			session->StartPlaying();
+	}
+
+	session->TearDown();
+	delete session;
+}
+
+RTSPServer::RTSPServer(IoServicePool& pool) : pool_(pool)
+{
+	boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::tcp::v4(), 10554);
+
+#if defined(__linux__)
+	// One acceptor per io_service, all bound to the port with SO_REUSEPORT.
+	// The kernel spreads the connections over them, and a connection is
+	// served on the thread that accepted it.
+	size_t numAcceptors = pool_.GetNumIoServices();
+#else
+	// One acceptor, handing the connections to the pool round robin
+	size_t numAcceptors = 1;
+#endif
+	for (size_t x = 0; x < numAcceptors; x++) {
+		auto acceptor = std::make_unique<boost::asio::ip::tcp::acceptor>(pool_.GetIoService(x));
+		acceptor->open(endpoint.protocol());
+		acceptor->set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+#if defined(__linux__)
+		acceptor->set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
+		acceptor->bind(endpoint);
+		acceptor->listen();
+		acceptors_.push_back(std::move(acceptor));
 	}
+
+	for (size_t x = 0; x < acceptors_.size(); x++)
+		AcceptConnections(*acceptors_[x], pool_.GetIoService(x));
 }
 
-CoTask RTSPServer::AcceptConnections() {
+CoTask RTSPServer::AcceptConnections(boost::asio::ip::tcp::acceptor& acceptor, boost::asio::io_service& acceptorService) {
+	bool handOff = (acceptors_.size() < pool_.GetNumIoServices());
 	while (true) {
-		Result<boost::asio::ip::tcp::socket> result = co_await AsyncAccept(acceptor_);
+		boost::asio::io_service& sessionService = handOff ? pool_.GetNextIoService() : acceptorService;
+		Result<boost::asio::ip::tcp::socket> result = co_await AsyncAccept(acceptor, sessionService);
 		if (result) {
-			RunRTSPSession(*this, std::move(result.Get()), new MyRTSPSession(*this));
+			// Interleaved packets go out as they come in, the last segment of
+			// a write mustn't wait for the viewer to ACK the one before
+			boost::system::error_code ignored;
+			result.Get().set_option(boost::asio::ip::tcp::no_delay(true), ignored);
+			RunRTSPSession(*this, std::make_shared<boost::asio::ip::tcp::socket>(std::move(result.Get())), new MyRTSPSession(*this));
 		}
 		else {
 			std::cerr << "Error accepting connection: " << result.Error().message()
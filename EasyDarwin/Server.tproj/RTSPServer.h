@@ -7,6 +7,7 @@
 #include <optional>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/io_service.hpp>
+#include "IoServicePool.h"
 #include "MyRTSPSession.h"
 #include "MyRTSPRequest.h"
 #include "coroutine_wrappers.h"
@@ -89,8 +90,9 @@ struct AVStream {
 class MyReflectorSession;
 class RTSPServer {
 	friend class MyRTSPSession;
-	boost::asio::ip::tcp::acceptor acceptor_;
-	boost::asio::io_service& io_service_;
+	IoServicePool& pool_;
+	std::vector<std::unique_ptr<boost::asio::ip::tcp::acceptor>> acceptors_;
+	// rtpMap and sessionMap are shared by the sessions on every thread of the pool
 	std::mutex connections_mutex;
 	std::mutex session_mutex;
 	std::mutex rtp_mutex;
@@ -117,10 +119,8 @@ class RTSPServer {
 	/// Set before calling start().
 	Config config;
 public:
-	RTSPServer(boost::asio::io_service& io_svr) : io_service_(io_svr), acceptor_(io_svr,
-		boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), 10554))
-	{
-		AcceptConnections();
-	}
-	CoTask AcceptConnections();
+	// Accepts on every io_service of the pool. A connection's session runs on
+	// one io_service for its whole life.
+	RTSPServer(IoServicePool& pool);
+	CoTask AcceptConnections(boost::asio::ip::tcp::acceptor& acceptor, boost::asio::io_service& acceptorService);
 };
\ No newline at end of file
@@ -60,9 +60,6 @@ static RTPSession* GetRTPSession(StrPtrLen *str)
 	return nullptr;
 }
 
-// hack stuff
-static boost::string_view                    sBroadcasterSessionName = "QTSSReflectorModuleBroadcasterSession";
-
 static StrPtrLen    sVideoStr("video");
 static StrPtrLen    sAudioStr("audio");
 static StrPtrLen    sRtpMapStr("rtpmap");
@@ -28,7 +28,9 @@
 	 Contains:   Implementation of RTSPSessionInterface object.
  */
 
+#include <algorithm>
 #include <random>
+#include <limits.h>
 #include <boost/algorithm/string/predicate.hpp>
 
 #include "RTSPSessionInterface.h"
@@ -139,13 +141,40 @@ boost::string_view  RTSPSessionInterface::GetSessionIDForChannelNum(uint8_t inCh
 
 QTSS_Error RTSPSessionInterface::InterleavedWrite(const std::vector<char > &inBuffer, uint32_t* outLenWritten, unsigned char channel)
 {
+	if (outLenWritten != nullptr)
+		*outLenWritten = 0;
 
-	if (inBuffer.empty() && fTCPCoalesceBuffer.empty())
-	{
-		if (outLenWritten != nullptr)
-			*outLenWritten = 0;
+	if (inBuffer.empty())
+		return QTSS_NoErr;
+
+	const std::vector<char>* thePacket = &inBuffer;
+	uint32_t theNumPacketsWritten = 0;
+	QTSS_Error err = this->InterleavedWriteV(&thePacket, 1, &theNumPacketsWritten, channel);
+	if (theNumPacketsWritten == 0)
+		return err;
+
+	if (outLenWritten != nullptr)
+		*outLenWritten = inBuffer.size();
+	return QTSS_NoErr;
+}
+
+/*********************************
+/
+/   InterleavedWriteV
+/
+/   Write the given RTP packets out on the RTSP channel in interleaved format,
+/   a batch of them in a single writev, as fCoalescer lays them out.
+/
+/   Returns EAGAIN if not all the packets could be written.
+/
+*/
+
+QTSS_Error RTSPSessionInterface::InterleavedWriteV(const std::vector<char>* const* inPackets, uint32_t inNumPackets,
+	uint32_t* outNumPacketsWritten, unsigned char channel)
+{
+	*outNumPacketsWritten = 0;
+	if (inNumPackets == 0)
 		return QTSS_NoErr;
-	}
 
 	// First attempt to grab the RTSPSession mutex. This is to prevent writing data to
 	// the connection at the same time an RTSPRequest is being processed. We cannot
@@ -156,94 +185,32 @@ QTSS_Error RTSPSessionInterface::InterleavedWrite(const std::vector<char > &inBu
 		return EAGAIN;
 	}
 
-	// DMS - this struct should be packed.
-	//rt todo -- is this struct more portable (byte alignment could be a problem)?
-	struct  RTPInterleaveHeader
+	QTSS_Error err = QTSS_NoErr;
+	while ((err == QTSS_NoErr) && (*outNumPacketsWritten < inNumPackets))
 	{
-		unsigned char header;
-		unsigned char channel;
-		uint16_t      len;
-	};
-
-	struct  iovec               iov[3];
-	QTSS_Error                  err = QTSS_NoErr;
-
-
-
-	// flush rules
-	if ((inBuffer.size() > kTCPCoalesceDirectWriteSize || inBuffer.empty()) && fTCPCoalesceBuffer.size() > 0
-		|| (inBuffer.size() + fTCPCoalesceBuffer.size() + kInteleaveHeaderSize > kTCPCoalesceBufferSize) && fTCPCoalesceBuffer.size() > 0
-		)
-	{
-		uint32_t      buffLenWritten;
-
-		// skip iov[0], WriteV uses it
-		iov[1].iov_base = &fTCPCoalesceBuffer[0];
-		iov[1].iov_len = fTCPCoalesceBuffer.size();
-
-		err = this->GetOutputStream()->WriteV(iov, 2, fTCPCoalesceBuffer.size(), &buffLenWritten, RTSPResponseStream::kAllOrNothing);
+		uint32_t theTotalLength = 0;
+		uint32_t theBatchSize = fCoalescer.PrepareBatch(inPackets + *outNumPacketsWritten, inNumPackets - *outNumPacketsWritten,
+			channel, &theTotalLength);
 
+		uint32_t theLengthSent = 0;
+		err = this->GetOutputStream()->WriteV(fCoalescer.GetVec(), fCoalescer.GetNumVecs(), theTotalLength, &theLengthSent, RTSPResponseStream::kAllOrNothing);
 		if (err == QTSS_NoErr)
-			fTCPCoalesceBuffer.clear();
-	}
-
-
-
-	if (err == QTSS_NoErr)
-	{
-
-		if (inBuffer.size() > kTCPCoalesceDirectWriteSize)
 		{
-			struct RTPInterleaveHeader  rih;
-
-			// write direct to stream
-			rih.header = '$';
-			rih.channel = channel;
-			rih.len = htons((uint16_t)inBuffer.size());
-
-			iov[1].iov_base = (char*)&rih;
-			iov[1].iov_len = sizeof(rih);
-
-			iov[2].iov_base = const_cast<char *>(&inBuffer[0]);
-			iov[2].iov_len = inBuffer.size();
-
-			err = this->GetOutputStream()->WriteV(iov, 3, inBuffer.size() + sizeof(rih), outLenWritten, RTSPResponseStream::kAllOrNothing);
-
+			// GetOutputStream()->WriteV guarantees all or nothing for writes: if
+			// no error, the whole batch was written. Whatever the socket didn't
+			// take sits in the output buffer though, so the socket is full.
+			*outNumPacketsWritten += theBatchSize;
+			if (this->GetOutputStream()->GetBytesBuffered() > 0)
+				err = EAGAIN;
 		}
-		else
-		{
-			// coalesce with other small writes
 
-			fTCPCoalesceBuffer.push_back('$');
-			fTCPCoalesceBuffer.push_back(channel);
-
-			// if we ever turn TCPCoalesce back on, this should be optimized
-			// for processors w/o alignment restrictions as above.
-
-			int16_t  pcketLen = htons((uint16_t)inBuffer.size());
-			std::copy(&pcketLen, &pcketLen + 2, std::back_inserter(fTCPCoalesceBuffer));
-
-			std::copy(begin(inBuffer), end(inBuffer), std::back_inserter(fTCPCoalesceBuffer));
-
-		}
-	}
-
-	if (err == QTSS_NoErr)
-	{
-		/*  if no error sure to correct outLenWritten, cuz WriteV above includes the interleave header count
-
-			 GetOutputStream()->WriteV guarantees all or nothing for writes
-			 if no error, then all was written.
-		*/
-		if (outLenWritten != nullptr)
-			*outLenWritten = inBuffer.size();
+		if ((err == QTSS_NoErr) || (err == EAGAIN))
+			fCoalescer.WriteDone(err == QTSS_NoErr);
 	}
 
 	this->GetSessionMutex()->Unlock();
 
-
 	return err;
-
 }
 
 std::string RTSPSessionInterface::GetRemoteAddr()
@@ -38,6 +38,7 @@
 #include <string>
 #include "RTSPRequestStream.h"
 #include "RTSPResponseStream.h"
+#include "RTSPInterleavedCoalescer.h"
 #include "Task.h"
 #include "QTSS.h"
 #include "atomic.h"
@@ -108,6 +109,12 @@ public:
 	// performs RTP over RTSP
 	QTSS_Error  InterleavedWrite(const std::vector<char> &inBuffer, uint32_t* outLenWritten, unsigned char channel);
 
+	// Same, for several packets on one channel, in as few writes as the
+	// coalescing budget allows. On return *outNumPacketsWritten packets
+	// were written, the first of the others is the one to try again.
+	QTSS_Error  InterleavedWriteV(const std::vector<char>* const* inPackets, uint32_t inNumPackets,
+		uint32_t* outNumPacketsWritten, unsigned char channel);
+
 	std::string GetRemoteAddr();
 protected:
 	enum
@@ -125,14 +132,9 @@ protected:
 	// be prevented from writing while an RTSP request is in progress
 	OSMutex             fSessionMutex;
 
-	// for coalescing small interleaved writes into a single TCP frame
-	enum
-	{
-		kTCPCoalesceBufferSize = 1450 //1450 is the max data space in an TCP segment over ent
-		, kTCPCoalesceDirectWriteSize = 0 // if > this # bytes bypass coalescing and make a direct write
-		, kInteleaveHeaderSize = 4  // '$ '+ 1 byte ch ID + 2 bytes length
-	};
-	std::vector<char>       fTCPCoalesceBuffer;
+	// for coalescing interleaved writes into as few writev calls as the
+	// connection keeps up with
+	RTSPInterleavedCoalescer    fCoalescer;
 
 
 	//+rt  socket we get from "accept()"
@@ -71,4 +71,59 @@ namespace ServerPrefs {
 	{
 		return { "Real" };
 	}
+	// datagrams a reflector socket drains per recvmmsg call, capped at UDPSocket::kMaxRecvBatch
+	uint32_t GetReflectorRecvBatchSize() {
+		constexpr uint32_t fReflectorRecvBatchSize = 32;
+		return fReflectorRecvBatchSize;
+	}
+	// most bytes of its latest GOP a reflected stream keeps for viewers that join late
+	uint32_t GetReflectorGOPCacheSizeInK() {
+		constexpr uint32_t fReflectorGOPCacheSizeInK = 4096;
+		return fReflectorGOPCacheSizeInK;
+	}
+	// most bytes of packets a reflected stream keeps around for its viewers, its current GOP is kept regardless
+	uint32_t GetReflectorStreamRetentionInK() {
+		constexpr uint32_t fReflectorStreamRetentionInK = 8192;
+		return fReflectorStreamRetentionInK;
+	}
+	// most bytes of packets all reflected streams keep together before each of them keeps less, 0 for no limit
+	uint32_t GetReflectorMaxRetentionInMB() {
+		constexpr uint32_t fReflectorMaxRetentionInMB = 1024;
+		return fReflectorMaxRetentionInMB;
+	}
+	// how much later each bucket of reflector outputs gets a packet than the one before it
+	uint32_t GetReflectorBucketOffsetDelayMsec() {
+		constexpr uint32_t fReflectorBucketOffsetDelayMsec = 73;
+		return fReflectorBucketOffsetDelayMsec;
+	}
+	// RTP packets a reflected stream may hold back to put its ingest in order, 0 takes packets as they come, duplicates included
+	uint32_t GetReflectorReorderWindow() {
+		constexpr uint32_t fReflectorReorderWindow = 0;
+		return fReflectorReorderWindow;
+	}
+	// longest a packet is held back waiting for the ones in front of it
+	uint32_t GetReflectorReorderMaxHoldMsec() {
+		constexpr uint32_t fReflectorReorderMaxHoldMsec = 40;
+		return fReflectorReorderMaxHoldMsec;
+	}
+	// how far behind live a viewer may fall before it skips ahead to a key frame, 0 for no limit
+	uint32_t GetReflectorMaxViewerLagMsec() {
+		constexpr uint32_t fReflectorMaxViewerLagMsec = 1000;
+		return fReflectorMaxViewerLagMsec;
+	}
+	// how many bytes of a stream a viewer may have left to send before it skips ahead to a key frame, 0 for no limit
+	uint32_t GetReflectorMaxViewerLagInK() {
+		constexpr uint32_t fReflectorMaxViewerLagInK = 2048;
+		return fReflectorMaxViewerLagInK;
+	}
+	// threads serving the coroutine RTSP server, 0 for one per core
+	uint32_t GetRTSPServerNumIoServices() {
+		constexpr uint32_t fRTSPServerNumIoServices = 0;
+		return fRTSPServerNumIoServices;
+	}
+	// port serving the server metrics at /metrics, 0 turns them off
+	uint16_t GetMetricsPort() {
+		constexpr uint16_t fMetricsPort = 9554;
+		return fMetricsPort;
+	}
 }
\ No newline at end of file
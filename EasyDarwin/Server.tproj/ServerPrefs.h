@@ -21,4 +21,15 @@ namespace ServerPrefs {
 	float GetTCPSecondsToBuffer();
 	boost::string_view GetMovieFolder();
 	std::vector<std::string> GetReqRTPStartTimeAdjust();
+	uint32_t GetReflectorRecvBatchSize();
+	uint32_t GetReflectorGOPCacheSizeInK();
+	uint32_t GetReflectorStreamRetentionInK();
+	uint32_t GetReflectorMaxRetentionInMB();
+	uint32_t GetReflectorBucketOffsetDelayMsec();
+	uint32_t GetReflectorReorderWindow();
+	uint32_t GetReflectorReorderMaxHoldMsec();
+	uint32_t GetReflectorMaxViewerLagMsec();
+	uint32_t GetReflectorMaxViewerLagInK();
+	uint32_t GetRTSPServerNumIoServices();
+	uint16_t GetMetricsPort();
 }
\ No newline at end of file
@@ -38,8 +38,8 @@ void AsyncWrite::await_suspend(std::experimental::coroutine_handle<> handle) {
 		HandleDone{ this, handle });
 }
 
-AsyncAccept::AsyncAccept(boost::asio::ip::tcp::acceptor& acceptor)
-	: acceptor_(acceptor), socket_(acceptor.get_io_service()) {}
+AsyncAccept::AsyncAccept(boost::asio::ip::tcp::acceptor& acceptor, boost::asio::io_service& socketService)
+	: acceptor_(acceptor), socket_(socketService) {}
 
 void AsyncAccept::await_suspend(std::experimental::coroutine_handle<> handle) {
 	acceptor_.async_accept(socket_, [this, handle](boost::system::error_code error) mutable {
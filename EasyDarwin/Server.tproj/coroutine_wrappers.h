@@ -1,6 +1,7 @@
 #pragma once
 
 #include <boost/asio/buffer.hpp>
+#include <boost/asio/io_service.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/streambuf.hpp>
 #include <experimental/coroutine>
@@ -89,7 +90,8 @@ private:
 
 class AsyncAccept {
 public:
-	explicit AsyncAccept(boost::asio::ip::tcp::acceptor& acceptor);
+	// The accepted socket belongs to socketService, which needn't be the acceptor's
+	AsyncAccept(boost::asio::ip::tcp::acceptor& acceptor, boost::asio::io_service& socketService);
 	bool await_ready() const { return false; }
 	void await_suspend(std::experimental::coroutine_handle<> handle);
 	Result<boost::asio::ip::tcp::socket> await_resume() { return std::move(result_); }
@@ -35,6 +35,8 @@
 #include "RunServer.h"
 #include "QTSServer.h"
 #include "RTSPServer.h"
+#include "MetricsServer.h"
+#include "ServerPrefs.h"
 
 boost::asio::io_service io_service;
 
@@ -44,7 +46,11 @@ static QTSS_ServerState sInitialState = qtssRunningState;
 
 int main(int argc, char * argv[])
 {
-	RTSPServer listener(io_service);
+	IoServicePool rtspServerPool(ServerPrefs::GetRTSPServerNumIoServices());
+	RTSPServer listener(rtspServerPool);
+	MetricsServer metricsListener(rtspServerPool, ServerPrefs::GetMetricsPort());
+	rtspServerPool.Start();
+
 	std::thread t([&] {
 		boost::asio::io_service::work work(io_service);
 		io_service.run();
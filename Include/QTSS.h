@@ -177,6 +177,7 @@ typedef uint32_t QTSS_RTSPSessionType;
 // What type of RTP transport is being used for the RTP stream?
 enum
 {
+    qtssRTPTransportTypeUDP         = 0,
     qtssRTPTransportTypeTCP         = 2,
     qtssRTPTransportTypeUnknown     = 3
 };
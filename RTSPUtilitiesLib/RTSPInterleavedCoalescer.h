@@ -0,0 +1,110 @@
+/*
+	File:       RTSPInterleavedCoalescer.h
+
+	Contains:   Lays RTP packets out for an interleaved write on an RTSP
+				connection, as many of them to a writev as its budget allows.
+
+				Each packet goes out from its own buffer behind a 4 byte '$'
+				header of its own, so nothing is copied. A batch takes the
+				packets that fit in the budget, but always at least one, so
+				coalescing never holds a packet back: it only ever combines
+				packets that are already due. The budget doubles while batches
+				it limited get through whole, and halves when the socket pushes
+				back.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <limits.h>
+#include "OSHeaders.h"
+#ifndef __Win32__
+#include <sys/uio.h>
+#endif
+
+class RTSPInterleavedCoalescer
+{
+public:
+	enum
+	{
+		kMinBudget = 1450,      // the max data space in a TCP segment over ethernet
+		kMaxBudget = 65536,     // most bytes to hand a single writev
+		kHeaderSize = 4         // '$' + 1 byte channel + 2 bytes length
+	};
+
+	// writev takes at most IOV_MAX vectors: the first is left blank for a
+	// buffered response to go out ahead, then a header and a payload per packet
+	enum
+	{
+#ifdef IOV_MAX
+		kMaxPackets = (IOV_MAX - 1) / 2
+#else
+		kMaxPackets = 7     // the least POSIX allows is 16
+#endif
+	};
+
+	// Lays out the next batch of inPackets for inChannel. Returns how many
+	// packets it takes, and their length with the headers in *outTotalLength.
+	// GetVec()[0] is left blank.
+	uint32_t    PrepareBatch(const std::vector<char>* const* inPackets, uint32_t inNumPackets,
+		unsigned char inChannel, uint32_t* outTotalLength)
+	{
+		uint32_t theNumPackets = std::min<uint32_t>(inNumPackets, kMaxPackets);
+		uint32_t theBatchSize = 0;
+		uint32_t theTotalLength = 0;
+		fIsBudgetLimited = false;
+		for (; theBatchSize < theNumPackets; theBatchSize++)
+		{
+			uint32_t thePacketLength = (uint32_t)inPackets[theBatchSize]->size() + kHeaderSize;
+			if ((theBatchSize > 0) && (theTotalLength + thePacketLength > fBudget))
+			{
+				fIsBudgetLimited = true;
+				break;
+			}
+			theTotalLength += thePacketLength;
+		}
+
+		fHeaders.resize(theBatchSize * kHeaderSize);
+		fVec.resize(theBatchSize * 2 + 1);
+		for (uint32_t x = 0; x < theBatchSize; x++)
+		{
+			const std::vector<char>& thePacket = *inPackets[x];
+			char* theHeader = &fHeaders[x * kHeaderSize];
+			theHeader[0] = '$';
+			theHeader[1] = inChannel;
+			theHeader[2] = (char)(thePacket.size() >> 8);
+			theHeader[3] = (char)(thePacket.size() & 0xFF);
+
+			fVec[x * 2 + 1].iov_base = theHeader;
+			fVec[x * 2 + 1].iov_len = kHeaderSize;
+			fVec[x * 2 + 2].iov_base = const_cast<char *>(thePacket.data());
+			fVec[x * 2 + 2].iov_len = thePacket.size();
+		}
+
+		*outTotalLength = theTotalLength;
+		return theBatchSize;
+	}
+
+	iovec*      GetVec() { return &fVec[0]; }
+	uint32_t    GetNumVecs() const { return (uint32_t)fVec.size(); }
+
+	// After the batch went out: inWroteAll if it all left for the socket,
+	// false if the socket took none or only part of it
+	void        WriteDone(bool inWroteAll)
+	{
+		if (!inWroteAll)
+			fBudget = std::max<uint32_t>(fBudget / 2, kMinBudget);
+		else if (fIsBudgetLimited)
+			fBudget = std::min<uint32_t>(fBudget * 2, kMaxBudget);
+	}
+
+	uint32_t    GetBudget() const { return fBudget; }
+
+private:
+	uint32_t            fBudget{ kMinBudget };
+	bool                fIsBudgetLimited{ false };
+	std::vector<char>   fHeaders;
+	std::vector<iovec>  fVec;
+};
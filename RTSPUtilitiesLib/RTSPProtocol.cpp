@@ -29,6 +29,7 @@
  */
 
 #include "RTSPProtocol.h"
+#include "MyAssert.h"
 #include <boost/algorithm/string/predicate.hpp>
 
 boost::string_view RTSPProtocol::sRetrProtName("our-retransmit");
@@ -131,45 +132,57 @@ boost::string_view RTSPProtocol::sHeaders[] =
 	"x-Random-Data-Size",
 };
 
-QTSS_RTSPHeader RTSPProtocol::GetRequestHeader(boost::string_view inHeaderStr)
+//
+// Request headers are looked up through a perfect hash: FNV-1a over the lower
+// cased name, started from a seed that puts every name in sHeaders into a
+// bucket of its own. Any other string either hashes to an empty bucket or
+// fails the final compare.
+enum
 {
-	if (inHeaderStr.empty())
-		return qtssIllegalHeader;
+	kHeaderHashSeed = 46,
+	kNumHeaderBuckets = 256
+};
 
-	QTSS_RTSPHeader theHeader = qtssIllegalHeader;
+static uint32_t HashHeaderName(boost::string_view inHeaderStr)
+{
+	uint32_t theHash = kHeaderHashSeed;
+	for (char theChar : inHeaderStr)
+	{
+		if ((theChar >= 'A') && (theChar <= 'Z'))
+			theChar += 'a' - 'A';
+		theHash = (theHash ^ (uint8_t)theChar) * 16777619;
+	}
+	return theHash & (kNumHeaderBuckets - 1);
+}
 
-	//chances are this is one of our selected "VIP" headers. so check for this.
-	switch (inHeaderStr[0])
+struct HeaderBuckets
+{
+	HeaderBuckets()
 	{
-	case 'C':   case 'c':   theHeader = qtssCSeqHeader;         break;
-	case 'S':   case 's':   theHeader = qtssSessionHeader;      break;
-	case 'U':   case 'u':   theHeader = qtssUserAgentHeader;    break;
-	case 'A':   case 'a':   theHeader = qtssAcceptHeader;       break;
-	case 'T':   case 't':   theHeader = qtssTransportHeader;    break;
-	case 'R':   case 'r':   theHeader = qtssRangeHeader;        break;
-	case 'X':   case 'x':   theHeader = qtssExtensionHeaders;   break;
+		for (auto &theBucket : fHeaders)
+			theBucket = qtssIllegalHeader;
+
+		for (uint32_t x = 0; x < qtssNumHeaders; x++)
+		{
+			uint32_t theBucket = HashHeaderName(RTSPProtocol::GetHeaderString(x));
+			Assert(fHeaders[theBucket] == qtssIllegalHeader); // pick another seed
+			fHeaders[theBucket] = (uint8_t)x;
+		}
 	}
 
-	//
-	// Check to see whether this is one of our extension headers. These
-	// are very likely to appear in requests.
-	if (theHeader == qtssExtensionHeaders)
-		for (int32_t y = qtssExtensionHeaders; y < qtssNumHeaders; y++)
-			if (boost::iequals(inHeaderStr, sHeaders[y]))
-				return y;
-
-	//
-	// It's not one of our extension headers, check to see if this is one of
-	// our normal VIP headers
-	if (theHeader != qtssIllegalHeader && boost::iequals(inHeaderStr, sHeaders[theHeader]))
-		return theHeader;
+	uint8_t fHeaders[kNumHeaderBuckets];
+};
 
-	//
-	//If this isn't one of our VIP headers, go through the remaining request headers, trying
-	//to find the right one.
-	for (int32_t x = qtssNumVIPHeaders; x < qtssNumHeaders; x++)
-		if (boost::iequals(inHeaderStr, sHeaders[x]))
-			return x;
+QTSS_RTSPHeader RTSPProtocol::GetRequestHeader(boost::string_view inHeaderStr)
+{
+	static const HeaderBuckets sBuckets;
+
+	if (inHeaderStr.empty())
+		return qtssIllegalHeader;
+
+	QTSS_RTSPHeader theHeader = sBuckets.fHeaders[HashHeaderName(inHeaderStr)];
+	if ((theHeader != qtssIllegalHeader) && boost::iequals(inHeaderStr, sHeaders[theHeader]))
+		return theHeader;
 	return qtssIllegalHeader;
 }
 
@@ -0,0 +1,147 @@
+/*
+	File:       RTSPRequestParser.cpp
+
+	Contains:   Implementation of class defined in RTSPRequestParser.h
+*/
+
+#include <string.h>
+#include "RTSPRequestParser.h"
+#include "RTSPProtocol.h"
+
+static bool IsBlank(char inChar)
+{
+	return (inChar == ' ') || (inChar == '\t');
+}
+
+static bool IsAlpha(char inChar)
+{
+	return ((inChar >= 'a') && (inChar <= 'z')) || ((inChar >= 'A') && (inChar <= 'Z'));
+}
+
+static bool IsDigit(char inChar)
+{
+	return (inChar >= '0') && (inChar <= '9');
+}
+
+static bool IsGraph(char inChar)
+{
+	return (inChar > ' ') && (inChar < 0x7F);
+}
+
+static void TrimBlanks(boost::string_view& ioStr)
+{
+	while (!ioStr.empty() && IsBlank(ioStr.front()))
+		ioStr.remove_prefix(1);
+	while (!ioStr.empty() && IsBlank(ioStr.back()))
+		ioStr.remove_suffix(1);
+}
+
+// Splits off the leading run of characters matching inPred
+template <typename Pred>
+static boost::string_view TakeWhile(boost::string_view& ioStr, Pred inPred)
+{
+	size_t theLen = 0;
+	while ((theLen < ioStr.size()) && inPred(ioStr[theLen]))
+		theLen++;
+
+	boost::string_view theToken = ioStr.substr(0, theLen);
+	ioStr.remove_prefix(theLen);
+	return theToken;
+}
+
+void RTSPRequestParser::Clear()
+{
+	fMethod = {};
+	fURI = {};
+	fVersion = {};
+	fNumHeaders = 0;
+	::memset(fHeaderIndex, kNoHeader, sizeof(fHeaderIndex));
+}
+
+bool RTSPRequestParser::Parse(boost::string_view inRequest)
+{
+	this->Clear();
+
+	bool foundRequestLine = false;
+	size_t thePos = 0;
+	while (thePos < inRequest.size())
+	{
+		size_t theEOL = inRequest.find('\n', thePos);
+		if (theEOL == boost::string_view::npos)
+			return false; // the headers have to end with an empty line
+
+		boost::string_view theLine = inRequest.substr(thePos, theEOL - thePos);
+		if (!theLine.empty() && (theLine.back() == '\r'))
+			theLine.remove_suffix(1);
+		thePos = theEOL + 1;
+
+		if (!foundRequestLine)
+		{
+			// Like HTTP, tolerate empty lines ahead of the request line
+			if (theLine.empty())
+				continue;
+			if (!this->ParseRequestLine(theLine))
+				return false;
+			foundRequestLine = true;
+		}
+		else if (theLine.empty())
+			return true;
+		else if (!this->ParseHeaderLine(theLine))
+			return false;
+	}
+
+	return false;
+}
+
+bool RTSPRequestParser::ParseRequestLine(boost::string_view inLine)
+{
+	//for example: DESCRIBE rtsp://www.easydarwin.org:554/live.sdp RTSP/1.0
+	fMethod = TakeWhile(inLine, [](char inChar) { return IsAlpha(inChar) || (inChar == '_'); }); // GET_PARAMETER
+	if (fMethod.empty() || inLine.empty() || !IsBlank(inLine.front()))
+		return false;
+	TakeWhile(inLine, IsBlank);
+
+	fURI = TakeWhile(inLine, IsGraph);
+	if (fURI.empty() || inLine.empty() || !IsBlank(inLine.front()))
+		return false;
+	TakeWhile(inLine, IsBlank);
+
+	static const boost::string_view sRTSPPrefix("RTSP/");
+	if (!inLine.starts_with(sRTSPPrefix))
+		return false;
+
+	boost::string_view theNumber = inLine.substr(sRTSPPrefix.size());
+	boost::string_view theDigits = TakeWhile(theNumber, [](char inChar) { return IsDigit(inChar) || (inChar == '.'); });
+	if (theDigits.empty())
+		return false;
+
+	fVersion = inLine.substr(0, sRTSPPrefix.size() + theDigits.size());
+	TakeWhile(theNumber, IsBlank);
+	return theNumber.empty();
+}
+
+bool RTSPRequestParser::ParseHeaderLine(boost::string_view inLine)
+{
+	boost::string_view theName = TakeWhile(inLine, [](char inChar) { return IsAlpha(inChar) || IsDigit(inChar) || (inChar == '-'); });
+	TakeWhile(inLine, IsBlank);
+	if (theName.empty() || inLine.empty() || (inLine.front() != ':'))
+		return false;
+
+	inLine.remove_prefix(1);
+	TrimBlanks(inLine);
+
+	if (fNumHeaders == kMaxHeaders)
+		return true;
+
+	Header& theHeader = fHeaders[fNumHeaders];
+	theHeader.fName = theName;
+	theHeader.fValue = inLine;
+	theHeader.fID = RTSPProtocol::GetRequestHeader(theName);
+
+	// The first occurrence of a header is the one that counts
+	if ((theHeader.fID < qtssNumHeaders) && (fHeaderIndex[theHeader.fID] == kNoHeader))
+		fHeaderIndex[theHeader.fID] = (uint8_t)fNumHeaders;
+
+	fNumHeaders++;
+	return true;
+}
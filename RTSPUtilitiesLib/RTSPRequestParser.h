@@ -0,0 +1,71 @@
+/*
+	File:       RTSPRequestParser.h
+
+	Contains:   Single pass parser for the request line and headers of an
+				RTSP request.
+
+				Nothing is copied: the method, URI, version and every header
+				name and value are views into the caller's buffer, which must
+				outlive the parser. Headers go into a fixed size table, and the
+				well known ones (see QTSSRTSPProtocol.h) can be looked up by ID
+				in constant time.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <boost/utility/string_view.hpp>
+#include "QTSSRTSPProtocol.h"
+
+class RTSPRequestParser
+{
+public:
+	enum
+	{
+		kMaxHeaders = 32    // any further headers are ignored
+	};
+
+	struct Header
+	{
+		boost::string_view  fName;
+		boost::string_view  fValue;
+		QTSS_RTSPHeader     fID;    // qtssIllegalHeader if it isn't a well known one
+	};
+
+	RTSPRequestParser() { this->Clear(); }
+
+	// Parses the request line and the headers up to the empty line ending
+	// them. Lines may end in CRLF or a bare LF. Returns false if the request
+	// is malformed, in which case what was parsed so far is left in place.
+	bool                Parse(boost::string_view inRequest);
+
+	boost::string_view  GetMethod() const { return fMethod; }
+	boost::string_view  GetURI() const { return fURI; }
+	boost::string_view  GetVersion() const { return fVersion; }
+
+	size_t              GetNumHeaders() const { return fNumHeaders; }
+	const Header&       GetHeader(size_t inIndex) const { return fHeaders[inIndex]; }
+
+	// The value of the first header with this ID, or an empty view
+	boost::string_view  GetHeaderValue(QTSS_RTSPHeader inHeader) const
+	{
+		if ((inHeader >= qtssNumHeaders) || (fHeaderIndex[inHeader] == kNoHeader))
+			return {};
+		return fHeaders[fHeaderIndex[inHeader]].fValue;
+	}
+
+private:
+	enum { kNoHeader = 0xFF };
+
+	void    Clear();
+	bool    ParseRequestLine(boost::string_view inLine);
+	bool    ParseHeaderLine(boost::string_view inLine);
+
+	boost::string_view  fMethod;
+	boost::string_view  fURI;
+	boost::string_view  fVersion;
+
+	Header      fHeaders[kMaxHeaders];
+	size_t      fNumHeaders;
+	uint8_t     fHeaderIndex[qtssNumHeaders];
+};
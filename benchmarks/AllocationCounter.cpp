@@ -0,0 +1,51 @@
+/*
+	File:       AllocationCounter.cpp
+
+	Contains:   Replaces the global operator new and delete of the benchmark
+				binary with ones that count, see AllocationCounter.h.
+*/
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "AllocationCounter.h"
+
+static std::atomic<uint64_t> sNumAllocations{ 0 };
+
+uint64_t AllocationCounter::GetCount()
+{
+	return sNumAllocations.load(std::memory_order_relaxed);
+}
+
+void* operator new(std::size_t inSize)
+{
+	sNumAllocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* thePtr = std::malloc(inSize == 0 ? 1 : inSize))
+		return thePtr;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t inSize)
+{
+	return ::operator new(inSize);
+}
+
+void operator delete(void* inPtr) noexcept
+{
+	std::free(inPtr);
+}
+
+void operator delete[](void* inPtr) noexcept
+{
+	std::free(inPtr);
+}
+
+void operator delete(void* inPtr, std::size_t) noexcept
+{
+	std::free(inPtr);
+}
+
+void operator delete[](void* inPtr, std::size_t) noexcept
+{
+	std::free(inPtr);
+}
@@ -0,0 +1,16 @@
+/*
+	File:       AllocationCounter.h
+
+	Contains:   Counts the heap allocations the benchmark binary makes, so that
+				a benchmark can report how many its loop did.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+namespace AllocationCounter
+{
+	// Number of operator new calls so far, from any thread
+	uint64_t    GetCount();
+}
@@ -0,0 +1,300 @@
+/*
+	File:       ContainerBenchmarks.cpp
+
+	Contains:   Microbenchmarks for the tables and queues the server looks
+				things up in: OSHeap, OSRefTable and SyncUnorderMap.
+
+				The lookup benchmarks also run on several threads, which is
+				where the locking shows. BM_OSRefTable_ResolveUnderChurn has the
+				threads register and unregister sessions while they resolve, and
+				the demuxer lookups run with a thread binding and tearing down
+				streams next to them.
+*/
+
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CowUnorderMap.h"
+#include "OSHeap.h"
+#include "OSRef.h"
+#include "SyncUnorderMap.h"
+
+namespace {
+
+	enum
+	{
+		kNumEntries = 1024,     // power of 2
+		kMaxThreads = 8
+	};
+
+	// A cheap generator, so that the benchmark times the table and not rand()
+	uint64_t NextRandom(uint64_t& ioState)
+	{
+		ioState ^= ioState << 13;
+		ioState ^= ioState >> 7;
+		ioState ^= ioState << 17;
+		return ioState;
+	}
+
+	// Timers going in and coming out in deadline order, as the idle task
+	// thread does with them
+	void BM_OSHeap_InsertExtract(benchmark::State& state)
+	{
+		size_t theNumElems = (size_t)state.range(0);
+		std::vector<OSHeapElem> theElems(theNumElems);
+		uint64_t theRandom = 88172645463325252ULL;
+		for (auto& theElem : theElems)
+			theElem.SetValue((int64_t)(NextRandom(theRandom) >> 1));
+
+		OSHeap theHeap;
+		for (auto _ : state)
+		{
+			for (auto& theElem : theElems)
+				theHeap.Insert(&theElem);
+			while (theHeap.ExtractMin() != nullptr) {}
+		}
+		state.SetItemsProcessed(state.iterations() * theNumElems);
+	}
+	BENCHMARK(BM_OSHeap_InsertExtract)->Arg(64)->Arg(1024)->Arg(16384);
+
+	struct RefTableFixture
+	{
+		RefTableFixture()
+		{
+			for (uint32_t x = 0; x < kNumEntries; x++)
+			{
+				fNames.push_back("live/stream" + std::to_string(x));
+				fRefs.emplace_back(new OSRef(StrPtrLen(&fNames.back()[0], (uint32_t)fNames.back().size()), nullptr));
+			}
+			for (auto& theRef : fRefs)
+				fTable.Register(theRef.get());
+		}
+
+		~RefTableFixture()
+		{
+			for (auto& theRef : fRefs)
+				fTable.UnRegister(theRef.get());
+		}
+
+		std::vector<std::string>            fNames;
+		std::vector<std::unique_ptr<OSRef>> fRefs;
+		OSRefTable                          fTable;
+	};
+
+	// Each DESCRIBE and each reflected session resolves a stream by name
+	void BM_OSRefTable_Resolve(benchmark::State& state)
+	{
+		static RefTableFixture sFixture;
+		std::vector<StrPtrLen> theKeys;
+		for (auto& theName : sFixture.fNames)
+			theKeys.emplace_back(&theName[0], (uint32_t)theName.size());
+
+		uint64_t theRandom = 88172645463325252ULL + state.thread_index();
+		for (auto _ : state)
+		{
+			OSRef* theRef = sFixture.fTable.Resolve(&theKeys[NextRandom(theRandom) & (kNumEntries - 1)]);
+			if (theRef != nullptr)
+				sFixture.fTable.Release(theRef);
+			benchmark::DoNotOptimize(theRef);
+		}
+		state.SetItemsProcessed(state.iterations());
+	}
+	BENCHMARK(BM_OSRefTable_Resolve)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+	// range(0) streams that stay up, and on top of them every thread's
+	// sessions coming and going. Everyone resolves both kinds, so an
+	// UnRegister often has to wait for a Release.
+	struct RefChurnFixture
+	{
+		enum { kChurnPerThread = 64 };
+
+		explicit RefChurnFixture(uint32_t inNumEntries)
+			: fRegistered(kMaxThreads * kChurnPerThread, 0)
+		{
+			uint32_t theNumNames = inNumEntries + kMaxThreads * kChurnPerThread;
+			fNames.reserve(theNumNames);
+			for (uint32_t x = 0; x < theNumNames; x++)
+			{
+				fNames.push_back(x < inNumEntries ? "live/stream" + std::to_string(x) : "session/" + std::to_string(x));
+				fKeys.emplace_back(&fNames.back()[0], (uint32_t)fNames.back().size());
+				fRefs.emplace_back(new OSRef(fKeys.back(), nullptr));
+			}
+			for (uint32_t x = 0; x < inNumEntries; x++)
+				fTable.Register(fRefs[x].get());
+			fNumEntries = inNumEntries;
+		}
+
+		~RefChurnFixture()
+		{
+			for (uint32_t x = 0; x < fNumEntries; x++)
+				fTable.UnRegister(fRefs[x].get());
+			for (size_t x = 0; x < fRegistered.size(); x++)
+				if (fRegistered[x])
+					fTable.UnRegister(fRefs[fNumEntries + x].get());
+		}
+
+		std::vector<std::string>            fNames;
+		std::vector<StrPtrLen>              fKeys;
+		std::vector<std::unique_ptr<OSRef>> fRefs;
+		std::vector<char>                   fRegistered;    // each thread only touches its own
+		uint32_t                            fNumEntries{ 0 };
+		OSRefTable                          fTable;
+	};
+
+	std::unique_ptr<RefChurnFixture> sRefChurnFixture;
+
+	void SetUpRefChurn(const benchmark::State& state)
+	{
+		sRefChurnFixture.reset(new RefChurnFixture((uint32_t)state.range(0)));
+	}
+
+	void TearDownRefChurn(const benchmark::State&)
+	{
+		sRefChurnFixture.reset();
+	}
+
+	// One operation in eight registers or unregisters one of this thread's
+	// sessions, the rest resolve and release a random stream or session
+	void BM_OSRefTable_ResolveUnderChurn(benchmark::State& state)
+	{
+		RefChurnFixture& theFixture = *sRefChurnFixture;
+		uint32_t theNumNames = (uint32_t)theFixture.fKeys.size();
+		uint32_t theFirstOwn = (uint32_t)state.thread_index() * RefChurnFixture::kChurnPerThread;
+		uint64_t theRandom = 88172645463325252ULL + state.thread_index();
+		uint64_t theNumChurned = 0, theNumResolved = 0;
+		for (auto _ : state)
+		{
+			uint64_t theNext = NextRandom(theRandom);
+			if ((theNext & 7) == 0)
+			{
+				uint32_t theOwn = theFirstOwn + (uint32_t)((theNext >> 3) % RefChurnFixture::kChurnPerThread);
+				OSRef* theRef = theFixture.fRefs[theFixture.fNumEntries + theOwn].get();
+				if (theFixture.fRegistered[theOwn])
+					theFixture.fTable.UnRegister(theRef);
+				else
+					theFixture.fTable.Register(theRef);
+				theFixture.fRegistered[theOwn] ^= 1;
+				theNumChurned++;
+				continue;
+			}
+
+			OSRef* theRef = theFixture.fTable.Resolve(&theFixture.fKeys[(theNext >> 3) % theNumNames]);
+			if (theRef != nullptr)
+			{
+				theFixture.fTable.Release(theRef);
+				theNumResolved++;
+			}
+		}
+		state.SetItemsProcessed(state.iterations());
+		state.counters["churn_per_s"] = benchmark::Counter((double)theNumChurned, benchmark::Counter::kIsRate);
+		state.counters["hit_ratio"] = benchmark::Counter((double)theNumResolved / (double)(state.iterations() - theNumChurned + 1), benchmark::Counter::kAvgThreads);
+	}
+	BENCHMARK(BM_OSRefTable_ResolveUnderChurn)->Setup(SetUpRefChurn)->Teardown(TearDownRefChurn)
+		->Arg(1000)->Arg(10000)->Arg(100000)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+	struct UnorderMapFixture
+	{
+		UnorderMapFixture()
+		{
+			for (uint32_t x = 0; x < kNumEntries; x++)
+				fMap.RegisterTask({ 0x7F000001, (uint16_t)(6970 + x * 2) }, x + 1);
+		}
+
+		SyncUnorderMap<uint32_t>    fMap;
+	};
+
+	// The UDP socket pool finds the socket of an address and port here
+	void BM_SyncUnorderMap_GetTask(benchmark::State& state)
+	{
+		static UnorderMapFixture sFixture;
+		uint64_t theRandom = 88172645463325252ULL + state.thread_index();
+		for (auto _ : state)
+		{
+			uint16_t thePort = (uint16_t)(6970 + (NextRandom(theRandom) & (kNumEntries - 1)) * 2);
+			benchmark::DoNotOptimize(sFixture.fMap.GetTask({ 0x7F000001, thePort }));
+		}
+		state.SetItemsProcessed(state.iterations());
+	}
+	BENCHMARK(BM_SyncUnorderMap_GetTask)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+	// The reflector sockets find the sender of each packet here, while
+	// streams get bound and torn down on other threads
+	template <typename Map>
+	struct DemuxChurnFixture
+	{
+		explicit DemuxChurnFixture(int64_t inPauseUsec)
+		{
+			for (uint32_t x = 0; x < kNumEntries; x++)
+				fMap.RegisterTask({ 0x7F000001, (uint16_t)(6970 + x * 2) }, x + 1);
+
+			fWriter = std::thread([this, inPauseUsec]() {
+				for (uint32_t theWrite = 0; !fDone.load(); theWrite++)
+				{
+					indexKey theKey = { 0x7F000002, (uint16_t)(6970 + (theWrite % 64) * 2) };
+					if ((theWrite / 64) % 2 == 0)
+						fMap.RegisterTask(theKey, theWrite + 1);
+					else
+						fMap.UnregisterTask(theKey);
+					fNumWrites++;
+					if (inPauseUsec > 0)
+						std::this_thread::sleep_for(std::chrono::microseconds(inPauseUsec));
+				}
+			});
+		}
+
+		~DemuxChurnFixture()
+		{
+			fDone = true;
+			fWriter.join();
+		}
+
+		Map                     fMap;
+		std::thread             fWriter;
+		std::atomic<bool>       fDone{ false };
+		std::atomic<uint64_t>   fNumWrites{ 0 };
+	};
+
+	template <typename Map>
+	std::unique_ptr<DemuxChurnFixture<Map>> sDemuxChurnFixture;
+
+	template <typename Map>
+	void SetUpDemuxChurn(const benchmark::State& state)
+	{
+		sDemuxChurnFixture<Map>.reset(new DemuxChurnFixture<Map>(state.range(0)));
+	}
+
+	template <typename Map>
+	void TearDownDemuxChurn(const benchmark::State&)
+	{
+		sDemuxChurnFixture<Map>.reset();
+	}
+
+	// range(0) is the writer's pause between writes in microseconds, 0 for
+	// writing flat out
+	template <typename Map>
+	void BM_Demux_GetTaskUnderChurn(benchmark::State& state)
+	{
+		DemuxChurnFixture<Map>& theFixture = *sDemuxChurnFixture<Map>;
+		uint64_t theRandom = 88172645463325252ULL + state.thread_index();
+		uint64_t theFirstWrite = theFixture.fNumWrites.load();
+		for (auto _ : state)
+		{
+			uint16_t thePort = (uint16_t)(6970 + (NextRandom(theRandom) & (kNumEntries - 1)) * 2);
+			benchmark::DoNotOptimize(theFixture.fMap.GetTask({ 0x7F000001, thePort }));
+		}
+		state.SetItemsProcessed(state.iterations());
+		state.counters["writes_per_s"] = benchmark::Counter((double)(theFixture.fNumWrites.load() - theFirstWrite),
+			benchmark::Counter::kIsRate | benchmark::Counter::kAvgThreads);
+	}
+	BENCHMARK_TEMPLATE(BM_Demux_GetTaskUnderChurn, SyncUnorderMap<uint32_t>)
+		->Setup(SetUpDemuxChurn<SyncUnorderMap<uint32_t>>)->Teardown(TearDownDemuxChurn<SyncUnorderMap<uint32_t>>)
+		->Arg(0)->Arg(100)->ThreadRange(1, kMaxThreads)->UseRealTime();
+	BENCHMARK_TEMPLATE(BM_Demux_GetTaskUnderChurn, CowUnorderMap<uint32_t>)
+		->Setup(SetUpDemuxChurn<CowUnorderMap<uint32_t>>)->Teardown(TearDownDemuxChurn<CowUnorderMap<uint32_t>>)
+		->Arg(0)->Arg(100)->ThreadRange(1, kMaxThreads)->UseRealTime();
+}
@@ -0,0 +1,311 @@
+/*
+	File:       InterleavedBenchmarks.cpp
+
+	Contains:   Interleaved RTP over a loopback TCP connection, written the way
+				RTSPSessionInterface::InterleavedWriteV writes it: the packets
+				due in a run of the sender, laid out by an
+				RTSPInterleavedCoalescer, as few writev calls as its budget
+				allows. What the socket doesn't take is buffered and goes out
+				ahead of the next batch, as RTSPResponseStream does, and the
+				budget backs off.
+
+				RTSPSessionInterface itself lives in the RTSP server, which the
+				benchmarks don't link, so its writes are played here on a plain
+				socket. The sender runs every 10 ms, and a viewer reads as
+				fast as it can.
+
+				Each bit rate runs once with the coalescer, and once with a
+				writev per packet as InterleavedWrite did. Reports writev calls
+				per packet, and the latency from the start of the run that
+				wrote a packet to the viewer having all of it.
+*/
+
+#include <benchmark/benchmark.h>
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "RTSPInterleavedCoalescer.h"
+
+namespace {
+
+	enum
+	{
+		kPacketLen = 1200,
+		kRTPHeaderLen = 12,         // the send time goes right after it
+		kRunMilSecs = 10,
+		kNumRuns = 300
+	};
+
+	int64_t Nanoseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// A connected loopback pair: the server's end writes, the viewer's reads
+	struct LoopbackConnection
+	{
+		LoopbackConnection()
+		{
+			int theListener = ::socket(AF_INET, SOCK_STREAM, 0);
+			struct sockaddr_in theAddr = {};
+			theAddr.sin_family = AF_INET;
+			theAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			socklen_t theAddrLen = sizeof(theAddr);
+			(void)::bind(theListener, (sockaddr*)&theAddr, sizeof(theAddr));
+			(void)::listen(theListener, 1);
+			(void)::getsockname(theListener, (sockaddr*)&theAddr, &theAddrLen);
+
+			fViewer = ::socket(AF_INET, SOCK_STREAM, 0);
+			(void)::connect(fViewer, (sockaddr*)&theAddr, sizeof(theAddr));
+			fServer = ::accept(theListener, nullptr, nullptr);
+			::close(theListener);
+
+			int theOne = 1;
+			(void)::setsockopt(fServer, IPPROTO_TCP, TCP_NODELAY, &theOne, sizeof(theOne));
+			(void)::fcntl(fServer, F_SETFL, ::fcntl(fServer, F_GETFL, 0) | O_NONBLOCK);
+		}
+		~LoopbackConnection()
+		{
+			::close(fServer);
+			::close(fViewer);
+		}
+
+		int fServer{ -1 };
+		int fViewer{ -1 };
+	};
+
+	// Reads '$' frames off the viewer's end until it closes, and logs when
+	// each packet got there against when it was sent
+	void ReadFrames(int inFileDesc, std::vector<int64_t>* outLatencies)
+	{
+		std::vector<char> theBuffer;
+		char theChunk[65536];
+		while (true)
+		{
+			ssize_t theLen = ::recv(inFileDesc, theChunk, sizeof(theChunk), 0);
+			if (theLen <= 0)
+				return;
+			int64_t theNow = Nanoseconds();
+			theBuffer.insert(theBuffer.end(), theChunk, theChunk + theLen);
+
+			size_t theOffset = 0;
+			while (theBuffer.size() - theOffset >= RTSPInterleavedCoalescer::kHeaderSize)
+			{
+				const uint8_t* theHeader = (const uint8_t*)&theBuffer[theOffset];
+				size_t theFrameLen = ((size_t)theHeader[2] << 8) | theHeader[3];
+				if (theBuffer.size() - theOffset < RTSPInterleavedCoalescer::kHeaderSize + theFrameLen)
+					break;
+
+				int64_t theSentAt = 0;
+				std::memcpy(&theSentAt, &theBuffer[theOffset + RTSPInterleavedCoalescer::kHeaderSize + kRTPHeaderLen], sizeof(theSentAt));
+				outLatencies->push_back(theNow - theSentAt);
+				theOffset += RTSPInterleavedCoalescer::kHeaderSize + theFrameLen;
+			}
+			theBuffer.erase(theBuffer.begin(), theBuffer.begin() + theOffset);
+		}
+	}
+
+	// The server's end of the connection, with what the socket didn't take
+	// buffered the way RTSPResponseStream buffers it
+	class InterleavedWriter
+	{
+	public:
+		InterleavedWriter(int inFileDesc, bool inCoalesce) : fFileDesc(inFileDesc), fCoalesce(inCoalesce) {}
+
+		// As InterleavedWriteV, but waits out a full socket instead of
+		// leaving the rest for the sender's next run
+		void Write(const std::vector<char>* const* inPackets, uint32_t inNumPackets)
+		{
+			uint32_t theNumWritten = 0;
+			while (theNumWritten < inNumPackets)
+			{
+				uint32_t theTotalLength = 0;
+				uint32_t theBatchSize = fCoalescer.PrepareBatch(inPackets + theNumWritten,
+					fCoalesce ? inNumPackets - theNumWritten : 1, 1, &theTotalLength);
+
+				iovec* theVec = fCoalescer.GetVec();
+				uint32_t theNumVecs = fCoalescer.GetNumVecs();
+				size_t theBufferedLen = fBuffered.size() - fBufferedSent;
+				if (theBufferedLen > 0)
+				{
+					theVec[0].iov_base = &fBuffered[fBufferedSent];
+					theVec[0].iov_len = theBufferedLen;
+				}
+				else
+				{
+					theVec++;
+					theNumVecs--;
+				}
+
+				fNumWriteCalls++;
+				ssize_t theLenSent = ::writev(fFileDesc, theVec, (int)theNumVecs);
+				if (theLenSent < 0)
+				{
+					if (errno != EAGAIN)
+						return;
+					fCoalescer.WriteDone(false);
+					this->WaitUntilWritable();
+					continue;
+				}
+
+				// What went out of the buffered bytes first, then of the batch
+				size_t theFromBuffered = std::min<size_t>((size_t)theLenSent, theBufferedLen);
+				fBufferedSent += theFromBuffered;
+				if (fBufferedSent == fBuffered.size())
+				{
+					fBuffered.clear();
+					fBufferedSent = 0;
+				}
+				size_t theBatchSent = (size_t)theLenSent - theFromBuffered;
+
+				// All or nothing: the rest of the batch is buffered, and the
+				// socket is full
+				if (theBatchSent < theTotalLength)
+				{
+					this->Buffer(theVec + ((theBufferedLen > 0) ? 1 : 0), theBatchSize * 2, theBatchSent);
+					fCoalescer.WriteDone(false);
+				}
+				else
+					fCoalescer.WriteDone(true);
+				theNumWritten += theBatchSize;
+			}
+
+			while (fBuffered.size() > fBufferedSent)
+				this->Flush();
+		}
+
+		uint64_t GetNumWriteCalls() const { return fNumWriteCalls; }
+
+	private:
+		void Buffer(const iovec* inVec, uint32_t inNumVecs, size_t inSkip)
+		{
+			for (uint32_t x = 0; x < inNumVecs; x++)
+			{
+				const char* theBase = (const char*)inVec[x].iov_base;
+				size_t theLen = inVec[x].iov_len;
+				size_t theSkip = std::min(inSkip, theLen);
+				fBuffered.insert(fBuffered.end(), theBase + theSkip, theBase + theLen);
+				inSkip -= theSkip;
+			}
+		}
+
+		void Flush()
+		{
+			fNumWriteCalls++;
+			ssize_t theLenSent = ::send(fFileDesc, &fBuffered[fBufferedSent], fBuffered.size() - fBufferedSent, 0);
+			if (theLenSent < 0)
+			{
+				if (errno != EAGAIN)
+					fBufferedSent = fBuffered.size();
+				this->WaitUntilWritable();
+				return;
+			}
+			fBufferedSent += (size_t)theLenSent;
+			if (fBufferedSent == fBuffered.size())
+			{
+				fBuffered.clear();
+				fBufferedSent = 0;
+			}
+		}
+
+		void WaitUntilWritable()
+		{
+			struct pollfd thePoll = { fFileDesc, POLLOUT, 0 };
+			(void)::poll(&thePoll, 1, 100);
+		}
+
+		int                         fFileDesc;
+		bool                        fCoalesce;
+		RTSPInterleavedCoalescer    fCoalescer;
+		std::vector<char>           fBuffered;
+		size_t                      fBufferedSent{ 0 };
+		uint64_t                    fNumWriteCalls{ 0 };
+	};
+
+	void BM_Interleaved_WriteV(benchmark::State& state)
+	{
+		uint32_t theKbps = (uint32_t)state.range(0);
+		bool isCoalescing = state.range(1) != 0;
+		uint64_t theBytesPerRun = (uint64_t)theKbps * 1000 / 8 * kRunMilSecs / 1000;
+
+		std::vector<std::vector<char>> thePackets;
+		std::vector<const std::vector<char>*> thePacketPtrs;
+		uint64_t theNumPackets = 0;
+		uint64_t theNumWriteCalls = 0;
+		std::vector<int64_t> theLatencies;
+
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			std::unique_ptr<LoopbackConnection> theConnection(new LoopbackConnection());
+			std::vector<int64_t> theRunLatencies;
+			std::thread theViewer(ReadFrames, theConnection->fViewer, &theRunLatencies);
+			InterleavedWriter theWriter(theConnection->fServer, isCoalescing);
+			state.ResumeTiming();
+
+			uint64_t theBytesOwed = 0;
+			int64_t theNextRun = Nanoseconds();
+			for (uint32_t theRun = 0; theRun < kNumRuns; theRun++)
+			{
+				while (Nanoseconds() < theNextRun)
+					std::this_thread::sleep_for(std::chrono::microseconds(100));
+				theNextRun += kRunMilSecs * 1000000LL;
+
+				// The packets that came in since the last run, each stamped
+				// with when this run started
+				int64_t theRunStart = Nanoseconds();
+				thePackets.clear();
+				for (theBytesOwed += theBytesPerRun; theBytesOwed >= kPacketLen; theBytesOwed -= kPacketLen)
+				{
+					thePackets.emplace_back(kPacketLen, (char)0xAB);
+					std::memcpy(&thePackets.back()[kRTPHeaderLen], &theRunStart, sizeof(theRunStart));
+				}
+				thePacketPtrs.clear();
+				for (auto& thePacket : thePackets)
+					thePacketPtrs.push_back(&thePacket);
+
+				theWriter.Write(thePacketPtrs.data(), (uint32_t)thePacketPtrs.size());
+				theNumPackets += thePackets.size();
+			}
+
+			state.PauseTiming();
+			::shutdown(theConnection->fServer, SHUT_WR);
+			theViewer.join();
+			theNumWriteCalls += theWriter.GetNumWriteCalls();
+			theLatencies.insert(theLatencies.end(), theRunLatencies.begin(), theRunLatencies.end());
+			state.ResumeTiming();
+		}
+
+		std::sort(theLatencies.begin(), theLatencies.end());
+		state.SetItemsProcessed(theNumPackets);
+		state.counters["writev_per_packet"] = benchmark::Counter(theNumPackets ? (double)theNumWriteCalls / theNumPackets : 0.0);
+		if (!theLatencies.empty())
+		{
+			state.counters["p50_us"] = benchmark::Counter(theLatencies[theLatencies.size() / 2] / 1000.0);
+			state.counters["p99_us"] = benchmark::Counter(theLatencies[theLatencies.size() * 99 / 100] / 1000.0);
+		}
+		state.counters["lost_packets"] = benchmark::Counter((double)(theNumPackets - theLatencies.size()));
+	}
+	// 500 kbit/s, 4 Mbit/s and 20 Mbit/s viewers, a writev per packet and coalesced
+	BENCHMARK(BM_Interleaved_WriteV)->ArgNames({ "kbps", "coalesce" })
+		->Args({ 500, 0 })->Args({ 500, 1 })->Args({ 4000, 0 })->Args({ 4000, 1 })->Args({ 20000, 0 })->Args({ 20000, 1 })
+		->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+}
+
+#endif
@@ -0,0 +1,81 @@
+/*
+	File:       RTCPBenchmarks.cpp
+
+	Contains:   Microbenchmarks for RTCP parsing, which runs for every report
+				a viewer or a pusher sends.
+*/
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <vector>
+#include "RTCPPacket.h"
+
+namespace {
+
+	void AppendWord(std::vector<uint8_t>& ioPacket, uint32_t inWord)
+	{
+		inWord = htonl(inWord);
+		const uint8_t* theBytes = reinterpret_cast<const uint8_t*>(&inWord);
+		ioPacket.insert(ioPacket.end(), theBytes, theBytes + 4);
+	}
+
+	// A compound packet as a player sends it: a receiver report with two
+	// report blocks, then an SDES with a CNAME
+	std::vector<uint8_t> MakeCompoundPacket()
+	{
+		std::vector<uint8_t> thePacket;
+		AppendWord(thePacket, (2u << 30) | (2u << 24) | (201u << 16) | 13);
+		AppendWord(thePacket, 0x11223344);
+		for (uint32_t x = 0; x < 2; x++)
+		{
+			AppendWord(thePacket, 0x55667788 + x);  // source
+			AppendWord(thePacket, (3u << 24) | 12); // fraction lost, cumulative lost
+			AppendWord(thePacket, 0x00012345);      // highest sequence
+			AppendWord(thePacket, 40);              // jitter
+			AppendWord(thePacket, 0x12345678);      // last SR
+			AppendWord(thePacket, 0x00000400);      // delay since last SR
+		}
+
+		// header, SSRC, the CNAME item and its terminating null, padded to a word
+		const char theCName[] = "rtspload@127.0.0.1";
+		size_t theSDESStart = thePacket.size();
+		size_t theSDESLen = (8 + 2 + (sizeof(theCName) - 1) + 1 + 3) & ~(size_t)3;
+		AppendWord(thePacket, (2u << 30) | (1u << 24) | (202u << 16) | (uint32_t)(theSDESLen / 4 - 1));
+		AppendWord(thePacket, 0x11223344);
+		thePacket.push_back(1);
+		thePacket.push_back((uint8_t)(sizeof(theCName) - 1));
+		thePacket.insert(thePacket.end(), theCName, theCName + sizeof(theCName) - 1);
+		thePacket.resize(theSDESStart + theSDESLen, 0);
+		return thePacket;
+	}
+
+	// Walks the compound packet the way RTPStream does
+	void BM_RTCPPacket_ParsePacket(benchmark::State& state)
+	{
+		std::vector<uint8_t> thePacket = MakeCompoundPacket();
+		for (auto _ : state)
+		{
+			uint8_t* theData = thePacket.data();
+			uint32_t theLen = (uint32_t)thePacket.size();
+			uint32_t theNumParsed = 0;
+			while (theLen > 0)
+			{
+				RTCPPacket theHeader;
+				if (!theHeader.ParsePacket(theData, theLen))
+					break;
+				uint32_t thePacketLen = (theHeader.GetPacketLength() + 1) * 4;
+				if (theHeader.GetPacketType() == RTCPPacket::kReceiverPacketType)
+				{
+					RTCPReceiverPacket theReport;
+					if (theReport.ParseReport(theData, thePacketLen))
+						benchmark::DoNotOptimize(theReport.GetCumulativeFractionLostPackets());
+				}
+				theNumParsed++;
+				theData += thePacketLen;
+				theLen -= std::min(theLen, thePacketLen);
+			}
+			benchmark::DoNotOptimize(theNumParsed);
+		}
+	}
+	BENCHMARK(BM_RTCPPacket_ParsePacket);
+}
@@ -0,0 +1,74 @@
+/*
+	File:       RTSPParserBenchmarks.cpp
+
+	Contains:   Parsing the request corpus (real OPTIONS, DESCRIBE, SETUP,
+				PLAY and friends) with RTSPRequestParser, against the Spirit
+				grammar RTSPRequest::Parse used to build for every request.
+				Reports requests per second and allocations per request.
+*/
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <cstring>
+#include "AllocationCounter.h"
+#include "LegacyRTSPRequestGrammar.h"
+#include "RTSPRequestCorpus.h"
+#include "RTSPRequestParser.h"
+
+namespace {
+
+	const size_t kNumRequests = sizeof(RTSPRequestCorpus::kRequests) / sizeof(RTSPRequestCorpus::kRequests[0]);
+
+	size_t CorpusBytes()
+	{
+		size_t theBytes = 0;
+		for (const char* theRequest : RTSPRequestCorpus::kRequests)
+			theBytes += ::strlen(theRequest);
+		return theBytes;
+	}
+
+	void BM_RTSPRequestParser_Parse(benchmark::State& state)
+	{
+		boost::string_view theRequests[kNumRequests];
+		for (size_t x = 0; x < kNumRequests; x++)
+			theRequests[x] = RTSPRequestCorpus::kRequests[x];
+
+		uint64_t theAllocations = AllocationCounter::GetCount();
+		for (auto _ : state)
+		{
+			for (const auto& theRequest : theRequests)
+			{
+				RTSPRequestParser theParser;
+				benchmark::DoNotOptimize(theParser.Parse(theRequest));
+				benchmark::DoNotOptimize(theParser.GetHeaderValue(qtssCSeqHeader).data());
+			}
+		}
+		theAllocations = AllocationCounter::GetCount() - theAllocations;
+
+		state.SetItemsProcessed(state.iterations() * kNumRequests);
+		state.SetBytesProcessed(state.iterations() * CorpusBytes());
+		state.counters["allocs_per_request"] = benchmark::Counter((double)theAllocations / (state.iterations() * kNumRequests));
+	}
+	BENCHMARK(BM_RTSPRequestParser_Parse);
+
+	// GET_PARAMETER fails early here, which only flatters the grammar
+	void BM_LegacyRTSPGrammar_Parse(benchmark::State& state)
+	{
+		uint64_t theAllocations = AllocationCounter::GetCount();
+		for (auto _ : state)
+		{
+			for (const char* theRequest : RTSPRequestCorpus::kRequests)
+			{
+				LegacyRTSPRequestGrammar::RTSPRequestHeader theHeader;
+				benchmark::DoNotOptimize(LegacyRTSPRequestGrammar::Parse(theRequest, &theHeader));
+				benchmark::DoNotOptimize(theHeader.header_fields.size());
+			}
+		}
+		theAllocations = AllocationCounter::GetCount() - theAllocations;
+
+		state.SetItemsProcessed(state.iterations() * kNumRequests);
+		state.SetBytesProcessed(state.iterations() * CorpusBytes());
+		state.counters["allocs_per_request"] = benchmark::Counter((double)theAllocations / (state.iterations() * kNumRequests));
+	}
+	BENCHMARK(BM_LegacyRTSPGrammar_Parse);
+}
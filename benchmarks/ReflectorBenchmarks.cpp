@@ -0,0 +1,276 @@
+/*
+	File:       ReflectorBenchmarks.cpp
+
+	Contains:   Microbenchmarks for the per packet work of the reflector.
+*/
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "AllocationCounter.h"
+#include "MyReflectorPacket.h"
+#include "ReflectorBucketSchedule.h"
+#include "ReflectorPacketRing.h"
+#include "ReflectorReorderBuffer.h"
+#include "RTPLossInjector.h"
+
+namespace {
+
+	std::unique_ptr<MyReflectorPacket> MakeH264Packet(std::vector<uint8_t> inPayload, size_t inLen)
+	{
+		std::vector<char> thePacket(12, 0);
+		thePacket[0] = (char)0x80;
+		thePacket[1] = 96;
+		thePacket.insert(thePacket.end(), inPayload.begin(), inPayload.end());
+		thePacket.resize(inLen, (char)0xAB);
+		return std::unique_ptr<MyReflectorPacket>(new MyReflectorPacket(thePacket.data(), thePacket.size()));
+	}
+
+	// Every packet a pusher sends is checked, most of them are not key frames
+	void BM_IsKeyFrameFirstPacket(benchmark::State& state)
+	{
+		std::vector<std::unique_ptr<MyReflectorPacket>> thePackets;
+		thePackets.push_back(MakeH264Packet({ 0x67, 0x64, 0x00, 0x1F }, 40));                 // SPS
+		thePackets.push_back(MakeH264Packet({ 0x18, 0x00, 0x0A, 0x67, 0x64 }, 60));           // STAP-A with SPS
+		thePackets.push_back(MakeH264Packet({ 0x7C, 0x85 }, 1400));                          // FU-A IDR start
+		thePackets.push_back(MakeH264Packet({ 0x7C, 0x05 }, 1400));                          // FU-A IDR middle
+		for (int x = 0; x < 12; x++)
+			thePackets.push_back(MakeH264Packet({ 0x5C, (uint8_t)(x == 0 ? 0x81 : 0x01) }, 1400)); // FU-A P frame
+
+		for (auto _ : state)
+		{
+			uint32_t theNumKeyFrames = 0;
+			for (const auto& thePacket : thePackets)
+				theNumKeyFrames += IsKeyFrameFirstPacket(*thePacket);
+			benchmark::DoNotOptimize(theNumKeyFrames);
+		}
+		state.SetItemsProcessed(state.iterations() * thePackets.size());
+	}
+	BENCHMARK(BM_IsKeyFrameFirstPacket);
+
+	// One packet in, then every output takes it out of the ring, as
+	// ReflectorSender::ReflectPackets does. allocs_per_packet should be 0 once
+	// the ring is warm, whatever the number of outputs.
+	void BM_PacketRing_FanOut(benchmark::State& state)
+	{
+		enum { kRingCapacity = 8192, kPacketLen = 1400 };
+		size_t theNumOutputs = (size_t)state.range(0);
+		std::vector<char> thePayload(kPacketLen, (char)0xAB);
+
+		ReflectorPacketRing theRing(kRingCapacity);
+		auto thePublish = [&]() {
+			MyReflectorPacket* thePacket = theRing.Reserve();
+			thePacket->SetPacketData(thePayload.data(), thePayload.size());
+			return theRing.Publish(thePacket);
+		};
+
+		// Warm up past a full wrap, so every slot has been carved out already
+		for (size_t x = 0; x < 2 * kRingCapacity; x++)
+			thePublish();
+
+		uint64_t theNumAllocations = AllocationCounter::GetCount();
+		for (auto _ : state)
+		{
+			uint64_t theSeq = thePublish();
+			for (size_t x = 0; x < theNumOutputs; x++)
+			{
+				MyReflectorPacket* thePacket = theRing.Acquire(theSeq);
+				benchmark::DoNotOptimize(thePacket);
+				theRing.Release(thePacket);
+			}
+			theRing.SetLowWaterSeq(theSeq + 1);
+		}
+		theNumAllocations = AllocationCounter::GetCount() - theNumAllocations;
+
+		state.SetItemsProcessed(state.iterations() * theNumOutputs);
+		state.counters["allocs_per_packet"] = benchmark::Counter((double)theNumAllocations / state.iterations());
+	}
+	BENCHMARK(BM_PacketRing_FanOut)->Arg(1)->Arg(100)->Arg(1000);
+
+	// Fan-out scheduled the way ReflectorSender::ReflectPackets does it, in
+	// simulated time: a 25 fps stream whose frames come in as one burst of
+	// packets, sent to range(0) outputs in buckets of 16 that are range(1) ms
+	// apart. An iteration is a second of stream, and what it costs is the
+	// fan-out. Over all the milliseconds simulated:
+	//   ms_idle, ms_1_16, ...    the fraction that sent that many packets
+	//   peak/p99_pkts_per_ms     the biggest send bursts
+	//   peak_queued_kB           the most the outputs' socket buffers held
+	//                            together, draining at 10 Gbit/s between them
+	void BM_ReflectorFanOut_Bursts(benchmark::State& state)
+	{
+		enum
+		{
+			kBucketSize = 16,               // ReflectorStream::sBucketSize
+			kFrameMilSecs = 40,
+			kFramesPerGOP = 50,
+			kPacketsPerFrame = 8,
+			kPacketsPerKeyFrame = 24,
+			kPacketLen = 1200,
+			kLinkBytesPerMilSec = 1250000,
+			kRingCapacity = 8192
+		};
+		using Clock = ReflectorBucketSchedule::Clock;
+
+		size_t theNumOutputs = (size_t)state.range(0);
+		std::chrono::milliseconds theBucketDelay(state.range(1));
+		std::vector<char> thePayload(kPacketLen, (char)0xAB);
+
+		ReflectorPacketRing theRing(kRingCapacity);
+		std::vector<Clock::time_point> theArrivals(kRingCapacity);     // by seq, as the ring keeps them
+		auto theGetArrival = [&](uint64_t inSeq, Clock::time_point* outArrived) {
+			*outArrived = theArrivals[inSeq & (kRingCapacity - 1)];
+			return true;
+		};
+
+		std::vector<uint64_t> theBookmarks(theNumOutputs, 0);
+		Clock::time_point theNextBucketTime = Clock::time_point::max();
+		uint64_t theMilSec = 0;
+		uint64_t theQueuedBytes = 0;
+		uint64_t thePeakQueuedBytes = 0;
+		uint64_t theNumSent = 0;
+		std::vector<uint32_t> theSentPerMilSec;
+
+		auto theRunMilSec = [&]() {
+			Clock::time_point theNow(std::chrono::milliseconds(++theMilSec));
+			bool hasNewPackets = (theMilSec % kFrameMilSecs) == 0;
+			if (hasNewPackets)
+			{
+				bool isKeyFrame = (theMilSec / kFrameMilSecs) % kFramesPerGOP == 0;
+				for (uint32_t x = 0; x < (isKeyFrame ? kPacketsPerKeyFrame : kPacketsPerFrame); x++)
+				{
+					MyReflectorPacket* thePacket = theRing.Reserve();
+					thePacket->SetPacketData(thePayload.data(), thePayload.size());
+					theArrivals[theRing.Publish(thePacket) & (kRingCapacity - 1)] = theNow;
+				}
+			}
+
+			uint32_t theSent = 0;
+			if (hasNewPackets || theNow >= theNextBucketTime)
+			{
+				ReflectorBucketSchedule theSchedule(theNow, kBucketSize, theBucketDelay);
+				uint64_t theHead = theRing.Head();
+				uint64_t theTail = theRing.Tail();
+				uint64_t theOldestBookmark = theHead;
+				uint32_t theBucket = 0;
+				uint64_t theBucketHead = theHead;
+				theNextBucketTime = Clock::time_point::max();
+
+				for (size_t theIndex = 0; theIndex < theNumOutputs; theIndex++)
+				{
+					if (theSchedule.GetBucket(theIndex) != theBucket)
+					{
+						theBucket = theSchedule.GetBucket(theIndex);
+						theBucketHead = ReflectorBucketSchedule::FindFirstArrivedAfter(theSchedule.GetCutoff(theBucket), theTail, theBucketHead, theGetArrival);
+						if (theBucketHead < theHead)
+							theNextBucketTime = std::min(theNextBucketTime,
+								theSchedule.GetDueTime(theArrivals[theBucketHead & (kRingCapacity - 1)], theBucket));
+					}
+
+					uint64_t& theSeq = theBookmarks[theIndex];
+					for (; theSeq < theBucketHead; theSeq++, theSent++)
+					{
+						MyReflectorPacket* thePacket = theRing.Acquire(theSeq);
+						benchmark::DoNotOptimize(thePacket);
+						if (thePacket != nullptr)
+							theRing.Release(thePacket);
+					}
+					theOldestBookmark = std::min(theOldestBookmark, theSeq);
+				}
+				theRing.SetLowWaterSeq(theOldestBookmark);
+			}
+
+			theQueuedBytes += (uint64_t)theSent * kPacketLen;
+			thePeakQueuedBytes = std::max(thePeakQueuedBytes, theQueuedBytes);
+			theQueuedBytes -= std::min<uint64_t>(theQueuedBytes, kLinkBytesPerMilSec);
+			return theSent;
+		};
+
+		// Until the last bucket gets packets as well
+		uint64_t theWarmUpMilSecs = ((theNumOutputs - 1) / kBucketSize) * theBucketDelay.count() + 2 * kFrameMilSecs * kFramesPerGOP;
+		while (theMilSec < theWarmUpMilSecs)
+			theRunMilSec();
+		thePeakQueuedBytes = 0;
+
+		for (auto _ : state)
+		{
+			for (uint32_t x = 0; x < 1000; x++)
+			{
+				uint32_t theSent = theRunMilSec();
+				theSentPerMilSec.push_back(theSent);
+				theNumSent += theSent;
+			}
+		}
+		state.SetItemsProcessed(theNumSent);
+
+		auto theFraction = [&](uint32_t inMin, uint32_t inMax) {
+			return (double)std::count_if(theSentPerMilSec.begin(), theSentPerMilSec.end(),
+				[&](uint32_t inSent) { return inSent >= inMin && inSent <= inMax; }) / theSentPerMilSec.size();
+		};
+		state.counters["ms_idle"] = theFraction(0, 0);
+		state.counters["ms_1_16"] = theFraction(1, 16);
+		state.counters["ms_17_256"] = theFraction(17, 256);
+		state.counters["ms_257_4k"] = theFraction(257, 4096);
+		state.counters["ms_over_4k"] = theFraction(4097, UINT32_MAX);
+
+		std::sort(theSentPerMilSec.begin(), theSentPerMilSec.end());
+		state.counters["p99_pkts_per_ms"] = theSentPerMilSec[theSentPerMilSec.size() * 99 / 100];
+		state.counters["peak_pkts_per_ms"] = theSentPerMilSec.back();
+		state.counters["peak_queued_kB"] = (double)thePeakQueuedBytes / 1024;
+	}
+	// No stagger, buckets spread over a frame interval, and the server's default
+	BENCHMARK(BM_ReflectorFanOut_Bursts)->Args({ 1000, 0 })->Args({ 1000, 1 })->Args({ 1000, 73 })->Unit(benchmark::kMillisecond);
+
+	// What the reorder stage in front of a sender's ring costs per packet, for
+	// a clean stream (0) and one with 1% loss, 2% duplicates and 5% of the
+	// packets up to 4 late (1). A packet arrives every millisecond of
+	// simulated time; held_us is how long the stage held packets on average.
+	void BM_ReorderBuffer_Push(benchmark::State& state)
+	{
+		enum { kNumPackets = 65536, kPacketLen = 1200, kWindow = 16, kMaxHoldMilSecs = 40 };
+		using Clock = std::chrono::high_resolution_clock;
+
+		RTPLossInjector::Settings theSettings;
+		if (state.range(0) != 0)
+		{
+			theSettings.fLoss = 0.01;
+			theSettings.fDuplicate = 0.02;
+			theSettings.fReorder = 0.05;
+		}
+		RTPLossInjector theInjector(theSettings, 1);
+		std::vector<std::vector<char>> thePackets;
+		for (size_t theIndex : theInjector.Inject(kNumPackets))
+			thePackets.push_back(RTPLossInjector::MakePacket((uint16_t)theIndex, kPacketLen));
+
+		ReflectorReorderBuffer theBuffer(kWindow, std::chrono::milliseconds(kMaxHoldMilSecs));
+		std::vector<Clock::time_point> theArrivals(kNumPackets);
+		Clock::time_point theNow;
+		uint64_t theNumHandedOn = 0;
+		std::chrono::nanoseconds theTotalHeld(0);
+		auto theDeliver = [&](const char* inPacket, size_t inPacketLen) {
+			theTotalHeld += theNow - theArrivals[RTPLossInjector::GetSeqNumber(inPacket)];
+			theNumHandedOn++;
+			benchmark::DoNotOptimize(inPacketLen);
+		};
+
+		uint64_t theNumPushed = 0;
+		for (auto _ : state)
+		{
+			for (const std::vector<char>& thePacket : thePackets)
+			{
+				theNow += std::chrono::milliseconds(1);
+				theBuffer.Expire(theNow, theDeliver);
+				theArrivals[RTPLossInjector::GetSeqNumber(thePacket.data())] = theNow;
+				theBuffer.Push(thePacket.data(), thePacket.size(), theNow, theDeliver);
+			}
+			theNumPushed += thePackets.size();
+		}
+
+		state.SetItemsProcessed(theNumPushed);
+		state.counters["held_us"] = theNumHandedOn ? std::chrono::duration<double, std::micro>(theTotalHeld).count() / theNumHandedOn : 0;
+		state.counters["dups_dropped"] = (double)theBuffer.GetNumDuplicates();
+		state.counters["late"] = (double)theBuffer.GetNumLate();
+	}
+	BENCHMARK(BM_ReorderBuffer_Push)->Arg(0)->Arg(1);
+}
@@ -0,0 +1,361 @@
+/*
+	File:       ReflectorLoopbackBenchmarks.cpp
+
+	Contains:   One publisher feeding a broadcast to many viewers through the
+				asio reflector, over loopback TCP both ways. The publisher
+				sends H264 interleaved on channel 0 at a set bit rate, with a
+				key frame every second. Its connection is read the way
+				MyRTSPSession::process_rtppacket reads a RECORD session: '$'
+				frame by '$' frame into MyReflectorStream::PushPacket, which
+				hands each packet to MyReflectorSender and to every viewer's
+				MyRTPSessionOutput. The outputs write on io_services of their
+				own, as the server's pool does, and the viewers read on one
+				epoll thread.
+
+				MyRTSPSession itself is a coroutine of the RTSP server, which
+				needs <experimental/coroutine> and isn't built here, so its
+				read loop is played on a plain socket, and the viewers'
+				connections are accepted here with the options RTSPServer sets.
+				The session, the stream, the sender and the outputs are the
+				server's own.
+
+				Reports packets delivered per second over all viewers, the
+				latency from the publisher's send to a viewer having the whole
+				packet, and the packets the outputs dropped or never delivered.
+*/
+
+#include <benchmark/benchmark.h>
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include "MyReflectorSession.h"
+#include "MyReflectorStream.h"
+#include "MyRTPSessionOutput.h"
+#include "MyRTSPRequest.h"
+#include "SDPSourceInfo.h"
+
+namespace {
+
+	enum
+	{
+		kPacketLen = 1200,
+		kRTPHeaderLen = 12,
+		kSendTimeOffset = kRTPHeaderLen + 2,    // after the FU-A indicator and header
+		kRunMilSecs = 10,
+		kNumRuns = 300,
+		kRunsPerKeyFrame = 100,
+		kHeaderSize = 4                         // '$' + 1 byte channel + 2 bytes length
+	};
+
+	const char sBroadcastSDP[] =
+		"v=0\r\n"
+		"o=- 1568894730 1 IN IP4 127.0.0.1\r\n"
+		"s=Loopback\r\n"
+		"t=0 0\r\n"
+		"c=IN IP4 0.0.0.0\r\n"
+		"m=video 0 RTP/AVP 96\r\n"
+		"a=rtpmap:96 H264/90000\r\n"
+		"a=control:trackID=1\r\n";
+
+	int64_t Nanoseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Both ends of a plain loopback connection
+	void Connect(int* outServer, int* outClient)
+	{
+		int theListener = ::socket(AF_INET, SOCK_STREAM, 0);
+		struct sockaddr_in theAddr = {};
+		theAddr.sin_family = AF_INET;
+		theAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t theAddrLen = sizeof(theAddr);
+		(void)::bind(theListener, (sockaddr*)&theAddr, sizeof(theAddr));
+		(void)::listen(theListener, 1);
+		(void)::getsockname(theListener, (sockaddr*)&theAddr, &theAddrLen);
+
+		*outClient = ::socket(AF_INET, SOCK_STREAM, 0);
+		(void)::connect(*outClient, (sockaddr*)&theAddr, sizeof(theAddr));
+		*outServer = ::accept(theListener, nullptr, nullptr);
+		::close(theListener);
+	}
+
+	// The publisher: a run of packets every 10 ms, each stamped with when it
+	// was sent, the first of every second one starting a key frame. It sends
+	// without delay, as an encoder does.
+	void Publish(int inFileDesc, uint32_t inKbps)
+	{
+		int theOne = 1;
+		(void)::setsockopt(inFileDesc, IPPROTO_TCP, TCP_NODELAY, &theOne, sizeof(theOne));
+		uint64_t theBytesPerRun = (uint64_t)inKbps * 1000 / 8 * kRunMilSecs / 1000;
+		uint64_t theBytesOwed = 0;
+		uint16_t theSeq = 0;
+		std::vector<char> theFrame(kHeaderSize + kPacketLen, (char)0xAB);
+		theFrame[0] = '$';
+		theFrame[1] = 0;
+		theFrame[2] = (char)(kPacketLen >> 8);
+		theFrame[3] = (char)(kPacketLen & 0xFF);
+		char* thePacket = &theFrame[kHeaderSize];
+		thePacket[0] = (char)0x80;
+		thePacket[1] = 96;
+
+		int64_t theNextRun = Nanoseconds();
+		for (uint32_t theRun = 0; theRun < kNumRuns; theRun++)
+		{
+			while (Nanoseconds() < theNextRun)
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			theNextRun += kRunMilSecs * 1000000LL;
+
+			bool isKeyFrame = (theRun % kRunsPerKeyFrame) == 0;
+			for (theBytesOwed += theBytesPerRun; theBytesOwed >= kPacketLen; theBytesOwed -= kPacketLen)
+			{
+				thePacket[2] = (char)(theSeq >> 8);
+				thePacket[3] = (char)(theSeq & 0xFF);
+				theSeq++;
+				thePacket[12] = isKeyFrame ? 0x7C : 0x5C;              // FU-A, IDR or not
+				thePacket[13] = isKeyFrame ? (char)0x85 : (char)0x05;  // start of the frame or not
+				isKeyFrame = false;
+
+				int64_t theSentAt = Nanoseconds();
+				std::memcpy(&thePacket[kSendTimeOffset], &theSentAt, sizeof(theSentAt));
+				if (::send(inFileDesc, theFrame.data(), theFrame.size(), MSG_NOSIGNAL) != (ssize_t)theFrame.size())
+					return;
+			}
+		}
+	}
+
+	// The RECORD session's end: reads '$' frames until the publisher is done,
+	// and pushes each into its stream as process_rtppacket does
+	void Ingest(int inFileDesc, MyReflectorSession* inSession, uint64_t* outNumPackets)
+	{
+		std::vector<char> theBuffer;
+		char theChunk[65536];
+		while (true)
+		{
+			ssize_t theLen = ::recv(inFileDesc, theChunk, sizeof(theChunk), 0);
+			if (theLen <= 0)
+				return;
+			theBuffer.insert(theBuffer.end(), theChunk, theChunk + theLen);
+
+			size_t theOffset = 0;
+			while (theBuffer.size() - theOffset >= kHeaderSize)
+			{
+				const uint8_t* theHeader = (const uint8_t*)&theBuffer[theOffset];
+				size_t theFrameLen = ((size_t)theHeader[2] << 8) | theHeader[3];
+				if (theBuffer.size() - theOffset < kHeaderSize + theFrameLen)
+					break;
+
+				uint8_t theChannel = theHeader[1];
+				if (theChannel / 2 < inSession->GetSourceInfo().GetNumStreams())
+				{
+					inSession->GetStreamByIndex(theChannel / 2).PushPacket(&theBuffer[theOffset + kHeaderSize], theFrameLen, (theChannel & 1) != 0);
+					(*outNumPackets)++;
+				}
+				theOffset += kHeaderSize + theFrameLen;
+			}
+			theBuffer.erase(theBuffer.begin(), theBuffer.begin() + theOffset);
+		}
+	}
+
+	// A viewer's end of its connection, read without blocking
+	struct Viewer
+	{
+		int                 fFileDesc{ -1 };
+		std::vector<char>   fBuffer;
+		uint64_t            fNumPackets{ 0 };
+	};
+
+	// Reads every viewer's '$' frames as they come, and logs when each packet
+	// got there against when it was sent, until told to stop
+	void ReadViewers(std::vector<Viewer>* ioViewers, std::atomic<uint64_t>* ioNumDelivered,
+		std::atomic<bool>* inStop, std::vector<int64_t>* outLatencies)
+	{
+		int theEpoll = ::epoll_create1(0);
+		for (size_t x = 0; x < ioViewers->size(); x++)
+		{
+			struct epoll_event theEvent = {};
+			theEvent.events = EPOLLIN;
+			theEvent.data.u64 = x;
+			(void)::epoll_ctl(theEpoll, EPOLL_CTL_ADD, (*ioViewers)[x].fFileDesc, &theEvent);
+		}
+
+		std::vector<struct epoll_event> theEvents(ioViewers->size());
+		char theChunk[65536];
+		while (!*inStop)
+		{
+			int theNumEvents = ::epoll_wait(theEpoll, theEvents.data(), (int)theEvents.size(), 50);
+			for (int e = 0; e < theNumEvents; e++)
+			{
+				Viewer& theViewer = (*ioViewers)[theEvents[e].data.u64];
+				ssize_t theLen = ::recv(theViewer.fFileDesc, theChunk, sizeof(theChunk), 0);
+				if (theLen <= 0)
+					continue;
+				int64_t theNow = Nanoseconds();
+				theViewer.fBuffer.insert(theViewer.fBuffer.end(), theChunk, theChunk + theLen);
+
+				size_t theOffset = 0;
+				uint64_t theNumPackets = 0;
+				while (theViewer.fBuffer.size() - theOffset >= kHeaderSize)
+				{
+					const uint8_t* theHeader = (const uint8_t*)&theViewer.fBuffer[theOffset];
+					size_t theFrameLen = ((size_t)theHeader[2] << 8) | theHeader[3];
+					if (theViewer.fBuffer.size() - theOffset < kHeaderSize + theFrameLen)
+						break;
+
+					int64_t theSentAt = 0;
+					std::memcpy(&theSentAt, &theViewer.fBuffer[theOffset + kHeaderSize + kSendTimeOffset], sizeof(theSentAt));
+					outLatencies->push_back(theNow - theSentAt);
+					theNumPackets++;
+					theOffset += kHeaderSize + theFrameLen;
+				}
+				theViewer.fBuffer.erase(theViewer.fBuffer.begin(), theViewer.fBuffer.begin() + theOffset);
+				theViewer.fNumPackets += theNumPackets;
+				*ioNumDelivered += theNumPackets;
+			}
+		}
+		::close(theEpoll);
+	}
+
+	void BM_ReflectorLoopback_FanOut(benchmark::State& state)
+	{
+		uint32_t theKbps = (uint32_t)state.range(0);
+		size_t theNumViewers = (size_t)state.range(1);
+		size_t theNumIoServices = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+		uint64_t theNumPublished = 0;
+		uint64_t theNumExpected = 0;
+		uint64_t theNumDelivered = 0;
+		uint64_t theNumDropped = 0;
+		std::vector<int64_t> theLatencies;
+
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+
+			// The broadcast, set up as a push session the way MyRTSPSession's
+			// ANNOUNCE and SETUP do
+			SDPSourceInfo theInfo(sBroadcastSDP);
+			MyReflectorSession theSession("live/loopback", theInfo);
+			MyRTSPRequest theRequest;
+			theRequest.fTransportType = qtssRTPTransportTypeTCP;
+			(void)theSession.SetupReflectorSession(theRequest, MyReflectorSession::kMarkSetup | MyReflectorSession::kIsPushSession);
+			MyReflectorStream& theStream = theSession.GetStreamByIndex(0);
+
+			// The viewers' connections, spread over the io_services, each
+			// playing the stream from the start
+			std::vector<std::unique_ptr<boost::asio::io_service>> theIoServices;
+			std::vector<std::unique_ptr<boost::asio::io_service::work>> theWork;
+			for (size_t x = 0; x < theNumIoServices; x++)
+			{
+				theIoServices.emplace_back(new boost::asio::io_service());
+				theWork.emplace_back(new boost::asio::io_service::work(*theIoServices.back()));
+			}
+			boost::asio::ip::tcp::acceptor theAcceptor(*theIoServices[0],
+				boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+			sockaddr_in theAddr = {};
+			theAddr.sin_family = AF_INET;
+			theAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			theAddr.sin_port = htons(theAcceptor.local_endpoint().port());
+
+			std::vector<Viewer> theViewers(theNumViewers);
+			std::vector<std::shared_ptr<MyRTPSessionOutput>> theOutputs;
+			for (size_t x = 0; x < theNumViewers; x++)
+			{
+				theViewers[x].fFileDesc = ::socket(AF_INET, SOCK_STREAM, 0);
+				(void)::connect(theViewers[x].fFileDesc, (sockaddr*)&theAddr, sizeof(theAddr));
+				(void)::fcntl(theViewers[x].fFileDesc, F_SETFL, ::fcntl(theViewers[x].fFileDesc, F_GETFL, 0) | O_NONBLOCK);
+
+				auto theSocket = std::make_shared<boost::asio::ip::tcp::socket>(*theIoServices[x % theNumIoServices]);
+				theAcceptor.accept(*theSocket);
+				theSocket->set_option(boost::asio::ip::tcp::no_delay(true));  // as RTSPServer sets it
+				theOutputs.push_back(std::make_shared<MyRTPSessionOutput>(std::move(theSocket)));
+				theStream.AddOutput(theOutputs.back(), 0);
+			}
+
+			std::vector<std::thread> theIoThreads;
+			for (auto& theIoService : theIoServices)
+				theIoThreads.emplace_back([&theIoService]() { theIoService->run(); });
+
+			std::atomic<uint64_t> theRunDelivered{ 0 };
+			std::atomic<bool> theStopReading{ false };
+			std::vector<int64_t> theRunLatencies;
+			std::thread theReader(ReadViewers, &theViewers, &theRunDelivered, &theStopReading, &theRunLatencies);
+
+			int theIngestFileDesc = -1, thePublisherFileDesc = -1;
+			Connect(&theIngestFileDesc, &thePublisherFileDesc);
+			uint64_t theRunPublished = 0;
+			state.ResumeTiming();
+
+			std::thread theIngest(Ingest, theIngestFileDesc, &theSession, &theRunPublished);
+			Publish(thePublisherFileDesc, theKbps);
+			::shutdown(thePublisherFileDesc, SHUT_WR);
+			theIngest.join();
+
+			// Whatever is still on its way gets a second to arrive
+			uint64_t theRunExpected = theRunPublished * theNumViewers;
+			int64_t theDeadline = Nanoseconds() + 1000000000LL;
+			while ((theRunDelivered < theRunExpected) && (Nanoseconds() < theDeadline))
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+			state.PauseTiming();
+			theStopReading = true;
+			theReader.join();
+			for (auto& theOutput : theOutputs)
+			{
+				theStream.RemoveOutput(theOutput.get());
+				theOutput->Close();
+				theNumDropped += theOutput->GetNumDroppedPackets();
+			}
+			theWork.clear();
+			for (auto& theIoService : theIoServices)
+				theIoService->stop();
+			for (auto& theIoThread : theIoThreads)
+				theIoThread.join();
+			theOutputs.clear();
+			for (auto& theViewer : theViewers)
+				::close(theViewer.fFileDesc);
+			::close(theIngestFileDesc);
+			::close(thePublisherFileDesc);
+
+			theNumPublished += theRunPublished;
+			theNumExpected += theRunExpected;
+			theNumDelivered += theRunDelivered;
+			theLatencies.insert(theLatencies.end(), theRunLatencies.begin(), theRunLatencies.end());
+			state.ResumeTiming();
+		}
+
+		std::sort(theLatencies.begin(), theLatencies.end());
+		state.SetItemsProcessed(theNumDelivered);
+		state.counters["published"] = benchmark::Counter((double)theNumPublished);
+		if (!theLatencies.empty())
+		{
+			state.counters["p50_us"] = benchmark::Counter(theLatencies[theLatencies.size() / 2] / 1000.0);
+			state.counters["p99_us"] = benchmark::Counter(theLatencies[theLatencies.size() * 99 / 100] / 1000.0);
+		}
+		state.counters["dropped_packets"] = benchmark::Counter((double)theNumDropped);
+		state.counters["lost_packets"] = benchmark::Counter((double)(theNumExpected - theNumDelivered));
+	}
+	// A 2 Mbit/s and an 8 Mbit/s broadcast, to 1 viewer and to 500
+	BENCHMARK(BM_ReflectorLoopback_FanOut)->ArgNames({ "kbps", "viewers" })
+		->Args({ 2000, 1 })->Args({ 2000, 500 })->Args({ 8000, 1 })->Args({ 8000, 500 })
+		->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+}
+
+#endif
@@ -0,0 +1,155 @@
+/*
+	File:       ReflectorSessionBenchmarks.cpp
+
+	Contains:   Load on the session lifecycle locking of QTSSReflectorModule:
+				10k DESCRIBE/SETUP/PLAY cycles across 1000 stream names from 8
+				threads. Each request finds or creates its stream's session
+				under the stream's ReflectorStreamLocks stripe and lets go of it
+				under the same lock, with an OSRefTable for the session map, as
+				FindOrCreateSession and ReleaseSession do.
+
+				The module's requests come in through the legacy RTSP server,
+				which this tree doesn't build, so the requests themselves are
+				left out: only the locking and the session map are real. The
+				first request for a stream creates its session, which sleeps
+				while it holds the lock, standing in for parsing the SDP and
+				binding the sockets.
+
+				One stripe is the global lock the module used to take; 1024 is
+				what it takes now. Reports cycle latency percentiles, and how
+				many of the streams share their stripe with another one.
+*/
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "OSRef.h"
+#include "ReflectorStreamLocks.h"
+
+namespace {
+
+	enum
+	{
+		kNumStreams = 1000,
+		kNumCycles = 10000,
+		kNumWorkers = 8,
+		kSetupMicroSecs = 200
+	};
+
+	int64_t Nanoseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	std::vector<std::string> MakeNames()
+	{
+		std::vector<std::string> theNames;
+		for (uint32_t x = 0; x < kNumStreams; x++)
+			theNames.push_back("live/stream" + std::to_string(x) + ".sdp");
+		return theNames;
+	}
+
+	class StreamSessions
+	{
+	public:
+		StreamSessions(uint32_t inNumStripes)
+			: fLocks(inNumStripes), fNames(MakeNames())
+		{
+			for (auto& theName : fNames)
+			{
+				fKeys.emplace_back(&theName[0], (uint32_t)theName.size());
+				fRefs.emplace_back(new OSRef(fKeys.back(), nullptr));
+			}
+		}
+
+		~StreamSessions()
+		{
+			for (auto& theRef : fRefs)
+				(void)fTable.TryUnRegister(theRef.get());
+		}
+
+		// What one request does with its stream's session
+		void Request(uint32_t inStream)
+		{
+			OSRef* theRef = nullptr;
+			{
+				OSMutexLocker locker(fLocks.GetLock(fNames[inStream]));
+				theRef = fTable.Resolve(&fKeys[inStream]);
+				if (theRef == nullptr)
+				{
+					std::this_thread::sleep_for(std::chrono::microseconds(kSetupMicroSecs));
+					(void)fTable.Register(fRefs[inStream].get());
+					theRef = fTable.Resolve(&fKeys[inStream]);
+				}
+			}
+
+			OSMutexLocker locker(fLocks.GetLock(fNames[inStream]));
+			fTable.Release(theRef);
+		}
+
+	private:
+		ReflectorStreamLocks                fLocks;
+		std::vector<std::string>            fNames;
+		std::vector<StrPtrLen>              fKeys;
+		std::vector<std::unique_ptr<OSRef>> fRefs;
+		OSRefTable                          fTable;
+	};
+
+	void BM_ReflectorStreamLocks_Cycles(benchmark::State& state)
+	{
+		uint32_t theNumStripes = (uint32_t)state.range(0);
+		std::vector<int64_t> theSamples;
+		theSamples.reserve(state.max_iterations * kNumCycles);
+
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			std::unique_ptr<StreamSessions> theSessions(new StreamSessions(theNumStripes));
+			std::vector<int64_t> theLatencies(kNumCycles);
+			std::atomic<uint32_t> theNextCycle{ 0 };
+			state.ResumeTiming();
+
+			std::vector<std::thread> theWorkers;
+			for (uint32_t x = 0; x < kNumWorkers; x++)
+				theWorkers.emplace_back([&]() {
+					for (uint32_t theCycle = theNextCycle++; theCycle < kNumCycles; theCycle = theNextCycle++)
+					{
+						int64_t theStart = Nanoseconds();
+						for (uint32_t theRequest = 0; theRequest < 3; theRequest++)   // DESCRIBE, SETUP, PLAY
+							theSessions->Request(theCycle % kNumStreams);
+						theLatencies[theCycle] = Nanoseconds() - theStart;
+					}
+				});
+			for (auto& theWorker : theWorkers)
+				theWorker.join();
+
+			state.PauseTiming();
+			theSamples.insert(theSamples.end(), theLatencies.begin(), theLatencies.end());
+			theSessions.reset();
+			state.ResumeTiming();
+		}
+
+		std::sort(theSamples.begin(), theSamples.end());
+		state.SetItemsProcessed(state.iterations() * kNumCycles);
+		state.counters["p50_us"] = benchmark::Counter(theSamples[theSamples.size() / 2] / 1000.0);
+		state.counters["p99_us"] = benchmark::Counter(theSamples[theSamples.size() * 99 / 100] / 1000.0);
+
+		ReflectorStreamLocks theLocks(theNumStripes);
+		std::vector<uint32_t> theStreamsPerStripe(theNumStripes, 0);
+		std::vector<std::string> theNames = MakeNames();
+		for (auto& theName : theNames)
+			theStreamsPerStripe[theLocks.GetStripe(theName)]++;
+		uint32_t theNumSharing = 0;
+		for (auto& theName : theNames)
+			theNumSharing += (theStreamsPerStripe[theLocks.GetStripe(theName)] > 1) ? 1 : 0;
+		state.counters["shared_stripe_pct"] = benchmark::Counter(100.0 * theNumSharing / kNumStreams);
+	}
+	BENCHMARK(BM_ReflectorStreamLocks_Cycles)->Arg(1)->Arg(1024)->Iterations(3)->UseRealTime()->Unit(benchmark::kMillisecond);
+}
@@ -0,0 +1,105 @@
+/*
+	File:       SDPBenchmarks.cpp
+
+	Contains:   Microbenchmarks for SDPContainer, which every ANNOUNCE and
+				DESCRIBE goes through.
+
+				The DESCRIBE pair compares rendering the announced SDP on every
+				request, as DoDescribe used to, with taking the rendering CSdpCache
+				keeps, from 1 to 8 threads describing the same stream. Taking
+				it should neither allocate nor, once a thread has seen the
+				current cache, lock.
+*/
+
+#include <benchmark/benchmark.h>
+#include <string>
+#include "AllocationCounter.h"
+#include "DescribeSDP.h"
+#include "SDPUtils.h"
+#include "sdpCache.h"
+
+namespace {
+
+	// What a typical encoder announces, with the session lines out of order
+	const char sAnnounceSDP[] =
+		"v=0\r\n"
+		"o=- 1568894730 1 IN IP4 192.168.1.20\r\n"
+		"s=Live Stream\r\n"
+		"t=0 0\r\n"
+		"a=tool:libavformat 58.29.100\r\n"
+		"c=IN IP4 0.0.0.0\r\n"
+		"a=range:npt=0-\r\n"
+		"b=AS:2064\r\n"
+		"m=video 0 RTP/AVP 96\r\n"
+		"b=AS:2000\r\n"
+		"a=rtpmap:96 H264/90000\r\n"
+		"a=fmtp:96 packetization-mode=1;profile-level-id=64001F;sprop-parameter-sets=Z2QAH6zZQFAFuwEQAAADABAAAAMDIPGDGWA=,aOvjyyLA\r\n"
+		"a=control:trackID=1\r\n"
+		"m=audio 0 RTP/AVP 97\r\n"
+		"b=AS:64\r\n"
+		"a=rtpmap:97 MPEG4-GENERIC/44100/2\r\n"
+		"a=fmtp:97 profile-level-id=1;mode=AAC-hbr;sizelength=13;indexlength=3;indexdeltalength=3;config=121056E500\r\n"
+		"a=control:trackID=2\r\n";
+
+	void BM_SDPContainer_Parse(benchmark::State& state)
+	{
+		std::string theSDP(sAnnounceSDP);
+		for (auto _ : state)
+		{
+			SDPContainer theContainer(theSDP);
+			benchmark::DoNotOptimize(theContainer.GetLines().size());
+		}
+		state.SetBytesProcessed(state.iterations() * theSDP.size());
+	}
+	BENCHMARK(BM_SDPContainer_Parse);
+
+	void BM_SortSDPLine(benchmark::State& state)
+	{
+		std::string theSDP(sAnnounceSDP);
+		SDPContainer theContainer(theSDP);
+		for (auto _ : state)
+		{
+			std::string theSorted = SortSDPLine(theContainer);
+			benchmark::DoNotOptimize(theSorted.data());
+		}
+	}
+	BENCHMARK(BM_SortSDPLine);
+
+	void BM_Describe_Render(benchmark::State& state)
+	{
+		std::string theSDP(sAnnounceSDP);
+		for (auto _ : state)
+		{
+			std::shared_ptr<const std::string> theDescribeSDP = DescribeSDP::Render(theSDP);
+			benchmark::DoNotOptimize(theDescribeSDP->data());
+		}
+		state.counters["describes_per_s"] = benchmark::Counter((double)state.iterations(), benchmark::Counter::kIsRate);
+	}
+	BENCHMARK(BM_Describe_Render)->ThreadRange(1, 8)->UseRealTime();
+
+	void BM_Describe_Cached(benchmark::State& state)
+	{
+		const std::string thePath = "benchmark/describe.sdp";
+		CSdpCache* theCache = CSdpCache::GetInstance();
+		if (state.thread_index() == 0)
+		{
+			theCache->setSdpMap(thePath, sAnnounceSDP);
+			auto theEntry = theCache->getSdpEntry(thePath);
+			theCache->setDescribeSdp(thePath, theEntry->fVersion, DescribeSDP::Render(theEntry->fSDP));
+		}
+		uint64_t theAllocations = AllocationCounter::GetCount();
+		for (auto _ : state)
+		{
+			std::shared_ptr<const CSdpCache::SdpEntry> theEntry = theCache->getSdpEntry(thePath);
+			if (theEntry && theEntry->fDescribeSDP)
+				benchmark::DoNotOptimize(theEntry->fDescribeSDP->data());
+		}
+		theAllocations = AllocationCounter::GetCount() - theAllocations;
+
+		state.counters["describes_per_s"] = benchmark::Counter((double)state.iterations(), benchmark::Counter::kIsRate);
+		// The count is process wide, so the first thread reports it for all
+		if (state.thread_index() == 0)
+			state.counters["allocs_per_describe"] = benchmark::Counter((double)theAllocations / ((double)state.iterations() * state.threads()));
+	}
+	BENCHMARK(BM_Describe_Cached)->ThreadRange(1, 8)->UseRealTime();
+}
@@ -0,0 +1,242 @@
+/*
+	File:       SocketBenchmarks.cpp
+
+	Contains:   Loopback benchmarks for draining a reflector's UDP socket:
+				one recvfrom per datagram, as ReflectorSocket used to, against
+				UDPSocket::RecvMany in batches.
+
+				Every iteration a local sender fills the socket with a burst of
+				RTP sized datagrams, and only the draining is timed. Reports
+				datagrams per second and system calls per datagram.
+
+				And the other way round, a reflector fanning one packet out to
+				a thousand UDP viewers on loopback: a sendto per viewer against
+				UDPSocket::QueueSendTo and one FlushSendQueue. Reports datagrams
+				per second and CPU time per packet per 1000 viewers.
+*/
+
+#include <benchmark/benchmark.h>
+
+#if defined(__linux__)
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include "UDPSocket.h"
+
+namespace {
+
+	enum
+	{
+		kBurstSize = 64,
+		kPacketLen = 1200
+	};
+
+	// A receiving UDPSocket on 127.0.0.1 and a plain socket that blasts at it
+	struct LoopbackPair
+	{
+		LoopbackPair() : fReceiver(nullptr, Socket::kNonBlockingSocketType)
+		{
+			fReceiver.Open();
+			fReceiver.SetSocketRcvBufSize(4 * 1024 * 1024);
+			fReceiver.Bind(INADDR_LOOPBACK, 0);
+
+			fSender = ::socket(AF_INET, SOCK_DGRAM, 0);
+			fDest.sin_family = AF_INET;
+			fDest.sin_port = htons(fReceiver.GetLocalPort());
+			fDest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+			fPayload.assign(kPacketLen, (char)0xAB);
+			fPayload[0] = (char)0x80;
+			fPayload[1] = 96;
+		}
+		~LoopbackPair() { ::close(fSender); }
+
+		void SendBurst()
+		{
+			struct mmsghdr theHeaders[kBurstSize] = {};
+			struct iovec theIOVec = { &fPayload[0], fPayload.size() };
+			for (auto& theHeader : theHeaders)
+			{
+				theHeader.msg_hdr.msg_name = &fDest;
+				theHeader.msg_hdr.msg_namelen = sizeof(fDest);
+				theHeader.msg_hdr.msg_iov = &theIOVec;
+				theHeader.msg_hdr.msg_iovlen = 1;
+			}
+			(void)::sendmmsg(fSender, theHeaders, kBurstSize, 0);
+		}
+
+		UDPSocket           fReceiver;
+		int                 fSender;
+		struct sockaddr_in  fDest = {};
+		std::vector<char>   fPayload;
+	};
+
+	using Clock = std::chrono::steady_clock;
+
+	void BM_UDPSocket_RecvFrom(benchmark::State& state)
+	{
+		LoopbackPair thePair;
+		std::vector<char> theBuffer(UDPSocket::kMaxQueuedPacketSize);
+		uint64_t theNumPackets = 0;
+		uint64_t theNumCalls = 0;
+
+		for (auto _ : state)
+		{
+			thePair.SendBurst();
+
+			auto theStart = Clock::now();
+			while (true)
+			{
+				uint32_t theAddr = 0;
+				uint16_t thePort = 0;
+				size_t theLen = 0;
+				theNumCalls++;
+				if (thePair.fReceiver.RecvFrom(&theAddr, &thePort, theBuffer.data(), theBuffer.size(), &theLen) != OS_NoErr)
+					break;
+				theNumPackets++;
+			}
+			state.SetIterationTime(std::chrono::duration<double>(Clock::now() - theStart).count());
+		}
+
+		state.SetItemsProcessed(theNumPackets);
+		state.counters["syscalls_per_packet"] = benchmark::Counter(theNumPackets ? (double)theNumCalls / theNumPackets : 0.0);
+		state.counters["lost_per_burst"] = benchmark::Counter(kBurstSize - (double)theNumPackets / state.iterations());
+	}
+	BENCHMARK(BM_UDPSocket_RecvFrom)->UseManualTime();
+
+	// Same as ReflectorSocket::GetIncomingData: a short batch means the socket is empty
+	void BM_UDPSocket_RecvMany(benchmark::State& state)
+	{
+		LoopbackPair thePair;
+		size_t theBatchSize = (size_t)state.range(0);
+		std::vector<char> theBuffers(UDPSocket::kMaxRecvBatch * UDPSocket::kMaxQueuedPacketSize);
+		UDPSocket::RecvMsg theMsgs[UDPSocket::kMaxRecvBatch];
+		for (size_t x = 0; x < UDPSocket::kMaxRecvBatch; x++)
+		{
+			theMsgs[x].fBuffer = &theBuffers[x * UDPSocket::kMaxQueuedPacketSize];
+			theMsgs[x].fBufLen = UDPSocket::kMaxQueuedPacketSize;
+		}
+		uint64_t theNumPackets = 0;
+		uint64_t theNumCalls = 0;
+
+		for (auto _ : state)
+		{
+			thePair.SendBurst();
+
+			auto theStart = Clock::now();
+			while (true)
+			{
+				size_t theNumMsgs = 0;
+				theNumCalls++;
+				if (thePair.fReceiver.RecvMany(theMsgs, theBatchSize, &theNumMsgs) != OS_NoErr)
+					break;
+				theNumPackets += theNumMsgs;
+				if (theNumMsgs < theBatchSize)
+					break;
+			}
+			state.SetIterationTime(std::chrono::duration<double>(Clock::now() - theStart).count());
+		}
+
+		state.SetItemsProcessed(theNumPackets);
+		state.counters["syscalls_per_packet"] = benchmark::Counter(theNumPackets ? (double)theNumCalls / theNumPackets : 0.0);
+		state.counters["lost_per_burst"] = benchmark::Counter(kBurstSize - (double)theNumPackets / state.iterations());
+	}
+	BENCHMARK(BM_UDPSocket_RecvMany)->UseManualTime()->Arg(8)->Arg(32)->Arg(64);
+
+	// A thousand viewers that never read. Once a viewer's buffer is full the
+	// kernel drops what it gets, which costs the sender about the same.
+	struct LoopbackViewers
+	{
+		explicit LoopbackViewers(size_t inNumViewers) : fSender(nullptr, Socket::kNonBlockingSocketType)
+		{
+			fSender.Open();
+			fSender.SetSocketBufSize(4 * 1024 * 1024);
+			fSender.Bind(INADDR_LOOPBACK, 0);
+
+			for (size_t x = 0; x < inNumViewers; x++)
+			{
+				int theViewer = ::socket(AF_INET, SOCK_DGRAM, 0);
+				struct sockaddr_in theAddr = {};
+				theAddr.sin_family = AF_INET;
+				theAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+				socklen_t theAddrLen = sizeof(theAddr);
+				(void)::bind(theViewer, (sockaddr*)&theAddr, sizeof(theAddr));
+				(void)::getsockname(theViewer, (sockaddr*)&theAddr, &theAddrLen);
+				fViewers.push_back(theViewer);
+				fPorts.push_back(ntohs(theAddr.sin_port));
+			}
+
+			fPayload.assign(kPacketLen, (char)0xAB);
+			fPayload[0] = (char)0x80;
+			fPayload[1] = 96;
+		}
+		~LoopbackViewers()
+		{
+			for (int theViewer : fViewers)
+				::close(theViewer);
+		}
+
+		UDPSocket               fSender;
+		std::vector<int>        fViewers;
+		std::vector<uint16_t>   fPorts;
+		std::vector<char>       fPayload;
+	};
+
+	double ProcessCPUSeconds()
+	{
+		struct timespec theTime;
+		::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &theTime);
+		return theTime.tv_sec + theTime.tv_nsec / 1e9;
+	}
+
+	void ReportFanOut(benchmark::State& state, size_t inNumViewers, double inCPUSeconds, uint64_t inNumBlocked)
+	{
+		state.SetItemsProcessed(state.iterations() * inNumViewers);
+		state.counters["cpu_us_per_1000_viewers"] = benchmark::Counter(inCPUSeconds * 1e6 / state.iterations() * 1000 / inNumViewers);
+		state.counters["blocked_per_packet"] = benchmark::Counter((double)inNumBlocked / state.iterations());
+	}
+
+	// What RTPStream::UDPWrite did before the send queue
+	void BM_UDPSocket_FanOutSendTo(benchmark::State& state)
+	{
+		LoopbackViewers theViewers((size_t)state.range(0));
+		uint64_t theNumBlocked = 0;
+
+		double theCPUStart = ProcessCPUSeconds();
+		for (auto _ : state)
+			for (uint16_t thePort : theViewers.fPorts)
+				if (theViewers.fSender.SendTo(INADDR_LOOPBACK, thePort, theViewers.fPayload) != OS_NoErr)
+					theNumBlocked++;
+
+		ReportFanOut(state, theViewers.fPorts.size(), ProcessCPUSeconds() - theCPUStart, theNumBlocked);
+	}
+	BENCHMARK(BM_UDPSocket_FanOutSendTo)->Arg(1000);
+
+	// What ReflectorSender::ReflectPackets does now: every viewer queues a
+	// pointer to the same packet, and the queue goes out at the end
+	void BM_UDPSocket_FanOutQueueSendTo(benchmark::State& state)
+	{
+		LoopbackViewers theViewers((size_t)state.range(0));
+		uint64_t theNumBlocked = 0;
+
+		double theCPUStart = ProcessCPUSeconds();
+		for (auto _ : state)
+		{
+			for (uint16_t thePort : theViewers.fPorts)
+				if (theViewers.fSender.QueueSendTo(INADDR_LOOPBACK, thePort, theViewers.fPayload.data(), theViewers.fPayload.size()) != OS_NoErr)
+					theNumBlocked++;
+			if (theViewers.fSender.FlushSendQueue() != OS_NoErr)
+				theNumBlocked++;
+		}
+
+		ReportFanOut(state, theViewers.fPorts.size(), ProcessCPUSeconds() - theCPUStart, theNumBlocked);
+	}
+	BENCHMARK(BM_UDPSocket_FanOutQueueSendTo)->Arg(1000);
+}
+
+#endif
@@ -0,0 +1,113 @@
+/*
+	File:       StringBenchmarks.cpp
+
+	Contains:   Microbenchmarks for StringParser and StrPtrLen, the way the
+				request and SDP parsers use them.
+*/
+
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <string>
+#include "StrPtrLen.h"
+#include "StringParser.h"
+
+namespace {
+
+	const char sSetupRequest[] =
+		"SETUP rtsp://127.0.0.1:554/live/camera1/trackID=1 RTSP/1.0\r\n"
+		"CSeq: 3\r\n"
+		"User-Agent: LibVLC/3.0.8 (LIVE555 Streaming Media v2018.02.18)\r\n"
+		"Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n"
+		"Session: 8A2F6C1D9E4B7350\r\n"
+		"Accept-Language: en-US\r\n"
+		"\r\n";
+
+	// A request line and its headers, split up like RTSPRequest does
+	void BM_StringParser_Request(benchmark::State& state)
+	{
+		std::string theRequest(sSetupRequest);
+		for (auto _ : state)
+		{
+			StrPtrLen theStream(&theRequest[0], (uint32_t)theRequest.size());
+			StringParser theParser(&theStream);
+
+			StrPtrLen theMethod, theURI, theVersion;
+			theParser.ConsumeWord(&theMethod);
+			theParser.ConsumeWhitespace();
+			theParser.ConsumeUntilWhitespace(&theURI);
+			theParser.ConsumeWhitespace();
+			theParser.ConsumeUntil(&theVersion, StringParser::sEOLMask);
+			theParser.ExpectEOL();
+
+			uint32_t theNumHeaders = 0;
+			while (theParser.GetDataRemaining() > 0 && theParser.PeekFast() != '\r')
+			{
+				StrPtrLen theName, theValue;
+				theParser.ConsumeUntil(&theName, ':');
+				theParser.Expect(':');
+				theParser.ConsumeWhitespace();
+				theParser.GetThruEOL(&theValue);
+				theNumHeaders++;
+			}
+			benchmark::DoNotOptimize(theNumHeaders);
+		}
+		state.SetBytesProcessed(state.iterations() * theRequest.size());
+	}
+	BENCHMARK(BM_StringParser_Request);
+
+	// Pulling the numbers out of a Transport header
+	void BM_StringParser_ConsumeInteger(benchmark::State& state)
+	{
+		std::string theTransport("RTP/AVP;unicast;client_port=50234-50235;server_port=6970-6971;ssrc=1A2B3C4D");
+		for (auto _ : state)
+		{
+			StrPtrLen theStream(&theTransport[0], (uint32_t)theTransport.size());
+			StringParser theParser(&theStream);
+			uint32_t theSum = 0;
+			while (theParser.GetDataRemaining() > 0)
+			{
+				theParser.ConsumeUntilDigit();
+				theSum += theParser.ConsumeInteger();
+			}
+			benchmark::DoNotOptimize(theSum);
+		}
+	}
+	BENCHMARK(BM_StringParser_ConsumeInteger);
+
+	void BM_StrPtrLen_Equal(benchmark::State& state)
+	{
+		char theA[] = "rtsp://127.0.0.1:554/live/camera1/trackID=1";
+		char theB[] = "rtsp://127.0.0.1:554/live/camera1/trackID=2";
+		StrPtrLen theFirst(theA), theSecond(theB);
+		for (auto _ : state)
+		{
+			benchmark::DoNotOptimize(theFirst.Equal(theSecond));
+			benchmark::DoNotOptimize(theFirst.Equal(theFirst));
+		}
+	}
+	BENCHMARK(BM_StrPtrLen_Equal);
+
+	// Header names are matched without case
+	void BM_StrPtrLen_EqualIgnoreCase(benchmark::State& state)
+	{
+		char theHeader[] = "content-length";
+		StrPtrLen theName(theHeader);
+		const char* theCandidates[] = { "CSeq", "Content-Type", "Content-Length", "Transport" };
+		for (auto _ : state)
+		{
+			for (const char* theCandidate : theCandidates)
+				benchmark::DoNotOptimize(theName.EqualIgnoreCase(theCandidate, (uint32_t)::strlen(theCandidate)));
+		}
+	}
+	BENCHMARK(BM_StrPtrLen_EqualIgnoreCase);
+
+	void BM_StrPtrLen_FindStringIgnoreCase(benchmark::State& state)
+	{
+		std::string theRequest(sSetupRequest);
+		StrPtrLen theStream(&theRequest[0], (uint32_t)theRequest.size());
+		char theQuery[] = "interleaved=";
+		for (auto _ : state)
+			benchmark::DoNotOptimize(theStream.FindStringIgnoreCase(theQuery));
+	}
+	BENCHMARK(BM_StrPtrLen_FindStringIgnoreCase);
+}
@@ -0,0 +1,336 @@
+/*
+	File:       TaskBenchmarks.cpp
+
+	Contains:   Microbenchmarks for Task::Signal: many producer threads
+				signalling tasks that all run on one task thread, which is
+				what the socket and reflector threads do to the RTSP thread.
+
+				Reports how many signals get run per second and how long a
+				task waits between its Signal and its Run. The RunTime variant
+				does the same from 8 producers with the task run time histogram
+				off (0), timing every Run (1), and sampling one in 16 as the
+				server does.
+
+				A skewed load, where the round robin picker hands every heavy
+				task to the same thread, shows how far stealing spreads it:
+				p99 signal to run latency, and how busy the pool's threads are.
+				It runs again with one thread stuck in a 20 ms Run while the
+				load is signalled, so that what lands on that thread can only
+				be had from its signal queue.
+
+				Also compares the bracket every TaskThread puts around
+				Task::Run: the global OSMutexRW read lock it used to take,
+				against the per-thread run epoch it bumps now. 100k short tasks
+				are shared out over 8 threads, and the time spent getting into
+				the bracket is reported as lock wait.
+*/
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "OS.h"
+#include "OSMutexRW.h"
+#include "OSThread.h"
+#include "Task.h"
+
+namespace {
+
+	enum
+	{
+		kTasksPerProducer = 64,
+		kMaxProducers = 8,
+		kNumRunTasks = 100000,
+		kNumRunThreads = 8,
+		kNumPoolThreads = 4,
+		kSkewedTasks = 64,          // a multiple of kNumPoolThreads
+		kHeavyTaskMicroSecs = 200,
+		kLightTaskMicroSecs = 5,
+		kLongTaskMicroSecs = 20000
+	};
+
+	int64_t Nanoseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void Spin(int64_t inMicroSecs)
+	{
+		int64_t theEnd = Nanoseconds() + inMicroSecs * 1000;
+		while (Nanoseconds() < theEnd) {}
+	}
+
+	// One pool for the whole run, started the first time it is needed
+	void StartTaskThreads()
+	{
+		static bool sStarted = []() {
+			OS::Initialize();
+			OSThread::Initialize();
+			TaskThreadPool::SetNumShortTaskThreads(kNumPoolThreads);
+			return TaskThreadPool::AddThreads(kNumPoolThreads);
+		}();
+		(void)sStarted;
+	}
+
+	class LatencyTask : public Task
+	{
+	public:
+		LatencyTask(std::vector<int64_t>* inSamples, std::atomic<uint32_t>* inRunCount)
+			: fSamples(inSamples), fRunCount(inRunCount) {}
+
+		void Send()
+		{
+			fSignalTime = Nanoseconds();
+			this->Signal(Task::kStartEvent);
+		}
+
+		int64_t Run() override
+		{
+			EventFlags theEvents = this->GetEvents();
+			if (theEvents & Task::kKillEvent)
+				return -1;
+
+			fSamples->push_back(Nanoseconds() - fSignalTime);
+			fRunCount->fetch_add(1, std::memory_order_release);
+			return 0;
+		}
+
+	private:
+		std::vector<int64_t>*   fSamples;       // the producer reads it once fRunCount says so
+		std::atomic<uint32_t>*  fRunCount;
+		int64_t                 fSignalTime{ 0 };
+	};
+
+	// Each producer signals its own batch of tasks and waits for all of
+	// them to have run before it signals them again, so no signal is lost
+	// to one that is still pending
+	void BM_Task_SignalToRun(benchmark::State& state)
+	{
+		StartTaskThreads();
+
+		std::vector<int64_t> theSamples;
+		std::atomic<uint32_t> theRunCount{ 0 };
+		std::vector<LatencyTask*> theTasks;
+		for (uint32_t x = 0; x < kTasksPerProducer; x++)
+		{
+			theTasks.push_back(new LatencyTask(&theSamples, &theRunCount));
+			theTasks.back()->SetDefaultThread(TaskThreadPool::GetThread(0));
+		}
+
+		for (auto _ : state)
+		{
+			theRunCount.store(0, std::memory_order_relaxed);
+			for (auto* theTask : theTasks)
+				theTask->Send();
+			while (theRunCount.load(std::memory_order_acquire) < kTasksPerProducer)
+				std::this_thread::yield();
+		}
+
+		// The task thread deletes them
+		for (auto* theTask : theTasks)
+			theTask->Signal(Task::kKillEvent);
+
+		state.SetItemsProcessed(state.iterations() * kTasksPerProducer);
+		if (!theSamples.empty())
+		{
+			std::sort(theSamples.begin(), theSamples.end());
+			state.counters["p50_us"] = benchmark::Counter(theSamples[theSamples.size() / 2] / 1000.0, benchmark::Counter::kAvgThreads);
+			state.counters["p99_us"] = benchmark::Counter(theSamples[theSamples.size() * 99 / 100] / 1000.0, benchmark::Counter::kAvgThreads);
+		}
+	}
+	BENCHMARK(BM_Task_SignalToRun)->ThreadRange(1, kMaxProducers)->UseRealTime();
+
+	void BM_Task_SignalToRunRunTime(benchmark::State& state)
+	{
+		TaskThreadPool::SetRunTimeSampleInterval((uint32_t)state.range(0));
+		BM_Task_SignalToRun(state);
+		TaskThreadPool::SetRunTimeSampleInterval(16);
+	}
+	BENCHMARK(BM_Task_SignalToRunRunTime)->Arg(0)->Arg(1)->Arg(16)->Threads(kMaxProducers)->UseRealTime();
+
+	class SkewedTask : public Task
+	{
+	public:
+		SkewedTask(int64_t inRunMicroSecs, std::atomic<uint32_t>* inRunCount, std::atomic<uint32_t>* inStartCount = nullptr)
+			: fRunMicroSecs(inRunMicroSecs), fRunCount(inRunCount), fStartCount(inStartCount) {}
+
+		void Send()
+		{
+			fSignalTime = Nanoseconds();
+			this->Signal(Task::kStartEvent);
+		}
+
+		int64_t Run() override
+		{
+			EventFlags theEvents = this->GetEvents();
+			if (theEvents & Task::kKillEvent)
+				return -1;
+
+			fLatency = Nanoseconds() - fSignalTime;
+			if (fStartCount != nullptr)
+				fStartCount->fetch_add(1, std::memory_order_release);
+			Spin(fRunMicroSecs);
+			fRunCount->fetch_add(1, std::memory_order_release);
+			return 0;
+		}
+
+		int64_t GetRunMicroSecs() const { return fRunMicroSecs; }
+		int64_t GetLatency() const { return fLatency; }
+
+	private:
+		int64_t                 fRunMicroSecs;
+		std::atomic<uint32_t>*  fRunCount;
+		std::atomic<uint32_t>*  fStartCount;
+		int64_t                 fSignalTime{ 0 };
+		int64_t                 fLatency{ 0 };   // read once fRunCount says so
+	};
+
+	// Every kNumPoolThreads-th task is heavy, so without stealing one thread
+	// gets all of them while the rest sit idle. With inLongTaskMicroSecs,
+	// a task that runs that long is going on one thread before the load is
+	// signalled; a quarter of the load queues up behind it.
+	void RunSkewedLoad(benchmark::State& state, int64_t inLongTaskMicroSecs)
+	{
+		StartTaskThreads();
+
+		std::atomic<uint32_t> theRunCount{ 0 };
+		std::vector<SkewedTask*> theTasks;
+		for (uint32_t x = 0; x < kSkewedTasks; x++)
+			theTasks.push_back(new SkewedTask(x % kNumPoolThreads == 0 ? kHeavyTaskMicroSecs : kLightTaskMicroSecs, &theRunCount));
+
+		std::atomic<uint32_t> theLongStartCount{ 0 };
+		std::atomic<uint32_t> theLongRunCount{ 0 };
+		SkewedTask* theLongTask = (inLongTaskMicroSecs > 0) ? new SkewedTask(inLongTaskMicroSecs, &theLongRunCount, &theLongStartCount) : nullptr;
+
+		std::vector<int64_t> theSamples;
+		int64_t theBusyNanos = 0;
+		int64_t theWallNanos = 0;
+		for (auto _ : state)
+		{
+			if (theLongTask != nullptr)
+			{
+				state.PauseTiming();
+				theLongStartCount.store(0, std::memory_order_relaxed);
+				theLongRunCount.store(0, std::memory_order_relaxed);
+				theLongTask->Send();
+				while (theLongStartCount.load(std::memory_order_acquire) == 0)
+					std::this_thread::yield();
+				state.ResumeTiming();
+			}
+
+			int64_t theStart = Nanoseconds();
+			theRunCount.store(0, std::memory_order_relaxed);
+			for (auto* theTask : theTasks)
+				theTask->Send();
+			while (theRunCount.load(std::memory_order_acquire) < kSkewedTasks)
+				std::this_thread::yield();
+			theWallNanos += Nanoseconds() - theStart;
+
+			for (auto* theTask : theTasks)
+			{
+				theSamples.push_back(theTask->GetLatency());
+				theBusyNanos += theTask->GetRunMicroSecs() * 1000;
+			}
+
+			if (theLongTask != nullptr)
+			{
+				state.PauseTiming();
+				while (theLongRunCount.load(std::memory_order_acquire) == 0)
+					std::this_thread::yield();
+				state.ResumeTiming();
+			}
+		}
+
+		for (auto* theTask : theTasks)
+			theTask->Signal(Task::kKillEvent);
+		if (theLongTask != nullptr)
+			theLongTask->Signal(Task::kKillEvent);
+
+		state.SetItemsProcessed(state.iterations() * kSkewedTasks);
+		if (!theSamples.empty())
+		{
+			std::sort(theSamples.begin(), theSamples.end());
+			state.counters["p99_us"] = benchmark::Counter(theSamples[theSamples.size() * 99 / 100] / 1000.0);
+		}
+		if (theWallNanos > 0)
+			state.counters["utilization"] = benchmark::Counter((double)theBusyNanos / ((double)theWallNanos * kNumPoolThreads));
+	}
+
+	void BM_Task_SkewedLoad(benchmark::State& state)
+	{
+		RunSkewedLoad(state, 0);
+	}
+	BENCHMARK(BM_Task_SkewedLoad)->UseRealTime();
+
+	// Utilization is only that of the load, so the long Run keeps it down
+	void BM_Task_SkewedLoadLongRun(benchmark::State& state)
+	{
+		RunSkewedLoad(state, kLongTaskMicroSecs);
+	}
+	BENCHMARK(BM_Task_SkewedLoadLongRun)->UseRealTime();
+
+	// Stands in for a short Task::Run
+	inline void RunShortTask(uint64_t* ioState)
+	{
+		*ioState = *ioState * 6364136223846793005ULL + 1442695040888963407ULL;
+		benchmark::DoNotOptimize(*ioState);
+	}
+
+	// What TaskThread::Entry did before: every thread takes the same
+	// OSMutexRW for reading around each Run
+	void BM_TaskRun_GlobalRWLock(benchmark::State& state)
+	{
+		static OSMutexRW sMutexRW;
+		uint64_t theTaskState = (uint64_t)state.thread_index();
+		int64_t theWaitNanos = 0;
+
+		for (auto _ : state)
+		{
+			for (uint32_t x = 0; x < kNumRunTasks / kNumRunThreads; x++)
+			{
+				int64_t theStart = Nanoseconds();
+				sMutexRW.LockRead();
+				theWaitNanos += Nanoseconds() - theStart;
+				RunShortTask(&theTaskState);
+				sMutexRW.Unlock();
+			}
+		}
+
+		state.SetItemsProcessed(state.iterations() * (kNumRunTasks / kNumRunThreads));
+		state.counters["lock_wait_ns_per_task"] = benchmark::Counter(
+			(double)theWaitNanos / (state.iterations() * (kNumRunTasks / kNumRunThreads)), benchmark::Counter::kAvgThreads);
+	}
+	BENCHMARK(BM_TaskRun_GlobalRWLock)->Threads(kNumRunThreads)->UseRealTime();
+
+	// What it does now: each thread bumps its own epoch, which
+	// TaskThreadPool::WaitForQuiescentState reads from outside
+	void BM_TaskRun_RunEpoch(benchmark::State& state)
+	{
+		struct alignas(64) PaddedEpoch { std::atomic<uint64_t> fEpoch{ 0 }; };
+		static PaddedEpoch sEpochs[kNumRunThreads];
+		std::atomic<uint64_t>& theEpoch = sEpochs[state.thread_index() % kNumRunThreads].fEpoch;
+		uint64_t theTaskState = (uint64_t)state.thread_index();
+		int64_t theWaitNanos = 0;
+
+		for (auto _ : state)
+		{
+			for (uint32_t x = 0; x < kNumRunTasks / kNumRunThreads; x++)
+			{
+				int64_t theStart = Nanoseconds();
+				theEpoch.fetch_add(1, std::memory_order_acq_rel);
+				theWaitNanos += Nanoseconds() - theStart;
+				RunShortTask(&theTaskState);
+				theEpoch.fetch_add(1, std::memory_order_release);
+			}
+		}
+
+		state.SetItemsProcessed(state.iterations() * (kNumRunTasks / kNumRunThreads));
+		state.counters["lock_wait_ns_per_task"] = benchmark::Counter(
+			(double)theWaitNanos / (state.iterations() * (kNumRunTasks / kNumRunThreads)), benchmark::Counter::kAvgThreads);
+	}
+	BENCHMARK(BM_TaskRun_RunEpoch)->Threads(kNumRunThreads)->UseRealTime();
+}
@@ -0,0 +1,141 @@
+/*
+	File:       TimerBenchmarks.cpp
+
+	Contains:   Benchmarks for the task timers with a million of them armed,
+				about what a server with many idle sessions carries.
+
+				Insert/cancel churn on OSTimerWheel, and on OSHeap for
+				comparison, and how late the wheel hands out expired timers
+				when a million of them are due over one second of real time.
+*/
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "OS.h"
+#include "OSHeap.h"
+#include "OSTimerWheel.h"
+
+namespace {
+
+	enum
+	{
+		kNumArmedTimers = 1000000,
+		kNumChurnTimers = 1024,         // power of 2
+		kMaxTimeoutMilSecs = 60000,
+		kFiringSpreadMilSecs = 1000
+	};
+
+	uint64_t NextRandom(uint64_t& ioState)
+	{
+		ioState ^= ioState << 13;
+		ioState ^= ioState >> 7;
+		ioState ^= ioState << 17;
+		return ioState;
+	}
+
+	int64_t Nanoseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Each iteration arms one of kNumChurnTimers and cancels it again, like a
+	// session pushing its timeout out, on top of a million that stay armed
+	void BM_OSTimerWheel_InsertCancel(benchmark::State& state)
+	{
+		uint64_t theRandom = 88172645463325252ULL;
+		std::vector<OSTimerWheelElem> theArmed(kNumArmedTimers);
+		std::vector<OSTimerWheelElem> theChurn(kNumChurnTimers);
+		OSTimerWheel theWheel;
+		int64_t theNow = OS::Milliseconds();
+		for (auto& theElem : theArmed)
+		{
+			theElem.SetValue(theNow + 1 + (int64_t)(NextRandom(theRandom) % kMaxTimeoutMilSecs));
+			theWheel.Insert(&theElem);
+		}
+
+		uint32_t theIndex = 0;
+		for (auto _ : state)
+		{
+			OSTimerWheelElem* theElem = &theChurn[theIndex++ & (kNumChurnTimers - 1)];
+			theElem->SetValue(theNow + 1 + (int64_t)(NextRandom(theRandom) % kMaxTimeoutMilSecs));
+			theWheel.Insert(theElem);
+			benchmark::DoNotOptimize(theWheel.Remove(theElem));
+		}
+		state.SetItemsProcessed(state.iterations());
+	}
+	BENCHMARK(BM_OSTimerWheel_InsertCancel);
+
+	void BM_OSHeap_InsertCancel(benchmark::State& state)
+	{
+		uint64_t theRandom = 88172645463325252ULL;
+		std::vector<OSHeapElem> theArmed(kNumArmedTimers);
+		std::vector<OSHeapElem> theChurn(kNumChurnTimers);
+		OSHeap theHeap;
+		int64_t theNow = OS::Milliseconds();
+		for (auto& theElem : theArmed)
+		{
+			theElem.SetValue(theNow + 1 + (int64_t)(NextRandom(theRandom) % kMaxTimeoutMilSecs));
+			theHeap.Insert(&theElem);
+		}
+
+		uint32_t theIndex = 0;
+		for (auto _ : state)
+		{
+			OSHeapElem* theElem = &theChurn[theIndex++ & (kNumChurnTimers - 1)];
+			theElem->SetValue(theNow + 1 + (int64_t)(NextRandom(theRandom) % kMaxTimeoutMilSecs));
+			theHeap.Insert(theElem);
+			benchmark::DoNotOptimize(theHeap.Remove(theElem));
+		}
+		state.SetItemsProcessed(state.iterations());
+	}
+	BENCHMARK(BM_OSHeap_InsertCancel);
+
+	// A million timers due over the next second, pulled out the way
+	// TaskThread::WaitForTask does, on OS::Milliseconds(), which is also
+	// what the wheel catches up to. Jitter is how long after its deadline
+	// each one came out, timed to the microsecond from a steady clock
+	// lined up with OS::Milliseconds() at the start.
+	void BM_OSTimerWheel_FiringJitter(benchmark::State& state)
+	{
+		uint64_t theRandom = 88172645463325252ULL;
+		std::vector<OSTimerWheelElem> theElems(kNumArmedTimers);
+		std::vector<int64_t> theJitter;
+		theJitter.reserve(kNumArmedTimers);
+
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			theJitter.clear();
+			OSTimerWheel theWheel;
+			int64_t theStartMilSecs = OS::Milliseconds();
+			int64_t theStartNanos = Nanoseconds();
+			(void)theWheel.ExtractExpired(theStartMilSecs);
+			for (auto& theElem : theElems)
+			{
+				theElem.SetValue(theStartMilSecs + 1 + (int64_t)(NextRandom(theRandom) % kFiringSpreadMilSecs));
+				theWheel.Insert(&theElem);
+			}
+			state.ResumeTiming();
+
+			while (theWheel.GetSize() > 0)
+			{
+				OSTimerWheelElem* theElem = theWheel.ExtractExpired(OS::Milliseconds());
+				if (theElem == nullptr)
+					continue;
+				int64_t theFiredAt = theStartMilSecs * 1000000 + (Nanoseconds() - theStartNanos);
+				theJitter.push_back(std::max<int64_t>(0, theFiredAt - theElem->GetValue() * 1000000));
+			}
+		}
+
+		std::sort(theJitter.begin(), theJitter.end());
+		state.SetItemsProcessed(state.iterations() * kNumArmedTimers);
+		state.counters["jitter_p50_us"] = benchmark::Counter(theJitter[theJitter.size() / 2] / 1000.0);
+		state.counters["jitter_p99_us"] = benchmark::Counter(theJitter[theJitter.size() * 99 / 100] / 1000.0);
+		state.counters["jitter_max_us"] = benchmark::Counter(theJitter.back() / 1000.0);
+	}
+	BENCHMARK(BM_OSTimerWheel_FiringJitter)->Iterations(3)->Unit(benchmark::kMillisecond);
+}
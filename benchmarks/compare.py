@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""Compares two Google Benchmark JSON outputs and flags the regressions.
+
+    compare.py [--threshold PERCENT] [--metric cpu_time|real_time]
+               [--counter NAME ...] BASELINE CURRENT
+    compare.py --check BASELINE
+
+Runs with repetitions are compared on their median, and a change has to be
+more than twice the noise between the repetitions to count. Latency
+counters (p50_us and p99_us, and any counter ending in _p50_us or _p99_us)
+are compared the same way as the times, and for them too lower is better.
+The exit status is 1 if any benchmark got slower than that and the
+threshold allow, or if the baseline doesn't have a benchmark that was run,
+0 otherwise. With --check, it only makes sure there is a baseline to
+compare against, and explains where to get one if there isn't.
+"""
+
+import argparse
+import json
+import math
+import sys
+
+NS_PER_UNIT = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+# Context keys that make two runs hard to compare when they differ
+CONTEXT_KEYS = ("build_type", "host_name", "num_cpus", "mhz_per_cpu", "library_build_type")
+
+# Counters in microseconds where lower is better, compared like the times
+LATENCY_COUNTERS = ("p50_us", "p99_us")
+
+
+def is_gated(key, counters):
+    return any(key == counter or key.endswith("_" + counter) for counter in counters)
+
+
+def measurements(run, metric, counters):
+    """Yields (name, value, ns per unit of value) for the time of a run and
+    for each of its gated counters, which get the counter's name after the
+    benchmark's."""
+    name = run.get("run_name", run["name"])
+    yield name, run[metric], NS_PER_UNIT[run.get("time_unit", "ns")]
+    for key, value in sorted(run.items()):
+        if is_gated(key, counters) and isinstance(value, (int, float)):
+            yield "%s %s" % (name, key), value, NS_PER_UNIT["us"]
+
+
+def load(path, metric, counters):
+    """Returns the run's context, {benchmark name: time in ns} and
+    {benchmark name: coefficient of variation} for the repeated ones.
+    Gated counters come as benchmarks of their own."""
+    with open(path) as f:
+        data = json.load(f)
+
+    medians, iterations, cvs = {}, {}, {}
+    for run in data.get("benchmarks", []):
+        if run.get("run_type") == "aggregate":
+            if run.get("aggregate_name") == "median":
+                for name, value, unit in measurements(run, metric, counters):
+                    medians[name] = value * unit
+            elif run.get("aggregate_name") == "cv":
+                for name, value, _ in measurements(run, metric, counters):
+                    cvs[name] = value
+        else:
+            for name, value, unit in measurements(run, metric, counters):
+                iterations.setdefault(name, []).append(value * unit)
+
+    # Repetitions reported one by one count by their median too
+    times = {}
+    for name, values in iterations.items():
+        values.sort()
+        times[name] = values[len(values) // 2]
+    times.update(medians)
+    return data.get("context", {}), times, cvs
+
+
+def check_baseline(path):
+    """Returns an explanation of what is wrong with the baseline at path,
+    or None if it holds benchmark results."""
+    hint = ("make one on this machine with -DBENCHMARK_BASELINE=<path> and the "
+            "benchmark_baseline target, from a Release build")
+    if not path:
+        return "no baseline given: BENCHMARK_BASELINE is not set; " + hint
+    try:
+        with open(path) as f:
+            data = json.load(f)
+    except OSError as e:
+        return "can't read the baseline %s: %s; %s" % (path, e.strerror, hint)
+    except ValueError as e:
+        return "the baseline %s is not benchmark output: %s" % (path, e)
+    if not data.get("benchmarks"):
+        return "the baseline %s has no benchmarks in it" % path
+    return None
+
+
+def format_time(ns):
+    for unit in ("s", "ms", "us"):
+        if ns >= NS_PER_UNIT[unit]:
+            return "%.3g %s" % (ns / NS_PER_UNIT[unit], unit)
+    return "%.3g ns" % ns
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current", nargs="?")
+    parser.add_argument("--check", action="store_true",
+                        help="only check that there is a baseline")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="percent slower than the baseline that counts as a regression (10)")
+    parser.add_argument("--metric", choices=("cpu_time", "real_time"), default="cpu_time")
+    parser.add_argument("--counter", action="append", dest="counters", metavar="NAME",
+                        help="latency counter in microseconds to compare as well (p50_us and p99_us)")
+    args = parser.parse_args()
+    counters = tuple(args.counters or LATENCY_COUNTERS)
+
+    problem = check_baseline(args.baseline)
+    if problem:
+        print("error: " + problem, file=sys.stderr)
+        return 1
+    if args.check:
+        return 0
+    if args.current is None:
+        parser.error("the current benchmark output is missing")
+
+    base_context, base, base_cvs = load(args.baseline, args.metric, counters)
+    cur_context, cur, cur_cvs = load(args.current, args.metric, counters)
+
+    for key in CONTEXT_KEYS:
+        if base_context.get(key) != cur_context.get(key):
+            print("warning: %s differs: baseline %s, current %s"
+                  % (key, base_context.get(key), cur_context.get(key)), file=sys.stderr)
+
+    regressions, missing = [], []
+    width = max([len(name) for name in cur] + [len("benchmark")])
+    print("%-*s %12s %12s %9s %7s" % (width, "benchmark", "baseline", "current", "change", "noise"))
+    for name in sorted(cur):
+        if name not in base:
+            print("%-*s %12s %12s %9s  NOT IN BASELINE" % (width, name, "-", format_time(cur[name]), "new"))
+            missing.append(name)
+            continue
+
+        change = (cur[name] - base[name]) / base[name] * 100.0 if base[name] > 0 else 0.0
+        noise = 2.0 * math.hypot(base_cvs.get(name, 0.0), cur_cvs.get(name, 0.0)) * 100.0
+        flag = ""
+        if change > max(args.threshold, noise):
+            flag = "  REGRESSION"
+            regressions.append(name)
+        print("%-*s %12s %12s %+8.1f%% %6.1f%%%s"
+              % (width, name, format_time(base[name]), format_time(cur[name]), change, noise, flag))
+
+    for name in sorted(set(base) - set(cur)):
+        print("%-*s %12s %12s %9s" % (width, name, format_time(base[name]), "-", "gone"))
+
+    if regressions:
+        print("\n%d benchmark(s) more than %g%% slower than the baseline"
+              % (len(regressions), args.threshold))
+    if missing:
+        # Nothing would ever catch them getting slower
+        print("\n%d benchmark(s) not in the baseline, record a new one"
+              % len(missing))
+    return 1 if regressions or missing else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
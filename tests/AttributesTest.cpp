@@ -0,0 +1,98 @@
+/*
+	File:       AttributesTest.cpp
+
+	Contains:   Unit tests for the compile-time typed attribute slots, and
+				for the IDs the reflector registers on them.
+*/
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include "Attributes.h"
+#include "ReflectorAttributes.h"
+
+namespace {
+
+	constexpr AttributeID<uint64_t> kPacketID{ 0 };
+	constexpr AttributeID<bool>     kFlag{ 1 };
+	constexpr AttributeID<void*>    kCookie{ 2 };
+	constexpr AttributeID<int32_t>  kLastSlot{ Attributes::kNumSlots - 1 };
+}
+
+TEST(Attributes, UnsetSlotsAreEmpty)
+{
+	Attributes theAttributes;
+	EXPECT_FALSE(theAttributes.getAttribute(kPacketID));
+	EXPECT_FALSE(theAttributes.getAttribute(kFlag));
+	EXPECT_FALSE(theAttributes.getAttribute(kCookie));
+	EXPECT_FALSE(theAttributes.getAttribute(kLastSlot));
+}
+
+TEST(Attributes, SlotsKeepTheirValuesApart)
+{
+	Attributes theAttributes;
+	int theObject = 0;
+	theAttributes.addAttribute(kPacketID, UINT64_MAX - 1);
+	theAttributes.addAttribute(kFlag, true);
+	theAttributes.addAttribute(kCookie, (void*)&theObject);
+	theAttributes.addAttribute(kLastSlot, -7);
+
+	EXPECT_EQ(*theAttributes.getAttribute(kPacketID), UINT64_MAX - 1);
+	EXPECT_TRUE(*theAttributes.getAttribute(kFlag));
+	EXPECT_EQ(*theAttributes.getAttribute(kCookie), (void*)&theObject);
+	EXPECT_EQ(*theAttributes.getAttribute(kLastSlot), -7);
+}
+
+TEST(Attributes, AddOverwritesAndRemoveClears)
+{
+	Attributes theAttributes;
+	theAttributes.addAttribute(kPacketID, 1u);
+	theAttributes.addAttribute(kPacketID, 2u);
+	EXPECT_EQ(*theAttributes.getAttribute(kPacketID), 2u);
+
+	// false is a value, not an unset slot
+	theAttributes.addAttribute(kFlag, false);
+	ASSERT_TRUE(theAttributes.getAttribute(kFlag));
+	EXPECT_FALSE(*theAttributes.getAttribute(kFlag));
+
+	theAttributes.removeAttribute(kPacketID);
+	EXPECT_FALSE(theAttributes.getAttribute(kPacketID));
+	EXPECT_TRUE(theAttributes.getAttribute(kFlag));
+
+	theAttributes.addAttribute(kPacketID, 3u);
+	EXPECT_EQ(*theAttributes.getAttribute(kPacketID), 3u);
+}
+
+TEST(Attributes, NamesFallBackToTheMap)
+{
+	Attributes theAttributes;
+	theAttributes.addAttribute(kPacketID, 5u);
+	theAttributes.addAttribute("name", boost::any(std::string("value")));
+	EXPECT_EQ(boost::any_cast<std::string>(*theAttributes.getAttribute("name")), "value");
+	EXPECT_FALSE(theAttributes.getAttribute("other"));
+
+	theAttributes.removeAttribute("name");
+	EXPECT_FALSE(theAttributes.getAttribute("name"));
+	EXPECT_EQ(*theAttributes.getAttribute(kPacketID), 5u);
+}
+
+TEST(Attributes, ReflectorIDsHaveSlotsOfTheirOwn)
+{
+	const uint32_t theSlots[] = {
+		ReflectorAttr::kOutput.fSlot, ReflectorAttr::kBroadcasterSession.fSlot,
+		ReflectorAttr::kTearDownClients.fSlot, ReflectorAttr::kStreamCookie.fSlot,
+		ReflectorAttr::kLastRTPPacketID.fSlot, ReflectorAttr::kLastRTCPPacketID.fSlot };
+	for (size_t x = 0; x < sizeof(theSlots) / sizeof(theSlots[0]); x++)
+	{
+		EXPECT_LT(theSlots[x], (uint32_t)Attributes::kNumSlots);
+		for (size_t y = 0; y < x; y++)
+			EXPECT_NE(theSlots[x], theSlots[y]);
+	}
+
+	Attributes theAttributes;
+	theAttributes.addAttribute(ReflectorAttr::kLastRTPPacketID, 10u);
+	theAttributes.addAttribute(ReflectorAttr::kLastRTCPPacketID, 20u);
+	theAttributes.addAttribute(ReflectorAttr::kStreamCookie, (void*)&theAttributes);
+	EXPECT_EQ(*theAttributes.getAttribute(ReflectorAttr::kLastRTPPacketID), 10u);
+	EXPECT_EQ(*theAttributes.getAttribute(ReflectorAttr::kLastRTCPPacketID), 20u);
+	EXPECT_EQ(*theAttributes.getAttribute(ReflectorAttr::kStreamCookie), (void*)&theAttributes);
+}
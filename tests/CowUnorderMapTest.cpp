@@ -0,0 +1,122 @@
+/*
+	File:       CowUnorderMapTest.cpp
+
+	Contains:   Unit tests for CowUnorderMap, the copy-on-write demuxer the
+				reflector sockets find their senders in.
+
+				The concurrency test has readers look up addresses that stay
+				registered and addresses that come and go, while a writer
+				registers and unregisters as fast as it can. A reader must always
+				find what stays, and never find a wrong value for what doesn't.
+*/
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "CowUnorderMap.h"
+
+namespace {
+
+	indexKey MakeKey(uint32_t inIndex)
+	{
+		return { 0x7F000001 + (inIndex >> 12), (uint16_t)(6970 + (inIndex & 0xFFF) * 2) };
+	}
+
+	// What a key maps to, so that a reader can tell a wrong value. Never 0,
+	// which is what GetTask returns for a key that isn't there.
+	uint64_t MakeValue(uint32_t inIndex)
+	{
+		return ((uint64_t)(inIndex + 1) << 32) | (inIndex * 2654435761U);
+	}
+}
+
+TEST(CowUnorderMap, RegistersLooksUpAndUnregisters)
+{
+	CowUnorderMap<uint64_t> theMap;
+	EXPECT_TRUE(theMap.empty());
+	EXPECT_EQ(theMap.GetTask(MakeKey(0)), 0u);
+
+	for (uint32_t x = 0; x < 100; x++)
+		EXPECT_TRUE(theMap.RegisterTask(MakeKey(x), MakeValue(x)));
+	EXPECT_FALSE(theMap.RegisterTask(MakeKey(7), 1));
+	EXPECT_FALSE(theMap.empty());
+
+	for (uint32_t x = 0; x < 100; x++)
+	{
+		EXPECT_TRUE(theMap.AddrInMap(MakeKey(x)));
+		EXPECT_EQ(theMap.GetTask(MakeKey(x)), MakeValue(x));
+	}
+	EXPECT_FALSE(theMap.AddrInMap(MakeKey(100)));
+
+	// Taking some out mustn't lose the ones that probed past them
+	for (uint32_t x = 0; x < 100; x += 2)
+		theMap.UnregisterTask(MakeKey(x));
+	theMap.UnregisterTask(MakeKey(1000));
+	for (uint32_t x = 0; x < 100; x++)
+		EXPECT_EQ(theMap.GetTask(MakeKey(x)), (x % 2) ? MakeValue(x) : 0u) << x;
+
+	for (uint32_t x = 1; x < 100; x += 2)
+		theMap.UnregisterTask(MakeKey(x));
+	EXPECT_TRUE(theMap.empty());
+}
+
+TEST(CowUnorderMap, ReadersSeeConsistentTablesUnderChurn)
+{
+	enum
+	{
+		kNumStable = 256,
+		kNumChurned = 64,
+		kNumReaders = 4,
+		kNumWrites = 512      // 8 rounds of the churned ones coming and going
+	};
+
+	CowUnorderMap<uint64_t> theMap;
+	for (uint32_t x = 0; x < kNumStable; x++)
+		ASSERT_TRUE(theMap.RegisterTask(MakeKey(x), MakeValue(x)));
+
+	std::atomic<bool> isDone{ false };
+	std::atomic<uint64_t> theNumMissing{ 0 }, theNumWrong{ 0 }, theNumLookups{ 0 };
+	std::vector<std::thread> theReaders;
+	for (int theReader = 0; theReader < kNumReaders; theReader++)
+	{
+		theReaders.emplace_back([&, theReader]() {
+			uint32_t theIndex = (uint32_t)theReader;
+			uint64_t theLookups = 0;
+			while (!isDone.load())
+			{
+				theIndex = (theIndex * 1103515245U + 12345U) % (kNumStable + kNumChurned);
+				uint64_t theValue = theMap.GetTask(MakeKey(theIndex));
+				if (theIndex < kNumStable && theValue == 0)
+					theNumMissing++;
+				else if (theValue != 0 && theValue != MakeValue(theIndex))
+					theNumWrong++;
+				theLookups++;
+			}
+			theNumLookups += theLookups;
+		});
+	}
+
+	// Every write swaps the table, and frees the old one once no reader
+	// can be looking at it
+	for (uint32_t theWrite = 0; theWrite < kNumWrites; theWrite++)
+	{
+		uint32_t theIndex = kNumStable + (theWrite % kNumChurned);
+		if ((theWrite / kNumChurned) % 2 == 0)
+			EXPECT_TRUE(theMap.RegisterTask(MakeKey(theIndex), MakeValue(theIndex)));
+		else
+			theMap.UnregisterTask(MakeKey(theIndex));
+	}
+	isDone = true;
+	for (auto& theReader : theReaders)
+		theReader.join();
+
+	EXPECT_EQ(theNumMissing.load(), 0u);
+	EXPECT_EQ(theNumWrong.load(), 0u);
+	EXPECT_GT(theNumLookups.load(), 0u);
+	for (uint32_t x = 0; x < kNumStable; x++)
+		EXPECT_EQ(theMap.GetTask(MakeKey(x)), MakeValue(x));
+	::testing::Test::RecordProperty("lookups", (int)std::min<uint64_t>(theNumLookups.load(), INT32_MAX));
+}
@@ -0,0 +1,30 @@
+/*
+	File:       DescribeSDP.h
+
+	Contains:   What DoDescribe does with an announced SDP the first time a
+				DESCRIBE asks for it, before CSdpCache keeps the result.
+
+				Shared by the SDP cache test and the DESCRIBE benchmark.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include "SDPSourceInfo.h"
+#include "SDPUtils.h"
+
+namespace DescribeSDP
+{
+	// Returns nullptr if the SDP doesn't parse, which DoDescribe answers
+	// with 415
+	inline std::shared_ptr<const std::string> Render(const std::string& inAnnouncedSDP)
+	{
+		SDPSourceInfo theSourceInfo(inAnnouncedSDP);
+		std::string theLocalSDP = theSourceInfo.GetLocalSDP();
+		SDPContainer theContainer(theLocalSDP);
+		if (!theContainer.Parse())
+			return nullptr;
+		return std::make_shared<const std::string>(SortSDPLine(theContainer));
+	}
+}
@@ -0,0 +1,170 @@
+/*
+	File:       EventThreadStressTest.cpp
+
+	Contains:   Stress test for the epoll EventThread: tens of thousands of
+				loopback socket pairs, each poked a few times, and every poke
+				has to be dispatched exactly once.
+
+				Reports epoll_ctl calls per event, which one-shot re-arming keeps
+				at one, and the latency from the write to ProcessEvent.
+
+				EASYDARWIN_STRESS_PAIRS overrides the number of pairs (50000). It
+				is cut down to what RLIMIT_NOFILE allows.
+*/
+
+#include <gtest/gtest.h>
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "EventContext.h"
+#include "ServerMetrics.h"
+#include "Socket.h"
+#include "TestEnvironment.h"
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	int64_t Nanoseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+	}
+
+	struct DispatchLog
+	{
+		std::mutex              fMutex;
+		std::condition_variable fCond;
+		uint64_t                fNumDispatched{ 0 };
+		std::vector<int64_t>    fLatencies;
+	};
+
+	// The read end of one pair. Every event reads the poke, logs how long it
+	// took to get here, and re-arms.
+	class PokeContext : public EventContext
+	{
+	public:
+		PokeContext(int inFileDesc, DispatchLog* inLog)
+			: EventContext(EventContext::kInvalidFileDesc, Socket::GetEventThread()), fLog(inLog)
+		{
+			this->InitNonBlocking(inFileDesc);
+		}
+
+		void Poke(int inWriteFD)
+		{
+			fPokedAt.store(Nanoseconds(), std::memory_order_release);
+			char theByte = 'x';
+			ASSERT_EQ(::write(inWriteFD, &theByte, 1), 1);
+		}
+
+		std::atomic<uint32_t>   fNumEvents{ 0 };
+
+	protected:
+		void ProcessEvent(int /*eventBits*/) override
+		{
+			int64_t theLatency = Nanoseconds() - fPokedAt.load(std::memory_order_acquire);
+			char theBytes[16];
+			while (::read(fFileDesc, theBytes, sizeof(theBytes)) > 0) {}
+			fNumEvents.fetch_add(1, std::memory_order_relaxed);
+			this->RequestEvent(EV_RE);
+
+			std::lock_guard<std::mutex> locker(fLog->fMutex);
+			fLog->fLatencies.push_back(theLatency);
+			fLog->fNumDispatched++;
+			fLog->fCond.notify_all();
+		}
+
+	private:
+		DispatchLog*            fLog;
+		std::atomic<int64_t>    fPokedAt{ 0 };
+	};
+
+	size_t GetNumPairs()
+	{
+		size_t theNumPairs = 50000;
+		if (const char* theEnv = ::getenv("EASYDARWIN_STRESS_PAIRS"))
+			theNumPairs = (size_t)::strtoul(theEnv, nullptr, 10);
+
+		// Two fds a pair, and some headroom for everything else
+		struct rlimit theLimit;
+		::getrlimit(RLIMIT_NOFILE, &theLimit);
+		theLimit.rlim_cur = theLimit.rlim_max;
+		::setrlimit(RLIMIT_NOFILE, &theLimit);
+		if (theLimit.rlim_cur != RLIM_INFINITY)
+			theNumPairs = std::min<size_t>(theNumPairs, (theLimit.rlim_cur - 256) / 2);
+		return theNumPairs;
+	}
+}
+
+TEST(EventThreadStress, EveryEventDispatchedOnceWithOneCtlPerEvent)
+{
+	enum { kNumRounds = 3 };
+	TestEnvironment::StartEventThread();
+
+	size_t theNumPairs = GetNumPairs();
+	DispatchLog theLog;
+	theLog.fLatencies.reserve(theNumPairs * kNumRounds);
+
+	std::vector<std::unique_ptr<PokeContext>> theContexts;
+	std::vector<int> theWriteFDs;
+	for (size_t x = 0; x < theNumPairs; x++)
+	{
+		int theFDs[2];
+		ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, theFDs), 0) << "pair " << x;
+		theContexts.emplace_back(new PokeContext(theFDs[0], &theLog));
+		theContexts.back()->RequestEvent(EV_RE);
+		theWriteFDs.push_back(theFDs[1]);
+	}
+
+	ServerMetrics::Counter& theCtlCalls = ServerMetrics::GetCounter("easydarwin_epoll_ctl_calls_total", "epoll_ctl calls made to arm or remove an fd");
+	uint64_t theCtlCallsBefore = theCtlCalls.GetValue();
+
+	for (uint32_t theRound = 1; theRound <= kNumRounds; theRound++)
+	{
+		for (size_t x = 0; x < theNumPairs; x++)
+			theContexts[x]->Poke(theWriteFDs[x]);
+
+		std::unique_lock<std::mutex> locker(theLog.fMutex);
+		ASSERT_TRUE(theLog.fCond.wait_for(locker, std::chrono::seconds(60),
+			[&]() { return theLog.fNumDispatched >= theRound * theNumPairs; }))
+			<< "round " << theRound << ": " << theLog.fNumDispatched << " events dispatched";
+	}
+
+	// Anything dispatched twice would show up now
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	uint64_t theNumEvents = theNumPairs * kNumRounds;
+	double theCtlPerEvent = (double)(theCtlCalls.GetValue() - theCtlCallsBefore) / theNumEvents;
+	for (auto& theContext : theContexts)
+		ASSERT_EQ(theContext->fNumEvents.load(), (uint32_t)kNumRounds);
+	EXPECT_LE(theCtlPerEvent, 1.0);
+
+	std::vector<int64_t> theLatencies;
+	{
+		std::lock_guard<std::mutex> locker(theLog.fMutex);
+		theLatencies = theLog.fLatencies;
+	}
+	std::sort(theLatencies.begin(), theLatencies.end());
+	auto thePercentile = [&](size_t inPercent) { return theLatencies[theLatencies.size() * inPercent / 100] / 1000; };
+	::printf("%zu pairs, %zu events: %.3f epoll_ctl per event, dispatch latency p50 %lld us, p90 %lld us, p99 %lld us, max %lld us\n",
+		theNumPairs, theLatencies.size(), theCtlPerEvent,
+		(long long)thePercentile(50), (long long)thePercentile(90), (long long)thePercentile(99), (long long)(theLatencies.back() / 1000));
+	::testing::Test::RecordProperty("pairs", (int)theNumPairs);
+	::testing::Test::RecordProperty("p99_us", (int)thePercentile(99));
+
+	theContexts.clear();
+	for (int theFD : theWriteFDs)
+		::close(theFD);
+}
+
+#endif
@@ -0,0 +1,69 @@
+/*
+	File:       LegacyRTSPRequestGrammar.h
+
+	Contains:   The Boost.Spirit grammar RTSPRequest::Parse used before
+				RTSPRequestParser, kept as it was. It is the reference the new
+				parser is checked against and benchmarked with.
+*/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <boost/spirit/include/qi.hpp>
+#include <boost/fusion/include/std_pair.hpp>
+#include <boost/utility/string_view.hpp>
+
+namespace LegacyRTSPRequestGrammar
+{
+	typedef std::map<std::string, std::string> header_fields_t;
+
+	struct RTSPRequestHeader
+	{
+		std::string method;
+		std::string uri;
+		std::string rtsp_version;
+
+		header_fields_t header_fields;
+	};
+}
+
+BOOST_FUSION_ADAPT_STRUCT(LegacyRTSPRequestGrammar::RTSPRequestHeader, method, uri, rtsp_version, header_fields)
+
+namespace LegacyRTSPRequestGrammar
+{
+	namespace qi = boost::spirit::qi;
+
+	template <typename Iterator, typename Skipper = qi::ascii::blank_type>
+	struct RTSPHeaderGrammar : qi::grammar <Iterator, RTSPRequestHeader(), Skipper> {
+		RTSPHeaderGrammar() : RTSPHeaderGrammar::base_type(rtsp_header, "RTSPHeaderGrammar Grammar") {
+			method = +qi::alpha;
+			uri = +qi::graph;
+			rtsp_ver = "RTSP/" >> +qi::char_("0-9.");
+
+			field_key = +qi::char_("0-9a-zA-Z-");
+			field_value = +~qi::char_("\r\n");
+
+			fields = *(field_key >> ':' >> field_value >> qi::lexeme["\r\n"]);
+
+			rtsp_header = method >> uri >> rtsp_ver >> qi::lexeme["\r\n"] >> fields >> qi::lexeme["\r\n"];
+		}
+	private:
+		qi::rule<Iterator, std::map<std::string, std::string>(), Skipper> fields;
+		qi::rule<Iterator, RTSPRequestHeader(), Skipper> rtsp_header;
+		// lexemes
+		qi::rule<Iterator, std::string()> method, uri, rtsp_ver;
+		qi::rule<Iterator, std::string()> field_key, field_value;
+	};
+
+	// What RTSPRequest::Parse did with a request, minus printing it:
+	// a new grammar every time, and a successful parse has to use it all
+	inline bool Parse(boost::string_view inRequest, RTSPRequestHeader* outHeader)
+	{
+		typedef boost::string_view::const_iterator It;
+		RTSPHeaderGrammar<It> rtspGrammar;
+		It iter = inRequest.begin(), end = inRequest.end();
+		bool r = qi::phrase_parse(iter, end, rtspGrammar, qi::ascii::blank, *outHeader);
+		return r && iter == end;
+	}
+}
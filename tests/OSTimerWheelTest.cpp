@@ -0,0 +1,79 @@
+/*
+	File:       OSTimerWheelTest.cpp
+
+	Contains:   Arms timers on an OSTimerWheel across all its levels, several
+				to a millisecond, and turns the wheel past all of them.
+
+				They have to come out in time order to the millisecond, and
+				timers armed together for the same millisecond in the order
+				they were armed, however many cascades they went through.
+*/
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <vector>
+#include "OS.h"
+#include "OSTimerWheel.h"
+#include "TestEnvironment.h"
+
+namespace {
+
+	enum
+	{
+		kNumTimers = 20000,
+		kTimersPerMilSec = 4,
+		kSpreadMilSecs = 70 * 1000  // reaches into the third level
+	};
+
+	struct Timer
+	{
+		Timer() : fElem(this) {}
+
+		OSTimerWheelElem    fElem;
+		uint32_t            fIndex{ 0 };
+	};
+}
+
+TEST(OSTimerWheel, FiresInTimeOrderAndFIFOWithinATick)
+{
+	TestEnvironment::Initialize();
+
+	uint64_t theRandom = 88172645463325252ULL;
+	std::vector<Timer> theTimers(kNumTimers);
+	OSTimerWheel theWheel;
+	// Far enough out that none is due by the time the wheel catches up to now
+	int64_t theStartTime = OS::Milliseconds() + 1000;
+	for (uint32_t x = 0; x < kNumTimers; x += kTimersPerMilSec)
+	{
+		theRandom ^= theRandom << 13;
+		theRandom ^= theRandom >> 7;
+		theRandom ^= theRandom << 17;
+		int64_t theValue = theStartTime + 1 + (int64_t)(theRandom % kSpreadMilSecs);
+		for (uint32_t y = x; y < x + kTimersPerMilSec; y++)
+		{
+			theTimers[y].fIndex = y;
+			theTimers[y].fElem.SetValue(theValue);
+			theWheel.Insert(&theTimers[y].fElem);
+		}
+	}
+	ASSERT_EQ(theWheel.GetSize(), (uint32_t)kNumTimers);
+
+	Timer* thePrevious = nullptr;
+	uint32_t theNumFired = 0;
+	while (OSTimerWheelElem* theElem = theWheel.ExtractExpired(theStartTime + kSpreadMilSecs + 1))
+	{
+		Timer* theTimer = (Timer*)theElem->GetEnclosingObject();
+		if (thePrevious != nullptr)
+		{
+			ASSERT_LE(thePrevious->fElem.GetValue(), theElem->GetValue()) << "timer " << theTimer->fIndex;
+			if (thePrevious->fElem.GetValue() == theElem->GetValue() &&
+				thePrevious->fIndex / kTimersPerMilSec == theTimer->fIndex / kTimersPerMilSec)
+				ASSERT_LT(thePrevious->fIndex, theTimer->fIndex);
+		}
+		thePrevious = theTimer;
+		theNumFired++;
+	}
+
+	EXPECT_EQ(theNumFired, (uint32_t)kNumTimers);
+	EXPECT_EQ(theWheel.GetSize(), 0u);
+}
@@ -0,0 +1,100 @@
+/*
+	File:       RTPLossInjector.h
+
+	Contains:   Does to a run of RTP packets what a bad network does: loses
+				some, delivers some twice, and delivers some late, behind
+				packets sent after them. The same seed gives the same damage.
+
+				Shared by the reorder buffer test and benchmark.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+class RTPLossInjector
+{
+public:
+	struct Settings
+	{
+		double      fLoss{ 0 };             // chance a packet never arrives
+		double      fDuplicate{ 0 };        // chance it arrives twice
+		double      fReorder{ 0 };          // chance it arrives late
+		uint32_t    fMaxReorderDistance{ 4 };   // at most this many packets late
+	};
+
+	RTPLossInjector(const Settings& inSettings, uint32_t inSeed) : fSettings(inSettings), fRandom(inSeed) {}
+
+	// An RTP packet of inPacketLen bytes with this sequence number
+	static std::vector<char> MakePacket(uint16_t inSeqNumber, size_t inPacketLen)
+	{
+		std::vector<char> thePacket(std::max<size_t>(inPacketLen, 12), (char)0xAB);
+		thePacket[0] = (char)0x80;
+		thePacket[1] = 96;
+		thePacket[2] = (char)(inSeqNumber >> 8);
+		thePacket[3] = (char)(inSeqNumber & 0xFF);
+		return thePacket;
+	}
+
+	static uint16_t GetSeqNumber(const char* inPacket)
+	{
+		return (uint16_t)(((uint8_t)inPacket[2] << 8) | (uint8_t)inPacket[3]);
+	}
+
+	// The order in which inNumSent packets, sent one after the other, arrive:
+	// the index of the packet sent for every packet that arrives
+	std::vector<size_t> Inject(size_t inNumSent)
+	{
+		std::uniform_real_distribution<double> theChance(0, 1);
+		std::uniform_int_distribution<uint32_t> theDistance(1, std::max<uint32_t>(fSettings.fMaxReorderDistance, 1));
+
+		// Every copy that arrives gets the position it arrives at; a late one
+		// lands in between the packets sent after it
+		std::vector<std::pair<double, size_t>> theArrivals;
+		for (size_t x = 0; x < inNumSent; x++)
+		{
+			if (theChance(fRandom) < fSettings.fLoss)
+			{
+				fNumLost++;
+				continue;
+			}
+
+			double thePosition = (double)x;
+			if (theChance(fRandom) < fSettings.fReorder)
+			{
+				thePosition += theDistance(fRandom) + 0.5;
+				fNumReordered++;
+			}
+			theArrivals.emplace_back(thePosition, x);
+
+			if (theChance(fRandom) < fSettings.fDuplicate)
+			{
+				theArrivals.emplace_back(thePosition + theDistance(fRandom) - 0.25, x);
+				fNumDuplicated++;
+			}
+		}
+
+		std::stable_sort(theArrivals.begin(), theArrivals.end(),
+			[](const std::pair<double, size_t>& inA, const std::pair<double, size_t>& inB) { return inA.first < inB.first; });
+
+		std::vector<size_t> theOrder;
+		theOrder.reserve(theArrivals.size());
+		for (const auto& theArrival : theArrivals)
+			theOrder.push_back(theArrival.second);
+		return theOrder;
+	}
+
+	uint64_t    GetNumLost() const { return fNumLost; }
+	uint64_t    GetNumDuplicated() const { return fNumDuplicated; }
+	uint64_t    GetNumReordered() const { return fNumReordered; }
+
+private:
+	Settings        fSettings;
+	std::mt19937    fRandom;
+	uint64_t        fNumLost{ 0 };
+	uint64_t        fNumDuplicated{ 0 };
+	uint64_t        fNumReordered{ 0 };
+};
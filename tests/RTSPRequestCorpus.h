@@ -0,0 +1,115 @@
+/*
+	File:       RTSPRequestCorpus.h
+
+	Contains:   Requests the way real clients send them: ffmpeg and VLC
+				playing, ffmpeg and OBS style encoders publishing, and a
+				camera that is chatty with its headers.
+
+				Shared by the RTSPRequestParser tests and the parse
+				benchmark, and the seeds for the fuzz target.
+*/
+
+#pragma once
+
+namespace RTSPRequestCorpus
+{
+	const char* const kRequests[] =
+	{
+		// ffmpeg playing
+		"OPTIONS rtsp://192.168.1.10:554/live/cam1 RTSP/1.0\r\n"
+		"CSeq: 1\r\n"
+		"User-Agent: Lavf58.29.100\r\n"
+		"\r\n",
+
+		"DESCRIBE rtsp://192.168.1.10:554/live/cam1 RTSP/1.0\r\n"
+		"Accept: application/sdp\r\n"
+		"CSeq: 2\r\n"
+		"User-Agent: Lavf58.29.100\r\n"
+		"\r\n",
+
+		"SETUP rtsp://192.168.1.10:554/live/cam1/trackID=1 RTSP/1.0\r\n"
+		"Transport: RTP/AVP/UDP;unicast;client_port=23014-23015\r\n"
+		"CSeq: 3\r\n"
+		"User-Agent: Lavf58.29.100\r\n"
+		"\r\n",
+
+		"SETUP rtsp://192.168.1.10:554/live/cam1/trackID=2 RTSP/1.0\r\n"
+		"Transport: RTP/AVP/UDP;unicast;client_port=23016-23017\r\n"
+		"CSeq: 4\r\n"
+		"User-Agent: Lavf58.29.100\r\n"
+		"Session: 5cbd4b4e1a2c7f09\r\n"
+		"\r\n",
+
+		"PLAY rtsp://192.168.1.10:554/live/cam1 RTSP/1.0\r\n"
+		"Range: npt=0.000-\r\n"
+		"CSeq: 5\r\n"
+		"User-Agent: Lavf58.29.100\r\n"
+		"Session: 5cbd4b4e1a2c7f09\r\n"
+		"\r\n",
+
+		// VLC playing over TCP
+		"DESCRIBE rtsp://example.com/vod/movie.mp4 RTSP/1.0\r\n"
+		"CSeq: 3\r\n"
+		"User-Agent: LibVLC/3.0.8 (LIVE555 Streaming Media v2016.11.28)\r\n"
+		"Accept: application/sdp\r\n"
+		"\r\n",
+
+		"SETUP rtsp://example.com/vod/movie.mp4/trackID=1 RTSP/1.0\r\n"
+		"CSeq: 4\r\n"
+		"User-Agent: LibVLC/3.0.8 (LIVE555 Streaming Media v2016.11.28)\r\n"
+		"Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n"
+		"\r\n",
+
+		"PLAY rtsp://example.com/vod/movie.mp4/ RTSP/1.0\r\n"
+		"CSeq: 6\r\n"
+		"User-Agent: LibVLC/3.0.8 (LIVE555 Streaming Media v2016.11.28)\r\n"
+		"Session: 7AF2C19D\r\n"
+		"Range: npt=12.500-95.25\r\n"
+		"\r\n",
+
+		"TEARDOWN rtsp://example.com/vod/movie.mp4/ RTSP/1.0\r\n"
+		"CSeq: 7\r\n"
+		"User-Agent: LibVLC/3.0.8 (LIVE555 Streaming Media v2016.11.28)\r\n"
+		"Session: 7AF2C19D\r\n"
+		"\r\n",
+
+		// An encoder publishing
+		"ANNOUNCE rtsp://127.0.0.1:554/live/stream.sdp RTSP/1.0\r\n"
+		"Content-Type: application/sdp\r\n"
+		"CSeq: 2\r\n"
+		"User-Agent: Lavf58.29.100\r\n"
+		"Content-Length: 486\r\n"
+		"\r\n",
+
+		"SETUP rtsp://127.0.0.1:554/live/stream.sdp/streamid=0 RTSP/1.0\r\n"
+		"Transport: RTP/AVP/TCP;unicast;interleaved=0-1;mode=record\r\n"
+		"CSeq: 3\r\n"
+		"User-Agent: Lavf58.29.100\r\n"
+		"\r\n",
+
+		"RECORD rtsp://127.0.0.1:554/live/stream.sdp RTSP/1.0\r\n"
+		"Range: npt=0.000-\r\n"
+		"CSeq: 5\r\n"
+		"User-Agent: Lavf58.29.100\r\n"
+		"Session: 3b8a4f0c6d2e1a97\r\n"
+		"\r\n",
+
+		// A camera, with auth and the clock in the range
+		"PLAY rtsp://10.0.0.64/Streaming/Channels/101 RTSP/1.0\r\n"
+		"CSeq: 8\r\n"
+		"Authorization: Digest username=\"admin\", realm=\"IP Camera\", nonce=\"4e3c8f2b\", uri=\"rtsp://10.0.0.64/Streaming/Channels/101\", response=\"a1b2c3d4e5f60718293a4b5c6d7e8f90\"\r\n"
+		"User-Agent: NKPlayer-1.00.00.081112\r\n"
+		"Session: 1736252617\r\n"
+		"Range: npt=01:02:03.5-\r\n"
+		"Scale: 1.0\r\n"
+		"Speed: 1.0\r\n"
+		"x-Retransmit: our-retransmit\r\n"
+		"Bandwidth: 4000000\r\n"
+		"\r\n",
+
+		"GET_PARAMETER rtsp://10.0.0.64/Streaming/Channels/101 RTSP/1.0\r\n"
+		"CSeq: 9\r\n"
+		"Session: 1736252617\r\n"
+		"\r\n"
+	};
+}
@@ -0,0 +1,183 @@
+/*
+	File:       RTSPRequestParserTest.cpp
+
+	Contains:   Checks RTSPRequestParser against the Spirit grammar it
+				replaced, on the request corpus, and looks up the well known
+				headers by ID.
+
+				Also runs every corpus request through a few thousand
+				deterministic mutations, the way the fuzz target does, and
+				checks that whatever the parser hands back points into the
+				request.
+*/
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "LegacyRTSPRequestGrammar.h"
+#include "RTSPProtocol.h"
+#include "RTSPRequestCorpus.h"
+#include "RTSPRequestParser.h"
+
+namespace {
+
+	bool IsInside(boost::string_view inView, const std::string& inRequest)
+	{
+		return inView.empty() ||
+			((inView.data() >= inRequest.data()) && (inView.data() + inView.size() <= inRequest.data() + inRequest.size()));
+	}
+
+	// Everything the fuzz target checks besides not crashing
+	void CheckViews(const RTSPRequestParser& inParser, const std::string& inRequest)
+	{
+		ASSERT_TRUE(IsInside(inParser.GetMethod(), inRequest));
+		ASSERT_TRUE(IsInside(inParser.GetURI(), inRequest));
+		ASSERT_TRUE(IsInside(inParser.GetVersion(), inRequest));
+		ASSERT_LE(inParser.GetNumHeaders(), (size_t)RTSPRequestParser::kMaxHeaders);
+		for (size_t x = 0; x < inParser.GetNumHeaders(); x++)
+		{
+			ASSERT_TRUE(IsInside(inParser.GetHeader(x).fName, inRequest));
+			ASSERT_TRUE(IsInside(inParser.GetHeader(x).fValue, inRequest));
+		}
+	}
+
+	uint64_t NextRandom(uint64_t& ioState)
+	{
+		ioState ^= ioState << 13;
+		ioState ^= ioState >> 7;
+		ioState ^= ioState << 17;
+		return ioState;
+	}
+}
+
+TEST(RTSPRequestParser, MatchesTheLegacyGrammar)
+{
+	for (const char* theRequest : RTSPRequestCorpus::kRequests)
+	{
+		boost::string_view theView(theRequest);
+		RTSPRequestParser theParser;
+		LegacyRTSPRequestGrammar::RTSPRequestHeader theLegacy;
+		bool isLegacyOK = LegacyRTSPRequestGrammar::Parse(theView, &theLegacy);
+
+		// The grammar took +alpha for the method, so it turned GET_PARAMETER away
+		if (theView.starts_with("GET_PARAMETER"))
+		{
+			EXPECT_FALSE(isLegacyOK);
+			EXPECT_TRUE(theParser.Parse(theView));
+			EXPECT_EQ(theParser.GetMethod(), "GET_PARAMETER");
+			continue;
+		}
+
+		ASSERT_TRUE(isLegacyOK) << theRequest;
+		ASSERT_TRUE(theParser.Parse(theView)) << theRequest;
+		EXPECT_EQ(theParser.GetMethod(), theLegacy.method);
+		EXPECT_EQ(theParser.GetURI(), theLegacy.uri);
+		// The grammar dropped the "RTSP/", which RTSPProtocol::GetVersion wants
+		EXPECT_EQ(theParser.GetVersion(), "RTSP/" + theLegacy.rtsp_version);
+		EXPECT_EQ(RTSPProtocol::GetVersion(theParser.GetVersion()), RTSPProtocol::k10Version);
+
+		// The grammar kept the first of each name, in a map
+		LegacyRTSPRequestGrammar::header_fields_t theHeaders;
+		for (size_t x = 0; x < theParser.GetNumHeaders(); x++)
+			theHeaders.emplace(std::string(theParser.GetHeader(x).fName), std::string(theParser.GetHeader(x).fValue));
+		EXPECT_EQ(theHeaders, theLegacy.header_fields) << theRequest;
+	}
+}
+
+TEST(RTSPRequestParser, LooksUpWellKnownHeadersByID)
+{
+	RTSPRequestParser theParser;
+	ASSERT_TRUE(theParser.Parse(RTSPRequestCorpus::kRequests[3]));
+	EXPECT_EQ(theParser.GetHeaderValue(qtssTransportHeader), "RTP/AVP/UDP;unicast;client_port=23016-23017");
+	EXPECT_EQ(theParser.GetHeaderValue(qtssCSeqHeader), "4");
+	EXPECT_EQ(theParser.GetHeaderValue(qtssSessionHeader), "5cbd4b4e1a2c7f09");
+	EXPECT_EQ(theParser.GetHeaderValue(qtssUserAgentHeader), "Lavf58.29.100");
+	EXPECT_TRUE(theParser.GetHeaderValue(qtssRangeHeader).empty());
+
+	// Names are case insensitive, and the first of two is the one that counts
+	ASSERT_TRUE(theParser.Parse("PLAY rtsp://a/b RTSP/1.0\r\ncseq: 7\r\nCSEQ: 8\r\nrange:npt=1.5-  \r\n\r\n"));
+	EXPECT_EQ(theParser.GetHeaderValue(qtssCSeqHeader), "7");
+	EXPECT_EQ(theParser.GetHeaderValue(qtssRangeHeader), "npt=1.5-");
+	EXPECT_EQ(theParser.GetNumHeaders(), 3u);
+}
+
+TEST(RTSPRequestParser, TurnsAwayMalformedRequests)
+{
+	const char* const theRequests[] =
+	{
+		"",
+		"\r\n",
+		"OPTIONS * RTSP/1.0\r\nCSeq: 1\r\n",                // no empty line at the end
+		"OPTIONS * RTSP/1.0\r\n",
+		"OPTIONS RTSP/1.0\r\n\r\n",                         // no URI
+		"OPTIONS * HTTP/1.1\r\n\r\n",
+		"OPTIONS * RTSP/\r\n\r\n",
+		"OPTIONS * RTSP/1.0 x\r\n\r\n",
+		"OPTIONS * RTSP/1.0\r\nCSeq 1\r\n\r\n",             // no colon
+		"OPTIONS * RTSP/1.0\r\n: 1\r\n\r\n",                // no name
+		"OPTIONS * RTSP/1.0\r\nC Seq: 1\r\n\r\n"
+	};
+	for (const char* theRequest : theRequests)
+	{
+		RTSPRequestParser theParser;
+		EXPECT_FALSE(theParser.Parse(theRequest)) << theRequest;
+	}
+
+	// Bare LFs, and empty lines ahead of the request line, are fine
+	RTSPRequestParser theParser;
+	EXPECT_TRUE(theParser.Parse("\r\nOPTIONS * RTSP/1.0\nCSeq: 1\n\n"));
+	EXPECT_EQ(theParser.GetHeaderValue(qtssCSeqHeader), "1");
+}
+
+TEST(RTSPRequestParser, KeepsAtMostMaxHeaders)
+{
+	std::string theRequest = "OPTIONS * RTSP/1.0\r\n";
+	for (int x = 0; x < RTSPRequestParser::kMaxHeaders + 10; x++)
+		theRequest += "X-Header-" + std::to_string(x) + ": " + std::to_string(x) + "\r\n";
+	theRequest += "CSeq: 1\r\n\r\n";
+
+	RTSPRequestParser theParser;
+	ASSERT_TRUE(theParser.Parse(theRequest));
+	EXPECT_EQ(theParser.GetNumHeaders(), (size_t)RTSPRequestParser::kMaxHeaders);
+	EXPECT_TRUE(theParser.GetHeaderValue(qtssCSeqHeader).empty());
+}
+
+TEST(RTSPRequestParser, SurvivesMutatedRequests)
+{
+	enum { kMutationsPerRequest = 4000 };
+	const char theInteresting[] = { '\r', '\n', ' ', '\t', ':', '/', '.', '_', '-', '\0', (char)0xFF };
+
+	uint64_t theRandom = 88172645463325252ULL;
+	size_t theNumParsed = 0;
+	for (const char* theSeed : RTSPRequestCorpus::kRequests)
+	{
+		for (int theMutation = 0; theMutation < kMutationsPerRequest; theMutation++)
+		{
+			std::string theRequest(theSeed);
+			for (uint64_t theEdits = 1 + NextRandom(theRandom) % 4; theEdits > 0 && !theRequest.empty(); theEdits--)
+			{
+				size_t thePos = NextRandom(theRandom) % theRequest.size();
+				switch (NextRandom(theRandom) % 4)
+				{
+				case 0: theRequest[thePos] = theInteresting[NextRandom(theRandom) % sizeof(theInteresting)]; break;
+				case 1: theRequest[thePos] = (char)NextRandom(theRandom); break;
+				case 2: theRequest.erase(thePos, 1 + NextRandom(theRandom) % 8); break;
+				default: theRequest.resize(thePos); break;
+				}
+			}
+
+			RTSPRequestParser theParser;
+			if (theParser.Parse(theRequest))
+			{
+				theNumParsed++;
+				ASSERT_FALSE(theParser.GetMethod().empty());
+				ASSERT_FALSE(theParser.GetURI().empty());
+			}
+			CheckViews(theParser, theRequest);
+			if (::testing::Test::HasFatalFailure())
+				FAIL() << "mutation " << theMutation << ": " << theRequest;
+		}
+	}
+	::testing::Test::RecordProperty("mutations_parsed", (int)theNumParsed);
+}
@@ -0,0 +1,98 @@
+/*
+	File:       ReflectorBucketScheduleTest.cpp
+
+	Contains:   Tests for ReflectorBucketSchedule, which tells ReflectPackets
+				what each bucket of outputs is due, and how far behind an
+				output is.
+
+				A viewer that joins late starts with the GOP cache burst, whose
+				first packet arrived up to a GOP ago. That must not count as
+				being behind, or a TCP viewer that takes a while to get through
+				the burst is made to skip ahead as soon as it joins.
+*/
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "ReflectorBucketSchedule.h"
+
+namespace {
+
+	using Clock = ReflectorBucketSchedule::Clock;
+	using std::chrono::milliseconds;
+
+	Clock::time_point At(int64_t inMilSecs)
+	{
+		return Clock::time_point(milliseconds(inMilSecs));
+	}
+
+	enum
+	{
+		kBucketSize = 16,
+		kBucketDelayMilSecs = 73,
+		kMaxLagMilSecs = 1000       // ServerPrefs::GetReflectorMaxViewerLagMsec
+	};
+}
+
+TEST(ReflectorBucketSchedule, BucketsGetPacketsProgressivelyLater)
+{
+	ReflectorBucketSchedule theSchedule(At(10000), kBucketSize, milliseconds(kBucketDelayMilSecs));
+	EXPECT_EQ(theSchedule.GetBucket(0), 0u);
+	EXPECT_EQ(theSchedule.GetBucket(kBucketSize - 1), 0u);
+	EXPECT_EQ(theSchedule.GetBucket(kBucketSize), 1u);
+	EXPECT_EQ(theSchedule.GetDelay(3), milliseconds(3 * kBucketDelayMilSecs));
+	EXPECT_EQ(theSchedule.GetCutoff(0), At(10000));
+	EXPECT_EQ(theSchedule.GetCutoff(2), At(10000 - 2 * kBucketDelayMilSecs));
+	EXPECT_EQ(theSchedule.GetDueTime(At(9000), 2), At(9000 + 2 * kBucketDelayMilSecs));
+
+	// A packet every 10 ms from 9000 on, packet 0 long gone
+	std::vector<Clock::time_point> theArrivals;
+	for (int64_t x = 0; x < 100; x++)
+		theArrivals.push_back(At(9000 + x * 10));
+	auto theGetArrival = [&](uint64_t inSeq, Clock::time_point* outArrived) {
+		if (inSeq == 0)
+			return false;
+		*outArrived = theArrivals[inSeq];
+		return true;
+	};
+
+	// Bucket 0 gets everything up to now, bucket 2 what arrived by 9854
+	EXPECT_EQ(ReflectorBucketSchedule::FindFirstArrivedAfter(theSchedule.GetCutoff(0), 0, 100, theGetArrival), 100u);
+	EXPECT_EQ(ReflectorBucketSchedule::FindFirstArrivedAfter(theSchedule.GetCutoff(2), 0, 100, theGetArrival), 86u);
+	EXPECT_EQ(ReflectorBucketSchedule::FindFirstArrivedAfter(At(8000), 0, 100, theGetArrival), 1u);
+}
+
+TEST(ReflectorBucketSchedule, LagOfAViewerThatFellBehind)
+{
+	// Joined long ago, and is at a packet that arrived 1500 ms ago
+	ReflectorBucketSchedule theSchedule(At(60000), kBucketSize, milliseconds(kBucketDelayMilSecs));
+	EXPECT_EQ(theSchedule.GetLag(At(58500), 0, At(0)), milliseconds(1500));
+
+	// Its bucket's own delay isn't lag
+	EXPECT_EQ(theSchedule.GetLag(At(58500), 4, At(0)), milliseconds(1500 - 4 * kBucketDelayMilSecs));
+}
+
+TEST(ReflectorBucketSchedule, LateJoinerIsNotBehindOnItsGOPBurst)
+{
+	// The GOP started 1900 ms before the viewer joined at 50000
+	const int64_t kGOPStart = 48100;
+	const int64_t kJoin = 50000;
+
+	// Right when it joins, and 200 ms into the burst, it isn't behind at all
+	// by the GOP's age, which alone would be over the limit
+	ReflectorBucketSchedule theJoining(At(kJoin), kBucketSize, milliseconds(kBucketDelayMilSecs));
+	EXPECT_EQ(theJoining.GetLag(At(kGOPStart), 0, At(kJoin)), milliseconds(0));
+	ReflectorBucketSchedule theInBurst(At(kJoin + 200), kBucketSize, milliseconds(kBucketDelayMilSecs));
+	EXPECT_EQ(theInBurst.GetLag(At(kGOPStart), 0, At(kJoin)), milliseconds(200));
+	EXPECT_LT(theInBurst.GetLag(At(kGOPStart), 0, At(kJoin)).count(), kMaxLagMilSecs);
+	EXPECT_GT(std::chrono::duration_cast<milliseconds>(At(kJoin + 200) - At(kGOPStart)).count(), kMaxLagMilSecs);
+
+	// One that never gets through the burst does fall behind in the end
+	ReflectorBucketSchedule theStuck(At(kJoin + 1500), kBucketSize, milliseconds(kBucketDelayMilSecs));
+	EXPECT_GT(theStuck.GetLag(At(kGOPStart + 40), 0, At(kJoin)).count(), kMaxLagMilSecs);
+
+	// Packets that arrived after the join count from their arrival as before
+	EXPECT_EQ(theStuck.GetLag(At(kJoin + 100), 0, At(kJoin)), milliseconds(1400));
+	EXPECT_EQ(theStuck.GetLag(At(kJoin + 100), 2, At(kJoin)), milliseconds(1400 - 2 * kBucketDelayMilSecs));
+}
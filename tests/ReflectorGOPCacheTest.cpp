@@ -0,0 +1,176 @@
+/*
+	File:       ReflectorGOPCacheTest.cpp
+
+	Contains:   Replays a synthetic H.264 RTP stream into a ReflectorPacketRing
+				and its ReflectorGOPCache, the way ReflectorSender::appendPacket
+				does, and has viewers join at every frame of it.
+
+				A late joiner that starts at the GOP cache has to get a key
+				frame as its very first packet, and every packet after it up to
+				the live edge, even when the ring has wrapped past the GOP start.
+				Time to first key frame, in stream time, is reported for joining
+				at the cache and for joining at the live edge as before.
+*/
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "MyReflectorPacket.h"
+#include "ReflectorGOPCache.h"
+#include "ReflectorPacketRing.h"
+
+namespace {
+
+	enum
+	{
+		kFrameMilSecs = 40,         // 25 fps
+		kFramesPerGOP = 50,         // a key frame every 2 seconds
+		kNumGOPs = 6,
+		kPacketsPerKeyFrame = 24,
+		kPacketsPerFrame = 4,
+		kPacketLen = 1200
+	};
+
+	// SPS, PPS and an IDR split into FU-A packets, or a P frame in FU-A packets
+	void MakeFrame(bool inKeyFrame, std::vector<std::vector<char>>* outPackets)
+	{
+		auto thePacket = [&](std::vector<uint8_t> inNALHeader) {
+			std::vector<char> theData(kPacketLen, (char)0xAB);
+			theData[0] = (char)0x80;
+			theData[1] = 96;
+			std::fill(theData.begin() + 2, theData.begin() + 12, 0);
+			std::copy(inNALHeader.begin(), inNALHeader.end(), theData.begin() + 12);
+			outPackets->push_back(theData);
+		};
+
+		outPackets->clear();
+		if (inKeyFrame)
+		{
+			thePacket({ 0x67, 0x64, 0x00, 0x1F });                              // SPS
+			thePacket({ 0x68, 0xEE, 0x3C, 0x80 });                              // PPS
+			for (uint32_t x = 0; x < kPacketsPerKeyFrame - 2; x++)
+				thePacket({ 0x7C, (uint8_t)(x == 0 ? 0x85 : 0x05) });           // FU-A IDR
+		}
+		else
+		{
+			for (uint32_t x = 0; x < kPacketsPerFrame; x++)
+				thePacket({ 0x5C, (uint8_t)(x == 0 ? 0x81 : 0x01) });           // FU-A P frame
+		}
+	}
+
+	// Publishes like ReflectorSender::appendPacket: SPS, PPS and IDR packets
+	// in a row start one GOP
+	class SyntheticStream
+	{
+	public:
+		SyntheticStream(size_t inRingCapacity, size_t inGOPBudget)
+			: fRing(inRingCapacity), fGOPCache(&fRing, inGOPBudget) {}
+		~SyntheticStream() { fGOPCache.Clear(); }
+
+		void AppendFrame(uint32_t inFrame)
+		{
+			std::vector<std::vector<char>> thePackets;
+			MakeFrame(inFrame % kFramesPerGOP == 0, &thePackets);
+			for (const auto& theData : thePackets)
+			{
+				MyReflectorPacket* thePacket = fRing.Reserve();
+				thePacket->SetPacketData(theData.data(), theData.size());
+				bool isKeyFrame = IsKeyFrameFirstPacket(*thePacket);
+				bool startsGOP = isKeyFrame && !fLastPacketWasKeyFrame;
+				fLastPacketWasKeyFrame = isKeyFrame;
+
+				uint64_t theSeq = fRing.Publish(thePacket);
+				fGOPCache.Append(thePacket, theSeq, startsGOP);
+				fFrameOfSeq.push_back(inFrame);
+			}
+		}
+
+		ReflectorPacketRing     fRing;
+		ReflectorGOPCache       fGOPCache;
+		std::vector<uint32_t>   fFrameOfSeq;    // frame each sequence index belongs to
+		bool                    fLastPacketWasKeyFrame{ false };
+	};
+
+	MyReflectorPacket* Acquire(SyntheticStream& inStream, uint64_t inSeq)
+	{
+		MyReflectorPacket* thePacket = inStream.fRing.Acquire(inSeq);
+		if (thePacket == nullptr)
+			thePacket = inStream.fGOPCache.Acquire(inSeq);
+		return thePacket;
+	}
+}
+
+TEST(ReflectorGOPCache, LateJoinersStartAtAKeyFrame)
+{
+	// Smaller than one GOP, so the ring has always wrapped past the GOP start
+	SyntheticStream theStream(256, 4 * 1024 * 1024);
+
+	std::vector<int64_t> theCacheWaits;
+	std::vector<int64_t> theLiveWaits;
+	int64_t theLongestBurstMicroSecs = 0;
+	for (uint32_t theFrame = 0; theFrame < kFramesPerGOP * kNumGOPs; theFrame++)
+	{
+		theStream.AppendFrame(theFrame);
+		uint64_t theHead = theStream.fRing.Head();
+
+		uint64_t theStartSeq = theStream.fGOPCache.GetStartSeq();
+		ASSERT_NE(theStartSeq, ReflectorPacketRing::kInvalidSeq) << "frame " << theFrame;
+
+		// The burst a new output gets: the whole GOP so far, key frame first
+		auto theBurstStart = std::chrono::steady_clock::now();
+		for (uint64_t theSeq = theStartSeq; theSeq < theHead; theSeq++)
+		{
+			MyReflectorPacket* thePacket = Acquire(theStream, theSeq);
+			ASSERT_NE(thePacket, nullptr) << "frame " << theFrame << ", seq " << theSeq;
+			if (theSeq == theStartSeq)
+				EXPECT_TRUE(IsKeyFrameFirstPacket(*thePacket)) << "frame " << theFrame;
+			theStream.fRing.Release(thePacket);
+		}
+		theLongestBurstMicroSecs = std::max<int64_t>(theLongestBurstMicroSecs,
+			std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - theBurstStart).count());
+
+		// Starting at the cache shows the key frame right away. Starting at
+		// the live edge means waiting for the next one.
+		theCacheWaits.push_back(0);
+		theLiveWaits.push_back((int64_t)(kFramesPerGOP - theFrame % kFramesPerGOP) % kFramesPerGOP * kFrameMilSecs);
+	}
+
+	std::sort(theLiveWaits.begin(), theLiveWaits.end());
+	::printf("time to first key frame: %lld ms joining at the GOP cache, p50 %lld ms / max %lld ms joining at the live edge; longest GOP burst %lld us\n",
+		(long long)*std::max_element(theCacheWaits.begin(), theCacheWaits.end()),
+		(long long)theLiveWaits[theLiveWaits.size() / 2], (long long)theLiveWaits.back(), (long long)theLongestBurstMicroSecs);
+	::testing::Test::RecordProperty("live_edge_p50_ms", (int)theLiveWaits[theLiveWaits.size() / 2]);
+}
+
+TEST(ReflectorGOPCache, StartsOverAtEveryKeyFrame)
+{
+	SyntheticStream theStream(1024, 4 * 1024 * 1024);
+
+	for (uint32_t theFrame = 0; theFrame < kFramesPerGOP * 3; theFrame++)
+	{
+		theStream.AppendFrame(theFrame);
+		uint64_t theStartSeq = theStream.fGOPCache.GetStartSeq();
+		ASSERT_EQ(theStream.fFrameOfSeq[theStartSeq], theFrame - theFrame % kFramesPerGOP);
+	}
+}
+
+TEST(ReflectorGOPCache, DropsAGOPThatOutgrowsTheBudget)
+{
+	// Room for the key frame and a few P frames, not for the whole GOP
+	SyntheticStream theStream(1024, (kPacketsPerKeyFrame + 10 * kPacketsPerFrame) * kPacketLen);
+
+	for (uint32_t theFrame = 0; theFrame < kFramesPerGOP; theFrame++)
+	{
+		theStream.AppendFrame(theFrame);
+		if (theFrame <= 10)
+			EXPECT_EQ(theStream.fGOPCache.GetStartSeq(), 0u) << "frame " << theFrame;
+		else
+			EXPECT_EQ(theStream.fGOPCache.GetStartSeq(), ReflectorPacketRing::kInvalidSeq) << "frame " << theFrame;
+	}
+
+	// and picks up again at the next key frame
+	theStream.AppendFrame(kFramesPerGOP);
+	EXPECT_NE(theStream.fGOPCache.GetStartSeq(), ReflectorPacketRing::kInvalidSeq);
+}
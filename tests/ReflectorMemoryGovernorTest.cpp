@@ -0,0 +1,188 @@
+/*
+	File:       ReflectorMemoryGovernorTest.cpp
+
+	Contains:   Ingests 500 synthetic streams at bit rates from 100 kbit/s to
+				2 Mbit/s into a ReflectorPacketRing and ReflectorGOPCache each,
+				the way ReflectorSender::appendPacket does, and trims them with
+				a ReflectorRetention each after every tick, the way
+				ReflectorSender::RemoveOldPackets does.
+
+				Left to their per-stream budgets, the streams would hold more
+				than the ceiling. The process's RSS must not grow by more than
+				the ceiling all the same, and every stream must keep its GOP.
+*/
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "MyReflectorPacket.h"
+#include "ReflectorGOPCache.h"
+#include "ReflectorMemoryGovernor.h"
+#include "ReflectorPacketRing.h"
+#include "ReflectorRetention.h"
+
+namespace {
+
+	enum
+	{
+		kNumStreams = 500,
+		kRingCapacity = 8192,       // as ReflectorSender's
+		kGOPCacheBudget = 4 * 1024 * 1024,
+		kStreamBudget = 8 * 1024 * 1024,
+		kCeiling = 512 * 1024 * 1024,
+		kPacketLen = 1200,
+		kTickMilSecs = 20,
+		kTicksPerGOP = 50,          // a key frame every second
+		kNumTicks = 500             // 10 seconds
+	};
+
+	uint64_t GetResidentBytes()
+	{
+		FILE* theFile = std::fopen("/proc/self/statm", "r");
+		if (theFile == nullptr)
+			return 0;
+		unsigned long theSize = 0, theResident = 0;
+		int theNumRead = std::fscanf(theFile, "%lu %lu", &theSize, &theResident);
+		std::fclose(theFile);
+		return (theNumRead == 2) ? (uint64_t)theResident * (uint64_t)sysconf(_SC_PAGESIZE) : 0;
+	}
+
+	class SyntheticStream
+	{
+	public:
+		SyntheticStream(uint32_t inKbps)
+			: fRing(kRingCapacity), fGOPCache(&fRing, kGOPCacheBudget),
+			fRetention(&fRing, &fGOPCache, true), fBytesPerTick(inKbps * 1000 / 8 * kTickMilSecs / 1000) {}
+		~SyntheticStream() { fGOPCache.Clear(); }
+
+		void Tick(uint32_t inTick, std::chrono::high_resolution_clock::time_point inNow)
+		{
+			std::vector<char> theData(kPacketLen, (char)0xAB);
+			bool startsGOP = (inTick % kTicksPerGOP == 0);
+			for (fBytesOwed += fBytesPerTick; fBytesOwed >= kPacketLen; fBytesOwed -= kPacketLen)
+			{
+				MyReflectorPacket* thePacket = fRing.Reserve();
+				thePacket->SetPacketData(theData.data(), theData.size());
+				thePacket->SetArrival(inNow, fBytesAppended);
+				fBytesAppended += kPacketLen;
+
+				uint64_t theSeq = fRing.Publish(thePacket);
+				fGOPCache.Append(thePacket, theSeq, startsGOP);
+				if (startsGOP)
+					fKeyFrameSeq = theSeq;
+				startsGOP = false;
+			}
+
+			fRetention.Trim(fBytesAppended, fKeyFrameSeq, ReflectorPacketRing::kInvalidSeq, inNow);
+		}
+
+		// Whether every packet of the latest GOP can still be had
+		bool HasItsGOP()
+		{
+			for (uint64_t theSeq = fKeyFrameSeq; theSeq < fRing.Head(); theSeq++)
+			{
+				MyReflectorPacket* thePacket = fRing.Acquire(theSeq);
+				if (thePacket == nullptr)
+					thePacket = fGOPCache.Acquire(theSeq);
+				if (thePacket == nullptr)
+					return false;
+				fRing.Release(thePacket);
+			}
+			return true;
+		}
+
+		ReflectorPacketRing     fRing;
+		ReflectorGOPCache       fGOPCache;
+		ReflectorRetention      fRetention;
+		uint32_t                fBytesPerTick;
+		uint32_t                fBytesOwed{ 0 };
+		uint64_t                fBytesAppended{ 0 };
+		uint64_t                fKeyFrameSeq{ ReflectorPacketRing::kInvalidSeq };
+	};
+}
+
+TEST(ReflectorMemoryGovernor, FiveHundredStreamsStayUnderTheCeiling)
+{
+	ReflectorMemoryGovernor& theGovernor = ReflectorMemoryGovernor::GetInstance();
+	theGovernor.SetLimits(kStreamBudget, kCeiling);
+	uint64_t theStartResident = GetResidentBytes();
+	ASSERT_NE(theStartResident, 0u);
+
+	std::vector<std::unique_ptr<SyntheticStream>> theStreams;
+	uint64_t theTotalKbps = 0;
+	for (uint32_t x = 0; x < kNumStreams; x++)
+	{
+		uint32_t theKbps = 100 + (x * 7 % 20) * 100;
+		theStreams.push_back(std::make_unique<SyntheticStream>(theKbps));
+		theTotalKbps += theKbps;
+	}
+
+	// Without the ceiling, every stream would keep all it took in
+	uint64_t theUncappedBytes = theTotalKbps * 1000 / 8 * kNumTicks * kTickMilSecs / 1000;
+	ASSERT_GT(theUncappedBytes, (uint64_t)kCeiling);
+
+	auto theNow = std::chrono::high_resolution_clock::now();
+	uint64_t thePeakResident = theStartResident;
+	uint64_t theLowestBudget = kStreamBudget;
+	for (uint32_t theTick = 0; theTick < kNumTicks; theTick++)
+	{
+		// The streams' key frames don't all come at once
+		for (uint32_t x = 0; x < kNumStreams; x++)
+			theStreams[x]->Tick(theTick + x, theNow);
+		theNow += std::chrono::milliseconds(kTickMilSecs);
+
+		thePeakResident = std::max(thePeakResident, GetResidentBytes());
+		theLowestBudget = std::min(theLowestBudget, theGovernor.GetStreamBudget());
+		ASSERT_LE(theGovernor.GetAllocatedBytes(), (uint64_t)kCeiling) << "tick " << theTick;
+	}
+
+	EXPECT_TRUE(theGovernor.IsUnderPressure());
+	EXPECT_LT(theLowestBudget, (uint64_t)kStreamBudget);
+	EXPECT_LT(thePeakResident - theStartResident, (uint64_t)kCeiling);
+	for (uint32_t x = 0; x < kNumStreams; x++)
+		EXPECT_TRUE(theStreams[x]->HasItsGOP()) << "stream " << x;
+
+	::testing::Test::RecordProperty("peak_rss_growth_MB", (int)((thePeakResident - theStartResident) >> 20));
+	::testing::Test::RecordProperty("allocated_MB", (int)(theGovernor.GetAllocatedBytes() >> 20));
+	::testing::Test::RecordProperty("retained_MB", (int)(theGovernor.GetRetainedBytes() >> 20));
+	::testing::Test::RecordProperty("stream_budget_kB", (int)(theGovernor.GetStreamBudget() >> 10));
+
+	theStreams.clear();
+	EXPECT_EQ(theGovernor.GetAllocatedBytes(), 0u);
+	EXPECT_EQ(theGovernor.GetRetainedBytes(), 0u);
+	EXPECT_FALSE(theGovernor.IsUnderPressure());
+}
+
+TEST(ReflectorMemoryGovernor, TrimmedSlabsGoBackUnderPressure)
+{
+	auto theSlabsAfterTrim = [](bool inKeepSpare) {
+		ReflectorPacketRing theRing(kRingCapacity);
+		theRing.SetKeepSpareSlabs(inKeepSpare);
+		std::vector<char> theData(kPacketLen, (char)0xAB);
+		auto thePublish = [&]() {
+			MyReflectorPacket* thePacket = theRing.Reserve();
+			thePacket->SetPacketData(theData.data(), theData.size());
+			theRing.Publish(thePacket);
+		};
+
+		for (uint32_t x = 0; x < 4000; x++)
+			thePublish();
+		theRing.Trim(theRing.Head() - 100);
+
+		// The ring recycles what was trimmed on the next publish, well before
+		// it would look for idle slabs anyway
+		for (uint32_t x = 0; x < 50; x++)
+			thePublish();
+		return theRing.GetNumAllocatedPackets();
+	};
+
+	size_t theKeptSpare = theSlabsAfterTrim(true);
+	size_t theGaveBack = theSlabsAfterTrim(false);
+	EXPECT_GE(theKeptSpare, 4000u);
+	EXPECT_LT(theGaveBack, 1000u);
+}
@@ -0,0 +1,89 @@
+/*
+	File:       ReflectorPacketRingTest.cpp
+
+	Contains:   Publishes into a ReflectorPacketRing while a reader's bookmark
+				pins it, the way ReflectorSender sets the ring's low water mark
+				to its oldest output bookmark.
+
+				A pinned ring keeps what wraps around aside, but never more than
+				its capacity of it: however long the reader stays put, the ring
+				holds at most twice its capacity in packets, and the reader's
+				bookmark ends up behind Tail().
+*/
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "MyReflectorPacket.h"
+#include "ReflectorPacketRing.h"
+
+namespace {
+
+	enum
+	{
+		kRingCapacity = 1024,
+		kPacketLen = 1200,
+		kPacketsPerSlab = 64        // as ReflectorPacketRing's
+	};
+
+	void Publish(ReflectorPacketRing* inRing, uint32_t inNumPackets)
+	{
+		std::vector<char> theData(kPacketLen, (char)0xAB);
+		for (uint32_t x = 0; x < inNumPackets; x++)
+		{
+			MyReflectorPacket* thePacket = inRing->Reserve();
+			thePacket->SetPacketData(theData.data(), theData.size());
+			inRing->Publish(thePacket);
+		}
+	}
+
+	bool CanAcquire(ReflectorPacketRing* inRing, uint64_t inSeq)
+	{
+		MyReflectorPacket* thePacket = inRing->Acquire(inSeq);
+		if (thePacket == nullptr)
+			return false;
+		inRing->Release(thePacket);
+		return true;
+	}
+}
+
+TEST(ReflectorPacketRing, KeepsWhatAPinnedReaderStillNeeds)
+{
+	ReflectorPacketRing theRing(kRingCapacity);
+	theRing.SetLowWaterSeq(0);
+	Publish(&theRing, kRingCapacity + kRingCapacity / 2);
+
+	EXPECT_EQ(theRing.Tail(), 0u);
+	for (uint64_t theSeq = 0; theSeq < theRing.Head(); theSeq++)
+		ASSERT_TRUE(CanAcquire(&theRing, theSeq)) << "seq " << theSeq;
+
+	// Once the reader moves on, so does the ring
+	theRing.SetLowWaterSeq(theRing.Head());
+	Publish(&theRing, 1);
+	EXPECT_EQ(theRing.Tail(), theRing.Head() - kRingCapacity);
+	EXPECT_FALSE(CanAcquire(&theRing, 0));
+}
+
+TEST(ReflectorPacketRing, OverflowStaysWithinTheCapacity)
+{
+	ReflectorPacketRing theRing(kRingCapacity);
+	theRing.SetLowWaterSeq(0);
+	size_t thePeakPackets = 0;
+	for (uint32_t x = 0; x < 3 * kRingCapacity / kPacketsPerSlab; x++)
+	{
+		Publish(&theRing, kPacketsPerSlab);
+		thePeakPackets = std::max(thePeakPackets, theRing.GetNumAllocatedPackets());
+	}
+
+	// The reader at 0 has fallen too far behind and has to start over
+	uint64_t theHead = theRing.Head();
+	EXPECT_EQ(theRing.Tail(), theHead - 2 * kRingCapacity);
+	EXPECT_FALSE(CanAcquire(&theRing, 0));
+	for (uint64_t theSeq = theRing.Tail(); theSeq < theHead; theSeq++)
+		ASSERT_TRUE(CanAcquire(&theRing, theSeq)) << "seq " << theSeq;
+
+	// Twice the capacity, plus the packets being published and a spare slab
+	EXPECT_LE(thePeakPackets, (size_t)(2 * kRingCapacity + 2 * kPacketsPerSlab));
+	::testing::Test::RecordProperty("peak_packets", (int)thePeakPackets);
+}
@@ -0,0 +1,156 @@
+/*
+	File:       ReflectorReorderBufferTest.cpp
+
+	Contains:   Runs RTP streams damaged by RTPLossInjector through a
+				ReflectorReorderBuffer, one packet arriving every millisecond.
+
+				Every packet that arrives has to be handed on exactly once, and
+				in sequence number order unless the buffer says it was late. No
+				packet may be held longer than the maximum hold time.
+*/
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "ReflectorReorderBuffer.h"
+#include "RTPLossInjector.h"
+
+namespace {
+
+	enum
+	{
+		kNumPackets = 200000,       // wraps the sequence numbers around 3 times
+		kFirstSeqNumber = 65000,
+		kPacketLen = 200,
+		kWindow = 16,
+		kMaxHoldMilSecs = 40        // ServerPrefs::GetReflectorReorderMaxHoldMsec
+	};
+
+	struct Result
+	{
+		std::vector<uint32_t>   fTimesHandedOn;     // by packet sent
+		uint64_t                fNumOutOfOrder{ 0 };
+		int64_t                 fMaxHeldMilSecs{ 0 };
+		double                  fMeanHeldMilSecs{ 0 };
+	};
+
+	Result Replay(RTPLossInjector* ioInjector, ReflectorReorderBuffer* ioBuffer)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+		Result theResult;
+		theResult.fTimesHandedOn.resize(kNumPackets);
+
+		std::vector<size_t> theOrder = ioInjector->Inject(kNumPackets);
+		std::vector<Clock::time_point> theArrivals(kNumPackets);
+		Clock::time_point theNow;
+		uint16_t theLastSeqNumber = kFirstSeqNumber - 1;
+		int64_t theTotalHeld = 0;
+		uint64_t theNumHandedOn = 0;
+
+		auto theDeliver = [&](const char* inPacket, size_t inPacketLen) {
+			ASSERT_EQ(inPacketLen, (size_t)kPacketLen);
+			uint16_t theSeqNumber = RTPLossInjector::GetSeqNumber(inPacket);
+			size_t theIndex = (uint16_t)(theSeqNumber - kFirstSeqNumber);
+			// The stream wraps, the packets a window holds don't
+			while (theIndex + 32768 < theNumHandedOn)
+				theIndex += 65536;
+			theResult.fTimesHandedOn[theIndex]++;
+
+			if ((int16_t)(theSeqNumber - theLastSeqNumber) <= 0)
+				theResult.fNumOutOfOrder++;
+			else
+				theLastSeqNumber = theSeqNumber;
+
+			int64_t theHeld = std::chrono::duration_cast<std::chrono::milliseconds>(theNow - theArrivals[theIndex]).count();
+			theResult.fMaxHeldMilSecs = std::max(theResult.fMaxHeldMilSecs, theHeld);
+			theTotalHeld += theHeld;
+			theNumHandedOn++;
+		};
+
+		for (size_t theIndex : theOrder)
+		{
+			theNow += std::chrono::milliseconds(1);
+			// ReflectorSocket::Run gets to the expired ones before reading more
+			ioBuffer->Expire(theNow, theDeliver);
+			if (theResult.fTimesHandedOn[theIndex] == 0)
+				theArrivals[theIndex] = theNow;
+			std::vector<char> thePacket = RTPLossInjector::MakePacket((uint16_t)(kFirstSeqNumber + theIndex), kPacketLen);
+			ioBuffer->Push(thePacket.data(), thePacket.size(), theNow, theDeliver);
+		}
+		theNow += std::chrono::milliseconds(kMaxHoldMilSecs);
+		ioBuffer->Expire(theNow, theDeliver);
+
+		theResult.fMeanHeldMilSecs = theNumHandedOn ? (double)theTotalHeld / theNumHandedOn : 0;
+		return theResult;
+	}
+}
+
+TEST(ReflectorReorderBuffer, PassesACleanStreamStraightThrough)
+{
+	RTPLossInjector::Settings theSettings;
+	RTPLossInjector theInjector(theSettings, 1);
+	ReflectorReorderBuffer theBuffer(kWindow, std::chrono::milliseconds(kMaxHoldMilSecs));
+	Result theResult = Replay(&theInjector, &theBuffer);
+
+	for (size_t x = 0; x < kNumPackets; x++)
+		ASSERT_EQ(theResult.fTimesHandedOn[x], 1u) << x;
+	EXPECT_EQ(theResult.fNumOutOfOrder, 0u);
+	EXPECT_EQ(theResult.fMaxHeldMilSecs, 0);
+	EXPECT_EQ(theBuffer.GetNumDuplicates(), 0u);
+	EXPECT_EQ(theBuffer.GetNumLost(), 0u);
+}
+
+TEST(ReflectorReorderBuffer, DropsDuplicatesAndReorders)
+{
+	RTPLossInjector::Settings theSettings;
+	theSettings.fDuplicate = 0.02;
+	theSettings.fReorder = 0.05;
+	theSettings.fMaxReorderDistance = 4;
+	RTPLossInjector theInjector(theSettings, 2);
+	ReflectorReorderBuffer theBuffer(kWindow, std::chrono::milliseconds(kMaxHoldMilSecs));
+	Result theResult = Replay(&theInjector, &theBuffer);
+
+	// Nothing is lost, so every gap fills well within the window and hold
+	// time: a late packet is at most that many packets late, each of which
+	// may have come with a duplicate of an earlier one
+	for (size_t x = 0; x < kNumPackets; x++)
+		ASSERT_EQ(theResult.fTimesHandedOn[x], 1u) << x;
+	EXPECT_EQ(theBuffer.GetNumDuplicates(), theInjector.GetNumDuplicated());
+	EXPECT_EQ(theResult.fNumOutOfOrder, 0u);
+	EXPECT_EQ(theBuffer.GetNumLate(), 0u);
+	EXPECT_EQ(theBuffer.GetNumLost(), 0u);
+	EXPECT_LE(theResult.fMaxHeldMilSecs, 2 * (int64_t)theSettings.fMaxReorderDistance + 2);
+	::testing::Test::RecordProperty("mean_held_us", (int)(theResult.fMeanHeldMilSecs * 1000));
+}
+
+TEST(ReflectorReorderBuffer, GivesUpOnLostPacketsInTime)
+{
+	RTPLossInjector::Settings theSettings;
+	theSettings.fLoss = 0.01;
+	theSettings.fDuplicate = 0.02;
+	theSettings.fReorder = 0.05;
+	theSettings.fMaxReorderDistance = 4;
+	RTPLossInjector theInjector(theSettings, 3);
+	ReflectorReorderBuffer theBuffer(kWindow, std::chrono::milliseconds(kMaxHoldMilSecs));
+	Result theResult = Replay(&theInjector, &theBuffer);
+
+	// What arrived at all is handed on once, even when the buffer had
+	// already given up on it
+	uint64_t theNumMissing = 0;
+	for (size_t x = 0; x < kNumPackets; x++)
+	{
+		ASSERT_LE(theResult.fTimesHandedOn[x], 1u) << x;
+		theNumMissing += (theResult.fTimesHandedOn[x] == 0);
+	}
+	EXPECT_EQ(theNumMissing, theInjector.GetNumLost());
+	EXPECT_EQ(theBuffer.GetNumDuplicates(), theInjector.GetNumDuplicated());
+	EXPECT_GE(theBuffer.GetNumLost(), theNumMissing);
+
+	// Only what the buffer gave up on comes out of order, and not much of it
+	EXPECT_EQ(theResult.fNumOutOfOrder, theBuffer.GetNumLate());
+	EXPECT_LT(theBuffer.GetNumLate(), (uint64_t)kNumPackets / 1000);
+	EXPECT_LE(theResult.fMaxHeldMilSecs, (int64_t)kMaxHoldMilSecs);
+	::testing::Test::RecordProperty("late", (int)theBuffer.GetNumLate());
+	::testing::Test::RecordProperty("mean_held_us", (int)(theResult.fMeanHeldMilSecs * 1000));
+}
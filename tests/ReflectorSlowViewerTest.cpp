@@ -0,0 +1,266 @@
+/*
+	File:       ReflectorSlowViewerTest.cpp
+
+	Contains:   One throttled viewer among fast ones on an 8 Mbit/s stream with
+				a key frame every second. Ingests into a ReflectorPacketRing and
+				ReflectorGOPCache, and trims with a ReflectorRetention, the way
+				ReflectorSender does, and hands the packets out to the viewers
+				in one bucket, the way ReflectPackets does, with the congestion
+				rules of ReflectorViewerLag.
+
+				ReflectorSender itself needs ServerPrefs and a ReflectorSession,
+				so its round of writes is played here in simulated time: a fast
+				viewer takes everything it is due, the throttled one half of it.
+
+				The throttled viewer has to stay within the lag limits, so what
+				it pins is bounded by them instead of by the stream's retention
+				budget, and it must not make the stream hold or allocate more
+				than fast viewers alone do. The fast viewers must get every
+				packet, in order, in the round it arrived.
+*/
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "MyReflectorPacket.h"
+#include "ReflectorBucketSchedule.h"
+#include "ReflectorGOPCache.h"
+#include "ReflectorMemoryGovernor.h"
+#include "ReflectorOutput.h"
+#include "ReflectorPacketRing.h"
+#include "ReflectorRetention.h"
+#include "ReflectorViewerLag.h"
+
+namespace {
+
+	using Clock = ReflectorBucketSchedule::Clock;
+
+	enum
+	{
+		kRingCapacity = 8192,           // as ReflectorSender's
+		kGOPCacheBudget = 4 * 1024 * 1024,
+		kStreamBudget = 8192 * 1024,    // ServerPrefs::GetReflectorStreamRetentionInK
+		kMaxLagMilSecs = 1000,          // ServerPrefs::GetReflectorMaxViewerLagMsec
+		kMaxLagInK = 2048,              // ServerPrefs::GetReflectorMaxViewerLagInK
+		kBucketSize = 16,
+		kBucketDelayMilSecs = 73,
+		kPacketLen = 1250,
+		kPacketsPerTick = 16,           // 8 Mbit/s
+		kTickMilSecs = 20,
+		kTicksPerGOP = 50,
+		kNumTicks = 1500,               // 30 seconds
+		kNumViewers = 16,               // one bucket
+		kSlowViewer = 7
+	};
+
+	struct Viewer
+	{
+		ReflectorOutput::BookMark   fBookMark;
+		uint32_t                    fPacketsPerTick{ UINT32_MAX };
+		uint64_t                    fNumDelivered{ 0 };
+		uint64_t                    fLastSeq{ ReflectorPacketRing::kInvalidSeq };
+		uint32_t                    fNumSkips{ 0 };
+		uint64_t                    fPeakBytesBehind{ 0 };
+		bool                        fInOrder{ true };
+	};
+
+	struct Result
+	{
+		std::vector<Viewer>         fViewers;
+		uint64_t                    fPeakRetained{ 0 };
+		uint64_t                    fPeakAllocated{ 0 };
+		bool                        fFastAlwaysCaughtUp{ true };
+	};
+
+	class SlowViewerStream
+	{
+	public:
+		SlowViewerStream(const ReflectorViewerLag& inLimits)
+			: fLimits(inLimits), fRing(kRingCapacity), fGOPCache(&fRing, kGOPCacheBudget), fRetention(&fRing, &fGOPCache, true) {}
+		~SlowViewerStream() { fGOPCache.Clear(); }
+
+		Result Run(bool inHasSlowViewer)
+		{
+			Result theResult;
+			theResult.fViewers.resize(kNumViewers);
+			for (auto& theViewer : theResult.fViewers)
+			{
+				theViewer.fBookMark.fSender = this;
+				theViewer.fBookMark.fJoinTime = fNow;
+			}
+			if (inHasSlowViewer)
+				theResult.fViewers[kSlowViewer].fPacketsPerTick = kPacketsPerTick / 2;
+
+			for (uint32_t theTick = 0; theTick < kNumTicks; theTick++)
+			{
+				this->Ingest(theTick % kTicksPerGOP == 0);
+				this->Reflect(&theResult);
+
+				theResult.fPeakRetained = std::max(theResult.fPeakRetained, fRetention.GetRetainedBytes());
+				theResult.fPeakAllocated = std::max(theResult.fPeakAllocated, fRetention.GetAllocatedBytes());
+				fNow += std::chrono::milliseconds(kTickMilSecs);
+			}
+			return theResult;
+		}
+
+	private:
+		void Ingest(bool inStartsGOP)
+		{
+			std::vector<char> theData(kPacketLen, (char)0xAB);
+			for (uint32_t x = 0; x < kPacketsPerTick; x++)
+			{
+				MyReflectorPacket* thePacket = fRing.Reserve();
+				thePacket->SetPacketData(theData.data(), theData.size());
+				thePacket->SetArrival(fNow, fBytesAppended);
+				fBytesAppended += kPacketLen;
+
+				uint64_t theSeq = fRing.Publish(thePacket);
+				fGOPCache.Append(thePacket, theSeq, inStartsGOP);
+				if (inStartsGOP)
+					fKeyFrameSeq = theSeq;
+				inStartsGOP = false;
+			}
+		}
+
+		MyReflectorPacket* Acquire(uint64_t inSeq)
+		{
+			MyReflectorPacket* thePacket = fRing.Acquire(inSeq);
+			if (thePacket == nullptr)
+				thePacket = fGOPCache.Acquire(inSeq);
+			return thePacket;
+		}
+
+		void Reflect(Result* ioResult)
+		{
+			ReflectorBucketSchedule theSchedule(fNow, kBucketSize, std::chrono::milliseconds(kBucketDelayMilSecs));
+			uint64_t theHead = fRing.Head();
+			uint64_t theTail = std::min(fRing.Tail(), fGOPCache.GetStartSeq());
+			uint64_t theFirstSeq = (fGOPCache.GetStartSeq() != ReflectorPacketRing::kInvalidSeq) ? fGOPCache.GetStartSeq() : theTail;
+			uint64_t theOldestBookmark = theHead;
+
+			for (size_t theIndex = 0; theIndex < ioResult->fViewers.size(); theIndex++)
+			{
+				Viewer& theViewer = ioResult->fViewers[theIndex];
+				ReflectorOutput::BookMark& theBookMark = theViewer.fBookMark;
+				if (theBookMark.fSeq < theTail)
+				{
+					// Fell off the ring, starts over at the cached GOP
+					theViewer.fNumSkips++;
+					theBookMark.fSeq = theFirstSeq;
+					theBookMark.fAwaitingKeyFrame = false;
+				}
+
+				if (theBookMark.fAwaitingKeyFrame)
+					theBookMark.fAwaitingKeyFrame = ReflectorViewerLag::AwaitKeyFrame(fKeyFrameSeq, &theBookMark.fSeq);
+
+				if (!theBookMark.fAwaitingKeyFrame)
+				{
+					for (uint32_t theNumSent = 0; (theBookMark.fSeq < theHead) && (theNumSent < theViewer.fPacketsPerTick); theNumSent++)
+					{
+						MyReflectorPacket* thePacket = this->Acquire(theBookMark.fSeq);
+						if (thePacket != nullptr)
+						{
+							if (theViewer.fLastSeq != ReflectorPacketRing::kInvalidSeq && theBookMark.fSeq != theViewer.fLastSeq + 1)
+								theViewer.fInOrder = false;
+							theViewer.fLastSeq = theBookMark.fSeq;
+							theViewer.fNumDelivered++;
+							fRing.Release(thePacket);
+						}
+						theBookMark.fSeq++;
+					}
+
+					uint64_t theBytesBehind = 0;
+					std::chrono::milliseconds theLag(0);
+					if (MyReflectorPacket* thePacket = (theBookMark.fSeq < theHead) ? this->Acquire(theBookMark.fSeq) : nullptr)
+					{
+						// A tick's packets all arrive together, and are all the same size
+						auto theArrived = fStart + std::chrono::milliseconds(theBookMark.fSeq / kPacketsPerTick * kTickMilSecs);
+						uint64_t theByteOffset = theBookMark.fSeq * kPacketLen;
+						theLag = theSchedule.GetLag(theArrived, theSchedule.GetBucket(theIndex), theBookMark.fJoinTime);
+						theBytesBehind = fBytesAppended - std::max(theByteOffset, theBookMark.fJoinByteOffset);
+						fRing.Release(thePacket);
+					}
+					theViewer.fPeakBytesBehind = std::max(theViewer.fPeakBytesBehind, theBytesBehind);
+
+					if (fLimits.IsCongested(theLag, theBytesBehind))
+					{
+						theViewer.fNumSkips++;
+						theBookMark.fAwaitingKeyFrame = ReflectorViewerLag::SkipToKeyFrame(fKeyFrameSeq, &theBookMark.fSeq, theHead);
+					}
+				}
+
+				if ((theViewer.fPacketsPerTick == UINT32_MAX) && (theBookMark.fSeq != theHead))
+					ioResult->fFastAlwaysCaughtUp = false;
+				theOldestBookmark = std::min(theOldestBookmark, theBookMark.fSeq);
+			}
+
+			fRing.SetLowWaterSeq(theOldestBookmark);
+			fRetention.Trim(fBytesAppended, fKeyFrameSeq, theOldestBookmark, fNow);
+		}
+
+		ReflectorViewerLag      fLimits;
+		ReflectorPacketRing     fRing;
+		ReflectorGOPCache       fGOPCache;
+		ReflectorRetention      fRetention;
+		Clock::time_point       fStart{ Clock::now() };
+		Clock::time_point       fNow{ fStart };
+		uint64_t                fBytesAppended{ 0 };
+		uint64_t                fKeyFrameSeq{ ReflectorPacketRing::kInvalidSeq };
+	};
+
+	Result RunStream(const ReflectorViewerLag& inLimits, bool inHasSlowViewer)
+	{
+		SlowViewerStream theStream(inLimits);
+		return theStream.Run(inHasSlowViewer);
+	}
+}
+
+TEST(ReflectorSlowViewer, ThrottledViewerStaysBoundedAndFastViewersUndisturbed)
+{
+	ReflectorMemoryGovernor::GetInstance().SetLimits(kStreamBudget, 0);
+	ReflectorViewerLag theLimits(std::chrono::milliseconds(kMaxLagMilSecs), (uint64_t)kMaxLagInK * 1024);
+	const uint64_t kBytesPerTick = kPacketsPerTick * kPacketLen;
+	const uint64_t kNumPackets = (uint64_t)kNumTicks * kPacketsPerTick;
+
+	Result theFastOnly = RunStream(theLimits, false);
+	Result theThrottled = RunStream(theLimits, true);
+
+	// Every fast viewer gets every packet, in order, in the round it came in
+	EXPECT_TRUE(theThrottled.fFastAlwaysCaughtUp);
+	for (uint32_t x = 0; x < kNumViewers; x++)
+	{
+		if (x == kSlowViewer)
+			continue;
+		const Viewer& theViewer = theThrottled.fViewers[x];
+		EXPECT_EQ(theViewer.fNumDelivered, kNumPackets) << "viewer " << x;
+		EXPECT_TRUE(theViewer.fInOrder) << "viewer " << x;
+		EXPECT_EQ(theViewer.fNumSkips, 0u) << "viewer " << x;
+	}
+
+	// The throttled one keeps skipping ahead, and never pins more than the
+	// limits let it
+	const Viewer& theSlow = theThrottled.fViewers[kSlowViewer];
+	EXPECT_GT(theSlow.fNumSkips, 0u);
+	EXPECT_GT(theSlow.fNumDelivered, kNumPackets / 4);
+	EXPECT_LE(theSlow.fPeakBytesBehind, (uint64_t)kMaxLagInK * 1024 + kBytesPerTick);
+
+	// and the stream holds no more than for fast viewers alone
+	EXPECT_LE(theThrottled.fPeakRetained, theFastOnly.fPeakRetained + kBytesPerTick);
+	EXPECT_LE(theThrottled.fPeakAllocated, theFastOnly.fPeakAllocated);
+
+	// Without the limits, it would pin all the stream's budget
+	Result theUnlimited = RunStream(ReflectorViewerLag(std::chrono::milliseconds(0), 0), true);
+	EXPECT_GT(theUnlimited.fViewers[kSlowViewer].fPeakBytesBehind, (uint64_t)kMaxLagInK * 1024 * 2);
+	EXPECT_TRUE(theUnlimited.fFastAlwaysCaughtUp);
+
+	::printf("throttled viewer: %llu of %llu packets, %u skips, peak %llu kB behind (%llu kB without limits); "
+		"retained peak %llu kB, %llu kB with fast viewers only\n",
+		(unsigned long long)theSlow.fNumDelivered, (unsigned long long)kNumPackets, theSlow.fNumSkips,
+		(unsigned long long)(theSlow.fPeakBytesBehind >> 10), (unsigned long long)(theUnlimited.fViewers[kSlowViewer].fPeakBytesBehind >> 10),
+		(unsigned long long)(theThrottled.fPeakRetained >> 10), (unsigned long long)(theFastOnly.fPeakRetained >> 10));
+	::testing::Test::RecordProperty("slow_peak_kB_behind", (int)(theSlow.fPeakBytesBehind >> 10));
+	::testing::Test::RecordProperty("peak_retained_kB", (int)(theThrottled.fPeakRetained >> 10));
+}
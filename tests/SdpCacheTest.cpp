@@ -0,0 +1,167 @@
+/*
+	File:       SdpCacheTest.cpp
+
+	Contains:   Tests for CSdpCache, where ANNOUNCE leaves the SDP of a stream
+				and DESCRIBE picks it up, rendered once per announced version.
+
+				The stress test has publishers re-announcing a few streams while
+				readers DESCRIBE them the way DoDescribe does: take the entry,
+				render it if nobody has, and hand the rendering back. A reader
+				must never get a rendering of another version than the entry it
+				holds, nor an entry whose rendering goes with another SDP.
+*/
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "DescribeSDP.h"
+#include "sdpCache.h"
+
+namespace {
+
+	// Each announce carries its number in the session name, which survives
+	// the rendering
+	std::string MakeSDP(uint64_t inAnnounce)
+	{
+		return "v=0\r\n"
+			"o=- 0 0 IN IP4 127.0.0.1\r\n"
+			"s=announce " + std::to_string(inAnnounce) + "\r\n"
+			"c=IN IP4 127.0.0.1\r\n"
+			"t=0 0\r\n"
+			"m=video 0 RTP/AVP 96\r\n"
+			"a=rtpmap:96 H264/90000\r\n"
+			"a=control:trackID=1\r\n";
+	}
+
+	std::string GetSessionName(const std::string& inSDP)
+	{
+		size_t theStart = inSDP.find("s=");
+		if (theStart == std::string::npos)
+			return {};
+		return inSDP.substr(theStart, inSDP.find("\r\n", theStart) - theStart);
+	}
+}
+
+TEST(SdpCache, ReannounceDropsTheRendering)
+{
+	CSdpCache* theCache = CSdpCache::GetInstance();
+	const std::string thePath = "sdpcachetest/reannounce.sdp";
+
+	theCache->setSdpMap(thePath, MakeSDP(1));
+	auto theFirst = theCache->getSdpEntry(thePath);
+	ASSERT_TRUE(theFirst);
+	EXPECT_FALSE(theFirst->fDescribeSDP);
+	EXPECT_EQ(theCache->getSdpMap(thePath), MakeSDP(1));
+
+	auto theRendering = DescribeSDP::Render(theFirst->fSDP);
+	ASSERT_TRUE(theRendering);
+	theCache->setDescribeSdp(thePath, theFirst->fVersion, theRendering);
+	auto theCached = theCache->getSdpEntry(thePath);
+	ASSERT_TRUE(theCached);
+	EXPECT_EQ(theCached->fDescribeSDP, theRendering);
+	EXPECT_EQ(theCached->fVersion, theFirst->fVersion);
+
+	// An entry someone holds doesn't change under them
+	EXPECT_FALSE(theFirst->fDescribeSDP);
+
+	theCache->setSdpMap(thePath, MakeSDP(2));
+	auto theSecond = theCache->getSdpEntry(thePath);
+	ASSERT_TRUE(theSecond);
+	EXPECT_GT(theSecond->fVersion, theFirst->fVersion);
+	EXPECT_FALSE(theSecond->fDescribeSDP);
+
+	// A rendering of the first version is too late for the second
+	theCache->setDescribeSdp(thePath, theFirst->fVersion, theRendering);
+	EXPECT_FALSE(theCache->getSdpEntry(thePath)->fDescribeSDP);
+
+	theCache->eraseSdpMap(thePath);
+	EXPECT_FALSE(theCache->getSdpEntry(thePath));
+	EXPECT_TRUE(theCache->getSdpMap(thePath).empty());
+	theCache->setDescribeSdp(thePath, theSecond->fVersion, theRendering);
+	EXPECT_FALSE(theCache->getSdpEntry(thePath));
+}
+
+TEST(SdpCache, ConcurrentAnnounceAndDescribe)
+{
+	enum
+	{
+		kNumStreams = 4,
+		kNumDescribers = 3,
+		kNumAnnounces = 2000
+	};
+
+	CSdpCache* theCache = CSdpCache::GetInstance();
+	std::vector<std::string> thePaths;
+	for (int x = 0; x < kNumStreams; x++)
+	{
+		thePaths.push_back("sdpcachetest/stream" + std::to_string(x) + ".sdp");
+		theCache->setSdpMap(thePaths.back(), MakeSDP(0));
+	}
+
+	std::atomic<bool> isDone{ false };
+	std::atomic<uint64_t> theNumMismatched{ 0 }, theNumRendered{ 0 }, theNumCached{ 0 };
+	std::vector<std::thread> theDescribers;
+	for (int theDescriber = 0; theDescriber < kNumDescribers; theDescriber++)
+	{
+		theDescribers.emplace_back([&, theDescriber]() {
+			for (uint32_t x = (uint32_t)theDescriber; !isDone.load(); x++)
+			{
+				const std::string& thePath = thePaths[x % kNumStreams];
+				auto theEntry = theCache->getSdpEntry(thePath);
+				if (!theEntry)
+					continue;
+
+				std::shared_ptr<const std::string> theDescribeSDP = theEntry->fDescribeSDP;
+				if (theDescribeSDP)
+					theNumCached++;
+				else
+				{
+					theDescribeSDP = DescribeSDP::Render(theEntry->fSDP);
+					if (!theDescribeSDP)
+					{
+						theNumMismatched++;
+						continue;
+					}
+					theCache->setDescribeSdp(thePath, theEntry->fVersion, theDescribeSDP);
+					theNumRendered++;
+				}
+
+				if (GetSessionName(*theDescribeSDP) != GetSessionName(theEntry->fSDP))
+					theNumMismatched++;
+			}
+		});
+	}
+
+	// Now and then a stream goes away altogether before it comes back
+	for (uint64_t theAnnounce = 1; theAnnounce <= kNumAnnounces; theAnnounce++)
+	{
+		const std::string& thePath = thePaths[theAnnounce % kNumStreams];
+		if (theAnnounce % 50 == 0)
+			theCache->eraseSdpMap(thePath);
+		else
+			theCache->setSdpMap(thePath, MakeSDP(theAnnounce));
+		std::this_thread::yield();
+	}
+	isDone = true;
+	for (auto& theDescriber : theDescribers)
+		theDescriber.join();
+
+	EXPECT_EQ(theNumMismatched.load(), 0u);
+	EXPECT_GT(theNumRendered.load(), 0u);
+	::testing::Test::RecordProperty("rendered", (int)theNumRendered.load());
+	::testing::Test::RecordProperty("cached", (int)std::min<uint64_t>(theNumCached.load(), INT32_MAX));
+
+	// What is left is the last announce of each stream, rendered at most once
+	for (const std::string& thePath : thePaths)
+	{
+		auto theEntry = theCache->getSdpEntry(thePath);
+		if (!theEntry)
+			continue;
+		if (theEntry->fDescribeSDP)
+			EXPECT_EQ(GetSessionName(*theEntry->fDescribeSDP), GetSessionName(theEntry->fSDP));
+		theCache->eraseSdpMap(thePath);
+	}
+}
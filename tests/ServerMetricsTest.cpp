@@ -0,0 +1,312 @@
+/*
+	File:       ServerMetricsTest.cpp
+
+	Contains:   Scrapes ServerMetrics the way the /metrics handler does.
+
+				Collectors keep their gauges in function-local statics, so the
+				first scrape is when they register them. That scrape must not
+				deadlock on the registry, and has to render what they set.
+
+				Scrapes again while task threads and the event thread are busy
+				updating their metrics: every scrape has to parse, counters and
+				histograms may only go up, and the sampled task run time
+				histogram has to count as many runs as there were.
+*/
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ServerMetrics.h"
+#include "Task.h"
+#include "TestEnvironment.h"
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <unistd.h>
+#include "EventContext.h"
+#include "Socket.h"
+#endif
+
+namespace {
+
+	// Renders on a thread of its own, so that a deadlock fails the test
+	// instead of hanging it. The registry stays locked then, and anything
+	// after would hang on it, so that ends the run as well.
+	std::string Render()
+	{
+		auto thePromise = std::make_shared<std::promise<std::string>>();
+		std::future<std::string> theFuture = thePromise->get_future();
+		std::thread([thePromise]() { thePromise->set_value(ServerMetrics::Render()); }).detach();
+		if (theFuture.wait_for(std::chrono::seconds(10)) != std::future_status::ready)
+		{
+			std::fprintf(stderr, "ServerMetrics::Render deadlocked\n");
+			std::_Exit(1);
+		}
+		return theFuture.get();
+	}
+
+	bool Contains(const std::string& inOutput, const std::string& inLine)
+	{
+		return inOutput.find(inLine + "\n") != std::string::npos;
+	}
+
+	// Every sample of a scrape by its name and labels, in the order rendered
+	using Samples = std::vector<std::pair<std::string, double>>;
+
+	bool Parse(const std::string& inOutput, Samples* outSamples)
+	{
+		std::istringstream theLines(inOutput);
+		std::string theLine;
+		while (std::getline(theLines, theLine))
+		{
+			if (theLine.empty() || theLine[0] == '#')
+				continue;
+			size_t theSpace = theLine.rfind(' ');
+			if (theSpace == std::string::npos || theSpace == 0)
+				return false;
+			char* theEnd = nullptr;
+			double theValue = std::strtod(theLine.c_str() + theSpace + 1, &theEnd);
+			if (*theEnd != '\0')
+				return false;
+			outSamples->emplace_back(theLine.substr(0, theSpace), theValue);
+		}
+		return true;
+	}
+
+	bool EndsWith(const std::string& inName, const std::string& inSuffix)
+	{
+		return inName.size() >= inSuffix.size() && inName.compare(inName.size() - inSuffix.size(), inSuffix.size(), inSuffix) == 0;
+	}
+
+	class CountingTask : public Task
+	{
+	public:
+		CountingTask(std::atomic<uint64_t>* inNumRuns) : fNumRuns(inNumRuns) {}
+
+		int64_t Run() override
+		{
+			EventFlags theEvents = this->GetEvents();
+			if (theEvents & Task::kKillEvent)
+				return -1;
+			fNumRuns->fetch_add(1, std::memory_order_release);
+			return 0;
+		}
+
+	private:
+		std::atomic<uint64_t>*  fNumRuns;
+	};
+
+#if defined(__linux__)
+	// The read end of a pair, that reads every poke and re-arms
+	class DrainContext : public EventContext
+	{
+	public:
+		DrainContext(int inFileDesc)
+			: EventContext(EventContext::kInvalidFileDesc, Socket::GetEventThread())
+		{
+			this->InitNonBlocking(inFileDesc);
+		}
+
+	protected:
+		void ProcessEvent(int /*eventBits*/) override
+		{
+			char theBytes[16];
+			while (::read(fFileDesc, theBytes, sizeof(theBytes)) > 0) {}
+			this->RequestEvent(EV_RE);
+		}
+	};
+#endif
+}
+
+TEST(ServerMetrics, CollectorsRegisterOnTheFirstScrape)
+{
+	// Collectors stay registered for good, this one outlives the test
+	static std::atomic<int> sNumCollected{ 0 };
+	ServerMetrics::AddCollector([]()
+	{
+		static ServerMetrics::Gauge& sCollected = ServerMetrics::GetGauge("servermetricstest_collected", "Set by a collector");
+		static ServerMetrics::Counter& sScrapes = ServerMetrics::GetCounter("servermetricstest_scrapes_total", "Counted by a collector");
+		sCollected.Set(42);
+		sScrapes.Add();
+		sNumCollected++;
+	});
+
+	std::string theOutput = Render();
+	EXPECT_EQ(sNumCollected.load(), 1);
+	EXPECT_TRUE(Contains(theOutput, "# TYPE servermetricstest_collected gauge"));
+	EXPECT_TRUE(Contains(theOutput, "servermetricstest_collected 42"));
+	EXPECT_TRUE(Contains(theOutput, "servermetricstest_scrapes_total 1"));
+
+	theOutput = Render();
+	EXPECT_EQ(sNumCollected.load(), 2);
+	EXPECT_TRUE(Contains(theOutput, "servermetricstest_scrapes_total 2"));
+}
+
+TEST(ServerMetrics, RendersEveryKindOfMetric)
+{
+	ServerMetrics::GetCounter("servermetricstest_packets_total", "Packets").Add(3);
+	ServerMetrics::GetCounter("servermetricstest_packets_total", "Packets").Add(4);
+
+	ServerMetrics::Histogram& theHistogram = ServerMetrics::GetHistogram("servermetricstest_backlog", "Backlog");
+	theHistogram.Observe(1);
+	theHistogram.Observe(3);
+	theHistogram.Observe(1000);
+
+	auto theGauge = ServerMetrics::AddLabelledGauge("servermetricstest_viewers", "Viewers", { { "stream", "live/\"a\"" } });
+	theGauge->Set(7);
+
+	std::string theOutput = Render();
+	EXPECT_TRUE(Contains(theOutput, "# TYPE servermetricstest_packets_total counter"));
+	EXPECT_TRUE(Contains(theOutput, "servermetricstest_packets_total 7"));
+	EXPECT_TRUE(Contains(theOutput, "servermetricstest_backlog_bucket{le=\"1\"} 1"));
+	EXPECT_TRUE(Contains(theOutput, "servermetricstest_backlog_bucket{le=\"4\"} 2"));
+	EXPECT_TRUE(Contains(theOutput, "servermetricstest_backlog_bucket{le=\"+Inf\"} 3"));
+	EXPECT_TRUE(Contains(theOutput, "servermetricstest_backlog_sum 1004"));
+	EXPECT_TRUE(Contains(theOutput, "servermetricstest_viewers{stream=\"live/\\\"a\\\"\"} 7"));
+
+	// A labelled gauge goes away with its owner
+	theGauge.reset();
+	theOutput = Render();
+	EXPECT_EQ(theOutput.find("servermetricstest_viewers{"), std::string::npos);
+}
+
+TEST(ServerMetrics, ScrapesStayConsistentUnderLoad)
+{
+	enum { kNumTasks = 64, kNumPairs = 64, kLoadMilliSecs = 2000, kScrapeMilliSecs = 20 };
+	TestEnvironment::StartTaskThreads();
+
+	std::atomic<uint64_t> theNumRuns{ 0 };
+	std::vector<CountingTask*> theTasks;
+	for (uint32_t x = 0; x < kNumTasks; x++)
+		theTasks.push_back(new CountingTask(&theNumRuns));
+
+#if defined(__linux__)
+	TestEnvironment::StartEventThread();
+	std::vector<std::unique_ptr<DrainContext>> theContexts;
+	std::vector<int> theWriteFDs;
+	for (uint32_t x = 0; x < kNumPairs; x++)
+	{
+		int theFDs[2];
+		ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, theFDs), 0);
+		theContexts.emplace_back(new DrainContext(theFDs[0]));
+		theContexts.back()->RequestEvent(EV_RE);
+		theWriteFDs.push_back(theFDs[1]);
+	}
+	ServerMetrics::Counter& theCtlCalls = ServerMetrics::GetCounter("easydarwin_epoll_ctl_calls_total", "epoll_ctl calls made to arm or remove an fd");
+	uint64_t theCtlCallsBefore = theCtlCalls.GetValue();
+#endif
+
+	ServerMetrics::Histogram& theRunTime = ServerMetrics::GetHistogram("easydarwin_task_run_microseconds", "Time a task spends in one Run, sampled");
+	uint64_t theBuckets[ServerMetrics::Histogram::kNumBuckets];
+	uint64_t theSum = 0;
+	auto theRunTimeCount = [&]() {
+		theRunTime.Snapshot(theBuckets, &theSum);
+		uint64_t theCount = 0;
+		for (uint64_t theBucket : theBuckets)
+			theCount += theBucket;
+		return theCount;
+	};
+	uint64_t theRunTimeCountBefore = theRunTimeCount();
+
+	// Signals every task and waits for them all to have run, so no signal
+	// is lost to one still pending, and pokes every pair
+	std::atomic<bool> isDone{ false };
+	std::thread theLoad([&]() {
+		uint64_t theExpected = 0;
+		while (!isDone.load(std::memory_order_relaxed))
+		{
+			for (auto theTask : theTasks)
+				theTask->Signal(Task::kStartEvent);
+			theExpected += kNumTasks;
+#if defined(__linux__)
+			char theByte = 'x';
+			for (int theFD : theWriteFDs)
+				(void)::write(theFD, &theByte, 1);
+#endif
+			while (theNumRuns.load(std::memory_order_acquire) < theExpected)
+				std::this_thread::yield();
+		}
+	});
+
+	std::vector<int64_t> theScrapeMicroSecs;
+	std::map<std::string, double> theLastValues;
+	auto theEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(kLoadMilliSecs);
+	while (std::chrono::steady_clock::now() < theEnd)
+	{
+		auto theStart = std::chrono::steady_clock::now();
+		std::string theOutput = Render();
+		theScrapeMicroSecs.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - theStart).count());
+
+		Samples theSamples;
+		ASSERT_TRUE(Parse(theOutput, &theSamples)) << theOutput;
+
+		// Buckets are cumulative, and the count is the last of them
+		double theLastBucket = 0;
+		for (auto& theSample : theSamples)
+		{
+			const std::string& theName = theSample.first;
+			if (theName.find("_bucket{") != std::string::npos)
+			{
+				bool isFirst = EndsWith(theName, "{le=\"1\"}");
+				if (!isFirst)
+					ASSERT_GE(theSample.second, theLastBucket) << theName;
+				theLastBucket = theSample.second;
+			}
+			else if (EndsWith(theName, "_count"))
+				ASSERT_EQ(theSample.second, theLastBucket) << theName;
+
+			// Nothing that counts ever goes down
+			if (EndsWith(theName, "_total") || EndsWith(theName, "_count") || theName.find("_bucket{") != std::string::npos)
+			{
+				auto theLast = theLastValues.find(theName);
+				if (theLast != theLastValues.end())
+					ASSERT_GE(theSample.second, theLast->second) << theName;
+				theLastValues[theName] = theSample.second;
+			}
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(kScrapeMilliSecs));
+	}
+
+	isDone = true;
+	theLoad.join();
+
+	// A run is observed after it returns, let the last ones get there
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	uint64_t theRuns = theNumRuns.load();
+	uint64_t theObserved = theRunTimeCount() - theRunTimeCountBefore;
+
+	// Each thread times one run in every interval and counts it for all of
+	// them, so the count is off by at most an interval a thread
+	const uint64_t kSlack = 16 * TestEnvironment::kNumTaskThreads;
+	EXPECT_GT(theRuns, (uint64_t)kNumTasks);
+	EXPECT_LE(theObserved, theRuns + kSlack);
+	EXPECT_GE(theObserved + kSlack, theRuns);
+
+#if defined(__linux__)
+	EXPECT_GT(theCtlCalls.GetValue(), theCtlCallsBefore);
+	theContexts.clear();
+	for (int theFD : theWriteFDs)
+		::close(theFD);
+#endif
+	for (auto theTask : theTasks)
+		theTask->Signal(Task::kKillEvent);
+
+	std::sort(theScrapeMicroSecs.begin(), theScrapeMicroSecs.end());
+	int64_t theP99 = theScrapeMicroSecs[theScrapeMicroSecs.size() * 99 / 100];
+	::printf("%zu scrapes under load, %llu task runs, %llu observed: scrape p50 %lld us, p99 %lld us\n",
+		theScrapeMicroSecs.size(), (unsigned long long)theRuns, (unsigned long long)theObserved,
+		(long long)theScrapeMicroSecs[theScrapeMicroSecs.size() / 2], (long long)theP99);
+	::testing::Test::RecordProperty("scrapes", (int)theScrapeMicroSecs.size());
+	::testing::Test::RecordProperty("scrape_p99_us", (int)theP99);
+}
@@ -0,0 +1,45 @@
+/*
+	File:       TestEnvironment.cpp
+
+	Contains:   Implementation of TestEnvironment.h.
+*/
+
+#include "TestEnvironment.h"
+#include "OS.h"
+#include "OSThread.h"
+#include "Socket.h"
+#include "Task.h"
+
+void TestEnvironment::Initialize()
+{
+	static bool sInitialized = []() {
+		OS::Initialize();
+		OSThread::Initialize();
+		return true;
+	}();
+	(void)sInitialized;
+}
+
+void TestEnvironment::StartEventThread()
+{
+	static bool sStarted = []() {
+		TestEnvironment::Initialize();
+#if defined(__linux__)
+		::epollInit();
+#endif
+		Socket::Initialize();
+		Socket::StartThread();
+		return true;
+	}();
+	(void)sStarted;
+}
+
+void TestEnvironment::StartTaskThreads()
+{
+	static bool sStarted = []() {
+		TestEnvironment::Initialize();
+		TaskThreadPool::SetNumShortTaskThreads(kNumTaskThreads);
+		return TaskThreadPool::AddThreads(kNumTaskThreads);
+	}();
+	(void)sStarted;
+}
@@ -0,0 +1,21 @@
+/*
+	File:       TestEnvironment.h
+
+	Contains:   Brings up the parts of the server runtime a test needs, once
+				per test binary, the way RunServer.cpp does at startup.
+*/
+
+#pragma once
+
+namespace TestEnvironment
+{
+	// OS and OSThread
+	void    Initialize();
+
+	// Initialize, plus epoll and the event thread Socket uses
+	void    StartEventThread();
+
+	// Initialize, plus a TaskThreadPool of kNumTaskThreads short task threads
+	enum { kNumTaskThreads = 2 };
+	void    StartTaskThreads();
+}
@@ -0,0 +1,43 @@
+/*
+	File:       RTSPRequestParserFuzzer.cpp
+
+	Contains:   libFuzzer target for RTSPRequestParser. Besides not crashing,
+				whatever the parser hands back has to point into the request.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include "RTSPRequestParser.h"
+
+static void CheckInside(boost::string_view inView, const char* inBegin, const char* inEnd)
+{
+	if (!inView.empty() && ((inView.data() < inBegin) || (inView.data() + inView.size() > inEnd)))
+		::abort();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* inData, size_t inSize)
+{
+	const char* theBegin = reinterpret_cast<const char*>(inData);
+	const char* theEnd = theBegin + inSize;
+
+	RTSPRequestParser theParser;
+	bool isOK = theParser.Parse(boost::string_view(theBegin, inSize));
+	if (isOK && (theParser.GetMethod().empty() || theParser.GetURI().empty()))
+		::abort();
+
+	CheckInside(theParser.GetMethod(), theBegin, theEnd);
+	CheckInside(theParser.GetURI(), theBegin, theEnd);
+	CheckInside(theParser.GetVersion(), theBegin, theEnd);
+	if (theParser.GetNumHeaders() > RTSPRequestParser::kMaxHeaders)
+		::abort();
+	for (size_t x = 0; x < theParser.GetNumHeaders(); x++)
+	{
+		CheckInside(theParser.GetHeader(x).fName, theBegin, theEnd);
+		CheckInside(theParser.GetHeader(x).fValue, theBegin, theEnd);
+	}
+	for (uint32_t theID = 0; theID < qtssNumHeaders; theID++)
+		CheckInside(theParser.GetHeaderValue((QTSS_RTSPHeader)theID), theBegin, theEnd);
+
+	return 0;
+}
@@ -0,0 +1,1369 @@
+/*
+	File:       rtspload.cpp
+
+	Contains:   A synthetic RTSP load generator for the reflector.
+
+				Publishers ANNOUNCE a stream, SETUP its H.264 and AAC tracks with
+				mode=record, RECORD, and then send paced synthetic RTP, either
+				interleaved on the RTSP connection or over UDP. Players DESCRIBE
+				a published stream, SETUP its tracks interleaved and PLAY it,
+				checking the sequence numbers of what they get.
+
+				Every RTP packet carries its send time in a trailer, so a player
+				can tell how long the packet took through the server. Everything
+				runs in one thread on one epoll set, against a server on the same
+				host, and the results come out as JSON on stdout.
+
+				With --storm N it also keeps N connections coming and going, each
+				one connecting, asking for OPTIONS and closing, and reports how
+				many the server got through and how long each took.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+	uint64_t NowNs()
+	{
+		struct timespec theTime;
+		::clock_gettime(CLOCK_MONOTONIC, &theTime);
+		return (uint64_t)theTime.tv_sec * 1000000000 + theTime.tv_nsec;
+	}
+
+	struct Options
+	{
+		std::string fHost{ "127.0.0.1" };
+		uint16_t    fPort{ 10554 };
+		uint32_t    fNumPublishers{ 1 };
+		uint32_t    fNumPlayers{ 1 };
+		uint32_t    fDurationSec{ 10 };
+		uint32_t    fPlayerDelayMsec{ 1000 };   // publishers get going before players show up
+		uint32_t    fPlayerRampMsec{ 0 };       // players start spread over this long
+		uint32_t    fVideoKbps{ 2000 };
+		uint32_t    fFps{ 25 };
+		uint32_t    fGop{ 50 };                 // frames from a key frame to the next
+		uint32_t    fAudioKbps{ 64 };           // 0 publishes video only
+		bool        fUDP{ false };              // publishers send RTP over UDP
+		uint32_t    fNumStormConnections{ 0 };  // connect, OPTIONS, close, over and over
+		std::string fPrefix{ "rtspload" };      // stream x is <prefix><x>
+	};
+
+	enum
+	{
+		kMaxPayload = 1400,
+		kTrailerSize = 12,                  // magic + send time, at the end of every payload
+		kMaxOutputBuffer = 8 * 1024 * 1024, // a publisher connection can't queue more than this
+		kAudioSampleRate = 44100,
+		kAudioSamplesPerFrame = 1024
+	};
+
+	const char kTrailerMagic[4] = { 'R', 'L', 'D', 'T' };
+
+	void AppendTrailer(std::string& ioPayload, uint64_t inSendTime)
+	{
+		ioPayload.append(kTrailerMagic, 4);
+		for (int x = 7; x >= 0; x--)
+			ioPayload.push_back((char)(inSendTime >> (x * 8)));
+	}
+
+	bool ReadTrailer(const char* inPayload, size_t inLen, uint64_t* outSendTime)
+	{
+		if (inLen < kTrailerSize || ::memcmp(inPayload + inLen - kTrailerSize, kTrailerMagic, 4) != 0)
+			return false;
+
+		uint64_t theTime = 0;
+		for (size_t x = inLen - 8; x < inLen; x++)
+			theTime = (theTime << 8) | (uint8_t)inPayload[x];
+		*outSendTime = theTime;
+		return true;
+	}
+
+	std::string ToLower(std::string inString)
+	{
+		std::transform(inString.begin(), inString.end(), inString.begin(), [](char c) { return (char)::tolower((unsigned char)c); });
+		return inString;
+	}
+
+	// The value of a "name=value" parameter of a Transport header
+	std::string GetTransportParam(const std::string& inTransport, const std::string& inName)
+	{
+		std::string theTransport = ToLower(inTransport);
+		size_t theStart = 0;
+		while (theStart < theTransport.size())
+		{
+			size_t theEnd = theTransport.find(';', theStart);
+			if (theEnd == std::string::npos)
+				theEnd = theTransport.size();
+			std::string theParam = theTransport.substr(theStart, theEnd - theStart);
+			if (theParam.compare(0, inName.size() + 1, inName + "=") == 0)
+				return theParam.substr(inName.size() + 1);
+			theStart = theEnd + 1;
+		}
+		return {};
+	}
+
+	struct Percentiles
+	{
+		uint64_t    fP50{ 0 };
+		uint64_t    fP90{ 0 };
+		uint64_t    fP99{ 0 };
+		uint64_t    fMax{ 0 };
+	};
+
+	Percentiles GetPercentiles(std::vector<uint64_t> ioSamples)
+	{
+		Percentiles thePercentiles;
+		if (ioSamples.empty())
+			return thePercentiles;
+
+		std::sort(ioSamples.begin(), ioSamples.end());
+		auto thePercentile = [&ioSamples](double inFraction) { return ioSamples[(size_t)(inFraction * (ioSamples.size() - 1))]; };
+		thePercentiles.fP50 = thePercentile(0.50);
+		thePercentiles.fP90 = thePercentile(0.90);
+		thePercentiles.fP99 = thePercentile(0.99);
+		thePercentiles.fMax = ioSamples.back();
+		return thePercentiles;
+	}
+
+	class EventLoop;
+
+	//
+	// An RTSP client connection: sends requests one at a time and parses the
+	// responses, and the interleaved packets that come in between them
+	class RTSPConnection
+	{
+	public:
+		RTSPConnection(EventLoop& inLoop, const Options& inOptions, std::string inStreamName)
+			: fLoop(inLoop), fOptions(inOptions), fStreamName(std::move(inStreamName)) {}
+		virtual ~RTSPConnection() { if (fSocket != -1) ::close(fSocket); }
+
+		void        Start();
+		void        OnEvent(uint32_t inEvents);
+
+		// Called every time round the loop
+		virtual void OnTick(uint64_t /*inNow*/) {}
+
+		const std::string& GetStreamName() const { return fStreamName; }
+		const std::string& GetError() const { return fError; }
+		bool        IsFailed() const { return !fError.empty(); }
+
+	protected:
+		struct Response
+		{
+			int                                 fStatus{ 0 };
+			std::map<std::string, std::string>  fHeaders;   // lower case names
+			std::string                         fBody;
+		};
+
+		virtual void OnConnected() = 0;
+		virtual void OnResponse(const Response& inResponse) = 0;
+		virtual void OnInterleaved(uint8_t /*inChannel*/, const char* /*inData*/, size_t /*inLen*/) {}
+
+		std::string GetURL() const;
+		void        SendRequest(const std::string& inMethod, const std::string& inURL, const std::string& inHeaders, const std::string& inBody = {});
+		void        Send(const char* inData, size_t inLen);
+		void        Fail(const std::string& inError);
+
+		size_t      GetOutputBuffered() const { return fOutput.size() - fOutputOffset; }
+
+		EventLoop&          fLoop;
+		const Options&      fOptions;
+		std::string         fStreamName;
+		std::string         fSession;
+		uint64_t            fStartTime{ 0 };
+
+	private:
+		void        OnReadable();
+		void        OnWritable();
+		bool        ParseInput();   // false if the connection failed
+		void        UpdateEvents();
+
+		int                 fSocket{ -1 };
+		bool                fConnected{ false };
+		bool                fWantWrite{ false };
+		uint32_t            fCSeq{ 0 };
+		std::string         fInput;
+		std::string         fOutput;
+		size_t              fOutputOffset{ 0 };
+		std::string         fError;
+	};
+
+	class EventLoop
+	{
+	public:
+		EventLoop() : fEpoll(::epoll_create1(EPOLL_CLOEXEC)) {}
+		~EventLoop() { ::close(fEpoll); }
+
+		void Add(int inSocket, RTSPConnection* inConnection, uint32_t inEvents)
+		{
+			struct epoll_event theEvent = {};
+			theEvent.events = inEvents;
+			theEvent.data.ptr = inConnection;
+			::epoll_ctl(fEpoll, EPOLL_CTL_ADD, inSocket, &theEvent);
+		}
+
+		void Modify(int inSocket, RTSPConnection* inConnection, uint32_t inEvents)
+		{
+			struct epoll_event theEvent = {};
+			theEvent.events = inEvents;
+			theEvent.data.ptr = inConnection;
+			::epoll_ctl(fEpoll, EPOLL_CTL_MOD, inSocket, &theEvent);
+		}
+
+		void Remove(int inSocket) { ::epoll_ctl(fEpoll, EPOLL_CTL_DEL, inSocket, nullptr); }
+
+		// Dispatches what is ready, waiting at most inTimeoutMsec
+		void Poll(int inTimeoutMsec)
+		{
+			struct epoll_event theEvents[256];
+			int theNumEvents = ::epoll_wait(fEpoll, theEvents, 256, inTimeoutMsec);
+			for (int x = 0; x < theNumEvents; x++)
+				static_cast<RTSPConnection*>(theEvents[x].data.ptr)->OnEvent(theEvents[x].events);
+		}
+
+	private:
+		int     fEpoll;
+	};
+
+	void RTSPConnection::Start()
+	{
+		fStartTime = NowNs();
+		fSocket = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fSocket == -1)
+		{
+			this->Fail(std::string("socket: ") + ::strerror(errno));
+			return;
+		}
+
+		int theOne = 1;
+		::setsockopt(fSocket, IPPROTO_TCP, TCP_NODELAY, &theOne, sizeof(theOne));
+
+		struct sockaddr_in theAddr = {};
+		theAddr.sin_family = AF_INET;
+		theAddr.sin_port = htons(fOptions.fPort);
+		::inet_pton(AF_INET, fOptions.fHost.c_str(), &theAddr.sin_addr);
+		if (::connect(fSocket, (struct sockaddr*)&theAddr, sizeof(theAddr)) == -1 && errno != EINPROGRESS)
+		{
+			this->Fail(std::string("connect: ") + ::strerror(errno));
+			return;
+		}
+
+		fWantWrite = true;
+		fLoop.Add(fSocket, this, EPOLLIN | EPOLLOUT);
+	}
+
+	void RTSPConnection::OnEvent(uint32_t inEvents)
+	{
+		if (this->IsFailed())
+			return;
+
+		if (!fConnected && (inEvents & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+		{
+			int theError = 0;
+			socklen_t theLen = sizeof(theError);
+			::getsockopt(fSocket, SOL_SOCKET, SO_ERROR, &theError, &theLen);
+			if (theError != 0)
+			{
+				this->Fail(std::string("connect: ") + ::strerror(theError));
+				return;
+			}
+			fConnected = true;
+			this->UpdateEvents();
+			this->OnConnected();
+			if (this->IsFailed())
+				return;
+		}
+
+		if (inEvents & (EPOLLIN | EPOLLERR | EPOLLHUP))
+			this->OnReadable();
+		if (!this->IsFailed() && (inEvents & EPOLLOUT))
+			this->OnWritable();
+	}
+
+	std::string RTSPConnection::GetURL() const
+	{
+		return "rtsp://" + fOptions.fHost + ":" + std::to_string(fOptions.fPort) + "/" + fStreamName;
+	}
+
+	void RTSPConnection::SendRequest(const std::string& inMethod, const std::string& inURL, const std::string& inHeaders, const std::string& inBody)
+	{
+		std::string theRequest = inMethod + " " + inURL + " RTSP/1.0\r\n"
+			"CSeq: " + std::to_string(++fCSeq) + "\r\n"
+			"User-Agent: rtspload\r\n";
+		if (!fSession.empty())
+			theRequest += "Session: " + fSession + "\r\n";
+		theRequest += inHeaders;
+		if (!inBody.empty())
+			theRequest += "Content-Length: " + std::to_string(inBody.size()) + "\r\n";
+		theRequest += "\r\n" + inBody;
+		this->Send(theRequest.data(), theRequest.size());
+	}
+
+	void RTSPConnection::Send(const char* inData, size_t inLen)
+	{
+		if (this->IsFailed())
+			return;
+
+		// Whatever is queued goes first
+		if (this->GetOutputBuffered() == 0 && fConnected)
+		{
+			ssize_t theSent = ::send(fSocket, inData, inLen, MSG_NOSIGNAL);
+			if (theSent == -1)
+			{
+				if (errno != EAGAIN && errno != EWOULDBLOCK)
+				{
+					this->Fail(std::string("send: ") + ::strerror(errno));
+					return;
+				}
+				theSent = 0;
+			}
+			inData += theSent;
+			inLen -= theSent;
+		}
+
+		if (inLen == 0)
+			return;
+
+		if (fOutputOffset > 0 && fOutputOffset == fOutput.size())
+		{
+			fOutput.clear();
+			fOutputOffset = 0;
+		}
+		fOutput.append(inData, inLen);
+		this->UpdateEvents();
+	}
+
+	void RTSPConnection::OnWritable()
+	{
+		while (this->GetOutputBuffered() > 0)
+		{
+			ssize_t theSent = ::send(fSocket, fOutput.data() + fOutputOffset, this->GetOutputBuffered(), MSG_NOSIGNAL);
+			if (theSent == -1)
+			{
+				if (errno != EAGAIN && errno != EWOULDBLOCK)
+					this->Fail(std::string("send: ") + ::strerror(errno));
+				break;
+			}
+			fOutputOffset += theSent;
+		}
+
+		if (this->GetOutputBuffered() == 0)
+		{
+			fOutput.clear();
+			fOutputOffset = 0;
+		}
+		this->UpdateEvents();
+	}
+
+	void RTSPConnection::UpdateEvents()
+	{
+		if (this->IsFailed())
+			return;
+
+		bool wantWrite = !fConnected || this->GetOutputBuffered() > 0;
+		if (wantWrite != fWantWrite)
+		{
+			fWantWrite = wantWrite;
+			fLoop.Modify(fSocket, this, EPOLLIN | (wantWrite ? (uint32_t)EPOLLOUT : 0));
+		}
+	}
+
+	void RTSPConnection::OnReadable()
+	{
+		char theBuffer[65536];
+		while (!this->IsFailed())
+		{
+			ssize_t theRead = ::recv(fSocket, theBuffer, sizeof(theBuffer), 0);
+			if (theRead == 0)
+			{
+				this->Fail("connection closed by the server");
+				return;
+			}
+			if (theRead == -1)
+			{
+				if (errno != EAGAIN && errno != EWOULDBLOCK)
+					this->Fail(std::string("recv: ") + ::strerror(errno));
+				break;
+			}
+
+			fInput.append(theBuffer, theRead);
+			if (!this->ParseInput())
+				return;
+		}
+	}
+
+	bool RTSPConnection::ParseInput()
+	{
+		size_t theOffset = 0;
+		while (theOffset < fInput.size() && !this->IsFailed())
+		{
+			const char* theData = fInput.data() + theOffset;
+			size_t theLen = fInput.size() - theOffset;
+
+			if (theData[0] == '$')
+			{
+				if (theLen < 4)
+					break;
+				size_t thePacketLen = ((uint8_t)theData[2] << 8) | (uint8_t)theData[3];
+				if (theLen < 4 + thePacketLen)
+					break;
+				this->OnInterleaved((uint8_t)theData[1], theData + 4, thePacketLen);
+				theOffset += 4 + thePacketLen;
+				continue;
+			}
+
+			size_t theHeaderEnd = fInput.find("\r\n\r\n", theOffset);
+			if (theHeaderEnd == std::string::npos)
+			{
+				if (theLen > 65536)
+					this->Fail("response header too long");
+				break;
+			}
+
+			Response theResponse;
+			std::string theHeader = fInput.substr(theOffset, theHeaderEnd - theOffset);
+			if (theHeader.compare(0, 5, "RTSP/") != 0 || ::sscanf(theHeader.c_str(), "RTSP/%*s %d", &theResponse.fStatus) != 1)
+			{
+				this->Fail("malformed response: " + theHeader.substr(0, 64));
+				break;
+			}
+
+			size_t theLineStart = theHeader.find("\r\n");
+			while (theLineStart != std::string::npos)
+			{
+				theLineStart += 2;
+				size_t theLineEnd = theHeader.find("\r\n", theLineStart);
+				std::string theLine = theHeader.substr(theLineStart, theLineEnd == std::string::npos ? std::string::npos : theLineEnd - theLineStart);
+				size_t theColon = theLine.find(':');
+				if (theColon != std::string::npos)
+				{
+					size_t theValueStart = theLine.find_first_not_of(' ', theColon + 1);
+					size_t theValueEnd = theLine.find_last_not_of(' ');
+					theResponse.fHeaders[ToLower(theLine.substr(0, theColon))] =
+						(theValueStart == std::string::npos) ? std::string() : theLine.substr(theValueStart, theValueEnd + 1 - theValueStart);
+				}
+				theLineStart = theLineEnd;
+			}
+
+			size_t theBodyLen = 0;
+			auto theContentLength = theResponse.fHeaders.find("content-length");
+			if (theContentLength != theResponse.fHeaders.end())
+				theBodyLen = std::strtoul(theContentLength->second.c_str(), nullptr, 10);
+			if (fInput.size() < theHeaderEnd + 4 + theBodyLen)
+				break;
+
+			theResponse.fBody = fInput.substr(theHeaderEnd + 4, theBodyLen);
+			theOffset = theHeaderEnd + 4 + theBodyLen;
+
+			auto theSession = theResponse.fHeaders.find("session");
+			if (theSession != theResponse.fHeaders.end() && fSession.empty())
+				fSession = theSession->second.substr(0, theSession->second.find(';'));
+
+			if (theResponse.fStatus != 200)
+			{
+				this->Fail("server answered " + std::to_string(theResponse.fStatus));
+				break;
+			}
+			this->OnResponse(theResponse);
+		}
+
+		fInput.erase(0, theOffset);
+		return !this->IsFailed();
+	}
+
+	void RTSPConnection::Fail(const std::string& inError)
+	{
+		if (this->IsFailed())
+			return;
+
+		fError = inError;
+		if (fSocket != -1)
+		{
+			fLoop.Remove(fSocket);
+			::close(fSocket);
+			fSocket = -1;
+		}
+	}
+
+	//
+	// Publishes a synthetic H.264 + AAC stream
+	class Publisher : public RTSPConnection
+	{
+	public:
+		using RTSPConnection::RTSPConnection;
+		~Publisher() override;
+
+		void        OnTick(uint64_t inNow) override;
+
+		uint64_t    GetNumPacketsSent() const { return fNumPacketsSent; }
+		uint64_t    GetNumBytesSent() const { return fNumBytesSent; }
+		uint64_t    GetNumPacketsDropped() const { return fNumPacketsDropped; }
+		uint64_t    GetRecordTime() const { return fRecordTime; }
+		uint64_t    GetSetupNs() const { return fRecordTime ? fRecordTime - fStartTime : 0; }
+
+	private:
+		enum class State { Announce, SetupVideo, SetupAudio, Record, Streaming };
+
+		struct Track
+		{
+			uint8_t     fPayloadType;
+			uint32_t    fSSRC;
+			uint16_t    fSeq{ 0 };
+			uint8_t     fChannel;
+			int         fUDPSocket{ -1 };
+		};
+
+		void        OnConnected() override;
+		void        OnResponse(const Response& inResponse) override;
+
+		bool        HasAudio() const { return fOptions.fAudioKbps > 0; }
+		std::string GetSDP() const;
+		std::string GetTransport(uint8_t inChannel);
+		bool        ConnectUDP(Track& inTrack, const std::string& inTransport);
+
+		void        SendVideoFrame(uint64_t inNow);
+		void        SendAudioFrame(uint64_t inNow);
+		void        SendRTP(Track& inTrack, uint32_t inTimestamp, bool inMarker, const std::string& inPayload);
+
+		State       fState{ State::Announce };
+		Track       fTracks[2]{ { 96, 0x10000000, 0, 0 }, { 97, 0x20000000, 0, 2 } };
+		int         fUDPClientSockets[2]{ -1, -1 };     // where our RTCP would come in, unused
+
+		uint64_t    fRecordTime{ 0 };
+		uint64_t    fNumVideoFrames{ 0 };
+		uint64_t    fNumAudioFrames{ 0 };
+
+		uint64_t    fNumPacketsSent{ 0 };
+		uint64_t    fNumBytesSent{ 0 };
+		uint64_t    fNumPacketsDropped{ 0 };
+
+	};
+
+	Publisher::~Publisher()
+	{
+		for (const Track& theTrack : fTracks)
+			if (theTrack.fUDPSocket != -1)
+				::close(theTrack.fUDPSocket);
+		for (int theSocket : fUDPClientSockets)
+			if (theSocket != -1)
+				::close(theSocket);
+	}
+
+	std::string Publisher::GetSDP() const
+	{
+		std::string theSDP =
+			"v=0\r\n"
+			"o=- 0 0 IN IP4 127.0.0.1\r\n"
+			"s=rtspload\r\n"
+			"c=IN IP4 127.0.0.1\r\n"
+			"t=0 0\r\n"
+			"m=video 0 RTP/AVP 96\r\n"
+			"a=rtpmap:96 H264/90000\r\n"
+			"a=fmtp:96 packetization-mode=1;profile-level-id=42001f;sprop-parameter-sets=Z0IAH5WoFAFuQA==,aM48gA==\r\n"
+			"a=control:trackID=1\r\n";
+		if (this->HasAudio())
+			theSDP +=
+			"m=audio 0 RTP/AVP 97\r\n"
+			"a=rtpmap:97 mpeg4-generic/44100/2\r\n"
+			"a=fmtp:97 streamtype=5;profile-level-id=15;mode=AAC-hbr;config=1210;sizelength=13;indexlength=3;indexdeltalength=3\r\n"
+			"a=control:trackID=2\r\n";
+		return theSDP;
+	}
+
+	std::string Publisher::GetTransport(uint8_t inChannel)
+	{
+		if (!fOptions.fUDP)
+			return "RTP/AVP/TCP;unicast;interleaved=" + std::to_string(inChannel) + "-" + std::to_string(inChannel + 1) + ";mode=record";
+
+		// A port pair for the server to talk back to; nothing is read from it
+		int theSocket = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+		struct sockaddr_in theAddr = {};
+		theAddr.sin_family = AF_INET;
+		theAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t theLen = sizeof(theAddr);
+		::bind(theSocket, (struct sockaddr*)&theAddr, sizeof(theAddr));
+		::getsockname(theSocket, (struct sockaddr*)&theAddr, &theLen);
+		fUDPClientSockets[inChannel / 2] = theSocket;
+
+		uint16_t thePort = ntohs(theAddr.sin_port);
+		return "RTP/AVP;unicast;client_port=" + std::to_string(thePort) + "-" + std::to_string(thePort + 1) + ";mode=record";
+	}
+
+	bool Publisher::ConnectUDP(Track& inTrack, const std::string& inTransport)
+	{
+		std::string theServerPort = GetTransportParam(inTransport, "server_port");
+		if (theServerPort.empty())
+		{
+			this->Fail("no server_port in the SETUP response, the server may only take interleaved RTP");
+			return false;
+		}
+
+		inTrack.fUDPSocket = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		struct sockaddr_in theAddr = {};
+		theAddr.sin_family = AF_INET;
+		theAddr.sin_port = htons((uint16_t)std::strtoul(theServerPort.c_str(), nullptr, 10));
+		::inet_pton(AF_INET, fOptions.fHost.c_str(), &theAddr.sin_addr);
+		if (::connect(inTrack.fUDPSocket, (struct sockaddr*)&theAddr, sizeof(theAddr)) == -1)
+		{
+			this->Fail(std::string("UDP connect: ") + ::strerror(errno));
+			return false;
+		}
+		return true;
+	}
+
+	void Publisher::OnConnected()
+	{
+		this->SendRequest("ANNOUNCE", this->GetURL(), "Content-Type: application/sdp\r\n", this->GetSDP());
+	}
+
+	void Publisher::OnResponse(const Response& inResponse)
+	{
+		std::string theTransport;
+		auto theHeader = inResponse.fHeaders.find("transport");
+		if (theHeader != inResponse.fHeaders.end())
+			theTransport = theHeader->second;
+
+		switch (fState)
+		{
+		case State::Announce:
+			fState = State::SetupVideo;
+			this->SendRequest("SETUP", this->GetURL() + "/trackID=1", "Transport: " + this->GetTransport(fTracks[0].fChannel) + "\r\n");
+			break;
+
+		case State::SetupVideo:
+			if (fOptions.fUDP && !this->ConnectUDP(fTracks[0], theTransport))
+				return;
+			if (this->HasAudio())
+			{
+				fState = State::SetupAudio;
+				this->SendRequest("SETUP", this->GetURL() + "/trackID=2", "Transport: " + this->GetTransport(fTracks[1].fChannel) + "\r\n");
+				break;
+			}
+			fState = State::Record;
+			this->SendRequest("RECORD", this->GetURL(), "Range: npt=0.000-\r\n");
+			break;
+
+		case State::SetupAudio:
+			if (fOptions.fUDP && !this->ConnectUDP(fTracks[1], theTransport))
+				return;
+			fState = State::Record;
+			this->SendRequest("RECORD", this->GetURL(), "Range: npt=0.000-\r\n");
+			break;
+
+		case State::Record:
+			fState = State::Streaming;
+			fRecordTime = NowNs();
+			break;
+
+		case State::Streaming:
+			break;
+		}
+	}
+
+	void Publisher::OnTick(uint64_t inNow)
+	{
+		if (fState != State::Streaming || this->IsFailed())
+			return;
+
+		// Catch up on whatever frames are due by now, in time order
+		uint64_t theElapsed = inNow - fRecordTime;
+		while (!this->IsFailed())
+		{
+			uint64_t theNextVideo = fNumVideoFrames * 1000000000 / fOptions.fFps;
+			uint64_t theNextAudio = this->HasAudio() ? fNumAudioFrames * kAudioSamplesPerFrame * 1000000000 / kAudioSampleRate : UINT64_MAX;
+			if (std::min(theNextVideo, theNextAudio) > theElapsed)
+				break;
+
+			if (theNextVideo <= theNextAudio)
+				this->SendVideoFrame(inNow);
+			else
+				this->SendAudioFrame(inNow);
+		}
+	}
+
+	void Publisher::SendVideoFrame(uint64_t inNow)
+	{
+		// Key frames are 4 times the size of the others, for the same bit rate overall
+		uint64_t theGop = std::max<uint32_t>(fOptions.fGop, 1);
+		bool isKeyFrame = (fNumVideoFrames % theGop) == 0;
+		uint64_t theUnit = (uint64_t)fOptions.fVideoKbps * 125 / std::max<uint32_t>(fOptions.fFps, 1) * theGop / (theGop + 3);
+		size_t theFrameSize = std::max<size_t>((size_t)(isKeyFrame ? theUnit * 4 : theUnit), kTrailerSize + 1);
+		uint32_t theTimestamp = (uint32_t)(fNumVideoFrames * 90000 / fOptions.fFps);
+		fNumVideoFrames++;
+
+		Track& theTrack = fTracks[0];
+		if (isKeyFrame)
+		{
+			static const char kSPS[] = { 0x67, 0x42, 0x00, 0x1f, (char)0x95, (char)0xa8, 0x14, 0x01, 0x6e, 0x40 };
+			static const char kPPS[] = { 0x68, (char)0xce, 0x3c, (char)0x80 };
+			std::string theSPS(kSPS, sizeof(kSPS));
+			std::string thePPS(kPPS, sizeof(kPPS));
+			AppendTrailer(theSPS, inNow);
+			AppendTrailer(thePPS, inNow);
+			this->SendRTP(theTrack, theTimestamp, false, theSPS);
+			this->SendRTP(theTrack, theTimestamp, false, thePPS);
+		}
+
+		// One FU-A fragment per packet, each carrying the send time
+		char theNALHeader = isKeyFrame ? 0x65 : 0x41;
+		size_t theFragmentSize = kMaxPayload - 2 - kTrailerSize;
+		for (size_t theOffset = 0; theOffset < theFrameSize; theOffset += theFragmentSize)
+		{
+			bool isFirst = theOffset == 0;
+			bool isLast = theOffset + theFragmentSize >= theFrameSize;
+			size_t theLen = std::min(theFragmentSize, theFrameSize - theOffset);
+
+			std::string thePayload;
+			thePayload.reserve(2 + theLen + kTrailerSize);
+			thePayload.push_back((char)((theNALHeader & 0x60) | 28));
+			thePayload.push_back((char)((isFirst ? 0x80 : 0) | (isLast ? 0x40 : 0) | (theNALHeader & 0x1F)));
+			thePayload.append(theLen, (char)0xAB);
+			AppendTrailer(thePayload, inNow);
+			this->SendRTP(theTrack, theTimestamp, isLast, thePayload);
+		}
+	}
+
+	void Publisher::SendAudioFrame(uint64_t inNow)
+	{
+		size_t theFrameSize = std::max<size_t>((size_t)fOptions.fAudioKbps * 125 * kAudioSamplesPerFrame / kAudioSampleRate, kTrailerSize);
+		theFrameSize = std::min<size_t>(theFrameSize, kMaxPayload - 4);
+		uint32_t theTimestamp = (uint32_t)(fNumAudioFrames * kAudioSamplesPerFrame);
+		fNumAudioFrames++;
+
+		// One AU header (13 bits of size, 3 of index) in front of the frame
+		std::string thePayload;
+		thePayload.push_back(0x00);
+		thePayload.push_back(0x10);
+		thePayload.push_back((char)(theFrameSize >> 5));
+		thePayload.push_back((char)((theFrameSize & 0x1F) << 3));
+		thePayload.append(theFrameSize - kTrailerSize, (char)0x21);
+		AppendTrailer(thePayload, inNow);
+		this->SendRTP(fTracks[1], theTimestamp, true, thePayload);
+	}
+
+	void Publisher::SendRTP(Track& inTrack, uint32_t inTimestamp, bool inMarker, const std::string& inPayload)
+	{
+		char thePacket[4 + 12 + kMaxPayload];
+		size_t theLen = 12 + inPayload.size();
+		char* theRTP = thePacket + 4;
+		theRTP[0] = (char)0x80;
+		theRTP[1] = (char)((inMarker ? 0x80 : 0) | inTrack.fPayloadType);
+		theRTP[2] = (char)(inTrack.fSeq >> 8);
+		theRTP[3] = (char)(inTrack.fSeq & 0xFF);
+		for (int x = 0; x < 4; x++)
+		{
+			theRTP[4 + x] = (char)(inTimestamp >> (24 - x * 8));
+			theRTP[8 + x] = (char)(inTrack.fSSRC >> (24 - x * 8));
+		}
+		::memcpy(theRTP + 12, inPayload.data(), inPayload.size());
+		inTrack.fSeq++;
+
+		if (fOptions.fUDP)
+		{
+			if (::send(inTrack.fUDPSocket, theRTP, theLen, 0) == -1)
+			{
+				fNumPacketsDropped++;
+				return;
+			}
+		}
+		else
+		{
+			// Don't let a server that stopped reading grow the buffer without end
+			if (this->GetOutputBuffered() > kMaxOutputBuffer)
+			{
+				fNumPacketsDropped++;
+				return;
+			}
+			thePacket[0] = '$';
+			thePacket[1] = (char)inTrack.fChannel;
+			thePacket[2] = (char)(theLen >> 8);
+			thePacket[3] = (char)(theLen & 0xFF);
+			this->Send(thePacket, 4 + theLen);
+		}
+
+		fNumPacketsSent++;
+		fNumBytesSent += theLen;
+	}
+
+	//
+	// Plays a stream interleaved and checks what it gets
+	class Player : public RTSPConnection
+	{
+	public:
+		Player(EventLoop& inLoop, const Options& inOptions, std::string inStreamName, uint64_t inStartTime)
+			: RTSPConnection(inLoop, inOptions, std::move(inStreamName)), fScheduledStart(inStartTime) {}
+
+		void        OnTick(uint64_t inNow) override
+		{
+			if (!fStarted && inNow >= fScheduledStart)
+			{
+				fStarted = true;
+				this->Start();
+			}
+		}
+
+		struct TrackStats
+		{
+			uint64_t    fNumPackets{ 0 };
+			uint64_t    fNumBytes{ 0 };
+			uint64_t    fNumLost{ 0 };          // gaps not filled in later
+			uint64_t    fNumLate{ 0 };          // arrived after a packet behind it
+			uint64_t    fNumDuplicates{ 0 };
+		};
+
+		bool        IsStarted() const { return fStarted; }
+		bool        IsPlaying() const { return fPlayTime != 0; }
+		uint64_t    GetPlayTime() const { return fPlayTime; }
+		uint64_t    GetFirstPacketNs() const { return fFirstPacketTime ? fFirstPacketTime - fStartTime : 0; }
+		uint64_t    GetFirstKeyFrameNs() const { return fFirstKeyFrameTime ? fFirstKeyFrameTime - fStartTime : 0; }
+		TrackStats  GetTotals() const;
+		uint64_t    GetNumCachedPackets() const { return fNumCachedPackets; }
+		const std::vector<uint64_t>& GetLatencies() const { return fLatencies; }
+
+	private:
+		enum class State { Describe, Setup, Play, Playing };
+
+		struct Track
+		{
+			std::string fControl;
+			uint8_t     fChannel{ 0 };
+			bool        fIsVideo{ false };
+			bool        fHasSeq{ false };
+			uint16_t    fHighestSeq{ 0 };
+			std::vector<bool> fReceived = std::vector<bool>(65536);
+			TrackStats  fStats;
+		};
+
+		void        OnConnected() override;
+		void        OnResponse(const Response& inResponse) override;
+		void        OnInterleaved(uint8_t inChannel, const char* inData, size_t inLen) override;
+		void        SetupNextTrack();
+		void        CheckSequence(Track& inTrack, uint16_t inSeq);
+
+		uint64_t    fScheduledStart;
+		bool        fStarted{ false };
+		State       fState{ State::Describe };
+		std::vector<Track> fTracks;
+		size_t      fNumTracksSetUp{ 0 };
+
+		uint64_t    fPlayRequestTime{ 0 };
+		uint64_t    fPlayTime{ 0 };
+		uint64_t    fFirstPacketTime{ 0 };
+		uint64_t    fFirstKeyFrameTime{ 0 };
+		uint64_t    fNumCachedPackets{ 0 };     // sent before we asked to PLAY, out of the server's cache
+		std::vector<uint64_t> fLatencies;   // in microseconds, live packets only
+	};
+
+	void Player::OnConnected()
+	{
+		this->SendRequest("DESCRIBE", this->GetURL(), "Accept: application/sdp\r\n");
+	}
+
+	void Player::SetupNextTrack()
+	{
+		Track& theTrack = fTracks[fNumTracksSetUp];
+		uint8_t theChannel = (uint8_t)(fNumTracksSetUp * 2);
+		std::string theURL = theTrack.fControl.compare(0, 7, "rtsp://") == 0 ? theTrack.fControl : this->GetURL() + "/" + theTrack.fControl;
+		this->SendRequest("SETUP", theURL,
+			"Transport: RTP/AVP/TCP;unicast;interleaved=" + std::to_string(theChannel) + "-" + std::to_string(theChannel + 1) + "\r\n");
+	}
+
+	void Player::OnResponse(const Response& inResponse)
+	{
+		switch (fState)
+		{
+		case State::Describe:
+		{
+			// Every m= section with an a=control is a track to set up
+			size_t theLineStart = 0;
+			while (theLineStart < inResponse.fBody.size())
+			{
+				size_t theLineEnd = inResponse.fBody.find('\n', theLineStart);
+				if (theLineEnd == std::string::npos)
+					theLineEnd = inResponse.fBody.size();
+				std::string theLine = inResponse.fBody.substr(theLineStart, theLineEnd - theLineStart);
+				if (!theLine.empty() && theLine.back() == '\r')
+					theLine.pop_back();
+
+				if (theLine.compare(0, 2, "m=") == 0)
+				{
+					fTracks.emplace_back();
+					fTracks.back().fIsVideo = theLine.compare(0, 7, "m=video") == 0;
+				}
+				else if (theLine.compare(0, 10, "a=control:") == 0 && !fTracks.empty())
+					fTracks.back().fControl = theLine.substr(10);
+
+				theLineStart = theLineEnd + 1;
+			}
+
+			fTracks.erase(std::remove_if(fTracks.begin(), fTracks.end(), [](const Track& inTrack) { return inTrack.fControl.empty(); }), fTracks.end());
+			if (fTracks.empty())
+			{
+				this->Fail("no tracks in the DESCRIBE response");
+				return;
+			}
+
+			fState = State::Setup;
+			this->SetupNextTrack();
+			break;
+		}
+
+		case State::Setup:
+		{
+			// The server picks the channels
+			Track& theTrack = fTracks[fNumTracksSetUp++];
+			theTrack.fChannel = (uint8_t)((fNumTracksSetUp - 1) * 2);
+			auto theTransport = inResponse.fHeaders.find("transport");
+			if (theTransport != inResponse.fHeaders.end())
+			{
+				std::string theInterleaved = GetTransportParam(theTransport->second, "interleaved");
+				if (!theInterleaved.empty())
+					theTrack.fChannel = (uint8_t)std::strtoul(theInterleaved.c_str(), nullptr, 10);
+			}
+
+			if (fNumTracksSetUp < fTracks.size())
+				this->SetupNextTrack();
+			else
+			{
+				fState = State::Play;
+				fPlayRequestTime = NowNs();
+				this->SendRequest("PLAY", this->GetURL(), "Range: npt=0.000-\r\n");
+			}
+			break;
+		}
+
+		case State::Play:
+			fState = State::Playing;
+			fPlayTime = NowNs();
+			break;
+
+		case State::Playing:
+			break;
+		}
+	}
+
+	void Player::OnInterleaved(uint8_t inChannel, const char* inData, size_t inLen)
+	{
+		// RTCP comes in on the odd channels
+		auto theTrack = std::find_if(fTracks.begin(), fTracks.end(), [inChannel](const Track& inTrack) { return inTrack.fChannel == inChannel; });
+		if (theTrack == fTracks.end() || inLen < 12)
+			return;
+
+		uint64_t theNow = NowNs();
+		if (fFirstPacketTime == 0)
+			fFirstPacketTime = theNow;
+
+		size_t theHeaderLen = 12 + (inData[0] & 0x0F) * 4;
+		if (theTrack->fIsVideo && fFirstKeyFrameTime == 0 && inLen > theHeaderLen)
+		{
+			uint8_t theNALType = inData[theHeaderLen] & 0x1F;
+			if (theNALType == 7 || theNALType == 5 || (theNALType == 28 && inLen > theHeaderLen + 1 && (inData[theHeaderLen + 1] & 0x1F) == 5))
+				fFirstKeyFrameTime = theNow;
+		}
+
+		theTrack->fStats.fNumPackets++;
+		theTrack->fStats.fNumBytes += inLen;
+		this->CheckSequence(*theTrack, (uint16_t)(((uint8_t)inData[2] << 8) | (uint8_t)inData[3]));
+
+		// What the server kept for a quick start says nothing about its latency
+		uint64_t theSendTime = 0;
+		if (!ReadTrailer(inData, inLen, &theSendTime) || theNow < theSendTime)
+			return;
+		if (theSendTime < fPlayRequestTime)
+			fNumCachedPackets++;
+		else
+			fLatencies.push_back((theNow - theSendTime) / 1000);
+	}
+
+	void Player::CheckSequence(Track& inTrack, uint16_t inSeq)
+	{
+		if (!inTrack.fHasSeq)
+		{
+			inTrack.fHasSeq = true;
+			inTrack.fHighestSeq = inSeq;
+			inTrack.fReceived[inSeq] = true;
+			return;
+		}
+
+		int16_t theDelta = (int16_t)(inSeq - inTrack.fHighestSeq);
+		if (theDelta > 0)
+		{
+			// Everything skipped over is missing until it shows up
+			for (uint16_t theSeq = inTrack.fHighestSeq + 1; theSeq != inSeq; theSeq++)
+				inTrack.fReceived[theSeq] = false;
+			inTrack.fStats.fNumLost += theDelta - 1;
+			inTrack.fHighestSeq = inSeq;
+			inTrack.fReceived[inSeq] = true;
+
+			// Half the sequence space ahead is where old packets would be mistaken for new ones
+			inTrack.fReceived[(uint16_t)(inSeq + 32768)] = false;
+		}
+		else if (inTrack.fReceived[inSeq])
+			inTrack.fStats.fNumDuplicates++;
+		else
+		{
+			inTrack.fReceived[inSeq] = true;
+			inTrack.fStats.fNumLate++;
+			if (inTrack.fStats.fNumLost > 0)
+				inTrack.fStats.fNumLost--;
+		}
+	}
+
+	Player::TrackStats Player::GetTotals() const
+	{
+		TrackStats theTotals;
+		for (const Track& theTrack : fTracks)
+		{
+			theTotals.fNumPackets += theTrack.fStats.fNumPackets;
+			theTotals.fNumBytes += theTrack.fStats.fNumBytes;
+			theTotals.fNumLost += theTrack.fStats.fNumLost;
+			theTotals.fNumLate += theTrack.fStats.fNumLate;
+			theTotals.fNumDuplicates += theTrack.fStats.fNumDuplicates;
+		}
+		return theTotals;
+	}
+
+	//
+	// Connects, asks for OPTIONS and hangs up, as a client that only probes
+	// the server does
+	class OptionsProbe : public RTSPConnection
+	{
+	public:
+		OptionsProbe(EventLoop& inLoop, const Options& inOptions)
+			: RTSPConnection(inLoop, inOptions, {}) {}
+
+		bool        IsDone() const { return fDoneTime != 0; }
+		uint64_t    GetDurationNs() const { return fDoneTime - fStartTime; }
+
+	private:
+		void        OnConnected() override { this->SendRequest("OPTIONS", this->GetURL(), {}); }
+		void        OnResponse(const Response&) override { fDoneTime = NowNs(); }
+
+		uint64_t    fDoneTime{ 0 };
+	};
+
+	//
+	// Keeps a number of OptionsProbes going, starting a new one as soon as
+	// one is done
+	class ConnectionStorm
+	{
+	public:
+		ConnectionStorm(EventLoop& inLoop, const Options& inOptions)
+			: fLoop(inLoop), fOptions(inOptions), fProbes(inOptions.fNumStormConnections) {}
+
+		void        OnTick(uint64_t inNow)
+		{
+			if (fStartTime == 0)
+				fStartTime = inNow;
+			for (auto& theProbe : fProbes)
+			{
+				if (theProbe && theProbe->IsDone())
+				{
+					fNumCompleted++;
+					fDurations.push_back(theProbe->GetDurationNs() / 1000);
+				}
+				else if (theProbe && theProbe->IsFailed())
+				{
+					fNumFailed++;
+					if (fFirstError.empty())
+						fFirstError = theProbe->GetError();
+				}
+				else if (theProbe)
+					continue;
+
+				// Closing it is the hang up
+				theProbe.reset(new OptionsProbe(fLoop, fOptions));
+				theProbe->Start();
+			}
+		}
+
+		uint64_t    GetNumCompleted() const { return fNumCompleted; }
+		uint64_t    GetNumFailed() const { return fNumFailed; }
+		uint64_t    GetStartTime() const { return fStartTime; }
+		const std::string& GetFirstError() const { return fFirstError; }
+		const std::vector<uint64_t>& GetDurations() const { return fDurations; }
+
+	private:
+		EventLoop&          fLoop;
+		const Options&      fOptions;
+		std::vector<std::unique_ptr<OptionsProbe>> fProbes;
+		uint64_t            fStartTime{ 0 };
+		uint64_t            fNumCompleted{ 0 };
+		uint64_t            fNumFailed{ 0 };
+		std::string         fFirstError;
+		std::vector<uint64_t> fDurations;    // in microseconds, connect to response
+	};
+
+	//
+	// REPORT
+
+	std::string JSONString(const std::string& inString)
+	{
+		std::string theString = "\"";
+		for (char c : inString)
+		{
+			if (c == '"' || c == '\\')
+				theString += '\\';
+			if ((unsigned char)c < 0x20)
+			{
+				char theEscape[8];
+				std::snprintf(theEscape, sizeof(theEscape), "\\u%04x", c);
+				theString += theEscape;
+			}
+			else
+				theString += c;
+		}
+		return theString + "\"";
+	}
+
+	std::string JSONPercentiles(const Percentiles& inPercentiles)
+	{
+		return "{\"p50\": " + std::to_string(inPercentiles.fP50) + ", \"p90\": " + std::to_string(inPercentiles.fP90) +
+			", \"p99\": " + std::to_string(inPercentiles.fP99) + ", \"max\": " + std::to_string(inPercentiles.fMax) + "}";
+	}
+
+	double GetKbps(uint64_t inBytes, uint64_t inSinceNs, uint64_t inEndNs)
+	{
+		if (inSinceNs == 0 || inEndNs <= inSinceNs)
+			return 0;
+		return inBytes * 8.0 / ((inEndNs - inSinceNs) / 1e9) / 1000;
+	}
+
+	std::string FormatDouble(double inValue)
+	{
+		char theBuffer[32];
+		std::snprintf(theBuffer, sizeof(theBuffer), "%.2f", inValue);
+		return theBuffer;
+	}
+
+	void PrintReport(const Options& inOptions, const std::vector<std::unique_ptr<Publisher>>& inPublishers,
+		const std::vector<std::unique_ptr<Player>>& inPlayers, const ConnectionStorm& inStorm, uint64_t inEndTime)
+	{
+		std::string theReport = "{\n  \"config\": {";
+		theReport += "\"host\": " + JSONString(inOptions.fHost) + ", \"port\": " + std::to_string(inOptions.fPort);
+		theReport += ", \"publishers\": " + std::to_string(inOptions.fNumPublishers) + ", \"players\": " + std::to_string(inOptions.fNumPlayers);
+		theReport += ", \"duration_sec\": " + std::to_string(inOptions.fDurationSec) + ", \"transport\": " + (inOptions.fUDP ? "\"udp\"" : "\"tcp\"");
+		theReport += ", \"video_kbps\": " + std::to_string(inOptions.fVideoKbps) + ", \"audio_kbps\": " + std::to_string(inOptions.fAudioKbps);
+		theReport += ", \"fps\": " + std::to_string(inOptions.fFps) + ", \"gop\": " + std::to_string(inOptions.fGop);
+		theReport += ", \"storm_connections\": " + std::to_string(inOptions.fNumStormConnections) + "},\n";
+
+		std::vector<uint64_t> theAllLatencies;
+		uint64_t theTotalPlayerBytes = 0, theTotalLost = 0, theTotalReceived = 0;
+		uint32_t theNumPlaying = 0;
+
+		theReport += "  \"streams\": [";
+		for (size_t x = 0; x < inPublishers.size(); x++)
+		{
+			const Publisher& thePublisher = *inPublishers[x];
+			std::vector<uint64_t> theLatencies, theStartups, theKeyFrameStartups;
+			Player::TrackStats theTotals;
+			uint32_t theNumPlayers = 0, theNumStreamPlaying = 0, theNumFailed = 0;
+			uint64_t theNumCachedPackets = 0;
+			double theKbps = 0;
+			std::string theFirstError;
+
+			for (const auto& thePlayer : inPlayers)
+			{
+				if (thePlayer->GetStreamName() != thePublisher.GetStreamName() || !thePlayer->IsStarted())
+					continue;
+				theNumPlayers++;
+				if (thePlayer->IsFailed())
+				{
+					theNumFailed++;
+					if (theFirstError.empty())
+						theFirstError = thePlayer->GetError();
+				}
+				if (!thePlayer->IsPlaying())
+					continue;
+
+				theNumStreamPlaying++;
+				Player::TrackStats theStats = thePlayer->GetTotals();
+				theTotals.fNumPackets += theStats.fNumPackets;
+				theTotals.fNumBytes += theStats.fNumBytes;
+				theTotals.fNumLost += theStats.fNumLost;
+				theTotals.fNumLate += theStats.fNumLate;
+				theTotals.fNumDuplicates += theStats.fNumDuplicates;
+				theNumCachedPackets += thePlayer->GetNumCachedPackets();
+				theKbps += GetKbps(theStats.fNumBytes, thePlayer->GetPlayTime(), inEndTime);
+				if (thePlayer->GetFirstPacketNs() != 0)
+					theStartups.push_back(thePlayer->GetFirstPacketNs() / 1000000);
+				if (thePlayer->GetFirstKeyFrameNs() != 0)
+					theKeyFrameStartups.push_back(thePlayer->GetFirstKeyFrameNs() / 1000000);
+				theLatencies.insert(theLatencies.end(), thePlayer->GetLatencies().begin(), thePlayer->GetLatencies().end());
+			}
+
+			theAllLatencies.insert(theAllLatencies.end(), theLatencies.begin(), theLatencies.end());
+			theTotalPlayerBytes += theTotals.fNumBytes;
+			theTotalLost += theTotals.fNumLost;
+			theTotalReceived += theTotals.fNumPackets;
+			theNumPlaying += theNumStreamPlaying;
+
+			theReport += (x == 0) ? "\n" : ",\n";
+			theReport += "    {\"stream\": " + JSONString(thePublisher.GetStreamName());
+			theReport += ",\n     \"publisher\": {\"recording\": " + std::string(thePublisher.GetRecordTime() ? "true" : "false");
+			theReport += ", \"setup_ms\": " + std::to_string(thePublisher.GetSetupNs() / 1000000);
+			theReport += ", \"packets_sent\": " + std::to_string(thePublisher.GetNumPacketsSent());
+			theReport += ", \"bytes_sent\": " + std::to_string(thePublisher.GetNumBytesSent());
+			theReport += ", \"packets_dropped\": " + std::to_string(thePublisher.GetNumPacketsDropped());
+			theReport += ", \"kbps\": " + FormatDouble(GetKbps(thePublisher.GetNumBytesSent(), thePublisher.GetRecordTime(), inEndTime));
+			theReport += ", \"error\": " + (thePublisher.IsFailed() ? JSONString(thePublisher.GetError()) : "null") + "}";
+			theReport += ",\n     \"players\": {\"started\": " + std::to_string(theNumPlayers) + ", \"playing\": " + std::to_string(theNumStreamPlaying);
+			theReport += ", \"failed\": " + std::to_string(theNumFailed) + ", \"first_error\": " + (theFirstError.empty() ? "null" : JSONString(theFirstError));
+			theReport += ", \"packets\": " + std::to_string(theTotals.fNumPackets) + ", \"bytes\": " + std::to_string(theTotals.fNumBytes);
+			theReport += ", \"kbps_per_player\": " + FormatDouble(theNumStreamPlaying ? theKbps / theNumStreamPlaying : 0);
+			theReport += ", \"lost\": " + std::to_string(theTotals.fNumLost) + ", \"late\": " + std::to_string(theTotals.fNumLate);
+			theReport += ", \"duplicates\": " + std::to_string(theTotals.fNumDuplicates) + ", \"cached_packets\": " + std::to_string(theNumCachedPackets);
+			theReport += ", \"loss_percent\": " + FormatDouble(theTotals.fNumPackets + theTotals.fNumLost ? 100.0 * theTotals.fNumLost / (theTotals.fNumPackets + theTotals.fNumLost) : 0);
+			theReport += ",\n                 \"startup_ms\": " + JSONPercentiles(GetPercentiles(theStartups));
+			theReport += ",\n                 \"first_keyframe_ms\": " + JSONPercentiles(GetPercentiles(theKeyFrameStartups));
+			theReport += ",\n                 \"latency_us\": " + JSONPercentiles(GetPercentiles(theLatencies)) + "}}";
+		}
+		theReport += "\n  ],\n";
+
+		theReport += "  \"totals\": {\"players_playing\": " + std::to_string(theNumPlaying);
+		theReport += ", \"player_bytes\": " + std::to_string(theTotalPlayerBytes);
+		theReport += ", \"packets\": " + std::to_string(theTotalReceived) + ", \"lost\": " + std::to_string(theTotalLost);
+		theReport += ", \"latency_us\": " + JSONPercentiles(GetPercentiles(std::move(theAllLatencies))) + "}";
+
+		if (inOptions.fNumStormConnections > 0)
+		{
+			double theSeconds = (inEndTime - inStorm.GetStartTime()) / 1e9;
+			theReport += ",\n  \"storm\": {\"completed\": " + std::to_string(inStorm.GetNumCompleted());
+			theReport += ", \"failed\": " + std::to_string(inStorm.GetNumFailed());
+			theReport += ", \"per_second\": " + FormatDouble(theSeconds > 0 ? inStorm.GetNumCompleted() / theSeconds : 0);
+			theReport += ", \"first_error\": " + (inStorm.GetFirstError().empty() ? "null" : JSONString(inStorm.GetFirstError()));
+			theReport += ",\n            \"connect_to_response_us\": " + JSONPercentiles(GetPercentiles(inStorm.GetDurations())) + "}";
+		}
+		theReport += "\n}\n";
+		std::fputs(theReport.c_str(), stdout);
+	}
+
+	void PrintUsage()
+	{
+		std::fprintf(stderr,
+			"usage: rtspload [options]\n"
+			"  --host ADDR          server address (127.0.0.1)\n"
+			"  --port N             RTSP port (10554)\n"
+			"  --publishers N       streams to publish (1)\n"
+			"  --players N          players, spread over the streams (1)\n"
+			"  --duration SEC       how long to run (10)\n"
+			"  --player-delay MS    wait before the first player starts (1000)\n"
+			"  --player-ramp MS     start the players spread over this long (0)\n"
+			"  --video-kbps N       video bit rate (2000)\n"
+			"  --audio-kbps N       audio bit rate, 0 for no audio track (64)\n"
+			"  --fps N              video frame rate (25)\n"
+			"  --gop N              frames per GOP (50)\n"
+			"  --udp                publish RTP over UDP instead of interleaved\n"
+			"  --storm N            also keep N connections doing connect, OPTIONS, close (0)\n"
+			"  --prefix NAME        stream names are NAME0, NAME1, ... (rtspload)\n");
+	}
+
+	bool ParseOptions(int argc, char* argv[], Options* outOptions)
+	{
+		for (int x = 1; x < argc; x++)
+		{
+			std::string theArg = argv[x];
+			if (theArg == "--udp")
+			{
+				outOptions->fUDP = true;
+				continue;
+			}
+			if (x + 1 >= argc)
+				return false;
+
+			std::string theValue = argv[++x];
+			uint32_t theNumber = (uint32_t)std::strtoul(theValue.c_str(), nullptr, 10);
+			if (theArg == "--host") outOptions->fHost = theValue;
+			else if (theArg == "--port") outOptions->fPort = (uint16_t)theNumber;
+			else if (theArg == "--publishers") outOptions->fNumPublishers = theNumber;
+			else if (theArg == "--players") outOptions->fNumPlayers = theNumber;
+			else if (theArg == "--duration") outOptions->fDurationSec = theNumber;
+			else if (theArg == "--player-delay") outOptions->fPlayerDelayMsec = theNumber;
+			else if (theArg == "--player-ramp") outOptions->fPlayerRampMsec = theNumber;
+			else if (theArg == "--video-kbps") outOptions->fVideoKbps = theNumber;
+			else if (theArg == "--audio-kbps") outOptions->fAudioKbps = theNumber;
+			else if (theArg == "--fps") outOptions->fFps = std::max<uint32_t>(theNumber, 1);
+			else if (theArg == "--gop") outOptions->fGop = std::max<uint32_t>(theNumber, 1);
+			else if (theArg == "--prefix") outOptions->fPrefix = theValue;
+			else if (theArg == "--storm") outOptions->fNumStormConnections = theNumber;
+			else return false;
+		}
+		return outOptions->fNumPublishers > 0 || outOptions->fNumPlayers == 0;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options theOptions;
+	if (!ParseOptions(argc, argv, &theOptions))
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	// A socket per client, and then some
+	struct rlimit theLimit;
+	if (::getrlimit(RLIMIT_NOFILE, &theLimit) == 0)
+	{
+		theLimit.rlim_cur = theLimit.rlim_max;
+		::setrlimit(RLIMIT_NOFILE, &theLimit);
+	}
+
+	EventLoop theLoop;
+	uint64_t theStartTime = NowNs();
+	uint64_t theEndTime = theStartTime + (uint64_t)theOptions.fDurationSec * 1000000000;
+
+	std::vector<std::unique_ptr<Publisher>> thePublishers;
+	for (uint32_t x = 0; x < theOptions.fNumPublishers; x++)
+	{
+		thePublishers.emplace_back(new Publisher(theLoop, theOptions, theOptions.fPrefix + std::to_string(x)));
+		thePublishers.back()->Start();
+	}
+
+	std::vector<std::unique_ptr<Player>> thePlayers;
+	for (uint32_t x = 0; x < theOptions.fNumPlayers; x++)
+	{
+		uint64_t theDelay = (uint64_t)theOptions.fPlayerDelayMsec * 1000000;
+		if (theOptions.fNumPlayers > 1)
+			theDelay += (uint64_t)theOptions.fPlayerRampMsec * 1000000 * x / (theOptions.fNumPlayers - 1);
+		std::string theStream = theOptions.fPrefix + std::to_string(x % theOptions.fNumPublishers);
+		thePlayers.emplace_back(new Player(theLoop, theOptions, theStream, theStartTime + theDelay));
+	}
+
+	ConnectionStorm theStorm(theLoop, theOptions);
+
+	// Publishers pace themselves off the ticks, a millisecond apart at most
+	uint64_t theNow = theStartTime;
+	while (theNow < theEndTime)
+	{
+		theLoop.Poll(1);
+		theNow = NowNs();
+		for (auto& thePublisher : thePublishers)
+			thePublisher->OnTick(theNow);
+		for (auto& thePlayer : thePlayers)
+			thePlayer->OnTick(theNow);
+		theStorm.OnTick(theNow);
+	}
+
+	PrintReport(theOptions, thePublishers, thePlayers, theStorm, theNow);
+	return 0;
+}
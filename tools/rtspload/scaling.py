@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""Measures how the coroutine RTSP server scales with the cores it gets.
+
+    scaling.py [options] SERVER
+
+For each core count the server is started under taskset on cores
+0..n-1, which also gives its RTSPServer one io_service per core, and
+two benchmarks are run against it with rtspload:
+
+  storm      connections that connect, ask for OPTIONS and close, as fast
+             as the server takes them
+  streaming  publishers sending interleaved RTP to players, all over TCP
+
+The clients run on the cores the server doesn't have, split over several
+rtspload processes, since one of them is a single thread. With fewer
+cores than the biggest server plus one, the clients share the server's
+cores and the numbers say more about the machine than the server.
+"""
+
+import argparse
+import json
+import os
+import socket
+import subprocess
+import sys
+import time
+
+def cpu_list(cpus):
+    return ",".join(str(cpu) for cpu in cpus)
+
+
+def wait_for_port(host, port, timeout):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        try:
+            with socket.create_connection((host, port), timeout=0.5):
+                return True
+        except OSError:
+            time.sleep(0.1)
+    return False
+
+
+def run_clients(args, client_cpus, extra, prefix):
+    """Runs args.clients rtspload processes at once, returns their reports."""
+    processes = []
+    for x in range(args.clients):
+        command = [args.rtspload, "--host", args.host, "--port", str(args.port),
+                   "--duration", str(args.duration), "--prefix", "%s%d_" % (prefix, x)] + extra(x)
+        if client_cpus:
+            command = ["taskset", "-c", cpu_list(client_cpus)] + command
+        processes.append(subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL))
+
+    reports = []
+    for process in processes:
+        out, _ = process.communicate(timeout=args.duration + 60)
+        try:
+            reports.append(json.loads(out))
+        except ValueError:
+            print("rtspload exited %d without a report" % process.returncode, file=sys.stderr)
+    return reports
+
+
+def split(total, parts, index):
+    return total // parts + (1 if index < total % parts else 0)
+
+
+def storm(args, client_cpus):
+    reports = run_clients(args, client_cpus, lambda x: [
+        "--publishers", "0", "--players", "0", "--storm", str(split(args.storm, args.clients, x))], "storm")
+    storms = [report["storm"] for report in reports if "storm" in report]
+    return {
+        "per_second": sum(s["per_second"] for s in storms),
+        "failed": sum(s["failed"] for s in storms),
+        # Percentiles don't add up, so take the worst client's
+        "p50_us": max([s["connect_to_response_us"]["p50"] for s in storms] or [0]),
+        "p99_us": max([s["connect_to_response_us"]["p99"] for s in storms] or [0]),
+    }
+
+
+def streaming(args, client_cpus):
+    reports = run_clients(args, client_cpus, lambda x: [
+        "--publishers", str(max(split(args.publishers, args.clients, x), 1)),
+        "--players", str(split(args.players, args.clients, x)),
+        "--player-delay", "500", "--player-ramp", "1000"], "stream")
+    totals = [report["totals"] for report in reports]
+    streams = [stream for report in reports for stream in report["streams"]]
+    return {
+        "playing": sum(t["players_playing"] for t in totals),
+        "mbps": sum(s["players"]["kbps_per_player"] * s["players"]["playing"] for s in streams) / 1000.0,
+        "lost": sum(t["lost"] for t in totals),
+        "p50_us": max([t["latency_us"]["p50"] for t in totals] or [0]),
+        "p99_us": max([t["latency_us"]["p99"] for t in totals] or [0]),
+    }
+
+
+def run_one(args, num_cores):
+    all_cpus = sorted(os.sched_getaffinity(0))
+    server_cpus = all_cpus[:num_cores]
+    client_cpus = all_cpus[num_cores:]
+
+    server = subprocess.Popen(["taskset", "-c", cpu_list(server_cpus), os.path.abspath(args.server), "-d"],
+                              cwd=os.path.dirname(os.path.abspath(args.server)),
+                              stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        if not wait_for_port(args.host, args.port, 15):
+            raise RuntimeError("the server didn't open port %d" % args.port)
+        result = {"cores": num_cores, "shared_cores": not client_cpus}
+        if args.storm > 0:
+            result["storm"] = storm(args, client_cpus)
+        if args.players > 0:
+            result["streaming"] = streaming(args, client_cpus)
+        return result
+    finally:
+        server.terminate()
+        try:
+            server.wait(timeout=10)
+        except subprocess.TimeoutExpired:
+            server.kill()
+            server.wait()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("server", help="the EasyDarwin binary, started with -d from its own directory")
+    parser.add_argument("--rtspload", default=os.path.join(os.getcwd(), "rtspload"),
+                        help="the rtspload binary (./rtspload)")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=10554)
+    parser.add_argument("--cores", default=None,
+                        help="comma separated core counts to try (1, 2, 4, ... up to all but one)")
+    parser.add_argument("--clients", type=int, default=4, help="rtspload processes per benchmark (4)")
+    parser.add_argument("--duration", type=int, default=10, help="seconds per benchmark (10)")
+    parser.add_argument("--storm", type=int, default=256, help="connections kept going in the storm, 0 skips it (256)")
+    parser.add_argument("--publishers", type=int, default=20, help="streams published (20)")
+    parser.add_argument("--players", type=int, default=1000, help="players over all streams, 0 skips streaming (1000)")
+    parser.add_argument("--json", help="also write the results here")
+    args = parser.parse_args()
+
+    num_cpus = len(os.sched_getaffinity(0))
+    if args.cores:
+        core_counts = [int(n) for n in args.cores.split(",")]
+    else:
+        core_counts, n = [], 1
+        while n < num_cpus:
+            core_counts.append(n)
+            n *= 2
+        core_counts = core_counts or [1]
+    if any(n < 1 or n > num_cpus for n in core_counts):
+        parser.error("core counts have to be between 1 and %d" % num_cpus)
+
+    results = []
+    print("%5s %12s %9s %9s %9s %9s %9s %9s" % ("cores", "conn/s", "speedup", "p99 us", "Mbit/s", "speedup", "p99 us", "playing"))
+    for n in core_counts:
+        result = run_one(args, n)
+        results.append(result)
+        first = results[0]
+        line = "%5d" % n
+        if "storm" in result:
+            s = result["storm"]
+            line += " %12.0f %8.2fx %9d" % (s["per_second"], s["per_second"] / max(first["storm"]["per_second"], 1e-9), s["p99_us"])
+        else:
+            line += " %12s %9s %9s" % ("-", "-", "-")
+        if "streaming" in result:
+            s = result["streaming"]
+            line += " %9.1f %8.2fx %9d %9d" % (s["mbps"], s["mbps"] / max(first["streaming"]["mbps"], 1e-9), s["p99_us"], s["playing"])
+        if result["shared_cores"]:
+            line += "  (clients on the server's cores)"
+        print(line)
+        sys.stdout.flush()
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"config": vars(args), "results": results}, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())